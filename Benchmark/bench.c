@@ -0,0 +1,577 @@
+/*!
+ * \file
+ *
+ * \brief Microbenchmarks for the SDK hot paths.
+ *
+ * Measures the HTTP parser on recorded SSDP, SOAP and GENA messages, the
+ * ixml parser and printer on a device description and a DIDL-Lite result,
+ * http_MakeMessage(), ThreadPoolAdd() throughput and TimerThreadSchedule()
+ * behind a large queue. Each line reports ns/op and allocations/op, so a
+ * change to one of these paths can be compared before and after.
+ *
+ * Usage: upnpbench [name-filter]
+ *
+ * On Windows build the Benchmark project of PUPNP.sln; allocations are
+ * only counted in the Debug configuration. On Linux, from the top of the
+ * tree:
+ *
+ *   gcc -O2 -DHAVE_STRNDUP -D_GNU_SOURCE -D_FILE_OFFSET_BITS=64
+ *       -Iupnp/src/threadutil -Iinclude/pupnp -Iupnp/src/inc -Iconfig
+ *       -Iinclude/ixml -Iixml/src/inc Benchmark/bench.c
+ *       $(find upnp/src ixml/src -name '*.c' ! -name win_dll.c
+ *         ! -name inet_pton.c) -lpthread -o upnpbench
+ */
+
+#include "ThreadPool.h"
+#include "TimerThread.h"
+#include "httpparser.h"
+#include "httpreadwrite.h"
+#include "ixml.h"
+#include "membuffer.h"
+#include "metrics.h"
+#include "statcodes.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+	#include <crtdbg.h>
+#endif
+
+/*! Minimum measuring time per benchmark, in microseconds. */
+#define BENCH_MIN_USEC 200000
+/*! Events queued ahead of the measured TimerThreadSchedule() calls. */
+#define BENCH_TIMER_DEPTH 10000
+/*! Items in the DIDL-Lite payload. */
+#define BENCH_DIDL_ITEMS 50
+
+/*! Number of allocations made by the process so far. */
+static upnp_atomic64_t gAllocs;
+/*! Number of ThreadPool jobs run so far. */
+static upnp_atomic_t gJobsRun;
+
+#if defined(__GLIBC__)
+/* glibc lets the executable interpose the allocator, including the calls
+ * made from inside libc itself such as strdup(). */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+	upnp_atomic64_add(&gAllocs, 1);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	upnp_atomic64_add(&gAllocs, 1);
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	upnp_atomic64_add(&gAllocs, 1);
+	return __libc_realloc(ptr, size);
+}
+
+static int alloc_counting(void) { return 1; }
+#elif defined(_WIN32) && defined(_DEBUG)
+static int alloc_hook(int allocType,
+	void *userData,
+	size_t size,
+	int blockType,
+	long requestNumber,
+	const unsigned char *filename,
+	int lineNumber)
+{
+	if (allocType == _HOOK_ALLOC || allocType == _HOOK_REALLOC)
+		upnp_atomic64_add(&gAllocs, 1);
+	return 1;
+}
+
+static int alloc_counting(void)
+{
+	_CrtSetAllocHook(alloc_hook);
+	return 1;
+}
+#else
+static int alloc_counting(void) { return 0; }
+#endif
+
+static const char ssdp_msearch[] =
+	"M-SEARCH * HTTP/1.1\r\n"
+	"HOST: 239.255.255.250:1900\r\n"
+	"MAN: \"ssdp:discover\"\r\n"
+	"MX: 2\r\n"
+	"ST: urn:schemas-upnp-org:device:MediaRenderer:1\r\n"
+	"USER-AGENT: Linux/5.10 UPnP/1.0 Portable SDK for UPnP "
+	"devices/1.14.18\r\n"
+	"\r\n";
+
+static const char ssdp_notify[] =
+	"NOTIFY * HTTP/1.1\r\n"
+	"HOST: 239.255.255.250:1900\r\n"
+	"CACHE-CONTROL: max-age=1800\r\n"
+	"LOCATION: http://192.168.1.20:49152/description.xml\r\n"
+	"NT: urn:schemas-upnp-org:service:AVTransport:1\r\n"
+	"NTS: ssdp:alive\r\n"
+	"SERVER: Linux/5.10 UPnP/1.0 Portable SDK for UPnP "
+	"devices/1.14.18\r\n"
+	"USN: uuid:5d4a3b2c-1e0f-4a9b-8c7d-6e5f4a3b2c1d::"
+	"urn:schemas-upnp-org:service:AVTransport:1\r\n"
+	"\r\n";
+
+static const char soap_body[] =
+	"<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n"
+	"<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" "
+	"s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\">"
+	"<s:Body>"
+	"<u:Browse xmlns:u=\"urn:schemas-upnp-org:service:ContentDirectory:1\">"
+	"<ObjectID>0</ObjectID>"
+	"<BrowseFlag>BrowseDirectChildren</BrowseFlag>"
+	"<Filter>*</Filter>"
+	"<StartingIndex>0</StartingIndex>"
+	"<RequestedCount>50</RequestedCount>"
+	"<SortCriteria></SortCriteria>"
+	"</u:Browse>"
+	"</s:Body>"
+	"</s:Envelope>\r\n";
+
+static const char gena_body[] =
+	"<?xml version=\"1.0\"?>\r\n"
+	"<e:propertyset xmlns:e=\"urn:schemas-upnp-org:event-1-0\">"
+	"<e:property><LastChange>&lt;Event xmlns=&quot;urn:schemas-upnp-org:"
+	"metadata-1-0/AVT/&quot;&gt;&lt;InstanceID val=&quot;0&quot;&gt;"
+	"&lt;TransportState val=&quot;PLAYING&quot;/&gt;&lt;/InstanceID&gt;"
+	"&lt;/Event&gt;</LastChange></e:property>"
+	"</e:propertyset>\r\n";
+
+static const char device_description[] =
+	"<?xml version=\"1.0\"?>\r\n"
+	"<root xmlns=\"urn:schemas-upnp-org:device-1-0\">"
+	"<specVersion><major>1</major><minor>0</minor></specVersion>"
+	"<device>"
+	"<deviceType>urn:schemas-upnp-org:device:MediaRenderer:1</deviceType>"
+	"<friendlyName>Living Room Renderer</friendlyName>"
+	"<manufacturer>Example</manufacturer>"
+	"<manufacturerURL>http://www.example.com/</manufacturerURL>"
+	"<modelDescription>Network audio renderer</modelDescription>"
+	"<modelName>Renderer</modelName>"
+	"<modelNumber>1.0</modelNumber>"
+	"<serialNumber>0001</serialNumber>"
+	"<UDN>uuid:5d4a3b2c-1e0f-4a9b-8c7d-6e5f4a3b2c1d</UDN>"
+	"<iconList>"
+	"<icon><mimetype>image/png</mimetype><width>48</width>"
+	"<height>48</height><depth>24</depth><url>/icon48.png</url></icon>"
+	"<icon><mimetype>image/png</mimetype><width>120</width>"
+	"<height>120</height><depth>24</depth><url>/icon120.png</url></icon>"
+	"</iconList>"
+	"<serviceList>"
+	"<service>"
+	"<serviceType>urn:schemas-upnp-org:service:RenderingControl:1"
+	"</serviceType>"
+	"<serviceId>urn:upnp-org:serviceId:RenderingControl</serviceId>"
+	"<SCPDURL>/RenderingControl/scpd.xml</SCPDURL>"
+	"<controlURL>/RenderingControl/control</controlURL>"
+	"<eventSubURL>/RenderingControl/event</eventSubURL>"
+	"</service>"
+	"<service>"
+	"<serviceType>urn:schemas-upnp-org:service:ConnectionManager:1"
+	"</serviceType>"
+	"<serviceId>urn:upnp-org:serviceId:ConnectionManager</serviceId>"
+	"<SCPDURL>/ConnectionManager/scpd.xml</SCPDURL>"
+	"<controlURL>/ConnectionManager/control</controlURL>"
+	"<eventSubURL>/ConnectionManager/event</eventSubURL>"
+	"</service>"
+	"<service>"
+	"<serviceType>urn:schemas-upnp-org:service:AVTransport:1"
+	"</serviceType>"
+	"<serviceId>urn:upnp-org:serviceId:AVTransport</serviceId>"
+	"<SCPDURL>/AVTransport/scpd.xml</SCPDURL>"
+	"<controlURL>/AVTransport/control</controlURL>"
+	"<eventSubURL>/AVTransport/event</eventSubURL>"
+	"</service>"
+	"</serviceList>"
+	"<presentationURL>/</presentationURL>"
+	"</device>"
+	"</root>\r\n";
+
+static const char didl_item[] =
+	"<item id=\"64$%d\" parentID=\"64\" restricted=\"1\">"
+	"<dc:title>Track %d</dc:title>"
+	"<dc:creator>Some Artist</dc:creator>"
+	"<upnp:artist>Some Artist</upnp:artist>"
+	"<upnp:album>Some Album</upnp:album>"
+	"<upnp:genre>Rock</upnp:genre>"
+	"<upnp:originalTrackNumber>%d</upnp:originalTrackNumber>"
+	"<upnp:albumArtURI dlna:profileID=\"JPEG_TN\">"
+	"http://192.168.1.20:8200/AlbumArt/%d.jpg</upnp:albumArtURI>"
+	"<res size=\"8123456\" duration=\"0:04:05.000\" bitrate=\"40000\" "
+	"sampleFrequency=\"44100\" nrAudioChannels=\"2\" "
+	"protocolInfo=\"http-get:*:audio/mpeg:DLNA.ORG_PN=MP3;"
+	"DLNA.ORG_OP=01;DLNA.ORG_CI=0;DLNA.ORG_FLAGS=01700000000000000000"
+	"000000000000\">http://192.168.1.20:8200/MediaItems/%d.mp3</res>"
+	"<upnp:class>object.item.audioItem.musicTrack</upnp:class>"
+	"</item>";
+
+/*! Complete SOAP request, built once with the right Content-Length. */
+static char soap_request[2048];
+/*! Complete GENA NOTIFY, built once with the right Content-Length. */
+static char gena_notify[2048];
+/*! DIDL-Lite result with BENCH_DIDL_ITEMS items. */
+static char *didl;
+
+/*! Parsed copies used by the print benchmarks. */
+static IXML_Document *device_doc;
+static IXML_Document *didl_doc;
+
+static void build_payloads(void)
+{
+	membuffer buf;
+	char item[2048];
+	int i;
+
+	snprintf(soap_request,
+		sizeof(soap_request),
+		"POST /ContentDirectory/control HTTP/1.1\r\n"
+		"HOST: 192.168.1.20:49152\r\n"
+		"CONTENT-LENGTH: %d\r\n"
+		"CONTENT-TYPE: text/xml; charset=\"utf-8\"\r\n"
+		"SOAPACTION: \"urn:schemas-upnp-org:service:ContentDirectory:1"
+		"#Browse\"\r\n"
+		"USER-AGENT: Linux/5.10 UPnP/1.0 ControlPoint/1.0\r\n"
+		"\r\n%s",
+		(int)strlen(soap_body),
+		soap_body);
+	snprintf(gena_notify,
+		sizeof(gena_notify),
+		"NOTIFY /event/1 HTTP/1.1\r\n"
+		"HOST: 192.168.1.30:49153\r\n"
+		"CONTENT-TYPE: text/xml; charset=\"utf-8\"\r\n"
+		"CONTENT-LENGTH: %d\r\n"
+		"NT: upnp:event\r\n"
+		"NTS: upnp:propchange\r\n"
+		"SID: uuid:9c1b5e2a-7f3d-4e6b-a1c2-d3e4f5a6b7c8\r\n"
+		"SEQ: 42\r\n"
+		"\r\n%s",
+		(int)strlen(gena_body),
+		gena_body);
+
+	membuffer_init(&buf);
+	membuffer_append_str(&buf,
+		"<DIDL-Lite xmlns=\"urn:schemas-upnp-org:metadata-1-0/DIDL-Lite/\" "
+		"xmlns:dc=\"http://purl.org/dc/elements/1.1/\" "
+		"xmlns:upnp=\"urn:schemas-upnp-org:metadata-1-0/upnp/\" "
+		"xmlns:dlna=\"urn:schemas-dlna-org:metadata-1-0/\">");
+	for (i = 0; i < BENCH_DIDL_ITEMS; i++) {
+		snprintf(item, sizeof(item), didl_item, i, i, i + 1, i, i);
+		membuffer_append_str(&buf, item);
+	}
+	membuffer_append_str(&buf, "</DIDL-Lite>");
+	didl = membuffer_detach(&buf);
+
+	ixmlParseBufferEx(device_description, &device_doc);
+	ixmlParseBufferEx(didl, &didl_doc);
+}
+
+static void parse_http(const char *msg, long iters)
+{
+	http_parser_t parser;
+	parse_status_t status;
+	size_t len = strlen(msg);
+	long i;
+
+	for (i = 0; i < iters; i++) {
+		parser_request_init(&parser);
+		membuffer_append(&parser.msg.msg, msg, len);
+		status = parser_parse(&parser);
+		/* SSDP NOTIFY has no body and ends in the same failure that
+		 * ssdp_event_handler_thread() accepts */
+		if (status != PARSE_SUCCESS &&
+			!(status == PARSE_FAILURE &&
+				parser.valid_ssdp_notify_hack)) {
+			fprintf(stderr, "parser_parse failed\n");
+			exit(EXIT_FAILURE);
+		}
+		httpmsg_destroy(&parser.msg);
+	}
+}
+
+static void bench_parse_ssdp_msearch(long iters)
+{
+	parse_http(ssdp_msearch, iters);
+}
+
+static void bench_parse_ssdp_notify(long iters)
+{
+	parse_http(ssdp_notify, iters);
+}
+
+static void bench_parse_soap_action(long iters)
+{
+	parse_http(soap_request, iters);
+}
+
+static void bench_parse_gena_notify(long iters)
+{
+	parse_http(gena_notify, iters);
+}
+
+static void parse_xml(const char *xml, long iters)
+{
+	IXML_Document *doc;
+	long i;
+
+	for (i = 0; i < iters; i++) {
+		if (ixmlParseBufferEx(xml, &doc) != IXML_SUCCESS) {
+			fprintf(stderr, "ixmlParseBufferEx failed\n");
+			exit(EXIT_FAILURE);
+		}
+		ixmlDocument_free(doc);
+	}
+}
+
+static void bench_ixml_parse_description(long iters)
+{
+	parse_xml(device_description, iters);
+}
+
+static void bench_ixml_parse_didl(long iters)
+{
+	parse_xml(didl, iters);
+}
+
+static void print_xml(IXML_Document *doc, long iters)
+{
+	long i;
+
+	for (i = 0; i < iters; i++)
+		ixmlFreeDOMString(ixmlPrintNode((IXML_Node *)doc));
+}
+
+static void bench_ixml_print_description(long iters)
+{
+	print_xml(device_doc, iters);
+}
+
+static void bench_ixml_print_didl(long iters)
+{
+	print_xml(didl_doc, iters);
+}
+
+static void bench_http_make_message(long iters)
+{
+	membuffer buf;
+	long i;
+
+	for (i = 0; i < iters; i++) {
+		membuffer_init(&buf);
+		/* same header set as a SOAP action response */
+		if (http_MakeMessage(&buf,
+			    1,
+			    1,
+			    "RNsDsSXcc",
+			    HTTP_OK,
+			    (off_t)1024,
+			    "CONTENT-TYPE: text/xml; charset=\"utf-8\"\r\n",
+			    "EXT:\r\n",
+			    "redsonic") != 0) {
+			fprintf(stderr, "http_MakeMessage failed\n");
+			exit(EXIT_FAILURE);
+		}
+		membuffer_destroy(&buf);
+	}
+}
+
+/*! Pool used by the ThreadPool and TimerThread benchmarks. */
+static ThreadPool bench_tp;
+/*! Timer used by the TimerThread benchmark. */
+static TimerThread bench_timer;
+
+static void count_job(void *arg)
+{
+	(void)arg;
+	upnp_atomic_inc(&gJobsRun);
+}
+
+static void setup_thread_pool(void)
+{
+	ThreadPoolAttr attr;
+
+	TPAttrInit(&attr);
+	TPAttrSetMinThreads(&attr, 4);
+	TPAttrSetMaxThreads(&attr, 4);
+	TPAttrSetMaxJobsTotal(&attr, 1 << 30);
+	ThreadPoolInit(&bench_tp, &attr);
+}
+
+static void teardown_thread_pool(void) { ThreadPoolShutdown(&bench_tp); }
+
+static void bench_thread_pool_add(long iters)
+{
+	ThreadPoolJob job;
+	long i;
+
+	upnp_atomic_store(&gJobsRun, 0);
+	for (i = 0; i < iters; i++) {
+		TPJobInit(&job, (start_routine)count_job, NULL);
+		TPJobSetPriority(&job, MED_PRIORITY);
+		if (ThreadPoolAdd(&bench_tp, &job, NULL) != 0) {
+			fprintf(stderr, "ThreadPoolAdd failed\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	/* throughput includes running every job */
+	while (upnp_atomic_load(&gJobsRun) < iters)
+		imillisleep(1);
+}
+
+static void noop_job(void *arg) { (void)arg; }
+
+static void schedule_timers(long count)
+{
+	ThreadPoolJob job;
+	long i;
+
+	TPJobInit(&job, (start_routine)noop_job, NULL);
+	for (i = 0; i < count; i++) {
+		/* spread over the queue so each insert walks part of it */
+		if (TimerThreadSchedule(&bench_timer,
+			    3600 + (time_t)(i % 600),
+			    REL_SEC,
+			    &job,
+			    SHORT_TERM,
+			    NULL) != 0) {
+			fprintf(stderr, "TimerThreadSchedule failed\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+}
+
+static void setup_timer(void)
+{
+	setup_thread_pool();
+	TimerThreadInit(&bench_timer, &bench_tp, NULL);
+	schedule_timers(BENCH_TIMER_DEPTH);
+}
+
+static void teardown_timer(void)
+{
+	TimerThreadShutdown(&bench_timer);
+	teardown_thread_pool();
+}
+
+static void bench_timer_schedule(long iters) { schedule_timers(iters); }
+
+typedef struct
+{
+	const char *name;
+	void (*run)(long iters);
+	/*! 0 to calibrate, or a fixed iteration count. */
+	long fixed;
+	/*! Optional, called before and after measuring. */
+	void (*setup)(void);
+	void (*teardown)(void);
+} benchmark;
+
+static const benchmark benchmarks[] = {
+	{"parser_parse/ssdp_msearch", bench_parse_ssdp_msearch, 0, NULL, NULL},
+	{"parser_parse/ssdp_notify", bench_parse_ssdp_notify, 0, NULL, NULL},
+	{"parser_parse/soap_action", bench_parse_soap_action, 0, NULL, NULL},
+	{"parser_parse/gena_notify", bench_parse_gena_notify, 0, NULL, NULL},
+	{"ixmlParseBufferEx/description",
+		bench_ixml_parse_description,
+		0,
+		NULL,
+		NULL},
+	{"ixmlParseBufferEx/didl", bench_ixml_parse_didl, 0, NULL, NULL},
+	{"ixmlPrintNode/description",
+		bench_ixml_print_description,
+		0,
+		NULL,
+		NULL},
+	{"ixmlPrintNode/didl", bench_ixml_print_didl, 0, NULL, NULL},
+	{"http_MakeMessage/soap_response",
+		bench_http_make_message,
+		0,
+		NULL,
+		NULL},
+	{"ThreadPoolAdd/run",
+		bench_thread_pool_add,
+		0,
+		setup_thread_pool,
+		teardown_thread_pool},
+	/* fixed count so the queue depth stays close to BENCH_TIMER_DEPTH */
+	{"TimerThreadSchedule/depth_10000",
+		bench_timer_schedule,
+		2000,
+		setup_timer,
+		teardown_timer},
+};
+
+static void run_benchmark(const benchmark *b, int counting)
+{
+	long iters = b->fixed ? b->fixed : 1;
+	int64_t start;
+	int64_t elapsed;
+	int64_t allocs;
+
+	if (b->setup)
+		b->setup();
+	for (;;) {
+		allocs = upnp_atomic64_load(&gAllocs);
+		start = upnp_clock_usec();
+		b->run(iters);
+		elapsed = upnp_clock_usec() - start;
+		allocs = upnp_atomic64_load(&gAllocs) - allocs;
+		if (b->fixed || elapsed >= BENCH_MIN_USEC)
+			break;
+		/* aim past the minimum, at most 100 times more per round */
+		if (elapsed <= 0)
+			iters *= 100;
+		else if (BENCH_MIN_USEC * 2 / elapsed > 100)
+			iters *= 100;
+		else
+			iters = iters * (long)(BENCH_MIN_USEC * 2 / elapsed);
+	}
+	if (b->teardown)
+		b->teardown();
+	if (counting)
+		printf("%-36s %10ld %12.1f ns/op %10.2f allocs/op\n",
+			b->name,
+			iters,
+			(double)elapsed * 1000.0 / (double)iters,
+			(double)allocs / (double)iters);
+	else
+		printf("%-36s %10ld %12.1f ns/op %10s allocs/op\n",
+			b->name,
+			iters,
+			(double)elapsed * 1000.0 / (double)iters,
+			"n/a");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *filter = argc > 1 ? argv[1] : NULL;
+	int counting;
+	size_t i;
+
+	ithread_initialize_library();
+	membuffer_pool_init();
+	counting = alloc_counting();
+	build_payloads();
+	for (i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+		if (filter && !strstr(benchmarks[i].name, filter))
+			continue;
+		run_benchmark(&benchmarks[i], counting);
+	}
+	ixmlDocument_free(device_doc);
+	ixmlDocument_free(didl_doc);
+	free(didl);
+	membuffer_pool_cleanup();
+	ithread_cleanup_library();
+
+	return EXIT_SUCCESS;
+}
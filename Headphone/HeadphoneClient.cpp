@@ -89,50 +89,13 @@ bool HeadphoneClient::SetVolume( const std::string &deviceId, unsigned char volu
 
     const UpnpDeviceInfo &device = *it;
     const char    *serviceType = "urn:schemas-upnp-org:service:HeadphoneVolume:1";
-    IXML_Document *actionNode  = NULL;
-
-    // 创建XML文档
-    IXML_Document *actionDoc = ixmlDocument_createDocument();
-    if( !actionDoc )
-    {
-        printf( "创建XML文档失败\n" );
-        return false;
-    }
-
-    IXML_Element *actionElement = ixmlDocument_createElement( actionDoc, "u:SetVolume" );
-    if( !actionElement )
-    {
-        printf( "创建SetVolume元素失败\n" );
-        ixmlDocument_free( actionDoc );
-        return false;
-    }
-
-    ixmlElement_setAttribute( actionElement, "xmlns:u", serviceType );
-
-    // 创建音量元素
-    IXML_Element *volumeElement = ixmlDocument_createElement( actionDoc, "NewVolume" );
-    if( !volumeElement )
-    {
-        printf( "创建NewVolume元素失败\n" );
-        ixmlDocument_free( actionDoc );
-        return false;
-    }
 
     char volumeStr[ 16 ];
     snprintf( volumeStr, sizeof( volumeStr ), "%d", volume );
-    IXML_Node *volumeText = ixmlDocument_createTextNode( actionDoc, volumeStr );
-
-    ixmlNode_appendChild( ( IXML_Node * )volumeElement, volumeText );
-    ixmlNode_appendChild( ( IXML_Node * )actionElement, ( IXML_Node * )volumeElement );
-    ixmlNode_appendChild( ( IXML_Node * )actionDoc, ( IXML_Node * )actionElement );
+    UpnpActionArgument volumeArg = { "NewVolume", volumeStr };
 
     // 发送动作请求
-    int ret = UpnpSendAction( m_clientHandle,
-                              device.controlURL.c_str(),
-                              serviceType,
-                              NULL,
-                              actionDoc,
-                              &actionNode );
+    int ret = UpnpSendActionBind( m_clientHandle, device.controlURL.c_str(), serviceType, "SetVolume", &volumeArg, 1, NULL, 0, NULL );
 
     bool success = ( ret == UPNP_E_SUCCESS );
     if( success )
@@ -144,18 +107,12 @@ bool HeadphoneClient::SetVolume( const std::string &deviceId, unsigned char volu
         printf( "设置音量失败: %d\n", ret );
     }
 
-    if( actionNode )
-        ixmlDocument_free( actionNode );
-    if( actionDoc )
-        ixmlDocument_free( actionDoc );
-
     return success;
 }
 
 int HeadphoneClient::GetVolume( const std::string &deviceId )
 {
-    const char    *serviceType = "urn:schemas-upnp-org:service:HeadphoneVolume:1";
-    IXML_Document *response    = NULL;
+    const char *serviceType = "urn:schemas-upnp-org:service:HeadphoneVolume:1";
 
     // 查找设备
     auto it = std::find_if( m_discoveredDevices.begin(), m_discoveredDevices.end(), [ &deviceId ]( const UpnpDeviceInfo &device ) { return device.deviceId == deviceId; } );
@@ -167,56 +124,20 @@ int HeadphoneClient::GetVolume( const std::string &deviceId )
 
     const UpnpDeviceInfo &device = *it;
 
-    // 创建XML文档
-    IXML_Document *actionDoc = ixmlDocument_createDocument();
-    if( !actionDoc )
+    // 发送动作请求, CurrentVolume直接写入volume
+    int                 volume  = -1;
+    UpnpArgumentBinding binding = { "CurrentVolume", UPNP_ARG_INT, 0, 0 };
+    int                 ret     = UpnpSendActionBind( m_clientHandle, device.controlURL.c_str(), serviceType, "GetVolume", NULL, 0, &binding, 1, &volume );
+    if( ret == UPNP_E_SUCCESS )
     {
-        printf( "创建XML文档失败\n" );
-        return -1;
-    }
-
-    IXML_Element *actionElement = ixmlDocument_createElement( actionDoc, "u:GetVolume" );
-    if( !actionElement )
-    {
-        printf( "创建GetVolume元素失败\n" );
-        ixmlDocument_free( actionDoc );
-        return -1;
-    }
-
-    ixmlElement_setAttribute( actionElement, "xmlns:u", serviceType );
-    ixmlNode_appendChild( ( IXML_Node * )actionDoc, ( IXML_Node * )actionElement );
-
-    // 发送动作请求
-    int ret = UpnpSendAction( m_clientHandle, device.controlURL.c_str(), serviceType, NULL, actionDoc, &response );
-
-    int volume = -1;
-    if( ret == UPNP_E_SUCCESS && response )
-    {
-        IXML_NodeList *volumeList = ixmlDocument_getElementsByTagName( response, "CurrentVolume" );
-        if( volumeList )
-        {
-            IXML_Node *volumeNode = ixmlNodeList_item( volumeList, 0 );
-            if( volumeNode )
-            {
-                IXML_Node *textNode = ixmlNode_getFirstChild( volumeNode );
-                if( textNode )
-                {
-                    const char *volumeValue = ixmlNode_getNodeValue( textNode );
-                    volume                  = atoi( volumeValue );
-                    printf( "当前音量: %d%%\n", volume );
-                }
-            }
-            ixmlNodeList_free( volumeList );
-        }
-        ixmlDocument_free( response );
+        printf( "当前音量: %d%%\n", volume );
     }
     else
     {
         printf( "获取音量失败: %d\n", ret );
+        volume = -1;
     }
 
-    if( actionDoc )
-        ixmlDocument_free( actionDoc );
     return volume;
 }
 
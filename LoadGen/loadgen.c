@@ -0,0 +1,805 @@
+/*!
+ * \file
+ *
+ * \brief Load generator that runs a swarm of control points against a
+ * device.
+ *
+ * Each simulated control point registers its own client handle and runs
+ * in its own thread, issuing SOAP actions, SSDP searches, description
+ * fetches and GENA subscriptions at the configured rates. At the end the
+ * throughput, latency percentiles and error counts of every operation are
+ * printed. Only the public API is used.
+ *
+ * With -H the tool also hosts a copy of the Headphone sample device in
+ * the same process, so the whole run stays on one host. On Linux use
+ * "-i lo" to keep it on the loopback interface:
+ *
+ *   loadgen -i lo -H -c 32 -d 30 -r 100 -s 1000 -D 500 -e 0
+ *
+ * On Windows build the LoadGen project of PUPNP.sln. On Linux, from the
+ * top of the tree:
+ *
+ *   gcc -O2 -DHAVE_STRNDUP -D_GNU_SOURCE -D_FILE_OFFSET_BITS=64
+ *       -Iupnp/src/threadutil -Iinclude/pupnp -Iupnp/src/inc -Iconfig
+ *       -Iinclude/ixml -Iixml/src/inc LoadGen/loadgen.c
+ *       $(find upnp/src ixml/src -name '*.c' ! -name win_dll.c
+ *         ! -name inet_pton.c) -lpthread -o loadgen
+ */
+
+#include "ithread.h"
+#include "ixml.h"
+#include "upnp.h"
+#include "upnptools.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <time.h>
+
+/*! Default search target, the Headphone sample device. */
+#define LOADGEN_TARGET "urn:schemas-upnp-org:device:HeadphoneDevice:1"
+/*! Seconds to wait for the device to answer the initial search. */
+#define LOADGEN_DISCOVERY_TIMEOUT 10
+/*! Subscription timeout requested from the device, in seconds. */
+#define LOADGEN_SUBSCRIPTION_TIMEOUT 1800
+
+enum loadgen_op
+{
+	OP_ACTION,
+	OP_SEARCH,
+	OP_DESCRIBE,
+	OP_SUBSCRIBE,
+	OP_COUNT
+};
+
+static const char *op_names[OP_COUNT] = {
+	"action", "search", "describe", "subscribe"};
+
+/*! Latency samples and errors of one operation. */
+typedef struct
+{
+	/*! Latency of each call in microseconds. */
+	int64_t *samples;
+	size_t count;
+	size_t size;
+	long errors;
+} op_stats;
+
+/*! A simulated control point. */
+typedef struct
+{
+	int id;
+	UpnpClient_Handle handle;
+	ithread_t thread;
+	op_stats stats[OP_COUNT];
+	Upnp_SID sid;
+	int subscribed;
+} control_point;
+
+/*! Command line options. */
+static struct
+{
+	const char *ifname;
+	const char *target;
+	const char *location;
+	const char *serviceType;
+	const char *actionName;
+	const char *argName;
+	const char *argValue;
+	int controlPoints;
+	int duration;
+	/*! Actions per second per control point, 0 for back to back. */
+	double actionRate;
+	/*! Intervals per control point in milliseconds. 0 turns searches and
+	 * description fetches off; for subscriptions 0 subscribes once at
+	 * start and -1 never. */
+	int searchInterval;
+	int describeInterval;
+	int subscribeInterval;
+	int hostDevice;
+} opt;
+
+/*! Device under test, filled in by discover_device(). */
+static char gLocation[LINE_SIZE];
+static char gServiceType[NAME_SIZE];
+static char *gControlURL;
+static char *gEventURL;
+
+/*! Protects the counters below and gLocation while discovering. */
+static ithread_mutex_t gLock;
+static ithread_cond_t gFound;
+static long gSearchReplies;
+static long gEventsReceived;
+
+/*! Set when the run time is over. */
+static volatile int gStop;
+
+/*!
+ * \brief Reads a monotonic clock.
+ *
+ * \return Microseconds since an arbitrary starting point.
+ */
+static int64_t now_usec(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return now.QuadPart / freq.QuadPart * 1000000 +
+	       now.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+/*!
+ * \brief Records the outcome of one call.
+ */
+static void op_record(op_stats *stats, int64_t start, int rc)
+{
+	int64_t *samples;
+
+	if (rc != UPNP_E_SUCCESS) {
+		stats->errors++;
+		return;
+	}
+	if (stats->count == stats->size) {
+		size_t size = stats->size ? stats->size * 2 : 1024;
+
+		samples = realloc(stats->samples, size * sizeof(*samples));
+		if (samples == NULL)
+			return;
+		stats->samples = samples;
+		stats->size = size;
+	}
+	stats->samples[stats->count++] = now_usec() - start;
+}
+
+static int cmp_samples(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a;
+	int64_t y = *(const int64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*!
+ * \brief Returns the sample at the given percentile, in milliseconds.
+ */
+static double percentile(const op_stats *stats, double p)
+{
+	size_t i;
+
+	if (stats->count == 0)
+		return 0.0;
+	i = (size_t)(p / 100.0 * (double)(stats->count - 1) + 0.5);
+	return (double)stats->samples[i] / 1000.0;
+}
+
+/*******************************************************************
+ * In-process device (-H), same description and service as the
+ * Headphone sample.
+ *******************************************************************/
+
+static const char device_description[] =
+	"<?xml version=\"1.0\"?>\r\n"
+	"<root xmlns=\"urn:schemas-upnp-org:device-1-0\">"
+	"<specVersion><major>1</major><minor>0</minor></specVersion>"
+	"<device>"
+	"<deviceType>urn:schemas-upnp-org:device:HeadphoneDevice:1"
+	"</deviceType>"
+	"<friendlyName>LoadGen Headphone</friendlyName>"
+	"<manufacturer>pupnp</manufacturer>"
+	"<modelName>LoadGen</modelName>"
+	"<UDN>uuid:LoadGenHeadphoneDevice-00000001</UDN>"
+	"<serviceList>"
+	"<service>"
+	"<serviceType>urn:schemas-upnp-org:service:HeadphoneVolume:1"
+	"</serviceType>"
+	"<serviceId>urn:upnp-org:serviceId:HeadphoneVolume</serviceId>"
+	"<SCPDURL>/headphonevolume.xml</SCPDURL>"
+	"<controlURL>/control</controlURL>"
+	"<eventSubURL>/event</eventSubURL>"
+	"</service>"
+	"</serviceList>"
+	"</device>"
+	"</root>\r\n";
+
+#define DEVICE_SERVICE_TYPE "urn:schemas-upnp-org:service:HeadphoneVolume:1"
+
+static UpnpDevice_Handle gDevice = -1;
+static ithread_mutex_t gVolumeLock;
+static int gVolume = 50;
+
+static void device_action(UpnpActionRequest *request)
+{
+	const char *name = UpnpActionRequest_get_ActionName_cstr(request);
+	IXML_Document *result = NULL;
+	char value[8];
+	const char *varName = "Volume";
+	const char *varValue = value;
+
+	if (strcmp(name, "GetVolume") == 0) {
+		ithread_mutex_lock(&gVolumeLock);
+		snprintf(value, sizeof(value), "%d", gVolume);
+		ithread_mutex_unlock(&gVolumeLock);
+		result = UpnpMakeActionResponse(
+			name, DEVICE_SERVICE_TYPE, 1, "CurrentVolume", value);
+	} else if (strcmp(name, "SetVolume") == 0) {
+		IXML_NodeList *nodes;
+		IXML_Node *text = NULL;
+
+		nodes = ixmlDocument_getElementsByTagName(
+			UpnpActionRequest_get_ActionRequest(request),
+			"NewVolume");
+		if (nodes)
+			text = ixmlNode_getFirstChild(ixmlNodeList_item(nodes, 0));
+		if (text) {
+			ithread_mutex_lock(&gVolumeLock);
+			gVolume = atoi(ixmlNode_getNodeValue(text));
+			snprintf(value, sizeof(value), "%d", gVolume);
+			ithread_mutex_unlock(&gVolumeLock);
+			UpnpNotify(gDevice,
+				UpnpActionRequest_get_DevUDN_cstr(request),
+				UpnpActionRequest_get_ServiceID_cstr(request),
+				&varName,
+				&varValue,
+				1);
+			result = UpnpMakeActionResponse(
+				name, DEVICE_SERVICE_TYPE, 0, NULL);
+		}
+		ixmlNodeList_free(nodes);
+	}
+	if (result) {
+		UpnpActionRequest_set_ActionResult(request, result);
+		UpnpActionRequest_set_ErrCode(request, UPNP_E_SUCCESS);
+	} else {
+		UpnpActionRequest_set_ErrCode(request, UPNP_SOAP_E_INVALID_ACTION);
+	}
+}
+
+static int device_callback(Upnp_EventType type, const void *event, void *cookie)
+{
+	(void)cookie;
+
+	switch (type) {
+	case UPNP_CONTROL_ACTION_REQUEST:
+		device_action((UpnpActionRequest *)event);
+		break;
+	case UPNP_EVENT_SUBSCRIPTION_REQUEST: {
+		const UpnpSubscriptionRequest *request = event;
+		const char *varName = "Volume";
+		char value[8];
+		const char *varValue = value;
+
+		ithread_mutex_lock(&gVolumeLock);
+		snprintf(value, sizeof(value), "%d", gVolume);
+		ithread_mutex_unlock(&gVolumeLock);
+		UpnpAcceptSubscription(gDevice,
+			UpnpSubscriptionRequest_get_UDN_cstr(request),
+			UpnpSubscriptionRequest_get_ServiceId_cstr(request),
+			&varName,
+			&varValue,
+			1,
+			UpnpSubscriptionRequest_get_SID_cstr(request));
+		break;
+	}
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static int start_device(void)
+{
+	int rc;
+
+	rc = UpnpRegisterRootDevice2(UPNPREG_BUF_DESC,
+		device_description,
+		strlen(device_description),
+		1,
+		device_callback,
+		NULL,
+		&gDevice);
+	if (rc != UPNP_E_SUCCESS) {
+		fprintf(stderr, "UpnpRegisterRootDevice2: %d\n", rc);
+		return rc;
+	}
+	rc = UpnpSendAdvertisement(gDevice, 1800);
+	if (rc != UPNP_E_SUCCESS)
+		fprintf(stderr, "UpnpSendAdvertisement: %d\n", rc);
+
+	return rc;
+}
+
+/*******************************************************************
+ * Control points.
+ *******************************************************************/
+
+static int cp_callback(Upnp_EventType type, const void *event, void *cookie)
+{
+	(void)cookie;
+
+	switch (type) {
+	case UPNP_DISCOVERY_SEARCH_RESULT: {
+		const UpnpDiscovery *d = event;
+
+		ithread_mutex_lock(&gLock);
+		gSearchReplies++;
+		if (gLocation[0] == '\0' &&
+			UpnpDiscovery_get_ErrCode(d) == UPNP_E_SUCCESS) {
+			strncpy(gLocation,
+				UpnpDiscovery_get_Location_cstr(d),
+				sizeof(gLocation) - 1);
+			ithread_cond_signal(&gFound);
+		}
+		ithread_mutex_unlock(&gLock);
+		break;
+	}
+	case UPNP_EVENT_RECEIVED:
+		ithread_mutex_lock(&gLock);
+		gEventsReceived++;
+		ithread_mutex_unlock(&gLock);
+		break;
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+/*!
+ * \brief Returns the text of the first \b tag element below \b node.
+ */
+static const char *element_text(IXML_Element *node, const char *tag)
+{
+	IXML_NodeList *nodes;
+	IXML_Node *text = NULL;
+
+	nodes = ixmlElement_getElementsByTagName(node, tag);
+	if (nodes)
+		text = ixmlNode_getFirstChild(ixmlNodeList_item(nodes, 0));
+	ixmlNodeList_free(nodes);
+
+	return text ? ixmlNode_getNodeValue(text) : NULL;
+}
+
+/*!
+ * \brief Finds the device with a search unless -l was given, then reads
+ * the control and event URLs of the service from its description.
+ */
+static int discover_device(UpnpClient_Handle handle)
+{
+	IXML_Document *desc = NULL;
+	IXML_NodeList *services;
+	const char *base;
+	unsigned long i;
+	int rc;
+
+	if (opt.location) {
+		strncpy(gLocation, opt.location, sizeof(gLocation) - 1);
+	} else {
+		struct timespec deadline;
+
+		rc = UpnpSearchAsync(handle, 2, opt.target, NULL);
+		if (rc != UPNP_E_SUCCESS) {
+			fprintf(stderr, "UpnpSearchAsync: %d\n", rc);
+			return rc;
+		}
+		deadline.tv_sec = time(NULL) + LOADGEN_DISCOVERY_TIMEOUT;
+		deadline.tv_nsec = 0;
+		ithread_mutex_lock(&gLock);
+		while (gLocation[0] == '\0' &&
+			ithread_cond_timedwait(&gFound, &gLock, &deadline) == 0)
+			;
+		ithread_mutex_unlock(&gLock);
+		if (gLocation[0] == '\0') {
+			fprintf(stderr, "no reply for %s\n", opt.target);
+			return UPNP_E_TIMEDOUT;
+		}
+	}
+	rc = UpnpDownloadXmlDoc(gLocation, &desc);
+	if (rc != UPNP_E_SUCCESS) {
+		fprintf(stderr, "UpnpDownloadXmlDoc(%s): %d\n", gLocation, rc);
+		return rc;
+	}
+	base = element_text((IXML_Element *)desc, "URLBase");
+	if (base == NULL)
+		base = gLocation;
+	services = ixmlDocument_getElementsByTagName(desc, "service");
+	for (i = 0; services && i < ixmlNodeList_length(services); i++) {
+		IXML_Element *service =
+			(IXML_Element *)ixmlNodeList_item(services, i);
+		const char *type = element_text(service, "serviceType");
+		const char *control = element_text(service, "controlURL");
+		const char *eventSub = element_text(service, "eventSubURL");
+
+		if (type == NULL || control == NULL || eventSub == NULL)
+			continue;
+		if (opt.serviceType && strcmp(type, opt.serviceType) != 0)
+			continue;
+		strncpy(gServiceType, type, sizeof(gServiceType) - 1);
+		UpnpResolveURL2(base, control, &gControlURL);
+		UpnpResolveURL2(base, eventSub, &gEventURL);
+		break;
+	}
+	ixmlNodeList_free(services);
+	ixmlDocument_free(desc);
+	if (gControlURL == NULL || gEventURL == NULL) {
+		fprintf(stderr, "no usable service in %s\n", gLocation);
+		return UPNP_E_INVALID_DESC;
+	}
+	printf("device %s\n  service %s\n  control %s\n  event   %s\n",
+		gLocation,
+		gServiceType,
+		gControlURL,
+		gEventURL);
+
+	return UPNP_E_SUCCESS;
+}
+
+static void do_action(control_point *cp)
+{
+	IXML_Document *action;
+	IXML_Document *response = NULL;
+	int64_t start;
+	int rc;
+
+	if (opt.argName)
+		action = UpnpMakeAction(opt.actionName,
+			gServiceType,
+			1,
+			opt.argName,
+			opt.argValue);
+	else
+		action = UpnpMakeAction(
+			opt.actionName, gServiceType, 0, NULL);
+	start = now_usec();
+	rc = UpnpSendAction(
+		cp->handle, gControlURL, gServiceType, NULL, action, &response);
+	op_record(&cp->stats[OP_ACTION], start, rc);
+	ixmlDocument_free(response);
+	ixmlDocument_free(action);
+}
+
+static void do_search(control_point *cp)
+{
+	int64_t start = now_usec();
+
+	op_record(&cp->stats[OP_SEARCH],
+		start,
+		UpnpSearchAsync(cp->handle, 1, opt.target, cp));
+}
+
+static void do_describe(control_point *cp)
+{
+	IXML_Document *desc = NULL;
+	int64_t start = now_usec();
+
+	op_record(&cp->stats[OP_DESCRIBE],
+		start,
+		UpnpDownloadXmlDoc(gLocation, &desc));
+	ixmlDocument_free(desc);
+}
+
+static void do_subscribe(control_point *cp)
+{
+	int timeout = LOADGEN_SUBSCRIPTION_TIMEOUT;
+	int64_t start;
+	int rc;
+
+	if (cp->subscribed) {
+		UpnpUnSubscribe(cp->handle, cp->sid);
+		cp->subscribed = 0;
+	}
+	start = now_usec();
+	rc = UpnpSubscribe(cp->handle, gEventURL, &timeout, cp->sid);
+	op_record(&cp->stats[OP_SUBSCRIBE], start, rc);
+	cp->subscribed = rc == UPNP_E_SUCCESS;
+}
+
+/*!
+ * \brief Runs one control point until gStop is set.
+ */
+static void *cp_thread(void *arg)
+{
+	control_point *cp = arg;
+	int64_t now = now_usec();
+	int64_t actionStep = opt.actionRate > 0.0
+				     ? (int64_t)(1000000.0 / opt.actionRate)
+				     : 0;
+	int64_t nextAction = now;
+	int64_t nextSearch = now;
+	int64_t nextDescribe = now;
+	int64_t nextSubscribe = opt.subscribeInterval >= 0 ? now : INT64_MAX;
+	int64_t next;
+	int64_t wait;
+
+	while (!gStop) {
+		now = now_usec();
+		if (now >= nextSubscribe) {
+			do_subscribe(cp);
+			nextSubscribe = opt.subscribeInterval > 0
+						? now + opt.subscribeInterval * 1000
+						: INT64_MAX;
+		}
+		if (opt.actionName && now >= nextAction) {
+			do_action(cp);
+			nextAction += actionStep;
+			/* do not try to catch up after a stall */
+			if (nextAction < now)
+				nextAction = now + actionStep;
+		}
+		if (opt.searchInterval > 0 && now >= nextSearch) {
+			do_search(cp);
+			nextSearch = now + opt.searchInterval * 1000;
+		}
+		if (opt.describeInterval > 0 && now >= nextDescribe) {
+			do_describe(cp);
+			nextDescribe = now + opt.describeInterval * 1000;
+		}
+		/* closed loop: send the next action right away */
+		if (opt.actionName && actionStep == 0)
+			continue;
+		next = nextSubscribe;
+		if (opt.actionName && nextAction < next)
+			next = nextAction;
+		if (opt.searchInterval > 0 && nextSearch < next)
+			next = nextSearch;
+		if (opt.describeInterval > 0 && nextDescribe < next)
+			next = nextDescribe;
+		/* wake up at least every 100 ms to notice gStop */
+		wait = (next - now_usec() + 999) / 1000;
+		if (wait > 100)
+			wait = 100;
+		if (wait > 0)
+			imillisleep((int)wait);
+	}
+	if (cp->subscribed)
+		UpnpUnSubscribe(cp->handle, cp->sid);
+
+	return NULL;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -i ifname   interface for UpnpInit2 (lo for loopback)\n"
+		"  -H          host the Headphone device in this process\n"
+		"  -l url      device description URL, skips discovery\n"
+		"  -t target   search target (default %s)\n"
+		"  -S type     service type (default: first service)\n"
+		"  -c n        control points (default 8)\n"
+		"  -d sec      run time (default 10)\n"
+		"  -a name     action to send (default GetVolume, - for none)\n"
+		"  -A n=v      action argument\n"
+		"  -r rate     actions/s per control point (default 0, back to "
+		"back)\n"
+		"  -s ms       search interval per control point (default 0, "
+		"off)\n"
+		"  -D ms       description fetch interval (default 0, off)\n"
+		"  -e ms       resubscribe interval, 0 once at start, -1 off "
+		"(default 0)\n",
+		prog,
+		LOADGEN_TARGET);
+}
+
+static void report(control_point *cps, double seconds)
+{
+	int op;
+	int i;
+
+	printf("\n%-10s %9s %7s %9s %9s %9s %9s %9s\n",
+		"op",
+		"ok",
+		"errors",
+		"ops/s",
+		"p50 ms",
+		"p90 ms",
+		"p99 ms",
+		"max ms");
+	for (op = 0; op < OP_COUNT; op++) {
+		op_stats all;
+
+		memset(&all, 0, sizeof(all));
+		for (i = 0; i < opt.controlPoints; i++) {
+			op_stats *s = &cps[i].stats[op];
+
+			all.errors += s->errors;
+			if (s->count == 0)
+				continue;
+			all.samples = realloc(all.samples,
+				(all.count + s->count) * sizeof(int64_t));
+			if (all.samples == NULL)
+				return;
+			memcpy(all.samples + all.count,
+				s->samples,
+				s->count * sizeof(int64_t));
+			all.count += s->count;
+		}
+		if (all.count == 0 && all.errors == 0)
+			continue;
+		qsort(all.samples, all.count, sizeof(int64_t), cmp_samples);
+		printf("%-10s %9lu %7ld %9.1f %9.2f %9.2f %9.2f %9.2f\n",
+			op_names[op],
+			(unsigned long)all.count,
+			all.errors,
+			(double)all.count / seconds,
+			percentile(&all, 50.0),
+			percentile(&all, 90.0),
+			percentile(&all, 99.0),
+			percentile(&all, 100.0));
+		free(all.samples);
+	}
+	printf("\nsearch replies %ld, events received %ld\n",
+		gSearchReplies,
+		gEventsReceived);
+}
+
+int main(int argc, char *argv[])
+{
+	control_point *cps;
+	int64_t start;
+	double seconds;
+	int rc;
+	int c;
+	int i;
+
+#ifdef _WIN32
+	opt.ifname = NULL;
+#else
+	opt.ifname = "lo";
+#endif
+	opt.target = LOADGEN_TARGET;
+	opt.actionName = "GetVolume";
+	opt.controlPoints = 8;
+	opt.duration = 10;
+	for (i = 1; i < argc; i++) {
+		char *value = i + 1 < argc ? argv[i + 1] : NULL;
+		char *sep;
+
+		if (argv[i][0] != '-' || argv[i][1] == '\0' ||
+			argv[i][2] != '\0') {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+		c = argv[i][1];
+		/* every option except -H and -h takes a value */
+		if (c != 'H' && c != 'h') {
+			if (value == NULL) {
+				usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			i++;
+		}
+		switch (c) {
+		case 'i':
+			opt.ifname = value;
+			break;
+		case 'H':
+			opt.hostDevice = 1;
+			break;
+		case 'l':
+			opt.location = value;
+			break;
+		case 't':
+			opt.target = value;
+			break;
+		case 'S':
+			opt.serviceType = value;
+			break;
+		case 'c':
+			opt.controlPoints = atoi(value);
+			break;
+		case 'd':
+			opt.duration = atoi(value);
+			break;
+		case 'a':
+			opt.actionName = strcmp(value, "-") ? value : NULL;
+			break;
+		case 'A':
+			sep = strchr(value, '=');
+			if (sep == NULL) {
+				usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			*sep = '\0';
+			opt.argName = value;
+			opt.argValue = sep + 1;
+			break;
+		case 'r':
+			opt.actionRate = atof(value);
+			break;
+		case 's':
+			opt.searchInterval = atoi(value);
+			break;
+		case 'D':
+			opt.describeInterval = atoi(value);
+			break;
+		case 'e':
+			opt.subscribeInterval = atoi(value);
+			break;
+		default:
+			usage(argv[0]);
+			return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	if (opt.controlPoints < 1 || opt.duration < 1) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	ithread_mutex_init(&gLock, NULL);
+	ithread_mutex_init(&gVolumeLock, NULL);
+	ithread_cond_init(&gFound, NULL);
+	rc = UpnpInit2(opt.ifname, 0);
+	if (rc != UPNP_E_SUCCESS) {
+		fprintf(stderr, "UpnpInit2: %d\n", rc);
+		return EXIT_FAILURE;
+	}
+	if (opt.hostDevice && start_device() != UPNP_E_SUCCESS)
+		goto finish;
+
+	cps = calloc((size_t)opt.controlPoints, sizeof(*cps));
+	if (cps == NULL)
+		goto finish;
+	for (i = 0; i < opt.controlPoints; i++) {
+		cps[i].id = i;
+		rc = UpnpRegisterClient(cp_callback, &cps[i], &cps[i].handle);
+		if (rc != UPNP_E_SUCCESS) {
+			fprintf(stderr, "UpnpRegisterClient: %d\n", rc);
+			opt.controlPoints = i;
+			break;
+		}
+	}
+	if (opt.controlPoints == 0 ||
+		discover_device(cps[0].handle) != UPNP_E_SUCCESS)
+		goto unregister;
+	/* count only replies and events caused by the run itself */
+	ithread_mutex_lock(&gLock);
+	gSearchReplies = 0;
+	gEventsReceived = 0;
+	ithread_mutex_unlock(&gLock);
+
+	printf("running %d control points for %d s\n",
+		opt.controlPoints,
+		opt.duration);
+	start = now_usec();
+	for (i = 0; i < opt.controlPoints; i++)
+		ithread_create(&cps[i].thread, NULL, cp_thread, &cps[i]);
+	isleep((unsigned)opt.duration);
+	gStop = 1;
+	for (i = 0; i < opt.controlPoints; i++)
+		ithread_join(cps[i].thread, NULL);
+	seconds = (double)(now_usec() - start) / 1000000.0;
+	report(cps, seconds);
+
+unregister:
+	for (i = 0; i < opt.controlPoints; i++) {
+		int op;
+
+		UpnpUnRegisterClient(cps[i].handle);
+		for (op = 0; op < OP_COUNT; op++)
+			free(cps[i].stats[op].samples);
+	}
+	free(cps);
+finish:
+	if (gDevice != -1)
+		UpnpUnRegisterRootDevice(gDevice);
+	UpnpFinish();
+	free(gControlURL);
+	free(gEventURL);
+	ithread_cond_destroy(&gFound);
+	ithread_mutex_destroy(&gVolumeLock);
+	ithread_mutex_destroy(&gLock);
+
+	return EXIT_SUCCESS;
+}
@@ -41,6 +41,7 @@
  */
 
 #include "UpnpGlobal.h" /* For UPNP_EXPORT_SPEC */
+#include <stddef.h> /* For size_t */
 
 /*!
  * \brief The type of DOM strings.
@@ -214,6 +215,11 @@ typedef struct _IXML_NamedNodeMap
 	struct _IXML_NamedNodeMap *next;
 } IXML_NamedNodeMap;
 
+/*!
+ * \brief State of an incremental parse, see \b ixmlPushParser_create.
+ */
+typedef struct _IXML_PushParser IXML_PushParser;
+
 /* @} DOM Interfaces */
 
 #ifdef __cplusplus
@@ -1707,6 +1713,75 @@ UPNP_EXPORT_SPEC int ixmlLoadDocumentEx(
 	 * NULL on an error. */
 	IXML_Document **doc);
 
+/*!
+ * \brief Creates a parser that builds a document from XML text given in
+ * pieces.
+ *
+ * The text is given with \b ixmlPushParser_feed as it becomes available,
+ * the nodes are added to the document as soon as they are complete. The
+ * document is returned by \b ixmlPushParser_finish, it is the one
+ * \b ixmlParseBufferEx would return for the whole text.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c IXML_SUCCESS: The operation completed successfully.
+ *     \li \c IXML_INVALID_PARAMETER: The \b parser is not a valid
+ *           pointer.
+ *     \li \c IXML_INSUFFICIENT_MEMORY: Not enough free memory exists
+ *           to complete this operation.
+ */
+UPNP_EXPORT_SPEC int ixmlPushParser_create(
+	/*! [out] A pointer to the new parser, to free with
+	 * \b ixmlPushParser_free. */
+	IXML_PushParser **parser);
+
+/*!
+ * \brief Gives the next piece of XML text to a parser.
+ *
+ * Only the part of the text that is not complete yet is kept. As with
+ * \b ixmlParseBufferEx, the text ends at the first null byte, what follows
+ * it is ignored.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c IXML_SUCCESS: The operation completed successfully.
+ *     \li \c IXML_INVALID_PARAMETER: Either \b parser or \b buffer is not a
+ *           valid pointer.
+ *     \li \c IXML_INSUFFICIENT_MEMORY: Not enough free memory exists
+ *           to complete this operation.
+ *     \li Any error of \b ixmlParseBufferEx. Once an error is returned, the
+ *           following calls return it too.
+ */
+UPNP_EXPORT_SPEC int ixmlPushParser_feed(
+	/*! [in] The parser. */
+	IXML_PushParser *parser,
+	/*! [in] The next piece of XML text, does not need to be null
+	 * terminated. */
+	const char *buffer,
+	/*! [in] The number of bytes in \b buffer. */
+	size_t length);
+
+/*!
+ * \brief Ends the XML text given to a parser and returns the document.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c IXML_SUCCESS: The operation completed successfully.
+ *     \li \c IXML_INVALID_PARAMETER: Either \b parser or \b doc is not a
+ *           valid pointer, or no text was given.
+ *     \li Any error of \b ixmlPushParser_feed or \b ixmlParseBufferEx.
+ */
+UPNP_EXPORT_SPEC int ixmlPushParser_finish(
+	/*! [in] The parser, it can only be freed afterwards. */
+	IXML_PushParser *parser,
+	/*! [out] A pointer to the \b Document if the text correctly parses or
+	 * \b NULL on an error. */
+	IXML_Document **doc);
+
+/*!
+ * \brief Frees a parser and the document it did not return.
+ */
+UPNP_EXPORT_SPEC void ixmlPushParser_free(
+	/*! [in] The parser to free, may be \b NULL. */
+	IXML_PushParser *parser);
+
 /*!
  * \brief Clones an existing \b DOMString.
  *
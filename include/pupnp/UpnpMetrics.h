@@ -0,0 +1,99 @@
+#ifndef UPNPMETRICS_H
+#define UPNPMETRICS_H
+
+/*!
+ * \file
+ *
+ * \brief Snapshot types returned by UpnpGetMetrics().
+ *
+ * All counters are cumulative since UpnpInit2(), except where noted as
+ * a current value.
+ */
+
+#include "UpnpGlobal.h"	 /* for UPNP_EXPORT_SPEC */
+#include "UpnpStdInt.h" /* for uint64_t */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*!
+ * \brief Number of buckets in a UpnpLatencyHistogram.
+ *
+ * Bucket 0 counts samples under 1 microsecond, bucket i (0 < i < last)
+ * counts samples in [2^(i-1), 2^i) microseconds and the last bucket
+ * counts everything from 2^(UPNP_METRICS_BUCKETS - 2) microseconds (about
+ * 67 seconds) up.
+ */
+#define UPNP_METRICS_BUCKETS 28
+
+/*! Number of entries in UpnpMetrics::httpResponses. */
+#define UPNP_METRICS_HTTP_CLASSES 6
+
+/*! Fixed bucket latency histogram. */
+typedef struct s_UpnpLatencyHistogram
+{
+	/*! Number of samples. */
+	uint64_t count;
+	/*! Sum of all samples, in microseconds. */
+	uint64_t totalUsec;
+	/*! Sample count per power of two bucket, see UPNP_METRICS_BUCKETS. */
+	uint64_t bucket[UPNP_METRICS_BUCKETS];
+} UpnpLatencyHistogram;
+
+/*! Metrics of one internal thread pool. */
+typedef struct s_UpnpThreadPoolMetrics
+{
+	/*! Current number of threads. */
+	int totalThreads;
+	/*! Current number of threads running a job. */
+	int busyThreads;
+	/*! Current number of jobs waiting in the queues. */
+	int queuedJobs;
+	/*! Time jobs spent queued before a worker picked them up. */
+	UpnpLatencyHistogram queueWait;
+	/*! Time spent running jobs. Persistent jobs (the miniserver and
+	 * the timer thread) are not included. */
+	UpnpLatencyHistogram runTime;
+} UpnpThreadPoolMetrics;
+
+/*! Runtime metrics of the SDK. */
+typedef struct s_UpnpMetrics
+{
+	/*! Pool serving incoming HTTP connections. */
+	UpnpThreadPoolMetrics miniServerPool;
+	/*! Pool handling received SSDP datagrams. */
+	UpnpThreadPoolMetrics recvPool;
+	/*! Pool running asynchronous API calls, timers and GENA
+	 * notifications. */
+	UpnpThreadPoolMetrics sendPool;
+	/*! Device side SOAP action handling, from parsing the request to
+	 * sending the response, including the application callback. */
+	UpnpLatencyHistogram soapAction;
+	/*! SOAP actions answered with a fault. */
+	uint64_t soapActionFailures;
+	/*! GENA NOTIFY delivery to one subscriber, including retries on
+	 * alternate delivery URLs. */
+	UpnpLatencyHistogram notifyDelivery;
+	/*! NOTIFY deliveries that failed or were not accepted. */
+	uint64_t notifyFailures;
+	/*! SSDP datagrams received. */
+	uint64_t ssdpPacketsIn;
+	/*! SSDP datagrams sent. */
+	uint64_t ssdpPacketsOut;
+	/*! HTTP responses generated by the SDK, including SSDP search
+	 * replies, indexed by status class: [1] to [5] for 1xx to 5xx, [0]
+	 * for anything else. */
+	uint64_t httpResponses[UPNP_METRICS_HTTP_CLASSES];
+	/*! Current number of subscriptions held by registered devices. */
+	int deviceSubscriptions;
+	/*! Current number of subscriptions held by registered control
+	 * points. */
+	int clientSubscriptions;
+} UpnpMetrics;
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* UPNPMETRICS_H */
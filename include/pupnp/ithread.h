@@ -173,6 +173,16 @@ typedef pthread_rwlock_t ithread_rwlock_t;
 typedef ithread_mutex_t ithread_rwlock_t;
 #endif /* UPNP_USE_RWLOCK */
 
+/****************************************************************************
+ * Name: ithread_key_t
+ *
+ *  Description:
+ *      Thread-specific data key.
+ *      typedef to pthread_key_t
+ *      Internal Use Only
+ ***************************************************************************/
+typedef pthread_key_t ithread_key_t;
+
 /****************************************************************************
  * Function: ithread_initialize_library
  *
@@ -826,6 +836,52 @@ static UPNP_INLINE int ithread_cleanup_thread(void)
  ***************************************************************************/
 #define ithread_self pthread_self
 
+/****************************************************************************
+ * Function: ithread_key_create
+ *
+ *  Description:
+ *		Creates a thread-specific data key. The destructor is called
+ *		with the thread's value when a thread with a non NULL value
+ *		exits.
+ *  Returns:
+ *		0 on success, Nonzero on failure.
+ *      See man page for pthread_key_create
+ ***************************************************************************/
+#define ithread_key_create pthread_key_create
+
+/****************************************************************************
+ * Function: ithread_key_delete
+ *
+ *  Description:
+ *		Deletes a thread-specific data key. Destructors are not called.
+ *  Returns:
+ *		0 on success, Nonzero on failure.
+ *      See man page for pthread_key_delete
+ ***************************************************************************/
+#define ithread_key_delete pthread_key_delete
+
+/****************************************************************************
+ * Function: ithread_getspecific
+ *
+ *  Description:
+ *		Returns the calling thread's value for a key.
+ *  Returns:
+ *		The value, NULL if none was set.
+ *      See man page for pthread_getspecific
+ ***************************************************************************/
+#define ithread_getspecific pthread_getspecific
+
+/****************************************************************************
+ * Function: ithread_setspecific
+ *
+ *  Description:
+ *		Sets the calling thread's value for a key.
+ *  Returns:
+ *		0 on success, Nonzero on failure.
+ *      See man page for pthread_setspecific
+ ***************************************************************************/
+#define ithread_setspecific pthread_setspecific
+
 /****************************************************************************
  * Function: ithread_detach
  *
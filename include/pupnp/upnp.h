@@ -403,6 +403,7 @@
 #include "UpnpEvent.h"		     // IWYU pragma: keep
 #include "UpnpEventSubscribe.h"	     // IWYU pragma: keep
 #include "UpnpFileInfo.h"	     // IWYU pragma: keep
+#include "UpnpMetrics.h"	     // IWYU pragma: keep
 #include "UpnpStateVarComplete.h"    // IWYU pragma: keep
 #include "UpnpStateVarRequest.h"     // IWYU pragma: keep
 #include "UpnpSubscriptionRequest.h" // IWYU pragma: keep
@@ -876,6 +877,10 @@ UPNP_EXPORT_SPEC int UpnpRegisterRootDevice3(
  * This is synchronous and does not generate any callbacks. Callbacks can occur
  * as soon as this function returns.
  *
+ * When \b DescUrl points at the internal web server and names an alias or a
+ * file below its root directory, the document is read from there instead of
+ * over HTTP.
+ *
  * \return An integer representing one of the following:
  *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
  *     \li \c UPNP_E_FINISH: The SDK is already terminated or
@@ -918,10 +923,119 @@ UPNP_EXPORT_SPEC int UpnpRegisterRootDevice4(
 	 * returned for legacy CPs for this root device instance. */
 	const char *LowerDescUrl);
 
+/*!
+ * \brief Registers a device application from a description document it has
+ * already parsed, like \b UpnpRegisterRootDevice4 without fetching
+ * \b DescUrl.
+ *
+ * \b DescUrl is still advertised and is the base of the relative URLs of the
+ * description, the application must keep serving the document there.
+ *
+ * The SDK takes ownership of \b DescDoc, also when an error is returned.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_FINISH: The SDK is already terminated or
+ *                                is not initialized.
+ *     \li \c UPNP_E_INVALID_DESC: The description document was not
+ *             a valid device description.
+ *     \li \c UPNP_E_INVALID_PARAM: \b DescDoc, \b Callback or \b Hnd
+ *             is not a valid pointer or \b DescURL is \c NULL.
+ *     \li \c UPNP_E_OUTOF_MEMORY: There are insufficient resources to
+ *             register this root device.
+ */
+UPNP_EXPORT_SPEC int UpnpRegisterRootDeviceDoc(
+	/*! [in] Description document of the root device. */
+	IXML_Document *DescDoc,
+	/*! [in] Pointer to a string containing the description URL for this
+	 * root device instance. */
+	const char *DescUrl,
+	/*! [in] Pointer to the callback function for receiving asynchronous
+	   events. */
+	Upnp_FunPtr Callback,
+	/*! [in] Pointer to user data returned with the callback function when
+	   invoked. */
+	const void *Cookie,
+	/*! [out] Pointer to a variable to store the new device handle. */
+	UpnpDevice_Handle *Hnd,
+	/*! [in] Address family of this device. Can be AF_INET for an IPv4
+	 * device, or AF_INET6 for an IPv6 device. */
+	int AddressFamily,
+	/*! [in] Pointer to a string containing the description URL to be
+	 * returned for legacy CPs for this root device instance, or NULL. */
+	const char *LowerDescUrl);
+
+/*!
+ * \brief A root device registered from a shared template, see
+ * \b UpnpRegisterRootDevices.
+ */
+struct UpnpDeviceInstance_s
+{
+	/*! UDN of the root device, replacing the one of the template. It is
+	 * shorter than \c LINE_SIZE by at least 22 characters, the room the
+	 * UDNs of the embedded devices take for their suffix. */
+	const char *UDN;
+	/*! Description URL of the device. */
+	const char *DescUrl;
+	/*! Description URL returned to legacy CPs, or NULL for \b DescUrl. */
+	const char *LowerDescUrl;
+	/*! Pointer to user data returned with the callback function. */
+	const void *Cookie;
+};
+
+typedef struct UpnpDeviceInstance_s UpnpDeviceInstance;
+
+/*!
+ * \brief Registers many root devices that differ only by their UDN and
+ * URLs from one parsed description.
+ *
+ * The devices share the DOM of \b Template instead of parsing and keeping a
+ * copy each. The root device of each instance is announced and eventing
+ * with the UDN of the instance; an embedded device takes that UDN followed
+ * by "-" and its index among the devices of the template, e.g.
+ * "uuid:...-1". The relative URLs of the services resolve against the
+ * \b DescUrl of each instance, so they should differ between the
+ * instances, for instance by giving each instance its own directory.
+ *
+ * The description of each instance, with its UDNs, must be served by the
+ * application at its \b DescUrl, e.g. from a virtual directory.
+ *
+ * Either all the devices are registered or none. The SDK takes ownership
+ * of \b Template, also when an error is returned. Each handle is
+ * unregistered with \b UpnpUnRegisterRootDevice; the template is freed with
+ * the last one.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_FINISH: The SDK is already terminated or
+ *                                is not initialized.
+ *     \li \c UPNP_E_INVALID_DESC: The template is not a valid device
+ *             description, or a device has no UDN.
+ *     \li \c UPNP_E_INVALID_PARAM: A pointer is not valid, \b Count is 0,
+ *             or an instance has no UDN or description URL, or a UDN
+ *             that is too long.
+ *     \li \c UPNP_E_OUTOF_MEMORY: There are insufficient resources or
+ *             handles to register the devices.
+ */
+UPNP_EXPORT_SPEC int UpnpRegisterRootDevices(
+	/*! [in] Description shared by the devices. */
+	IXML_Document *Template,
+	/*! [in] The devices to register. */
+	const UpnpDeviceInstance *Instances,
+	/*! [in] Number of entries of \b Instances. */
+	size_t Count,
+	/*! [in] Pointer to the callback function for receiving asynchronous
+	   events. */
+	Upnp_FunPtr Callback,
+	/*! [in] Address family of the devices, AF_INET or AF_INET6. */
+	int AddressFamily,
+	/*! [out] Array of \b Count entries receiving the device handles. */
+	UpnpDevice_Handle *Hnds);
+
 /*!
  * \brief Unregisters a root device registered with \b UpnpRegisterRootDevice,
- * \b UpnpRegisterRootDevice2, \b UpnpRegisterRootDevice3 or
- * \b UpnpRegisterRootDevice4.
+ * \b UpnpRegisterRootDevice2, \b UpnpRegisterRootDevice3,
+ * \b UpnpRegisterRootDevice4 or \b UpnpRegisterRootDeviceDoc.
  *
  * After this call, the \b UpnpDevice_Handle is no longer valid. For all
  * advertisements that have not yet expired, the SDK sends a device unavailable
@@ -940,8 +1054,8 @@ UPNP_EXPORT_SPEC int UpnpUnRegisterRootDevice(
 
 /*!
  * \brief Unregisters a root device registered with \b UpnpRegisterRootDevice,
- * \b UpnpRegisterRootDevice2, \b UpnpRegisterRootDevice3 or
- * \b UpnpRegisterRootDevice4.
+ * \b UpnpRegisterRootDevice2, \b UpnpRegisterRootDevice3,
+ * \b UpnpRegisterRootDevice4 or \b UpnpRegisterRootDeviceDoc.
  *
  * After this call, the \b UpnpDevice_Handle is no longer valid. For all
  * advertisements that have not yet expired, the SDK sends a device unavailable
@@ -1161,6 +1275,32 @@ UPNP_EXPORT_SPEC int UpnpSendAdvertisementLowPower(
 	/*! RegistrationState as defined by UPnP Low Power. */
 	int RegistrationState);
 
+/*!
+ * \brief Sends out the discovery announcements of several devices, like
+ * \b UpnpSendAdvertisement, and renews them together.
+ *
+ * The devices are announced in one pass, with a single pause between the
+ * copies of the announcements instead of one per device. As for any
+ * announced device, the announcements are then renewed by the advertisement
+ * scheduler of the SDK, which spreads the renewals of all the devices over
+ * their renewal period.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_INVALID_HANDLE: None of the handles is a valid device
+ *             handle.
+ *     \li \c UPNP_E_INVALID_PARAM: \b Hnds is not valid or \b Count is 0.
+ *     \li \c UPNP_E_OUTOF_MEMORY: There are insufficient resources to
+ *             send future advertisements.
+ */
+UPNP_EXPORT_SPEC int UpnpSendAdvertisements(
+	/*! [in] The device handles, e.g. from \b UpnpRegisterRootDevices. */
+	const UpnpDevice_Handle *Hnds,
+	/*! [in] Number of entries of \b Hnds. */
+	size_t Count,
+	/*! [in] The expiration age, in seconds, of the announcements. */
+	int Exp);
+
 /* @} Discovery */
 
 /******************************************************************************
@@ -1405,6 +1545,137 @@ UPNP_EXPORT_SPEC int UpnpSendActionExAsync(
 	 * invoked. */
 	const void *Cookie);
 
+/*!
+ * \brief An action argument, see \b UpnpSendActionArgs.
+ */
+struct UpnpActionArgument_s
+{
+	/*! Name of the argument. */
+	const char *name;
+	/*! Value of the argument, without XML escaping. */
+	const char *value;
+};
+
+typedef struct UpnpActionArgument_s UpnpActionArgument;
+
+/*!
+ * \brief Type of the field an output argument is stored to, see
+ * \b UpnpSendActionBind.
+ */
+enum UpnpArgumentType_e
+{
+	/*! A char array of \b size bytes. Longer values are truncated, the
+	 * field is always null terminated. */
+	UPNP_ARG_STRING = 0,
+	/*! An int, from a decimal value. */
+	UPNP_ARG_INT = 1,
+	/*! An unsigned int, from a decimal value. */
+	UPNP_ARG_UINT = 2,
+	/*! An int set to 1 or 0, from "1", "true", "yes" or "0", "false",
+	 * "no". */
+	UPNP_ARG_BOOLEAN = 3
+};
+
+typedef enum UpnpArgumentType_e UpnpArgumentType;
+
+/*!
+ * \brief Where \b UpnpSendActionBind stores an output argument.
+ */
+struct UpnpArgumentBinding_s
+{
+	/*! Name of the output argument. */
+	const char *name;
+	/*! Type of the field. */
+	UpnpArgumentType type;
+	/*! Offset of the field in the output struct, use offsetof(). */
+	size_t offset;
+	/*! Size of the field, used for \c UPNP_ARG_STRING. */
+	size_t size;
+};
+
+typedef struct UpnpArgumentBinding_s UpnpArgumentBinding;
+
+/*!
+ * \brief Sends an action and returns its output arguments as name/value
+ * pairs.
+ *
+ * The action is built and its response is parsed without a DOM, which
+ * makes this cheaper than \b UpnpSendAction for the common case of
+ * actions with plain text arguments. An output argument holding XML
+ * elements is returned as the unparsed markup.
+ *
+ * This is a synchronous call that does not return until the action is
+ * complete. A positive return value is the UPnP error code of a SOAP
+ * fault.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_INVALID_HANDLE: The handle is not a valid control
+ *             point handle.
+ *     \li \c UPNP_E_INVALID_URL: \b ActionURL is not a valid URL.
+ *     \li \c UPNP_E_INVALID_PARAM: \b ServiceType, \b ActionName,
+ *             \b ActionURL, \b OutArgs or \b OutCount is not a valid
+ *             pointer, or an input argument has no name or value.
+ *     \li \c UPNP_E_BAD_RESPONSE: The response is not a valid response
+ *             to the action.
+ *     \li \c UPNP_E_OUTOF_MEMORY: Insufficient resources exist to
+ *             complete this operation.
+ */
+UPNP_EXPORT_SPEC int UpnpSendActionArgs(
+	/*! [in] The handle of the control point sending the action. */
+	UpnpClient_Handle Hnd,
+	/*! [in] The action URL of the service. */
+	const char *ActionURL,
+	/*! [in] The type of the service. */
+	const char *ServiceType,
+	/*! [in] The name of the action. */
+	const char *ActionName,
+	/*! [in] The input arguments, in the order of the service
+	 * description. May be \c NULL if \b InCount is 0. */
+	const UpnpActionArgument *InArgs,
+	/*! [in] The number of input arguments. */
+	size_t InCount,
+	/*! [out] The output arguments, in the order of the response. The
+	 * array and the strings it points to are allocated as one block that
+	 * the caller frees with free(). \c NULL when there are none. */
+	UpnpActionArgument **OutArgs,
+	/*! [out] The number of output arguments. */
+	size_t *OutCount);
+
+/*!
+ * \brief Sends an action and stores its output arguments into the fields
+ * of a caller supplied struct.
+ *
+ * Works as \b UpnpSendActionArgs, without allocating the output. Output
+ * arguments that have no binding are ignored, and fields whose argument is
+ * not in the response are left unchanged.
+ *
+ * \return The values of \b UpnpSendActionArgs, with
+ * \c UPNP_E_BAD_RESPONSE also meaning that a bound value could not be
+ * converted to the type of its field.
+ */
+UPNP_EXPORT_SPEC int UpnpSendActionBind(
+	/*! [in] The handle of the control point sending the action. */
+	UpnpClient_Handle Hnd,
+	/*! [in] The action URL of the service. */
+	const char *ActionURL,
+	/*! [in] The type of the service. */
+	const char *ServiceType,
+	/*! [in] The name of the action. */
+	const char *ActionName,
+	/*! [in] The input arguments, in the order of the service
+	 * description. May be \c NULL if \b InCount is 0. */
+	const UpnpActionArgument *InArgs,
+	/*! [in] The number of input arguments. */
+	size_t InCount,
+	/*! [in] Where to store the output arguments. */
+	const UpnpArgumentBinding *Bindings,
+	/*! [in] The number of bindings. */
+	size_t BindingCount,
+	/*! [out] The struct the bindings refer to. May be \c NULL if
+	 * \b BindingCount is 0. */
+	void *Out);
+
 /*! @} Control */
 
 /******************************************************************************
@@ -2562,6 +2833,38 @@ UPNP_EXPORT_SPEC int UpnpDownloadXmlDoc(
 
 /*! @} Control Point HTTP API */
 
+/******************************************************************************
+ ******************************************************************************
+ *                                                                            *
+ *                             M E T R I C S                                  *
+ *                                                                            *
+ ******************************************************************************
+ ******************************************************************************/
+
+/*!
+ * \name Metrics API
+ *
+ * @{
+ */
+
+/*!
+ * \brief Takes a snapshot of the SDK runtime metrics.
+ *
+ * Counters are updated with atomic operations on the hot paths and are
+ * always enabled. The snapshot reads each counter independently, so
+ * related counters may be off by a few in-flight operations.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_INVALID_PARAM: \b metrics is \c NULL.
+ *     \li \c UPNP_E_FINISH: The SDK is not initialized.
+ */
+UPNP_EXPORT_SPEC int UpnpGetMetrics(
+	/*! [out] Receives the snapshot. */
+	UpnpMetrics *metrics);
+
+/*! @} Metrics API */
+
 /******************************************************************************
  ******************************************************************************
  *                                                                            *
@@ -2803,6 +3106,104 @@ UPNP_EXPORT_SPEC void UpnpSetHostValidateCallback(
  */
 UPNP_EXPORT_SPEC void UpnpSetAllowLiteralHostRedirection(int enable);
 
+/*!
+ * \brief Resolves a host name found in a URL.
+ *
+ * \return \c 0 with \b address set to the first address of the host, or
+ * 	non-zero if the name does not resolve.
+ */
+typedef int (*UpnpHostResolver)(
+	/*! [in] Host name. */
+	const char *hostname,
+	/*! [out] IPv4 or IPv6 address, the port is ignored. */
+	struct sockaddr_storage *address,
+	/*! [in] Cookie given to UpnpSetHostResolver(). */
+	void *cookie);
+
+/*!
+ * \brief Sets the function resolving the host names of URLs in place of
+ * getaddrinfo(), for instance a local stand-in resolver in tests.
+ *
+ * Resolutions are cached, the cache is emptied by this call.
+ */
+UPNP_EXPORT_SPEC void UpnpSetHostResolver(
+	/*! [in] The resolver, or NULL to go back to getaddrinfo(). */
+	UpnpHostResolver resolver,
+	/*! [in] Argument of \b resolver. */
+	void *cookie);
+
+/*!
+ * \brief Enables or disables asynchronous host name resolution.
+ *
+ * When enabled, a URL whose host name is not cached is rejected with
+ * \c UPNP_E_TIMEDOUT while the name is resolved in the background, so
+ * that no thread waits for a name server. The call can be made again
+ * once the name is cached. An expired cached address is still used while
+ * it is refreshed.
+ */
+UPNP_EXPORT_SPEC void UpnpSetAsyncHostResolution(
+	/*! [in] Non-zero to enable, zero to disable (default). */
+	int enable);
+
+/*!
+ * \brief Sets how many HTTP listener sockets the internal web server opens
+ * on its port, each one accepting connections in its own thread.
+ *
+ * The listeners share the port with SO_REUSEPORT and the kernel spreads
+ * the incoming connections over them. On Linux, the thread of each one is
+ * bound to a processor. Must be called before UpnpInit2(). SSDP keeps a
+ * single socket per address family.
+ *
+ * \return UPNP_E_SUCCESS, UPNP_E_INIT if the SDK is initialized, or
+ * 	UPNP_E_INVALID_PARAM if \b shards is out of range or, above 1, if the
+ * 	system cannot spread connections over listeners.
+ */
+UPNP_EXPORT_SPEC int UpnpSetMiniServerShards(
+	/*! [in] Number of listeners, 1 (default) to 64. */
+	int shards);
+
+/*!
+ * \brief Thread pools of the SDK, see UpnpSetThreadPoolPlacement().
+ */
+typedef enum
+{
+	/*! Sends requests, advertisements and events. */
+	UPNP_THREADPOOL_SEND,
+	/*! Runs the callbacks of received messages. */
+	UPNP_THREADPOOL_RECV,
+	/*! Reads the sockets and handles HTTP requests. */
+	UPNP_THREADPOOL_MINISERVER,
+	/*! The timer thread, otherwise placed with the send pool. */
+	UPNP_THREADPOOL_TIMER
+} Upnp_ThreadPool;
+
+/*!
+ * \brief Sets the processors and the NUMA node the threads of a thread pool
+ * run on.
+ *
+ * Must be called before UpnpInit2(). With both \b cpus and \b numaNode,
+ * the threads run on the processors of the list that belong to the node.
+ * The memory the threads allocate then comes from their node. Thread
+ * affinity is supported on Linux and Windows, where a thread stays in a
+ * single processor group. Elsewhere a processor list or a NUMA node is
+ * rejected.
+ *
+ * \return UPNP_E_SUCCESS, UPNP_E_INIT if the SDK is initialized, or
+ * 	UPNP_E_INVALID_PARAM if \b pool, \b cpus or \b numaNode is not
+ * 	valid or not supported.
+ */
+UPNP_EXPORT_SPEC int UpnpSetThreadPoolPlacement(
+	/*! [in] The thread pool. */
+	Upnp_ThreadPool pool,
+	/*! [in] Processors and ranges like "0-3,8", NULL or empty for any. */
+	const char *cpus,
+	/*! [in] NUMA node, -1 for any. */
+	int numaNode,
+	/*! [in] Non-zero to have the pool allocate its free jobs from one of
+	 * its threads, so that they live on its node. Ignored for the timer
+	 * thread. */
+	int localJobs);
+
 /*!
  * \brief Assign the Access-Control-Allow-Origin specfied by the input
  * const char* cors_string parameterto the global CORS string
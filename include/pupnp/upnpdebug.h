@@ -162,6 +162,44 @@ static UPNP_INLINE void UpnpSetLogFileNames_Inlined(
 }
 #endif
 
+/*!
+ * \brief Enable or disable asynchronous logging. Must be called before
+ * \c UpnpInit2 (or \c UpnpInitLog) to take effect.
+ *
+ * In asynchronous mode \c UpnpPrintf formats the message into a ring buffer
+ * owned by the calling thread and returns without taking any lock or doing
+ * any I/O. A background thread adds the header (time, module, level, thread,
+ * file and line) and writes the messages to the log file. When the ring of a
+ * thread is full its messages are dropped; see \c UpnpGetLogDropCount. The
+ * ring of a thread is kept until the thread exits.
+ */
+UPNP_EXPORT_SPEC void UpnpSetLogAsync(
+	/*! [in] Nonzero to enable, zero to disable. */
+	int enable);
+
+#if defined NDEBUG && !defined UPNP_DEBUG_C
+	#define UpnpSetLogAsync UpnpSetLogAsync_Inlined
+static UPNP_INLINE void UpnpSetLogAsync_Inlined(int enable)
+{
+	(void)enable;
+	return;
+}
+#endif
+
+/*!
+ * \brief Returns the number of messages dropped by asynchronous logging
+ * because a ring buffer was full.
+ */
+UPNP_EXPORT_SPEC unsigned long UpnpGetLogDropCount(void);
+
+#if defined NDEBUG && !defined UPNP_DEBUG_C
+	#define UpnpGetLogDropCount UpnpGetLogDropCount_Inlined
+static UPNP_INLINE unsigned long UpnpGetLogDropCount_Inlined(void)
+{
+	return 0;
+}
+#endif
+
 /*!
  * \brief Check if the module is turned on for debug and returns the file
  * descriptor corresponding to the debug level
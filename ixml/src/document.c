@@ -35,6 +35,7 @@
  */
 
 #include "ixmldebug.h"
+#include "ixmlintern.h"
 #include "ixmlparser.h"
 
 #include <stdio.h>
@@ -122,7 +123,7 @@ int ixmlDocument_createElementEx(
 	}
 
 	ixmlElement_init(newElement);
-	newElement->tagName = strdup(tagName);
+	newElement->tagName = ixml_intern(tagName);
 	if (newElement->tagName == NULL) {
 		ixmlElement_free(newElement);
 		newElement = NULL;
@@ -131,9 +132,8 @@ int ixmlDocument_createElementEx(
 	}
 	/* set the node fields */
 	newElement->n.nodeType = eELEMENT_NODE;
-	newElement->n.nodeName = strdup(tagName);
+	newElement->n.nodeName = ixml_intern(tagName);
 	if (newElement->n.nodeName == NULL) {
-		free(newElement->tagName);
 		ixmlElement_free(newElement);
 		newElement = NULL;
 		errCode = IXML_INSUFFICIENT_MEMORY;
@@ -180,7 +180,7 @@ int ixmlDocument_createDocumentEx(IXML_Document **rtDoc)
 
 	ixmlDocument_init(doc);
 
-	doc->n.nodeName = strdup((const char *)DOCUMENTNODENAME);
+	doc->n.nodeName = ixml_intern((const char *)DOCUMENTNODENAME);
 	if (doc->n.nodeName == NULL) {
 		ixmlDocument_free(doc);
 		doc = NULL;
@@ -225,7 +225,7 @@ int ixmlDocument_createTextNodeEx(
 	/* initialize the node */
 	ixmlNode_init(returnNode);
 
-	returnNode->nodeName = strdup((const char *)TEXTNODENAME);
+	returnNode->nodeName = ixml_intern((const char *)TEXTNODENAME);
 	if (returnNode->nodeName == NULL) {
 		ixmlNode_free(returnNode);
 		returnNode = NULL;
@@ -283,7 +283,7 @@ int ixmlDocument_createAttributeEx(
 	attrNode->n.nodeType = eATTRIBUTE_NODE;
 
 	/* set the node fields */
-	attrNode->n.nodeName = strdup(name);
+	attrNode->n.nodeName = ixml_intern(name);
 	if (attrNode->n.nodeName == NULL) {
 		ixmlAttr_free(attrNode);
 		attrNode = NULL;
@@ -379,7 +379,7 @@ int ixmlDocument_createCDATASectionEx(
 
 	ixmlCDATASection_init(cDSectionNode);
 	cDSectionNode->n.nodeType = eCDATA_SECTION_NODE;
-	cDSectionNode->n.nodeName = strdup((const char *)CDATANODENAME);
+	cDSectionNode->n.nodeName = ixml_intern((const char *)CDATANODENAME);
 	if (cDSectionNode->n.nodeName == NULL) {
 		ixmlCDATASection_free(cDSectionNode);
 		cDSectionNode = NULL;
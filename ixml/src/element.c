@@ -34,6 +34,7 @@
  * \file
  */
 
+#include "ixmlintern.h"
 #include "ixmlparser.h"
 
 #include <assert.h>
@@ -61,6 +62,7 @@ const DOMString ixmlElement_getTagName(IXML_Element *element)
 int ixmlElement_setTagName(IXML_Element *element, const char *tagName)
 {
 	int rc = IXML_SUCCESS;
+	DOMString newTagName;
 
 	assert(element != NULL && tagName != NULL);
 
@@ -68,10 +70,9 @@ int ixmlElement_setTagName(IXML_Element *element, const char *tagName)
 		return IXML_FAILED;
 	}
 
-	if (element->tagName != NULL) {
-		free(element->tagName);
-	}
-	element->tagName = strdup(tagName);
+	newTagName = ixml_intern(tagName);
+	ixml_intern_release(element->tagName);
+	element->tagName = newTagName;
 	if (element->tagName == NULL) {
 		rc = IXML_INSUFFICIENT_MEMORY;
 	}
@@ -404,7 +405,7 @@ int ixmlElement_setAttributeNS(IXML_Element *element,
 	}
 
 	ixmlNode_init(&newAttrNode);
-	newAttrNode.nodeName = strdup(qualifiedName);
+	newAttrNode.nodeName = ixml_intern(qualifiedName);
 	if (newAttrNode.nodeName == NULL) {
 		return IXML_INSUFFICIENT_MEMORY;
 	}
@@ -439,26 +440,16 @@ int ixmlElement_setAttributeNS(IXML_Element *element,
 		}
 	}
 	if (attrNode != NULL) {
-		if (attrNode->prefix != NULL) {
-			/* Remove the old prefix */
-			free(attrNode->prefix);
-		}
-		/* replace it with the new prefix */
-		if (newAttrNode.prefix != NULL) {
-			attrNode->prefix = strdup(newAttrNode.prefix);
-			if (attrNode->prefix == NULL) {
-				Parser_freeNodeContent(&newAttrNode);
-				return IXML_INSUFFICIENT_MEMORY;
-			}
-		} else
-			attrNode->prefix = newAttrNode.prefix;
+		/* replace the old prefix with the new one, both interned */
+		ixml_intern_release(attrNode->prefix);
+		attrNode->prefix = newAttrNode.prefix;
+		newAttrNode.prefix = NULL;
 
 		if (attrNode->nodeValue != NULL) {
 			free(attrNode->nodeValue);
 		}
 		attrNode->nodeValue = strdup(value);
 		if (attrNode->nodeValue == NULL) {
-			free(attrNode->prefix);
 			Parser_freeNodeContent(&newAttrNode);
 			return IXML_INSUFFICIENT_MEMORY;
 		}
@@ -0,0 +1,92 @@
+/**************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * - Neither name of Intel Corporation nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+#ifndef IXML_INTERN_H
+#define IXML_INTERN_H
+
+/*!
+ * \file
+ *
+ * \brief Shared, reference counted storage of node names.
+ *
+ * The nodeName, prefix and localName of the nodes and the tagName of the
+ * elements are interned: all nodes with the same name point to the same
+ * string, so names are compared by pointer. The table is global and
+ * thread safe, names live as long as a node refers to them.
+ */
+
+#include "ixml.h"
+
+#include <stdlib.h> /* for size_t */
+
+/*!
+ * \brief Returns the interned copy of a string, with one more reference.
+ *
+ * \return The interned string, or NULL if \b str is NULL or on memory
+ * 	allocation failure.
+ */
+DOMString ixml_intern(
+	/*! [in] The string, may be NULL. */
+	const char *str);
+
+/*!
+ * \brief Returns the interned copy of the first \b len characters of a
+ * string, with one more reference.
+ *
+ * \return The interned string, or NULL on memory allocation failure.
+ */
+DOMString ixml_intern_len(
+	/*! [in] The characters. */
+	const char *str,
+	/*! [in] Their number. */
+	size_t len);
+
+/*!
+ * \brief Returns the interned copy of a string if there is one, with one more
+ * reference. Nothing is added to the table.
+ *
+ * A node name equal to \b str is equal to the returned pointer, when NULL is
+ * returned no node has this name.
+ *
+ * \return The interned string, or NULL.
+ */
+DOMString ixml_intern_find(
+	/*! [in] The string. */
+	const char *str);
+
+/*!
+ * \brief Drops a reference to an interned string.
+ */
+void ixml_intern_release(
+	/*! [in] The interned string, may be NULL. */
+	DOMString str);
+
+#endif /* IXML_INTERN_H */
@@ -0,0 +1,232 @@
+/**************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * - Neither name of Intel Corporation nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+/*!
+ * \file
+ */
+
+#include "ixmlintern.h"
+
+#include <stddef.h> /* for offsetof() */
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+	#include <windows.h>
+	#include <intrin.h>
+#else
+	#include <sched.h>
+#endif
+
+/*!
+ * \brief Number of hash chains of the table.
+ */
+#define IXML_INTERN_BUCKETS 1024u
+
+/*!
+ * \brief Number of locks of the table, each guards the chains of the same
+ * number modulo IXML_INTERN_LOCKS.
+ */
+#define IXML_INTERN_LOCKS 64u
+
+/*!
+ * \brief An interned string.
+ */
+typedef struct IXML_INTERNED
+{
+	/*! Next string of the hash chain. */
+	struct IXML_INTERNED *next;
+	/*! Hash of the string. */
+	unsigned int hash;
+	/*! Number of references. */
+	unsigned int refs;
+	/*! Length of the string. */
+	size_t len;
+	/*! The string, null terminated. */
+	char str[1];
+} ixml_interned;
+
+/*! The hash chains. */
+static ixml_interned *gInternBuckets[IXML_INTERN_BUCKETS];
+/*! The spin locks of the hash chains. */
+static volatile long gInternLocks[IXML_INTERN_LOCKS];
+
+/*!
+ * \brief Takes the spin lock of a hash chain.
+ *
+ * The locks are only held to walk a chain, so a waiting thread yields
+ * rather than sleeps.
+ */
+static void ixml_intern_lock(
+	/*! [in] The hash. */
+	unsigned int hash)
+{
+	volatile long *lock =
+		&gInternLocks[hash % IXML_INTERN_BUCKETS % IXML_INTERN_LOCKS];
+
+#ifdef _WIN32
+	while (_InterlockedExchange(lock, 1) != 0) {
+		while (*lock != 0) {
+			SwitchToThread();
+		}
+	}
+#else
+	while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE) != 0) {
+		while (__atomic_load_n(lock, __ATOMIC_RELAXED) != 0) {
+			sched_yield();
+		}
+	}
+#endif
+}
+
+/*!
+ * \brief Releases the spin lock of a hash chain.
+ */
+static void ixml_intern_unlock(
+	/*! [in] The hash. */
+	unsigned int hash)
+{
+	volatile long *lock =
+		&gInternLocks[hash % IXML_INTERN_BUCKETS % IXML_INTERN_LOCKS];
+
+#ifdef _WIN32
+	_InterlockedExchange(lock, 0);
+#else
+	__atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+#endif
+}
+
+/*!
+ * \brief FNV-1a hash of a string.
+ */
+static unsigned int ixml_intern_hash(
+	/*! [in] The characters. */
+	const char *str,
+	/*! [in] Their number. */
+	size_t len)
+{
+	unsigned int hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= (unsigned char)str[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/*!
+ * \brief Looks up a string and takes a reference, adds it if \b add is set.
+ *
+ * \return The interned string, or NULL.
+ */
+static DOMString ixml_intern_lookup(
+	/*! [in] The characters. */
+	const char *str,
+	/*! [in] Their number. */
+	size_t len,
+	/*! [in] 1 to add the string when it is not in the table. */
+	int add)
+{
+	unsigned int hash = ixml_intern_hash(str, len);
+	ixml_interned **bucket =
+		&gInternBuckets[hash % IXML_INTERN_BUCKETS];
+	ixml_interned *entry;
+
+	ixml_intern_lock(hash);
+	for (entry = *bucket; entry != NULL; entry = entry->next) {
+		if (entry->hash == hash && entry->len == len &&
+			memcmp(entry->str, str, len) == 0) {
+			entry->refs++;
+			break;
+		}
+	}
+	if (entry == NULL && add) {
+		entry = malloc(offsetof(ixml_interned, str) + len + (size_t)1);
+		if (entry != NULL) {
+			entry->hash = hash;
+			entry->refs = 1u;
+			entry->len = len;
+			memcpy(entry->str, str, len);
+			entry->str[len] = '\0';
+			entry->next = *bucket;
+			*bucket = entry;
+		}
+	}
+	ixml_intern_unlock(hash);
+
+	return entry != NULL ? entry->str : NULL;
+}
+
+DOMString ixml_intern(const char *str)
+{
+	if (str == NULL) {
+		return NULL;
+	}
+
+	return ixml_intern_lookup(str, strlen(str), 1);
+}
+
+DOMString ixml_intern_len(const char *str, size_t len)
+{
+	return ixml_intern_lookup(str, len, 1);
+}
+
+DOMString ixml_intern_find(const char *str)
+{
+	return ixml_intern_lookup(str, strlen(str), 0);
+}
+
+void ixml_intern_release(DOMString str)
+{
+	ixml_interned *entry;
+	ixml_interned **prev;
+	unsigned int hash;
+
+	if (str == NULL) {
+		return;
+	}
+	entry = (ixml_interned *)(str - offsetof(ixml_interned, str));
+	hash = entry->hash;
+	ixml_intern_lock(hash);
+	if (--entry->refs == 0u) {
+		prev = &gInternBuckets[hash % IXML_INTERN_BUCKETS];
+		while (*prev != entry) {
+			prev = &(*prev)->next;
+		}
+		*prev = entry->next;
+	} else {
+		entry = NULL;
+	}
+	ixml_intern_unlock(hash);
+	free(entry);
+}
@@ -39,6 +39,7 @@
 #include "ixmlparser.h"
 
 #include "ixmldebug.h"
+#include "ixmlintern.h"
 
 #include <assert.h>
 #include <limits.h>
@@ -47,6 +48,12 @@
 #include <stdlib.h> /* for free(), malloc() */
 #include <string.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || \
+	(defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define IXML_HAVE_SSE2 1
+#endif
+
 #include "posix_overwrites.h" // IWYU pragma: keep
 
 static char g_error_char = '\0';
@@ -443,6 +450,35 @@ static char_info_t NameChar[] = {
  */
 #define NAMECHARTABLESIZE (sizeof(NameChar) / sizeof(NameChar[0]))
 
+/*!
+ * \brief ASCII character in the Letter table, '_' or ':'.
+ */
+#define ASCII_NAMESTART 1
+/*!
+ * \brief ASCII character in the Letter or NameChar tables.
+ */
+#define ASCII_NAMECHAR 2
+/*!
+ * \brief ASCII XML character that is copied to a token as is, that is all
+ * but '&'.
+ */
+#define ASCII_TEXT 4
+
+/*!
+ * \brief Classes of the ASCII characters, so that the tokenizer only decodes
+ * and looks up the tables above for the other characters. Bytes above 0x7F
+ * have no class.
+ */
+static const unsigned char AsciiClass[256] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 4, 0, 0, 4, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	4, 4, 4, 4, 4, 4, 0, 4, 4, 4, 4, 4, 4, 6, 6, 4,
+	6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 7, 4, 4, 4, 4, 4,
+	4, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+	7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 4, 4, 4, 4, 7,
+	4, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+	7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 4, 4, 4, 4, 4};
+
 /*!
  * \brief Frees one ElementStack item.
  */
@@ -771,7 +807,11 @@ static void Parser_clearTokenBuf(
 	/*! [in] The XML parser. */
 	Parser *xmlParser)
 {
-	ixml_membuf_destroy(&(xmlParser->tokenBuf));
+	/* keep the allocation for the next token */
+	xmlParser->tokenBuf.length = (size_t)0;
+	if (xmlParser->tokenBuf.buf != NULL) {
+		xmlParser->tokenBuf.buf[0] = '\0';
+	}
 }
 
 /*!
@@ -886,6 +926,12 @@ static int Parser_isNameChar(
 	/*! [in] 1 if you also want to check in the NameChar table. */
 	int bNameChar)
 {
+	if (c >= 0 && c < 0x80) {
+		return (AsciiClass[c] &
+			       (bNameChar ? ASCII_NAMECHAR : ASCII_NAMESTART)) !=
+		       0;
+	}
+
 	if (Parser_isCharInTable(c, Letter, (int)LETTERTABLESIZE)) {
 		return 1;
 	}
@@ -1146,6 +1192,50 @@ static int Parser_appendTokBufStr(
 	return rc;
 }
 
+/*!
+ * \brief Returns the length of the run of ASCII characters at src that are
+ * copied to a token as is.
+ */
+static ptrdiff_t Parser_plainRun(
+	/*! [in] The string to scan. */
+	const char *src,
+	/*! [in] The end of the string. */
+	const char *end)
+{
+	const char *p = src;
+	const char *stop;
+#ifdef IXML_HAVE_SSE2
+	const __m128i space = _mm_set1_epi8(0x20);
+	const __m128i amp = _mm_set1_epi8('&');
+	__m128i v;
+#endif
+
+	while (p < end) {
+#ifdef IXML_HAVE_SSE2
+		/* 16 bytes at a time while none is a control character, a
+		 * non-ASCII byte (negative as signed) or '&' */
+		while (end - p >= 16) {
+			v = _mm_loadu_si128((const __m128i *)p);
+			if (_mm_movemask_epi8(_mm_or_si128(_mm_cmplt_epi8(v, space),
+				    _mm_cmpeq_epi8(v, amp))) != 0) {
+				break;
+			}
+			p += 16;
+		}
+#endif
+		/* tab, new line and carriage return are plain too */
+		stop = end - p > 16 ? p + 16 : end;
+		while (p < stop && (AsciiClass[(unsigned char)*p] & ASCII_TEXT)) {
+			p++;
+		}
+		if (p < stop) {
+			break;
+		}
+	}
+
+	return p - src;
+}
+
 /*!
  * \brief Copy string in src into xml parser token buffer
  */
@@ -1176,6 +1266,21 @@ static int Parser_copyToken(
 	pend = src + len;
 
 	while (psrc < pend) {
+		/* plain ASCII is copied in bulk, the rest one character at a
+		 * time */
+		cl = Parser_plainRun(psrc, pend);
+		if (cl > 0) {
+			if (ixml_membuf_insert(&(xmlParser->tokenBuf),
+				    psrc,
+				    (size_t)cl,
+				    xmlParser->tokenBuf.length) != IXML_SUCCESS) {
+				line = __LINE__;
+				ret = IXML_INSUFFICIENT_MEMORY;
+				goto ExitFunction;
+			}
+			psrc += cl;
+			continue;
+		}
 		c = Parser_getChar(psrc, &cl);
 		if (c <= 0) {
 			line = __LINE__;
@@ -1272,11 +1377,22 @@ static ptrdiff_t Parser_getNextToken(
 		/* Check for name tokens, name found, so find out how long it is
 		 */
 		ptrdiff_t iIndex = tlen;
-
-		while (Parser_isNameChar(
-			Parser_UTF8ToInt(xmlParser->curPtr + iIndex, &tlen),
-			1)) {
-			iIndex += tlen;
+		unsigned char uc;
+
+		for (;;) {
+			uc = (unsigned char)xmlParser->curPtr[iIndex];
+			if (AsciiClass[uc] & ASCII_NAMECHAR) {
+				iIndex++;
+			} else if (uc >= 0x80 &&
+				   Parser_isNameChar(
+					   Parser_UTF8ToInt(
+						   xmlParser->curPtr + iIndex,
+						   &tlen),
+					   1)) {
+				iIndex += tlen;
+			} else {
+				break;
+			}
 		}
 		tokenLength = iIndex;
 	} else {
@@ -1328,7 +1444,7 @@ static int Parser_processSTag(
 
 	pCurToken = (xmlParser->tokenBuf).buf;
 	if (pCurToken != NULL) {
-		node->nodeName = safe_strdup(pCurToken);
+		node->nodeName = ixml_intern(pCurToken);
 		if (node->nodeName == NULL) {
 			return IXML_INSUFFICIENT_MEMORY;
 		}
@@ -1449,7 +1565,7 @@ static int Parser_processCDSect(
 		strncpy(node->nodeValue, pCDataStart, tokenLength);
 		node->nodeValue[tokenLength] = '\0';
 
-		node->nodeName = safe_strdup(CDATANODENAME);
+		node->nodeName = ixml_intern(CDATANODENAME);
 		if (node->nodeName == NULL) {
 			/* no need to free node->nodeValue at all, bacause node
 			 * contents will be freed by the main loop. */
@@ -1530,11 +1646,15 @@ static int Parser_processContent(
 		xmlParser->curPtr = xmlParser->savePtr;
 		pEndContent = xmlParser->curPtr;
 
-		while ((*pEndContent != LESSTHAN) &&
-			(strncmp(pEndContent,
-				 (const char *)notAllowed,
-				 strlen(notAllowed)) != 0) &&
-			*pEndContent) {
+		/* only a ']' can start the "]]>" that is not allowed */
+		for (;;) {
+			pEndContent += strcspn(pEndContent, "<]");
+			if (*pEndContent != ']' ||
+				strncmp(pEndContent,
+					(const char *)notAllowed,
+					strlen(notAllowed)) == 0) {
+				break;
+			}
 			pEndContent++;
 		}
 
@@ -1571,7 +1691,7 @@ static int Parser_processContent(
 			goto ExitFunction;
 		}
 
-		node->nodeName = safe_strdup(TEXTNODENAME);
+		node->nodeName = ixml_intern(TEXTNODENAME);
 		if (node->nodeName == NULL) {
 			line = __LINE__;
 			ret = IXML_SYNTAX_ERR;
@@ -1623,7 +1743,7 @@ static int Parser_processETag(
 		ret = IXML_SYNTAX_ERR;
 		goto ExitFunction;
 	}
-	node->nodeName = safe_strdup(pCurToken);
+	node->nodeName = ixml_intern(pCurToken);
 	if (node->nodeName == NULL) {
 		line = __LINE__;
 		ret = IXML_INSUFFICIENT_MEMORY;
@@ -1927,7 +2047,7 @@ static int Parser_processAttribute(
 		goto ExitFunction;
 	}
 	/* copy in the attribute name */
-	node->nodeName = safe_strdup(pCurToken);
+	node->nodeName = ixml_intern(pCurToken);
 	if (node->nodeName == NULL) {
 		ret = IXML_INSUFFICIENT_MEMORY;
 		line = __LINE__;
@@ -1968,16 +2088,10 @@ static int Parser_processAttribute(
 	/* check between curPtr and strEndQuote,
 	 * whether there are illegal chars. */
 	pCur = xmlParser->curPtr;
-	while (pCur < strEndQuote) {
-		if (*pCur == '<') {
-			ret = IXML_SYNTAX_ERR;
-			line = __LINE__;
-			goto ExitFunction;
-		}
-		/*if (*pCur == '&') {
-			Parser_parseReference(++pCur);
-		}*/
-		pCur++;
+	if (memchr(pCur, '<', (size_t)(strEndQuote - pCur)) != NULL) {
+		ret = IXML_SYNTAX_ERR;
+		line = __LINE__;
+		goto ExitFunction;
 	}
 	/* clear token buffer */
 	Parser_clearTokenBuf(xmlParser);
@@ -2118,7 +2232,7 @@ static int Parser_getNextNode(
 				goto ExitFunction;
 			}
 
-			node->nodeName = safe_strdup(lastElement);
+			node->nodeName = ixml_intern(lastElement);
 			if (node->nodeName == NULL) {
 				line = __LINE__;
 				ret = IXML_INSUFFICIENT_MEMORY;
@@ -2561,44 +2675,32 @@ static int Parser_eTagVerification(
 }
 
 /*!
- * \brief Parses the xml file and returns the DOM document tree.
+ * \brief Parses nodes until the end of the document or until \b end is
+ * reached, and adds them to the document tree.
  *
- * \return
+ * The nodes that are still open are kept in the parser, so that a later call
+ * can go on with the same document.
+ *
+ * \return IXML_SUCCESS or an error code.
  */
-static int Parser_parseDocument(
-	/*! [out] The XML document. */
-	IXML_Document **retDoc,
+static int Parser_parseNodes(
+	/*! [in] The XML document being built. */
+	IXML_Document *gRootDoc,
 	/*! [in] The XML parser. */
-	Parser *xmlParser)
+	Parser *xmlParser,
+	/*! [in] Where to stop, or \b NULL to parse up to the end of the
+	 * buffer. Must be at a markup boundary. */
+	const char *end)
 {
-	IXML_Document *gRootDoc = NULL;
 	IXML_Node newNode;
 	int bETag = 0;
 	IXML_Node *tempNode = NULL;
 	int rc = IXML_SUCCESS;
 	IXML_CDATASection *cdataSecNode = NULL;
 
-	/* It is important that the node gets initialized here, otherwise things
-	 * can go wrong on the error handler. */
-	ixmlNode_init(&newNode);
-
-	rc = ixmlDocument_createDocumentEx(&gRootDoc);
-	if (rc != IXML_SUCCESS) {
-		goto ErrorHandler;
-	}
-
-	xmlParser->currentNodePtr = (IXML_Node *)gRootDoc;
-
-	rc = Parser_skipProlog(xmlParser);
-	if (rc != IXML_SUCCESS) {
-		goto ErrorHandler;
-	}
-
-	while (bETag == 0) {
-		/* clear the newNode contents. Redundant on the first iteration,
-		 * but nonetheless, necessary due to the possible calls to
-		 * ErrorHandler above. Currently, this is just a memset to zero.
-		 */
+	while (bETag == 0 && (end == NULL || xmlParser->curPtr < end)) {
+		/* clear the newNode contents. Currently, this is just a memset
+		 * to zero. */
 		ixmlNode_init(&newNode);
 
 		if (Parser_getNextNode(xmlParser, &newNode, &bETag) ==
@@ -2684,6 +2786,44 @@ static int Parser_parseDocument(
 		Parser_freeNodeContent(&newNode);
 	}
 
+	return IXML_SUCCESS;
+
+ErrorHandler:
+	Parser_freeNodeContent(&newNode);
+	return rc;
+}
+
+/*!
+ * \brief Parses the xml file and returns the DOM document tree.
+ *
+ * \return
+ */
+static int Parser_parseDocument(
+	/*! [out] The XML document. */
+	IXML_Document **retDoc,
+	/*! [in] The XML parser. */
+	Parser *xmlParser)
+{
+	IXML_Document *gRootDoc = NULL;
+	int rc = IXML_SUCCESS;
+
+	rc = ixmlDocument_createDocumentEx(&gRootDoc);
+	if (rc != IXML_SUCCESS) {
+		goto ErrorHandler;
+	}
+
+	xmlParser->currentNodePtr = (IXML_Node *)gRootDoc;
+
+	rc = Parser_skipProlog(xmlParser);
+	if (rc != IXML_SUCCESS) {
+		goto ErrorHandler;
+	}
+
+	rc = Parser_parseNodes(gRootDoc, xmlParser, NULL);
+	if (rc != IXML_SUCCESS) {
+		goto ErrorHandler;
+	}
+
 	if (xmlParser->pCurElement != NULL) {
 		rc = IXML_SYNTAX_ERR;
 		goto ErrorHandler;
@@ -2694,7 +2834,6 @@ static int Parser_parseDocument(
 	return rc;
 
 ErrorHandler:
-	Parser_freeNodeContent(&newNode);
 	ixmlDocument_free(gRootDoc);
 	Parser_free(xmlParser);
 	return rc;
@@ -2848,15 +2987,435 @@ int Parser_LoadDocument(
 	return rc;
 }
 
+/*!
+ * \brief States of the markup scanner of the push parser.
+ */
+typedef enum
+{
+	/*! Character data. */
+	eSCAN_TEXT,
+	/*! After a '<'. */
+	eSCAN_LT,
+	/*! After "<!". */
+	eSCAN_BANG,
+	/*! In "<![CDATA[". */
+	eSCAN_CDSTART,
+	/*! In a start or end tag. */
+	eSCAN_TAG,
+	/*! In a comment. */
+	eSCAN_COMMENT,
+	/*! In a CDATA section. */
+	eSCAN_CDATA,
+	/*! In a processing instruction. */
+	eSCAN_PI,
+	/*! In a declaration, such as the doctype. */
+	eSCAN_DECL
+} PUSH_SCAN_STATE;
+
+/*! Value of rootStart while no start tag has been seen. */
+#define PUSH_NO_ROOT ((size_t)-1)
+/*! Initial size of the buffer of a push parser. */
+#define PUSH_BUFFER_SIZE ((size_t)1024)
+
+/*!
+ * \brief State of an incremental parse.
+ *
+ * The data buffer of the parser holds the text that is not parsed yet. The
+ * text is scanned for markup as it comes, the parser only goes up to the end
+ * of the last complete markup, where no node is cut.
+ */
+struct _IXML_PushParser
+{
+	/*! The parser. */
+	Parser *parser;
+	/*! The document being built. */
+	IXML_Document *doc;
+	/*! Number of bytes in the data buffer. */
+	size_t length;
+	/*! Size of the data buffer. */
+	size_t size;
+	/*! Offset of the first byte not scanned yet. */
+	size_t scanned;
+	/*! Offset just after the last complete markup. */
+	size_t safeEnd;
+	/*! Offset of the first start tag, or PUSH_NO_ROOT. */
+	size_t rootStart;
+	/*! State of the scanner. */
+	PUSH_SCAN_STATE scan;
+	/*! Characters of the closing sequence seen by the scanner. */
+	int scanCount;
+	/*! Quote that closes the current value, or 0. */
+	char scanQuote;
+	/*! Nesting depth in a declaration. */
+	int scanDepth;
+	/*! 1 if the markup being scanned is inside a tag. */
+	int scanInTag;
+	/*! 1 once the prolog is skipped. */
+	int prologDone;
+	/*! 1 once a null byte ended the text. */
+	int ended;
+	/*! First error, returned by every following call. */
+	int error;
+};
+
+/*!
+ * \brief Ends the markup that was just scanned.
+ */
+static void Parser_pushEndMarkup(
+	/*! [in] The push parser. */
+	IXML_PushParser *pushParser,
+	/*! [in] Offset of the closing '>'. */
+	size_t i)
+{
+	if (pushParser->scanInTag) {
+		/* a comment or a processing instruction in a tag */
+		pushParser->scan = eSCAN_TAG;
+	} else {
+		pushParser->scan = eSCAN_TEXT;
+		pushParser->safeEnd = i + (size_t)1;
+	}
+}
+
+/*!
+ * \brief Scans the new text for the end of the markup, following the
+ * rules of the parser.
+ */
+static void Parser_pushScan(
+	/*! [in] The push parser. */
+	IXML_PushParser *pushParser)
+{
+	static const char cdStart[] = "[CDATA[";
+	const char *buf = pushParser->parser->dataBuffer;
+	const char *lt;
+	size_t i = pushParser->scanned;
+	char c;
+
+	while (i < pushParser->length) {
+		c = buf[i];
+		switch (pushParser->scan) {
+		case eSCAN_TEXT:
+			lt = memchr(buf + i, '<', pushParser->length - i);
+			if (lt == NULL) {
+				i = pushParser->length;
+				continue;
+			}
+			i = (size_t)(lt - buf);
+			pushParser->scan = eSCAN_LT;
+			pushParser->scanInTag = 0;
+			break;
+		case eSCAN_LT:
+			if (c == '!') {
+				pushParser->scan = eSCAN_BANG;
+				pushParser->scanCount = 0;
+				break;
+			} else if (c == '?') {
+				pushParser->scan = eSCAN_PI;
+				pushParser->scanCount = 1;
+				break;
+			}
+			if (!pushParser->scanInTag && c != '/' &&
+				pushParser->rootStart == PUSH_NO_ROOT) {
+				pushParser->rootStart = i - (size_t)1;
+			}
+			pushParser->scan = eSCAN_TAG;
+			pushParser->scanQuote = 0;
+			/* scan c again as part of the tag */
+			continue;
+		case eSCAN_BANG:
+			if (c == '-') {
+				if (++pushParser->scanCount == 2) {
+					pushParser->scan = eSCAN_COMMENT;
+				}
+				break;
+			} else if (c == '[' && pushParser->scanCount == 0) {
+				pushParser->scan = eSCAN_CDSTART;
+				pushParser->scanCount = 1;
+				break;
+			}
+			pushParser->scan = eSCAN_DECL;
+			pushParser->scanQuote = 0;
+			pushParser->scanDepth = 1;
+			continue;
+		case eSCAN_CDSTART:
+			if (c == cdStart[pushParser->scanCount]) {
+				if (++pushParser->scanCount ==
+					(int)sizeof cdStart - 1) {
+					pushParser->scan = eSCAN_CDATA;
+					pushParser->scanCount = 0;
+				}
+				break;
+			}
+			pushParser->scan = eSCAN_DECL;
+			pushParser->scanQuote = 0;
+			pushParser->scanDepth = 1;
+			continue;
+		case eSCAN_COMMENT:
+			if (c == '-') {
+				++pushParser->scanCount;
+			} else if (c == '>' && pushParser->scanCount >= 2) {
+				Parser_pushEndMarkup(pushParser, i);
+			} else {
+				pushParser->scanCount = 0;
+			}
+			break;
+		case eSCAN_CDATA:
+			if (c == ']') {
+				++pushParser->scanCount;
+			} else if (c == '>' && pushParser->scanCount >= 2) {
+				Parser_pushEndMarkup(pushParser, i);
+			} else {
+				pushParser->scanCount = 0;
+			}
+			break;
+		case eSCAN_PI:
+			if (c == '>' && pushParser->scanCount) {
+				Parser_pushEndMarkup(pushParser, i);
+			} else {
+				pushParser->scanCount = c == '?';
+			}
+			break;
+		case eSCAN_TAG:
+			if (pushParser->scanQuote) {
+				if (c == pushParser->scanQuote) {
+					pushParser->scanQuote = 0;
+				}
+			} else if (c == '"' || c == '\'') {
+				pushParser->scanQuote = c;
+			} else if (c == '>') {
+				pushParser->scanInTag = 0;
+				Parser_pushEndMarkup(pushParser, i);
+			} else if (c == '<') {
+				pushParser->scan = eSCAN_LT;
+				pushParser->scanInTag = 1;
+			}
+			break;
+		case eSCAN_DECL:
+			/* same rules as Parser_skipDocType() */
+			if (pushParser->scanQuote) {
+				if (c == '"') {
+					pushParser->scanQuote = 0;
+				}
+			} else if (c == '"') {
+				pushParser->scanQuote = c;
+			} else if (c == '<') {
+				++pushParser->scanDepth;
+			} else if (c == '>' && --pushParser->scanDepth == 0) {
+				Parser_pushEndMarkup(pushParser, i);
+			}
+			break;
+		}
+		++i;
+	}
+	pushParser->scanned = i;
+}
+
+/*!
+ * \brief Parses the nodes that are complete, or all the nodes if
+ * \b final is set, then drops the parsed text from the buffer.
+ *
+ * \return IXML_SUCCESS or an error code.
+ */
+static int Parser_pushParse(
+	/*! [in] The push parser. */
+	IXML_PushParser *pushParser,
+	/*! [in] 1 if there is no more text. */
+	int final)
+{
+	Parser *xmlParser = pushParser->parser;
+	char *end = NULL;
+	char saved = '\0';
+	size_t done;
+	int rc = IXML_SUCCESS;
+
+	if (!final) {
+		if (pushParser->safeEnd == (size_t)0) {
+			return IXML_SUCCESS;
+		}
+		/* the prolog is only skipped once the root tag is complete */
+		if (!pushParser->prologDone &&
+			(pushParser->rootStart == PUSH_NO_ROOT ||
+				pushParser->safeEnd <= pushParser->rootStart)) {
+			return IXML_SUCCESS;
+		}
+		end = xmlParser->dataBuffer + pushParser->safeEnd;
+		saved = *end;
+		*end = '\0';
+	}
+	if (!pushParser->prologDone) {
+		pushParser->prologDone = 1;
+		rc = Parser_skipProlog(xmlParser);
+	}
+	if (rc == IXML_SUCCESS) {
+		rc = Parser_parseNodes(pushParser->doc, xmlParser, end);
+	}
+	if (!final) {
+		*end = saved;
+	}
+	if (rc != IXML_SUCCESS) {
+		return rc;
+	}
+
+	done = (size_t)(xmlParser->curPtr - xmlParser->dataBuffer);
+	if (done > (size_t)0) {
+		pushParser->length -= done;
+		memmove(xmlParser->dataBuffer,
+			xmlParser->curPtr,
+			pushParser->length + (size_t)1);
+		xmlParser->curPtr = xmlParser->dataBuffer;
+		pushParser->scanned -= done;
+		pushParser->safeEnd -= done;
+	}
+
+	return IXML_SUCCESS;
+}
+
+int ixmlPushParser_create(IXML_PushParser **parser)
+{
+	IXML_PushParser *pushParser = NULL;
+	int rc = IXML_SUCCESS;
+
+	if (parser == NULL) {
+		return IXML_INVALID_PARAMETER;
+	}
+	*parser = NULL;
+
+	pushParser = (IXML_PushParser *)malloc(sizeof(IXML_PushParser));
+	if (pushParser == NULL) {
+		return IXML_INSUFFICIENT_MEMORY;
+	}
+	memset(pushParser, 0, sizeof(IXML_PushParser));
+	pushParser->rootStart = PUSH_NO_ROOT;
+	pushParser->scan = eSCAN_TEXT;
+
+	pushParser->parser = Parser_init();
+	if (pushParser->parser == NULL) {
+		rc = IXML_INSUFFICIENT_MEMORY;
+		goto ErrorHandler;
+	}
+	pushParser->parser->dataBuffer = (char *)malloc(PUSH_BUFFER_SIZE);
+	if (pushParser->parser->dataBuffer == NULL) {
+		rc = IXML_INSUFFICIENT_MEMORY;
+		goto ErrorHandler;
+	}
+	pushParser->parser->dataBuffer[0] = '\0';
+	pushParser->parser->curPtr = pushParser->parser->dataBuffer;
+	pushParser->size = PUSH_BUFFER_SIZE;
+
+	rc = ixmlDocument_createDocumentEx(&pushParser->doc);
+	if (rc != IXML_SUCCESS) {
+		goto ErrorHandler;
+	}
+	pushParser->parser->currentNodePtr = (IXML_Node *)pushParser->doc;
+
+	*parser = pushParser;
+	return IXML_SUCCESS;
+
+ErrorHandler:
+	ixmlPushParser_free(pushParser);
+	return rc;
+}
+
+int ixmlPushParser_feed(
+	IXML_PushParser *parser, const char *buffer, size_t length)
+{
+	Parser *xmlParser = NULL;
+	const char *nul = NULL;
+	char *newBuffer = NULL;
+	size_t newSize;
+
+	if (parser == NULL || (buffer == NULL && length > (size_t)0)) {
+		return IXML_INVALID_PARAMETER;
+	}
+	if (parser->error != IXML_SUCCESS || parser->ended ||
+		length == (size_t)0) {
+		return parser->error;
+	}
+	xmlParser = parser->parser;
+
+	/* the text ends at a null byte, as with ixmlParseBufferEx() */
+	nul = memchr(buffer, '\0', length);
+	if (nul != NULL) {
+		length = (size_t)(nul - buffer);
+		parser->ended = 1;
+	}
+
+	if (parser->length + length >= parser->size) {
+		newSize = parser->size * (size_t)2;
+		while (parser->length + length >= newSize) {
+			newSize *= (size_t)2;
+		}
+		/* curPtr is at the start of the buffer, see
+		 * Parser_pushParse() */
+		newBuffer = (char *)realloc(xmlParser->dataBuffer, newSize);
+		if (newBuffer == NULL) {
+			parser->error = IXML_INSUFFICIENT_MEMORY;
+			return parser->error;
+		}
+		xmlParser->dataBuffer = newBuffer;
+		xmlParser->curPtr = newBuffer;
+		parser->size = newSize;
+	}
+	memcpy(xmlParser->dataBuffer + parser->length, buffer, length);
+	parser->length += length;
+	xmlParser->dataBuffer[parser->length] = '\0';
+
+	Parser_pushScan(parser);
+	parser->error = Parser_pushParse(parser, 0);
+
+	return parser->error;
+}
+
+int ixmlPushParser_finish(IXML_PushParser *parser, IXML_Document **doc)
+{
+	int rc = IXML_SUCCESS;
+
+	if (parser == NULL || doc == NULL) {
+		return IXML_INVALID_PARAMETER;
+	}
+	*doc = NULL;
+	if (parser->error != IXML_SUCCESS) {
+		return parser->error;
+	}
+	if (parser->doc == NULL) {
+		/* already finished */
+		return IXML_INVALID_PARAMETER;
+	}
+	if (!parser->prologDone && parser->length == (size_t)0) {
+		/* no text, as ixmlParseBufferEx() with an empty buffer */
+		return IXML_INVALID_PARAMETER;
+	}
+
+	rc = Parser_pushParse(parser, 1);
+	if (rc == IXML_SUCCESS && parser->parser->pCurElement != NULL) {
+		rc = IXML_SYNTAX_ERR;
+	}
+	if (rc != IXML_SUCCESS) {
+		parser->error = rc;
+		return rc;
+	}
+	*doc = parser->doc;
+	parser->doc = NULL;
+
+	return IXML_SUCCESS;
+}
+
+void ixmlPushParser_free(IXML_PushParser *parser)
+{
+	if (parser == NULL) {
+		return;
+	}
+	Parser_free(parser->parser);
+	ixmlDocument_free(parser->doc);
+	free(parser);
+}
+
 void Parser_freeNodeContent(IXML_Node *nodeptr)
 {
 	if (nodeptr == NULL) {
 		return;
 	}
 
-	if (nodeptr->nodeName != NULL) {
-		free(nodeptr->nodeName);
-	}
+	ixml_intern_release(nodeptr->nodeName);
 
 	if (nodeptr->nodeValue != NULL) {
 		free(nodeptr->nodeValue);
@@ -2866,13 +3425,8 @@ void Parser_freeNodeContent(IXML_Node *nodeptr)
 		free(nodeptr->namespaceURI);
 	}
 
-	if (nodeptr->prefix != NULL) {
-		free(nodeptr->prefix);
-	}
-
-	if (nodeptr->localName != NULL) {
-		free(nodeptr->localName);
-	}
+	ixml_intern_release(nodeptr->prefix);
+	ixml_intern_release(nodeptr->localName);
 }
 
 /*!
@@ -2892,10 +3446,15 @@ int Parser_setNodePrefixAndLocalName(
 		return IXML_FAILED;
 	}
 
+	/* the node may be renamed, drop the parts of its previous name */
+	ixml_intern_release(node->prefix);
+	node->prefix = NULL;
+	ixml_intern_release(node->localName);
+	node->localName = NULL;
+
 	pStrPrefix = strchr(node->nodeName, ':');
 	if (pStrPrefix == NULL) {
-		node->prefix = NULL;
-		node->localName = safe_strdup(node->nodeName);
+		node->localName = ixml_intern(node->nodeName);
 		if (node->localName == NULL) {
 			return IXML_INSUFFICIENT_MEMORY;
 		}
@@ -2904,17 +3463,14 @@ int Parser_setNodePrefixAndLocalName(
 		/* fill in the local name and prefix */
 		pLocalName = (char *)pStrPrefix + 1;
 		nPrefix = pStrPrefix - node->nodeName;
-		node->prefix = malloc((size_t)nPrefix + (size_t)1);
+		node->prefix = ixml_intern_len(node->nodeName, (size_t)nPrefix);
 		if (!node->prefix) {
 			return IXML_INSUFFICIENT_MEMORY;
 		}
 
-		memset(node->prefix, 0, (size_t)nPrefix + (size_t)1);
-		strncpy(node->prefix, node->nodeName, (size_t)nPrefix);
-
-		node->localName = safe_strdup(pLocalName);
+		node->localName = ixml_intern(pLocalName);
 		if (node->localName == NULL) {
-			free(node->prefix);
+			ixml_intern_release(node->prefix);
 			/* no need to free really, main loop will frees it
 			 * when return code is not success */
 			node->prefix = NULL;
@@ -34,6 +34,7 @@
  * \file
  */
 
+#include "ixmlintern.h"
 #include "ixmlparser.h"
 
 #include <assert.h>
@@ -71,25 +72,19 @@ static void ixmlNode_freeSingleNode(
 	IXML_Element *element = NULL;
 
 	if (nodeptr != NULL) {
-		if (nodeptr->nodeName != NULL) {
-			free(nodeptr->nodeName);
-		}
+		ixml_intern_release(nodeptr->nodeName);
 		if (nodeptr->nodeValue != NULL) {
 			free(nodeptr->nodeValue);
 		}
 		if (nodeptr->namespaceURI != NULL) {
 			free(nodeptr->namespaceURI);
 		}
-		if (nodeptr->prefix != NULL) {
-			free(nodeptr->prefix);
-		}
-		if (nodeptr->localName != NULL) {
-			free(nodeptr->localName);
-		}
+		ixml_intern_release(nodeptr->prefix);
+		ixml_intern_release(nodeptr->localName);
 		switch (nodeptr->nodeType) {
 		case eELEMENT_NODE:
 			element = (IXML_Element *)nodeptr;
-			free(element->tagName);
+			ixml_intern_release(element->tagName);
 			break;
 		default:
 			break;
@@ -237,21 +232,22 @@ static int ixmlNode_setPrefix(
 	/*! [in] The prefix string to set. */
 	const char *prefix)
 {
+	DOMString newPrefix = NULL;
+
 	if (nodeptr == NULL) {
 		return IXML_INVALID_PARAMETER;
 	}
 
-	if (nodeptr->prefix != NULL) {
-		free(nodeptr->prefix);
-		nodeptr->prefix = NULL;
-	}
-
 	if (prefix != NULL) {
-		nodeptr->prefix = strdup(prefix);
-		if (nodeptr->prefix == NULL) {
+		newPrefix = ixml_intern(prefix);
+		if (newPrefix == NULL) {
+			ixml_intern_release(nodeptr->prefix);
+			nodeptr->prefix = NULL;
 			return IXML_INSUFFICIENT_MEMORY;
 		}
 	}
+	ixml_intern_release(nodeptr->prefix);
+	nodeptr->prefix = newPrefix;
 
 	return IXML_SUCCESS;
 }
@@ -267,19 +263,20 @@ static int ixmlNode_setLocalName(
 	/*! [in] The local name to set. */
 	const char *localName)
 {
-	assert(nodeptr != NULL);
+	DOMString newLocalName = NULL;
 
-	if (nodeptr->localName != NULL) {
-		free(nodeptr->localName);
-		nodeptr->localName = NULL;
-	}
+	assert(nodeptr != NULL);
 
 	if (localName != NULL) {
-		nodeptr->localName = strdup(localName);
-		if (nodeptr->localName == NULL) {
+		newLocalName = ixml_intern(localName);
+		if (newLocalName == NULL) {
+			ixml_intern_release(nodeptr->localName);
+			nodeptr->localName = NULL;
 			return IXML_INSUFFICIENT_MEMORY;
 		}
 	}
+	ixml_intern_release(nodeptr->localName);
+	nodeptr->localName = newLocalName;
 
 	return IXML_SUCCESS;
 }
@@ -1243,24 +1240,21 @@ int ixmlNode_hasAttributes(IXML_Node *nodeptr)
 /*!
  * \brief Recursively traverse the whole tree, search for element with the
  * given tagname.
+ *
+ * Node names are interned, so the names are compared by address.
  */
 static void ixmlNode_getElementsByTagNameRecursive(
 	/*! [in] The \b Node tree. */
 	IXML_Node *n,
-	/*! [in] The tag name to match. */
+	/*! [in] The interned tag name to match, NULL to match all elements. */
 	const char *tagname,
 	/*! [out] The output \b NodeList. */
 	IXML_NodeList **list)
 {
-	const char *name;
-
 	if (n != NULL) {
-		if (ixmlNode_getNodeType(n) == eELEMENT_NODE) {
-			name = ixmlNode_getNodeName(n);
-			if (strcmp(tagname, name) == 0 ||
-				strcmp(tagname, "*") == 0) {
-				ixmlNodeList_addToNodeList(list, n);
-			}
+		if (ixmlNode_getNodeType(n) == eELEMENT_NODE &&
+			(tagname == NULL || n->nodeName == tagname)) {
+			ixmlNodeList_addToNodeList(list, n);
 		}
 		ixmlNode_getElementsByTagNameRecursive(
 			ixmlNode_getFirstChild(n), tagname, list);
@@ -1272,18 +1266,24 @@ static void ixmlNode_getElementsByTagNameRecursive(
 void ixmlNode_getElementsByTagName(
 	IXML_Node *n, const char *tagname, IXML_NodeList **list)
 {
-	const char *name;
+	DOMString name = NULL;
 
 	assert(n != NULL && tagname != NULL);
 
-	if (ixmlNode_getNodeType(n) == eELEMENT_NODE) {
-		name = ixmlNode_getNodeName(n);
-		if (strcmp(tagname, name) == 0 || strcmp(tagname, "*") == 0) {
-			ixmlNodeList_addToNodeList(list, n);
+	if (strcmp(tagname, "*") != 0) {
+		/* no node can have a name that is not interned */
+		name = ixml_intern_find(tagname);
+		if (name == NULL) {
+			return;
 		}
 	}
+	if (ixmlNode_getNodeType(n) == eELEMENT_NODE &&
+		(name == NULL || n->nodeName == name)) {
+		ixmlNodeList_addToNodeList(list, n);
+	}
 	ixmlNode_getElementsByTagNameRecursive(
-		ixmlNode_getFirstChild(n), tagname, list);
+		ixmlNode_getFirstChild(n), name, list);
+	ixml_intern_release(name);
 }
 
 /*!
@@ -1294,7 +1294,7 @@ static void ixmlNode_getElementsByTagNameNSRecursive(
 	IXML_Node *n,
 	/*! [in] . */
 	const char *namespaceURI,
-	/*! [in] . */
+	/*! [in] The interned local name, NULL to match all local names. */
 	const char *localName,
 	/*! [out] . */
 	IXML_NodeList **list)
@@ -1310,8 +1310,7 @@ static void ixmlNode_getElementsByTagNameNSRecursive(
 			if (name != NULL && nsURI != NULL &&
 				(strcmp(namespaceURI, nsURI) == 0 ||
 					strcmp(namespaceURI, "*") == 0) &&
-				(strcmp(name, localName) == 0 ||
-					strcmp(localName, "*") == 0)) {
+				(localName == NULL || name == localName)) {
 				ixmlNodeList_addToNodeList(list, n);
 			}
 		}
@@ -1335,46 +1334,55 @@ void ixmlNode_getElementsByTagNameNS(IXML_Node *n,
 {
 	const DOMString nsURI;
 	const DOMString name;
+	DOMString local = NULL;
 
 	assert(n != NULL && namespaceURI != NULL && localName != NULL);
 
+	if (strcmp(localName, "*") != 0) {
+		/* no node can have a name that is not interned */
+		local = ixml_intern_find(localName);
+		if (local == NULL) {
+			return;
+		}
+	}
 	if (ixmlNode_getNodeType(n) == eELEMENT_NODE) {
 		name = ixmlNode_getLocalName(n);
 		nsURI = ixmlNode_getNamespaceURI(n);
 		if (name != NULL && nsURI != NULL &&
 			(strcmp(namespaceURI, nsURI) == 0 ||
 				strcmp(namespaceURI, "*") == 0) &&
-			(strcmp(name, localName) == 0 ||
-				strcmp(localName, "*") == 0)) {
+			(local == NULL || name == local)) {
 			ixmlNodeList_addToNodeList(list, n);
 		}
 	}
 
 	ixmlNode_getElementsByTagNameNSRecursive(
-		ixmlNode_getFirstChild(n), namespaceURI, localName, list);
+		ixmlNode_getFirstChild(n), namespaceURI, local, list);
+	ixml_intern_release(local);
 }
 
 int ixmlNode_setNodeName(IXML_Node *node, const DOMString qualifiedName)
 {
 	int rc = IXML_SUCCESS;
+	DOMString newName = NULL;
 
 	assert(node != NULL);
 
-	if (node->nodeName != NULL) {
-		free(node->nodeName);
-		node->nodeName = NULL;
-	}
-
 	if (qualifiedName != NULL) {
-		/* set the name part */
-		node->nodeName = strdup(qualifiedName);
-		if (node->nodeName == NULL) {
+		newName = ixml_intern(qualifiedName);
+		if (newName == NULL) {
 			return IXML_INSUFFICIENT_MEMORY;
 		}
+	}
+	ixml_intern_release(node->nodeName);
+	node->nodeName = newName;
 
+	if (newName != NULL) {
+		/* set the name part */
 		rc = Parser_setNodePrefixAndLocalName(node);
 		if (rc != IXML_SUCCESS) {
-			free(node->nodeName);
+			ixml_intern_release(node->nodeName);
+			node->nodeName = NULL;
 		}
 	}
 
@@ -1410,18 +1418,14 @@ int ixmlNode_setNodeProperties(IXML_Node *destNode, IXML_Node *src)
 	return IXML_SUCCESS;
 
 ErrorHandler:
-	if (destNode->nodeName != NULL) {
-		free(destNode->nodeName);
-		destNode->nodeName = NULL;
-	}
+	ixml_intern_release(destNode->nodeName);
+	destNode->nodeName = NULL;
 	if (destNode->nodeValue != NULL) {
 		free(destNode->nodeValue);
 		destNode->nodeValue = NULL;
 	}
-	if (destNode->localName != NULL) {
-		free(destNode->localName);
-		destNode->localName = NULL;
-	}
+	ixml_intern_release(destNode->localName);
+	destNode->localName = NULL;
 
 	return IXML_INSUFFICIENT_MEMORY;
 }
@@ -45,8 +45,12 @@
 #include "ThreadPool.h"
 #include "UpnpStdInt.h"                    // IWYU pragma: keep
 #include "UpnpUniStd.h" /* for close() */  // IWYU pragma: keep
+#include "httpasync.h"
+#include "httpconnpool.h"
 #include "httpreadwrite.h"
 #include "membuffer.h"
+#include "metrics.h"
+#include "resolver.h"
 #include "soaplib.h"
 #include "ssdplib.h"
 #include "sysdep.h"
@@ -107,6 +111,8 @@ virtualDirList *pVirtualDirList;
 #ifdef INCLUDE_CLIENT_APIS
 /*! Mutex to synchronize the subscription handling at the client side. */
 ithread_mutex_t GlobalClientSubscribeMutex;
+/*! Signaled when an asynchronous subscription completes. */
+ithread_cond_t GlobalClientSubscribeCond;
 #endif /* INCLUDE_CLIENT_APIS */
 
 /*! rwlock to synchronize handles (root device or control point handle). */
@@ -130,6 +136,13 @@ ThreadPool gRecvThreadPool;
 /*! Mini server thread pool. */
 ThreadPool gMiniServerThreadPool;
 
+/*! Placement of the thread pools and of the timer thread, indexed by
+ * Upnp_ThreadPool, see UpnpSetThreadPoolPlacement(). */
+static TPPlacement gThreadPoolPlacement[ UPNP_THREADPOOL_TIMER + 1 ];
+
+/*! Non-zero where gThreadPoolPlacement is set. */
+static int gThreadPoolPlaced[ UPNP_THREADPOOL_TIMER + 1 ];
+
 /*! Flag to indicate the state of web server */
 WebServerState bWebServerState = WEB_SERVER_DISABLED;
 
@@ -180,6 +193,9 @@ unsigned short LOCAL_PORT_V6_ULA_GUA;
 /*! UPnP device and control point handle table  */
 static void *HandleTable[ NUM_HANDLE ];
 
+/*! Counters behind UpnpGetMetrics(). (extern'ed in metrics.h) */
+upnp_metrics_t gUpnpMetrics;
+
 /*! a local dir which serves as webserver root */
 extern membuffer gDocumentRootDir;
 
@@ -236,27 +252,9 @@ SSL_CTX *gSslCtx = NULL;
 #endif
 
 typedef union {
-    struct
-    {
-        int   handle;
-        int   eventId;
-        void *Event;
-    } advertise;
     struct UpnpNonblockParam action;
 } job_arg;
 
-/*!
- * \brief Free memory associated with advertise job's argument
- */
-static void free_advertise_arg( job_arg *arg )
-{
-    if( arg->advertise.Event )
-    {
-        free( arg->advertise.Event );
-    }
-    free( arg );
-}
-
 /*!
  * \brief Free memory associated with an action job's argument
  */
@@ -343,6 +341,10 @@ static int UpnpInitMutexes( void )
     {
         return UPNP_E_INIT_FAILED;
     }
+    if( ithread_cond_init( &GlobalClientSubscribeCond, NULL ) != 0 )
+    {
+        return UPNP_E_INIT_FAILED;
+    }
 #endif
     return UPNP_E_SUCCESS;
 }
@@ -357,8 +359,10 @@ static int UpnpInitThreadPools( void )
 {
     int            ret = UPNP_E_SUCCESS;
     ThreadPoolAttr attr;
+    TPPlacement    anyPlacement;
 
     TPAttrInit( &attr );
+    anyPlacement = attr.placement;
     TPAttrSetMaxThreads( &attr, MAX_THREADS );
     TPAttrSetMinThreads( &attr, MIN_THREADS );
     TPAttrSetStackSize( &attr, THREAD_STACK_SIZE );
@@ -366,18 +370,28 @@ static int UpnpInitThreadPools( void )
     TPAttrSetIdleTime( &attr, THREAD_IDLE_TIME );
     TPAttrSetMaxJobsTotal( &attr, maxJobsTotal );
 
+    attr.placement = gThreadPoolPlaced[ UPNP_THREADPOOL_SEND ] ?
+        gThreadPoolPlacement[ UPNP_THREADPOOL_SEND ] : anyPlacement;
     if( ThreadPoolInit( &gSendThreadPool, &attr ) != UPNP_E_SUCCESS )
     {
         ret = UPNP_E_INIT_FAILED;
         goto exit_function;
     }
 
+    attr.placement = gThreadPoolPlaced[ UPNP_THREADPOOL_RECV ] ?
+        gThreadPoolPlacement[ UPNP_THREADPOOL_RECV ] : anyPlacement;
     if( ThreadPoolInit( &gRecvThreadPool, &attr ) != UPNP_E_SUCCESS )
     {
         ret = UPNP_E_INIT_FAILED;
         goto exit_function;
     }
 
+#if EXCLUDE_MINISERVER == 0
+    /* The HTTP listener shards each keep a thread. */
+    TPAttrSetMaxThreads( &attr, MAX_THREADS + GetMiniServerShardThreads() );
+#endif
+    attr.placement = gThreadPoolPlaced[ UPNP_THREADPOOL_MINISERVER ] ?
+        gThreadPoolPlacement[ UPNP_THREADPOOL_MINISERVER ] : anyPlacement;
     if( ThreadPoolInit( &gMiniServerThreadPool, &attr ) != UPNP_E_SUCCESS )
     {
         ret = UPNP_E_INIT_FAILED;
@@ -439,6 +453,35 @@ static int UpnpInitPreamble( void )
         return retVal;
     }
 
+    /* Initialize the per-thread pools of recycled buffers. */
+    retVal = membuffer_pool_init();
+    if( retVal != UPNP_E_SUCCESS )
+    {
+        return retVal;
+    }
+
+#ifdef INCLUDE_DEVICE_APIS
+#    if EXCLUDE_GENA == 0
+    /* Initialize the free lists of the GENA notify jobs. */
+    retVal = genaNotifyPoolInit();
+    if( retVal != UPNP_E_SUCCESS )
+    {
+        return retVal;
+    }
+#    endif
+#    if EXCLUDE_SSDP == 0
+    /* Initialize the scheduler of the advertisement renewals. */
+    retVal = SsdpAdvertiserInit();
+    if( retVal != UPNP_E_SUCCESS )
+    {
+        return retVal;
+    }
+#    endif
+#endif /* INCLUDE_DEVICE_APIS */
+
+    /* Metrics count from UpnpInit2(). */
+    memset( &gUpnpMetrics, 0, sizeof( gUpnpMetrics ) );
+
 #ifdef UPNP_HAVE_OPTSSDP
     /* Create the NLS uuid. */
     uuid_create( &nls_uuid );
@@ -453,6 +496,12 @@ static int UpnpInitPreamble( void )
     }
     HandleUnlock( __FILE__, __LINE__ );
 
+    /* Initialize the pool of keep-alive client connections. */
+    http_ConnPoolInit();
+
+    /* Initialize the cache of host name resolutions. */
+    resolver_Init();
+
     /* Initialize SDK global thread pools. */
     retVal = UpnpInitThreadPools();
     if( retVal != UPNP_E_SUCCESS )
@@ -473,7 +522,9 @@ static int UpnpInitPreamble( void )
 #endif /* INTERNAL_WEB_SERVER */
 
     /* Initialize the SDK timer thread. */
-    retVal = TimerThreadInit( &gTimerThread, &gSendThreadPool );
+    retVal = TimerThreadInit( &gTimerThread, &gSendThreadPool,
+        gThreadPoolPlaced[ UPNP_THREADPOOL_TIMER ] ?
+        &gThreadPoolPlacement[ UPNP_THREADPOOL_TIMER ] : NULL );
     if( retVal != UPNP_E_SUCCESS )
     {
         UpnpFinish();
@@ -481,6 +532,32 @@ static int UpnpInitPreamble( void )
         return retVal;
     }
 
+#if EXCLUDE_SOAP == 0
+#    ifdef INCLUDE_CLIENT_APIS
+    /* Start the event loop of the asynchronous actions. */
+    retVal = http_AsyncInit();
+    if( retVal != UPNP_E_SUCCESS )
+    {
+        UpnpFinish();
+
+        return retVal;
+    }
+#    endif
+#endif /* EXCLUDE_SOAP == 0 */
+
+#ifdef INCLUDE_DEVICE_APIS
+#    if EXCLUDE_SSDP == 0
+    /* Start the scheduler of the search replies. */
+    retVal = SsdpReplierInit();
+    if( retVal != UPNP_E_SUCCESS )
+    {
+        UpnpFinish();
+
+        return retVal;
+    }
+#    endif
+#endif /* INCLUDE_DEVICE_APIS */
+
     return UPNP_E_SUCCESS;
 }
 
@@ -704,6 +781,11 @@ int UpnpFinish( void )
     }
 #endif
     TimerThreadShutdown( &gTimerThread );
+#if EXCLUDE_SOAP == 0
+#    ifdef INCLUDE_CLIENT_APIS
+    http_AsyncShutdown();
+#    endif
+#endif /* EXCLUDE_SOAP == 0 */
 #if EXCLUDE_MINISERVER == 0
     StopMiniServer();
 #endif
@@ -713,10 +795,27 @@ int UpnpFinish( void )
     ThreadPoolShutdown( &gMiniServerThreadPool );
     PrintThreadPoolStats( &gMiniServerThreadPool, __FILE__, __LINE__, "MiniServer Thread Pool" );
     ThreadPoolShutdown( &gRecvThreadPool );
+#ifdef INCLUDE_DEVICE_APIS
+#    if EXCLUDE_SSDP == 0
+    /* No search comes anymore, its thread leaves the send pool. */
+    SsdpReplierShutdown();
+#    endif
+#endif /* INCLUDE_DEVICE_APIS */
     PrintThreadPoolStats( &gSendThreadPool, __FILE__, __LINE__, "Send Thread Pool" );
     ThreadPoolShutdown( &gSendThreadPool );
     PrintThreadPoolStats( &gRecvThreadPool, __FILE__, __LINE__, "Recv Thread Pool" );
+    http_ConnPoolShutdown();
+    resolver_Shutdown();
+#ifdef INCLUDE_DEVICE_APIS
+#    if EXCLUDE_GENA == 0
+    genaNotifyPoolDestroy();
+#    endif
+#    if EXCLUDE_SSDP == 0
+    SsdpAdvertiserShutdown();
+#    endif
+#endif /* INCLUDE_DEVICE_APIS */
 #ifdef INCLUDE_CLIENT_APIS
+    ithread_cond_destroy( &GlobalClientSubscribeCond );
     ithread_mutex_destroy( &GlobalClientSubscribeMutex );
 #endif
     ithread_rwlock_destroy( &GlobalHndRWLock );
@@ -726,6 +825,7 @@ int UpnpFinish( void )
     UpnpSdkInit = 0;
     UpnpPrintf( UPNP_INFO, API, __FILE__, __LINE__, "Exiting UpnpFinish: UpnpSdkInit is :%d:\n", UpnpSdkInit );
     UpnpCloseLog();
+    membuffer_pool_cleanup();
     /* Clean-up ithread library resources */
     ithread_cleanup_library();
 
@@ -796,6 +896,69 @@ char *UpnpGetServerUlaGuaIp6Address( void )
 #endif
 }
 
+int UpnpGetMetrics( UpnpMetrics *metrics )
+{
+    struct Handle_Info *HInfo = NULL;
+    int i;
+#ifdef INCLUDE_DEVICE_APIS
+    service_info *service;
+#endif
+#ifdef INCLUDE_CLIENT_APIS
+    GenlibClientSubscription *sub;
+#endif
+
+    if( UpnpSdkInit != 1 )
+        return UPNP_E_FINISH;
+    if( metrics == NULL )
+        return UPNP_E_INVALID_PARAM;
+
+    memset( metrics, 0, sizeof( *metrics ) );
+    ThreadPoolGetMetrics( &gMiniServerThreadPool, &metrics->miniServerPool );
+    ThreadPoolGetMetrics( &gRecvThreadPool, &metrics->recvPool );
+    ThreadPoolGetMetrics( &gSendThreadPool, &metrics->sendPool );
+    upnp_histogram_snapshot( &gUpnpMetrics.soapAction, &metrics->soapAction );
+    metrics->soapActionFailures = ( uint64_t )upnp_atomic64_load( &gUpnpMetrics.soapActionFailures );
+    upnp_histogram_snapshot( &gUpnpMetrics.notifyDelivery, &metrics->notifyDelivery );
+    metrics->notifyFailures = ( uint64_t )upnp_atomic64_load( &gUpnpMetrics.notifyFailures );
+    metrics->ssdpPacketsIn = ( uint64_t )upnp_atomic64_load( &gUpnpMetrics.ssdpPacketsIn );
+    metrics->ssdpPacketsOut = ( uint64_t )upnp_atomic64_load( &gUpnpMetrics.ssdpPacketsOut );
+    for( i = 0; i < UPNP_METRICS_HTTP_CLASSES; i++ )
+    {
+        metrics->httpResponses[ i ] = ( uint64_t )upnp_atomic64_load( &gUpnpMetrics.httpResponses[ i ] );
+    }
+
+    /* Subscription counts are gauges, read them from the handle table
+     * rather than tracking every add and remove. */
+    HandleReadLock( __FILE__, __LINE__ );
+    for( i = 1; i < NUM_HANDLE; i++ )
+    {
+        switch( GetHandleInfo( i, &HInfo ) )
+        {
+#ifdef INCLUDE_DEVICE_APIS
+            case HND_DEVICE:
+                for( service = HInfo->ServiceTable.serviceList; service; service = service->next )
+                {
+                    metrics->deviceSubscriptions += service->TotalSubscriptions;
+                }
+                break;
+#endif
+#ifdef INCLUDE_CLIENT_APIS
+            case HND_CLIENT:
+                for( sub = HInfo->ClientSubList; sub; sub = GenlibClientSubscription_get_Next( sub ) )
+                {
+                    metrics->clientSubscriptions++;
+                }
+                break;
+#endif
+            default:
+                break;
+        }
+    }
+    HandleUnlock( __FILE__, __LINE__ );
+
+    return UPNP_E_SUCCESS;
+}
+
 /*!
  * \brief Get a free handle.
  *
@@ -838,6 +1001,9 @@ static int FreeHandle(
     }
     else
     {
+#if defined( INCLUDE_DEVICE_APIS ) && EXCLUDE_SSDP == 0
+        SsdpIndexRemove( Upnp_Handle );
+#endif
         free( HandleTable[ Upnp_Handle ] );
         HandleTable[ Upnp_Handle ] = NULL;
         ret                        = UPNP_E_SUCCESS;
@@ -848,6 +1014,78 @@ static int FreeHandle(
 }
 
 #ifdef INCLUDE_DEVICE_APIS
+#    ifdef INTERNAL_WEB_SERVER
+/*!
+ * \brief Tells whether an address is the one of an HTTP listener of the
+ * miniserver.
+ *
+ * \return 1 if it is, 0 otherwise.
+ */
+static int IsMiniServerAddress(
+    /*! [in] Address and port, as parsed from a URL. */
+    const struct sockaddr_storage *addr )
+{
+    const struct sockaddr_in  *sa4 = ( const struct sockaddr_in * )addr;
+    const struct sockaddr_in6 *sa6 = ( const struct sockaddr_in6 * )addr;
+    struct in_addr             v4;
+    struct in6_addr            v6;
+
+    switch( addr->ss_family )
+    {
+        case AF_INET:
+            return gIF_IPV4[ 0 ] != '\0' && ntohs( sa4->sin_port ) == LOCAL_PORT_V4 && inet_pton( AF_INET, gIF_IPV4, &v4 ) == 1 &&
+                   memcmp( &v4, &sa4->sin_addr, sizeof( v4 ) ) == 0;
+        case AF_INET6:
+            if( gIF_IPV6[ 0 ] != '\0' && ntohs( sa6->sin6_port ) == LOCAL_PORT_V6 && inet_pton( AF_INET6, gIF_IPV6, &v6 ) == 1 &&
+                memcmp( &v6, &sa6->sin6_addr, sizeof( v6 ) ) == 0 )
+                return 1;
+            return gIF_IPV6_ULA_GUA[ 0 ] != '\0' && ntohs( sa6->sin6_port ) == LOCAL_PORT_V6_ULA_GUA &&
+                   inet_pton( AF_INET6, gIF_IPV6_ULA_GUA, &v6 ) == 1 && memcmp( &v6, &sa6->sin6_addr, sizeof( v6 ) ) == 0;
+        default:
+            return 0;
+    }
+}
+#    endif /* INTERNAL_WEB_SERVER */
+
+/*!
+ * \brief Gets the description document of a device to register.
+ *
+ * A document the internal web server publishes, as an alias or below its
+ * root directory, is parsed in place instead of being requested from our
+ * own HTTP server. Remote URLs and virtual directories are downloaded.
+ *
+ * \return An error code of UpnpDownloadXmlDoc().
+ */
+static int UpnpLoadDescDocument(
+    /*! [in] URL of the description document. */
+    const char *url,
+    /*! [out] The parsed document. */
+    IXML_Document **xmlDoc )
+{
+#    ifdef INTERNAL_WEB_SERVER
+    uri_type parsed_url;
+    char    *path;
+    int      retVal;
+
+    if( bWebServerState == WEB_SERVER_ENABLED && parse_uri( url, strlen( url ), &parsed_url ) == HTTP_SUCCESS &&
+        IsMiniServerAddress( &parsed_url.hostport.IPaddress ) )
+    {
+        path = str_alloc( parsed_url.pathquery.buff, parsed_url.pathquery.size );
+        if( path == NULL )
+            return UPNP_E_OUTOF_MEMORY;
+        retVal = web_server_load_xml( path, xmlDoc );
+        free( path );
+        if( retVal != UPNP_E_NOT_FOUND )
+        {
+            UpnpPrintf( UPNP_INFO, API, __FILE__, __LINE__, "Description %s loaded locally: %d\n", url, retVal );
+            return retVal;
+        }
+    }
+#    endif /* INTERNAL_WEB_SERVER */
+
+    return UpnpDownloadXmlDoc( url, xmlDoc );
+}
+
 int UpnpRegisterRootDevice( const char *DescUrl, Upnp_FunPtr Fun, const void *Cookie, UpnpDevice_Handle *Hnd )
 {
     struct Handle_Info *HInfo  = NULL;
@@ -915,7 +1153,7 @@ int UpnpRegisterRootDevice( const char *DescUrl, Upnp_FunPtr Fun, const void *Co
     HInfo->MaxSubscriptionTimeOut = UPNP_INFINITE;
     HInfo->DeviceAf               = AF_INET;
 
-    retVal = UpnpDownloadXmlDoc( HInfo->DescURL, &( HInfo->DescDocument ) );
+    retVal = UpnpLoadDescDocument( HInfo->DescURL, &( HInfo->DescDocument ) );
     if( retVal != UPNP_E_SUCCESS )
     {
         UpnpPrintf( UPNP_ALL,
@@ -957,6 +1195,21 @@ int UpnpRegisterRootDevice( const char *DescUrl, Upnp_FunPtr Fun, const void *Co
         goto exit_function;
     }
 
+#    if EXCLUDE_SSDP == 0
+    /* Index the devices and services searches are matched against. */
+    retVal = SsdpIndexAdd( *Hnd, HInfo );
+    if( retVal != UPNP_E_SUCCESS )
+    {
+        ixmlNodeList_free( HInfo->DeviceList );
+#        ifdef INCLUDE_CLIENT_APIS
+        ListDestroy( &HInfo->SsdpSearchList, 0 );
+#        endif /* INCLUDE_CLIENT_APIS */
+        ixmlDocument_free( HInfo->DescDocument );
+        FreeHandle( *Hnd );
+        goto exit_function;
+    }
+#    endif /* EXCLUDE_SSDP == 0 */
+
     HInfo->ServiceList = ixmlDocument_getElementsByTagName( HInfo->DescDocument, "serviceList" );
     if( !HInfo->ServiceList )
     {
@@ -1123,6 +1376,21 @@ int UpnpRegisterRootDevice2( Upnp_DescType descriptionType, const char *descript
         goto exit_function;
     }
 
+#    if EXCLUDE_SSDP == 0
+    /* Index the devices and services searches are matched against. */
+    retVal = SsdpIndexAdd( *Hnd, HInfo );
+    if( retVal != UPNP_E_SUCCESS )
+    {
+        ixmlNodeList_free( HInfo->DeviceList );
+#        ifdef INCLUDE_CLIENT_APIS
+        ListDestroy( &HInfo->SsdpSearchList, 0 );
+#        endif /* INCLUDE_CLIENT_APIS */
+        ixmlDocument_free( HInfo->DescDocument );
+        FreeHandle( *Hnd );
+        goto exit_function;
+    }
+#    endif /* EXCLUDE_SSDP == 0 */
+
     HInfo->ServiceList = ixmlDocument_getElementsByTagName( HInfo->DescDocument, "serviceList" );
     if( !HInfo->ServiceList )
     {
@@ -1178,7 +1446,29 @@ int UpnpRegisterRootDevice3( const char *DescUrl, Upnp_FunPtr Fun, const void *C
 #endif /* INCLUDE_DEVICE_APIS */
 
 #ifdef INCLUDE_DEVICE_APIS
-int UpnpRegisterRootDevice4( const char *DescUrl, Upnp_FunPtr Fun, const void *Cookie, UpnpDevice_Handle *Hnd, int AddressFamily, const char *LowerDescUrl )
+/*!
+ * \brief Registers a root device described by \b DescDoc, or by the document
+ * at \b DescUrl when \b DescDoc is NULL.
+ *
+ * \b DescDoc is owned by the function, the handle keeps it or it is freed.
+ *
+ * \return An error code of UpnpRegisterRootDevice4().
+ */
+static int RegisterRootDevice(
+    /*! [in] Parsed description, or NULL to get it from \b DescUrl. */
+    IXML_Document *DescDoc,
+    /*! [in] URL of the description document. */
+    const char *DescUrl,
+    /*! [in] Callback of the device. */
+    Upnp_FunPtr Fun,
+    /*! [in] Argument of the callback. */
+    const void *Cookie,
+    /*! [out] Handle of the device. */
+    UpnpDevice_Handle *Hnd,
+    /*! [in] AF_INET or AF_INET6. */
+    int AddressFamily,
+    /*! [in] Description URL for legacy control points, or NULL. */
+    const char *LowerDescUrl )
 {
     struct Handle_Info *HInfo;
     int                 retVal = 0;
@@ -1241,7 +1531,14 @@ int UpnpRegisterRootDevice4( const char *DescUrl, Upnp_FunPtr Fun, const void *C
     HInfo->MaxSubscriptions       = UPNP_INFINITE;
     HInfo->MaxSubscriptionTimeOut = UPNP_INFINITE;
     HInfo->DeviceAf               = AddressFamily;
-    retVal                        = UpnpDownloadXmlDoc( HInfo->DescURL, &( HInfo->DescDocument ) );
+    if( DescDoc != NULL )
+    {
+        HInfo->DescDocument = DescDoc;
+        DescDoc             = NULL;
+        retVal              = UPNP_E_SUCCESS;
+    }
+    else
+        retVal = UpnpLoadDescDocument( HInfo->DescURL, &( HInfo->DescDocument ) );
     if( retVal != UPNP_E_SUCCESS )
     {
 #    ifdef INCLUDE_CLIENT_APIS
@@ -1276,6 +1573,21 @@ int UpnpRegisterRootDevice4( const char *DescUrl, Upnp_FunPtr Fun, const void *C
         goto exit_function;
     }
 
+#    if EXCLUDE_SSDP == 0
+    /* Index the devices and services searches are matched against. */
+    retVal = SsdpIndexAdd( *Hnd, HInfo );
+    if( retVal != UPNP_E_SUCCESS )
+    {
+        ixmlNodeList_free( HInfo->DeviceList );
+#        ifdef INCLUDE_CLIENT_APIS
+        ListDestroy( &HInfo->SsdpSearchList, 0 );
+#        endif /* INCLUDE_CLIENT_APIS */
+        ixmlDocument_free( HInfo->DescDocument );
+        FreeHandle( *Hnd );
+        goto exit_function;
+    }
+#    endif /* EXCLUDE_SSDP == 0 */
+
     HInfo->ServiceList = ixmlDocument_getElementsByTagName( HInfo->DescDocument, "serviceList" );
     if( !HInfo->ServiceList )
     {
@@ -1324,6 +1636,277 @@ int UpnpRegisterRootDevice4( const char *DescUrl, Upnp_FunPtr Fun, const void *C
 exit_function:
     UpnpPrintf( UPNP_ALL, API, __FILE__, __LINE__, "Exiting RegisterRootDevice4, return value == %d\n", retVal );
     HandleUnlock( __FILE__, __LINE__ );
+    ixmlDocument_free( DescDoc );
+
+    return retVal;
+}
+
+int UpnpRegisterRootDevice4( const char *DescUrl, Upnp_FunPtr Fun, const void *Cookie, UpnpDevice_Handle *Hnd, int AddressFamily, const char *LowerDescUrl )
+{
+    return RegisterRootDevice( NULL, DescUrl, Fun, Cookie, Hnd, AddressFamily, LowerDescUrl );
+}
+
+int UpnpRegisterRootDeviceDoc( IXML_Document *DescDoc, const char *DescUrl, Upnp_FunPtr Fun, const void *Cookie, UpnpDevice_Handle *Hnd, int AddressFamily, const char *LowerDescUrl )
+{
+    if( DescDoc == NULL )
+        return UPNP_E_INVALID_PARAM;
+
+    return RegisterRootDevice( DescDoc, DescUrl, Fun, Cookie, Hnd, AddressFamily, LowerDescUrl );
+}
+
+int GetInstanceUDN( const struct Handle_Info *HInfo, unsigned long index, char *UDN, size_t len )
+{
+    int rc;
+
+    if( HInfo->Template == NULL )
+        return UPNP_E_SUCCESS;
+    if( index == 0lu )
+        rc = snprintf( UDN, len, "%s", HInfo->InstanceUDN );
+    else
+        rc = snprintf( UDN, len, "%s-%lu", HInfo->InstanceUDN, index );
+    /* a truncated UDN could be the one of another device */
+    if( rc < 0 || ( size_t )rc >= len )
+        return UPNP_E_INVALID_PARAM;
+
+    return UPNP_E_SUCCESS;
+}
+
+/*!
+ * \brief Drops a reference on a template, the last one frees it. Must be
+ * called with the handle lock held.
+ */
+static void ReleaseHandleTemplate(
+    /*! [in] Template of a bulk registration. */
+    struct Handle_Template *Template )
+{
+    unsigned long i;
+
+    if( --Template->refs > 0 )
+        return;
+    if( Template->UDNs )
+    {
+        for( i = 0lu; i < Template->UDNCount; i++ )
+            ixmlFreeDOMString( Template->UDNs[ i ] );
+        free( Template->UDNs );
+    }
+    ixmlNodeList_free( Template->DeviceList );
+    ixmlNodeList_free( Template->ServiceList );
+    ixmlDocument_free( Template->DescDocument );
+    free( Template );
+}
+
+/*!
+ * \brief Indexes the devices of a description for a bulk registration.
+ *
+ * \return UPNP_E_SUCCESS, UPNP_E_INVALID_DESC or UPNP_E_OUTOF_MEMORY.
+ * 	\b DescDoc belongs to the template, or is freed on error.
+ */
+static int NewHandleTemplate(
+    /*! [in] Description shared by the devices. */
+    IXML_Document *DescDoc,
+    /*! [out] The template, with one reference for the caller. */
+    struct Handle_Template **Template )
+{
+    struct Handle_Template *t;
+    IXML_Node              *udn;
+    unsigned long           i;
+
+    t = ( struct Handle_Template * )calloc( 1, sizeof( struct Handle_Template ) );
+    if( t == NULL )
+    {
+        ixmlDocument_free( DescDoc );
+        return UPNP_E_OUTOF_MEMORY;
+    }
+    t->refs         = 1;
+    t->DescDocument = DescDoc;
+    t->DeviceList   = ixmlDocument_getElementsByTagName( DescDoc, "device" );
+    t->ServiceList  = ixmlDocument_getElementsByTagName( DescDoc, "serviceList" );
+    if( t->DeviceList == NULL )
+    {
+        ReleaseHandleTemplate( t );
+        return UPNP_E_INVALID_DESC;
+    }
+    t->UDNCount = ixmlNodeList_length( t->DeviceList );
+    t->UDNs     = ( char ** )calloc( t->UDNCount, sizeof( char * ) );
+    if( t->UDNs == NULL )
+    {
+        ReleaseHandleTemplate( t );
+        return UPNP_E_OUTOF_MEMORY;
+    }
+    for( i = 0lu; i < t->UDNCount; i++ )
+    {
+        if( !getSubElement( "UDN", ixmlNodeList_item( t->DeviceList, i ), &udn ) || ( t->UDNs[ i ] = getElementValue( udn ) ) == NULL )
+        {
+            UpnpPrintf( UPNP_CRITICAL, API, __FILE__, __LINE__, "Template device %lu has no UDN\n", i );
+            ReleaseHandleTemplate( t );
+            return UPNP_E_INVALID_DESC;
+        }
+    }
+    *Template = t;
+
+    return UPNP_E_SUCCESS;
+}
+
+#    if EXCLUDE_GENA == 0
+/*!
+ * \brief Replaces the UDNs of the template in the service table of a bulk
+ * registered device.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_OUTOF_MEMORY.
+ */
+static int SetInstanceServiceUDNs(
+    /*! [in,out] Device handle structure. */
+    struct Handle_Info *HInfo )
+{
+    service_info *service;
+    unsigned long i;
+    char          UDN[ LINE_SIZE ];
+
+    for( service = HInfo->ServiceTable.serviceList; service; service = service->next )
+    {
+        for( i = 0lu; i < HInfo->Template->UDNCount; i++ )
+        {
+            if( strcmp( service->UDN, HInfo->Template->UDNs[ i ] ) == 0 )
+                break;
+        }
+        if( i == HInfo->Template->UDNCount )
+            continue;
+        if( GetInstanceUDN( HInfo, i, UDN, sizeof( UDN ) ) != UPNP_E_SUCCESS )
+            return UPNP_E_INVALID_PARAM;
+        ixmlFreeDOMString( service->UDN );
+        service->UDN = ixmlCloneDOMString( UDN );
+        if( service->UDN == NULL )
+            return UPNP_E_OUTOF_MEMORY;
+    }
+
+    return UPNP_E_SUCCESS;
+}
+#    endif /* EXCLUDE_GENA */
+
+/*!
+ * \brief Frees a handle created by UpnpRegisterRootDevices() that was not
+ * announced yet. Must be called with the handle lock held.
+ */
+static void FreeInstanceHandle(
+    /*! [in] Handle of the device. */
+    UpnpDevice_Handle Hnd )
+{
+    struct Handle_Info *HInfo = ( struct Handle_Info * )HandleTable[ Hnd ];
+
+#    if EXCLUDE_GENA == 0
+    freeServiceTable( &HInfo->ServiceTable );
+#    endif /* EXCLUDE_GENA */
+#    ifdef INCLUDE_CLIENT_APIS
+    ListDestroy( &HInfo->SsdpSearchList, 0 );
+#    endif /* INCLUDE_CLIENT_APIS */
+    ReleaseHandleTemplate( HInfo->Template );
+    FreeHandle( Hnd );
+}
+
+int UpnpRegisterRootDevices( IXML_Document *Template, const UpnpDeviceInstance *Instances, size_t Count, Upnp_FunPtr Fun, int AddressFamily, UpnpDevice_Handle *Hnds )
+{
+    struct Handle_Template *t = NULL;
+    struct Handle_Info     *HInfo;
+    size_t                  n;
+    int                     retVal;
+
+    UpnpPrintf( UPNP_ALL, API, __FILE__, __LINE__, "Inside UpnpRegisterRootDevices\n" );
+    if( UpnpSdkInit != 1 )
+    {
+        ixmlDocument_free( Template );
+        return UPNP_E_FINISH;
+    }
+    if( Template == NULL || Instances == NULL || Count == ( size_t )0 || Fun == NULL || Hnds == NULL || ( AddressFamily != AF_INET && AddressFamily != AF_INET6 ) )
+    {
+        ixmlDocument_free( Template );
+        return UPNP_E_INVALID_PARAM;
+    }
+    for( n = 0; n < Count; n++ )
+    {
+        /* room for the suffix of the embedded devices, see GetInstanceUDN() */
+        if( Instances[ n ].UDN == NULL || Instances[ n ].UDN[ 0 ] == '\0' || strlen( Instances[ n ].UDN ) >= LINE_SIZE - INSTANCE_UDN_SUFFIX_LEN || Instances[ n ].DescUrl == NULL ||
+            Instances[ n ].DescUrl[ 0 ] == '\0' || strlen( Instances[ n ].DescUrl ) >= LINE_SIZE )
+        {
+            ixmlDocument_free( Template );
+            return UPNP_E_INVALID_PARAM;
+        }
+    }
+    retVal = NewHandleTemplate( Template, &t );
+    if( retVal != UPNP_E_SUCCESS )
+        return retVal;
+
+    HandleLock( __FILE__, __LINE__ );
+    for( n = 0; n < Count; n++ )
+    {
+        Hnds[ n ] = GetFreeHandle();
+        if( Hnds[ n ] == UPNP_E_OUTOF_HANDLE )
+        {
+            retVal = UPNP_E_OUTOF_MEMORY;
+            break;
+        }
+        HInfo = ( struct Handle_Info * )calloc( 1, sizeof( struct Handle_Info ) );
+        if( HInfo == NULL )
+        {
+            retVal = UPNP_E_OUTOF_MEMORY;
+            break;
+        }
+        HandleTable[ Hnds[ n ] ] = HInfo;
+        HInfo->HType             = HND_DEVICE;
+        strncpy( HInfo->DescURL, Instances[ n ].DescUrl, sizeof( HInfo->DescURL ) - 1 );
+        strncpy( HInfo->LowerDescURL, Instances[ n ].LowerDescUrl ? Instances[ n ].LowerDescUrl : Instances[ n ].DescUrl, sizeof( HInfo->LowerDescURL ) - 1 );
+        strncpy( HInfo->InstanceUDN, Instances[ n ].UDN, sizeof( HInfo->InstanceUDN ) - 1 );
+        HInfo->Callback     = Fun;
+        HInfo->Cookie       = ( void * )Instances[ n ].Cookie;
+        HInfo->MaxAge       = DEFAULT_MAXAGE;
+        HInfo->Template     = t;
+        HInfo->DescDocument = t->DescDocument;
+        HInfo->DeviceList   = t->DeviceList;
+        HInfo->ServiceList  = t->ServiceList;
+        t->refs++;
+#    ifdef INCLUDE_CLIENT_APIS
+        ListInit( &HInfo->SsdpSearchList, NULL, NULL );
+#    endif /* INCLUDE_CLIENT_APIS */
+        HInfo->MaxSubscriptions       = UPNP_INFINITE;
+        HInfo->MaxSubscriptionTimeOut = UPNP_INFINITE;
+        HInfo->DeviceAf               = AddressFamily;
+#    if EXCLUDE_GENA == 0
+        getServiceTable( ( IXML_Node * )t->DescDocument, &HInfo->ServiceTable, HInfo->DescURL );
+        retVal = SetInstanceServiceUDNs( HInfo );
+        if( retVal != UPNP_E_SUCCESS )
+        {
+            n++;
+            break;
+        }
+#    endif /* EXCLUDE_GENA */
+#    if EXCLUDE_SSDP == 0
+        retVal = SsdpIndexAdd( Hnds[ n ], HInfo );
+        if( retVal != UPNP_E_SUCCESS )
+        {
+            n++;
+            break;
+        }
+#    endif /* EXCLUDE_SSDP == 0 */
+    }
+    if( retVal != UPNP_E_SUCCESS )
+    {
+        /* All or nothing: drop the devices of this call. */
+        while( n-- > 0 )
+            FreeInstanceHandle( Hnds[ n ] );
+    }
+    else
+    {
+        switch( AddressFamily )
+        {
+            case AF_INET:
+                UpnpSdkDeviceRegisteredV4 = 1;
+                break;
+            default:
+                UpnpSdkDeviceregisteredV6 = 1;
+        }
+    }
+    ReleaseHandleTemplate( t );
+    HandleUnlock( __FILE__, __LINE__ );
+    UpnpPrintf( UPNP_ALL, API, __FILE__, __LINE__, "Exiting UpnpRegisterRootDevices, return value == %d\n", retVal );
 
     return retVal;
 }
@@ -1366,7 +1949,9 @@ int UpnpUnRegisterRootDeviceLowPower( UpnpDevice_Handle Hnd, int PowerState, int
     HandleUnlock( __FILE__, __LINE__ );
 
 #    if EXCLUDE_SSDP == 0
-    retVal = AdvertiseAndReply( -1, Hnd, ( enum SsdpSearchType )0, ( struct sockaddr * )NULL, ( char * )NULL, ( char * )NULL, ( char * )NULL, HInfo->MaxAge );
+    /* No renewal after the byebye messages. */
+    SsdpAdvertiserRemove( Hnd );
+    retVal = AdvertiseAndReply( -1, Hnd, HInfo->MaxAge );
 #    endif
 
     HandleLock( __FILE__, __LINE__ );
@@ -1378,15 +1963,22 @@ int UpnpUnRegisterRootDeviceLowPower( UpnpDevice_Handle Hnd, int PowerState, int
         default:
             break;
     }
-    ixmlNodeList_free( HInfo->DeviceList );
-    ixmlNodeList_free( HInfo->ServiceList );
-    ixmlDocument_free( HInfo->DescDocument );
+    if( HInfo->Template )
+    {
+        ReleaseHandleTemplate( HInfo->Template );
+    }
+    else
+    {
+        ixmlNodeList_free( HInfo->DeviceList );
+        ixmlNodeList_free( HInfo->ServiceList );
+        ixmlDocument_free( HInfo->DescDocument );
+    }
 #    ifdef INCLUDE_CLIENT_APIS
     ListDestroy( &HInfo->SsdpSearchList, 0 );
 #    endif /* INCLUDE_CLIENT_APIS */
 #    ifdef INTERNAL_WEB_SERVER
     if( HInfo->aliasInstalled )
-        web_server_set_alias( NULL, NULL, 0, 0 );
+        web_server_remove_alias( HInfo->DescURL );
 #    endif /* INTERNAL_WEB_SERVER */
     switch( HInfo->DeviceAf )
     {
@@ -1401,6 +1993,10 @@ int UpnpUnRegisterRootDeviceLowPower( UpnpDevice_Handle Hnd, int PowerState, int
     }
     FreeHandle( Hnd );
     HandleUnlock( __FILE__, __LINE__ );
+#    if EXCLUDE_SSDP == 0
+    /* In case the device was announced again in the meantime. */
+    SsdpAdvertiserRemove( Hnd );
+#    endif
 
     UpnpPrintf( UPNP_INFO, API, __FILE__, __LINE__, "Exiting UpnpUnRegisterRootDeviceLowPower\n" );
 
@@ -1603,7 +2199,7 @@ static int GetDescDocumentAndURL( Upnp_DescType descriptionType, char *descripti
     /* Get XML doc and last modified time */
     if( descriptionType == ( enum Upnp_DescType_e )UPNPREG_URL_DESC )
     {
-        retVal = UpnpDownloadXmlDoc( description, xmlDoc );
+        retVal = UpnpLoadDescDocument( description, xmlDoc );
         if( retVal != UPNP_E_SUCCESS )
             return retVal;
         last_modified = time( NULL );
@@ -1791,21 +2387,40 @@ int UpnpSendAdvertisement( UpnpDevice_Handle Hnd, int Exp )
     return UpnpSendAdvertisementLowPower( Hnd, Exp, -1, -1, -1 );
 }
 
-int UpnpSendAdvertisementLowPower( UpnpDevice_Handle Hnd, int Exp, int PowerState, int SleepPeriod, int RegistrationState )
+/*!
+ * \brief Returns the advertisement age to use for \b Exp, leaving time to
+ * renew the advertisements before they expire.
+ */
+static int AdvertisementMaxAge(
+    /*! [in] Requested age, in seconds. */
+    int Exp )
 {
-    struct Handle_Info *SInfo  = NULL;
-    int                 retVal = 0, *ptrMx;
-    job_arg            *adEvent;
-    ThreadPoolJob       job;
-
-    memset( &job, 0, sizeof( job ) );
+    if( Exp < 1 )
+        Exp = DEFAULT_MAXAGE;
+    if( Exp <= AUTO_ADVERTISEMENT_TIME * 2 )
+        Exp = ( AUTO_ADVERTISEMENT_TIME + 1 ) * 2;
 
-    if( UpnpSdkInit != 1 )
-    {
-        return UPNP_E_FINISH;
-    }
+    return Exp;
+}
 
-    UpnpPrintf( UPNP_ALL, API, __FILE__, __LINE__, "Inside UpnpSendAdvertisementLowPower \n" );
+/*!
+ * \brief Stores the parameters of the next advertisements of a device.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_INVALID_HANDLE.
+ */
+static int SetAdvertisementState(
+    /*! [in] Handle of the device. */
+    UpnpDevice_Handle Hnd,
+    /*! [in] Age of the advertisements, from AdvertisementMaxAge(). */
+    int Exp,
+    /*! [in] PowerState as defined by UPnP Low Power. */
+    int PowerState,
+    /*! [in] SleepPeriod as defined by UPnP Low Power. */
+    int SleepPeriod,
+    /*! [in] RegistrationState as defined by UPnP Low Power. */
+    int RegistrationState )
+{
+    struct Handle_Info *SInfo = NULL;
 
     HandleLock( __FILE__, __LINE__ );
     switch( GetHandleInfo( Hnd, &SInfo ) )
@@ -1814,12 +2429,8 @@ int UpnpSendAdvertisementLowPower( UpnpDevice_Handle Hnd, int Exp, int PowerStat
             break;
         default:
             HandleUnlock( __FILE__, __LINE__ );
-            return UPNP_E_INVALID_HANDLE;
-    }
-    if( Exp < 1 )
-        Exp = DEFAULT_MAXAGE;
-    if( Exp <= AUTO_ADVERTISEMENT_TIME * 2 )
-        Exp = ( AUTO_ADVERTISEMENT_TIME + 1 ) * 2;
+            return UPNP_E_INVALID_HANDLE;
+    }
     SInfo->MaxAge     = Exp;
     SInfo->PowerState = PowerState;
     if( SleepPeriod < 0 )
@@ -1827,59 +2438,55 @@ int UpnpSendAdvertisementLowPower( UpnpDevice_Handle Hnd, int Exp, int PowerStat
     SInfo->SleepPeriod       = SleepPeriod;
     SInfo->RegistrationState = RegistrationState;
     HandleUnlock( __FILE__, __LINE__ );
-    retVal = AdvertiseAndReply( 1, Hnd, ( enum SsdpSearchType )0, ( struct sockaddr * )NULL, ( char * )NULL, ( char * )NULL, ( char * )NULL, Exp );
 
-    if( retVal != UPNP_E_SUCCESS )
-        return retVal;
-    ptrMx = ( int * )malloc( sizeof( int ) );
-    if( ptrMx == NULL )
-        return UPNP_E_OUTOF_MEMORY;
-    adEvent = ( job_arg * )malloc( sizeof( job_arg ) );
+    return UPNP_E_SUCCESS;
+}
 
-    if( adEvent == NULL )
-    {
-        free( ptrMx );
-        return UPNP_E_OUTOF_MEMORY;
-    }
-    *ptrMx                    = Exp;
-    adEvent->advertise.handle = Hnd;
-    adEvent->advertise.Event  = ptrMx;
+int UpnpSendAdvertisementLowPower( UpnpDevice_Handle Hnd, int Exp, int PowerState, int SleepPeriod, int RegistrationState )
+{
+    int retVal;
 
-    HandleLock( __FILE__, __LINE__ );
-    switch( GetHandleInfo( Hnd, &SInfo ) )
+    if( UpnpSdkInit != 1 )
     {
-        case HND_DEVICE:
-            break;
-        default:
-            HandleUnlock( __FILE__, __LINE__ );
-            free( adEvent );
-            free( ptrMx );
-            return UPNP_E_INVALID_HANDLE;
+        return UPNP_E_FINISH;
     }
-#        ifdef SSDP_PACKET_DISTRIBUTE
-    TPJobInit( &job, ( start_routine )AutoAdvertise, adEvent );
-    TPJobSetFreeFunction( &job, ( free_routine )free_advertise_arg );
-    TPJobSetPriority( &job, MED_PRIORITY );
-    if( ( retVal = TimerThreadSchedule( &gTimerThread, ( ( Exp / 2 ) - ( AUTO_ADVERTISEMENT_TIME ) ), REL_SEC, &job, SHORT_TERM, &( adEvent->advertise.eventId ) ) ) != UPNP_E_SUCCESS )
-    {
-        HandleUnlock( __FILE__, __LINE__ );
-        free_advertise_arg( adEvent );
+
+    UpnpPrintf( UPNP_ALL, API, __FILE__, __LINE__, "Inside UpnpSendAdvertisementLowPower \n" );
+
+    Exp    = AdvertisementMaxAge( Exp );
+    retVal = SetAdvertisementState( Hnd, Exp, PowerState, SleepPeriod, RegistrationState );
+    if( retVal != UPNP_E_SUCCESS )
         return retVal;
-    }
-#        else
-    TPJobInit( &job, ( start_routine )AutoAdvertise, adEvent );
-    TPJobSetFreeFunction( &job, ( free_routine )free_advertise_arg );
-    TPJobSetPriority( &job, MED_PRIORITY );
-    if( ( retVal = TimerThreadSchedule( &gTimerThread, Exp - AUTO_ADVERTISEMENT_TIME, REL_SEC, &job, SHORT_TERM, &( adEvent->advertise.eventId ) ) ) != UPNP_E_SUCCESS )
+    /* Announced now, then renewed by the advertisement scheduler. */
+    retVal = SsdpAdvertiserAdd( &Hnd, ( size_t )1 );
+    UpnpPrintf( UPNP_ALL, API, __FILE__, __LINE__, "Exiting UpnpSendAdvertisementLowPower \n" );
+
+    return retVal;
+}
+
+int UpnpSendAdvertisements( const UpnpDevice_Handle *Hnds, size_t Count, int Exp )
+{
+    size_t i;
+    int    found = 0;
+    int    retVal;
+
+    if( UpnpSdkInit != 1 )
+        return UPNP_E_FINISH;
+    if( Hnds == NULL || Count == ( size_t )0 )
+        return UPNP_E_INVALID_PARAM;
+    UpnpPrintf( UPNP_ALL, API, __FILE__, __LINE__, "Inside UpnpSendAdvertisements \n" );
+
+    Exp = AdvertisementMaxAge( Exp );
+    for( i = 0; i < Count; i++ )
     {
-        HandleUnlock( __FILE__, __LINE__ );
-        free_advertise_arg( adEvent );
-        return retVal;
+        if( SetAdvertisementState( Hnds[ i ], Exp, -1, -1, -1 ) == UPNP_E_SUCCESS )
+            found = 1;
     }
-#        endif
-
-    HandleUnlock( __FILE__, __LINE__ );
-    UpnpPrintf( UPNP_ALL, API, __FILE__, __LINE__, "Exiting UpnpSendAdvertisementLowPower \n" );
+    if( !found )
+        return UPNP_E_INVALID_HANDLE;
+    /* All the devices in one pass, with one pause between the copies. */
+    retVal = SsdpAdvertiserAdd( Hnds, Count );
+    UpnpPrintf( UPNP_ALL, API, __FILE__, __LINE__, "Exiting UpnpSendAdvertisements \n" );
 
     return retVal;
 }
@@ -2012,11 +2619,41 @@ int UpnpSetMaxSubscriptionTimeOut( UpnpDevice_Handle Hnd, int MaxSubscriptionTim
 #    endif /* INCLUDE_DEVICE_APIS */
 
 #    ifdef INCLUDE_CLIENT_APIS
+/*!
+ * \brief Reports the result of an asynchronous subscription to the
+ * application.
+ *
+ * Takes ownership of the UpnpNonblockParam.
+ */
+static void UpnpSubscribeAsyncComplete(
+    /*! [in] Result of the subscription. */
+    int errCode,
+    /*! [in] SID of the subscription. */
+    const UpnpString *Sid,
+    /*! [in] Duration granted by the service. */
+    int TimeOut,
+    /*! [in] The UpnpNonblockParam of the request. */
+    void *Cookie )
+{
+    struct UpnpNonblockParam *Param = ( struct UpnpNonblockParam * )Cookie;
+    UpnpEventSubscribe       *evt   = UpnpEventSubscribe_new();
+
+    UpnpEventSubscribe_strcpy_PublisherUrl( evt, Param->Url );
+    UpnpEventSubscribe_set_ErrCode( evt, errCode );
+    UpnpEventSubscribe_set_TimeOut( evt, TimeOut );
+    UpnpEventSubscribe_set_SID( evt, Sid );
+    Param->Fun( UPNP_EVENT_SUBSCRIBE_COMPLETE, evt, Param->Cookie );
+    UpnpEventSubscribe_delete( evt );
+    free( Param );
+}
+
 int UpnpSubscribeAsync( UpnpClient_Handle Hnd, const char *EvtUrl_const, int TimeOut, Upnp_FunPtr Fun, const void *Cookie_const )
 {
     struct Handle_Info       *SInfo = NULL;
     struct UpnpNonblockParam *Param;
     char                     *EvtUrl = ( char * )EvtUrl_const;
+    UpnpString               *Url;
+    int                       retVal;
     ThreadPoolJob             job;
 
     memset( &job, 0, sizeof( job ) );
@@ -2068,6 +2705,21 @@ int UpnpSubscribeAsync( UpnpClient_Handle Hnd, const char *EvtUrl_const, int Tim
     Param->Fun     = Fun;
     Param->Cookie  = ( void * )Cookie_const;
 
+    /* No thread waits for the service, unless the request cannot be started:
+     * then a thread subscribes the blocking way and reports the error. */
+    Url = UpnpString_new();
+    if( Url != NULL )
+    {
+        UpnpString_set_String( Url, Param->Url );
+        retVal = genaSubscribeAsync( Hnd, Url, TimeOut, UpnpSubscribeAsyncComplete, ( free_routine )free, Param );
+        UpnpString_delete( Url );
+        if( retVal == UPNP_E_SUCCESS )
+        {
+            UpnpPrintf( UPNP_ALL, API, __FILE__, __LINE__, "Exiting UpnpSubscribeAsync\n" );
+            return UPNP_E_SUCCESS;
+        }
+    }
+
     TPJobInit( &job, ( start_routine )UpnpThreadDistribution, Param );
     TPJobSetFreeFunction( &job, ( free_routine )free );
     TPJobSetPriority( &job, MED_PRIORITY );
@@ -2648,6 +3300,59 @@ exit_function:
 
 #if EXCLUDE_SOAP == 0
 #    ifdef INCLUDE_CLIENT_APIS
+/*!
+ * \brief Reports the result of an asynchronous action to the application.
+ *
+ * Takes ownership of \b actionResult and of the UpnpNonblockParam.
+ */
+static void UpnpActionAsyncComplete(
+    /*! [in] Result of the action. */
+    int errCode,
+    /*! [in] SOAP response node, or NULL. */
+    IXML_Document *actionResult,
+    /*! [in] The UpnpNonblockParam of the request. */
+    void *Cookie )
+{
+    struct UpnpNonblockParam *Param = ( struct UpnpNonblockParam * )Cookie;
+    UpnpActionComplete       *Evt   = UpnpActionComplete_new();
+
+    UpnpActionComplete_set_ErrCode( Evt, errCode );
+    UpnpActionComplete_set_ActionRequest( Evt, Param->Act );
+    UpnpActionComplete_set_ActionResult( Evt, actionResult );
+    UpnpActionComplete_strcpy_CtrlUrl( Evt, Param->Url );
+    Param->Fun( UPNP_CONTROL_ACTION_COMPLETE, Evt, Param->Cookie );
+    UpnpActionComplete_delete( Evt );
+    ixmlDocument_free( actionResult );
+    free_action_arg( ( job_arg * )Param );
+}
+
+/*!
+ * \brief Reports the result of an asynchronous state variable query to the
+ * application.
+ *
+ * Takes ownership of \b currentVal and of the UpnpNonblockParam.
+ */
+static void UpnpStateVarAsyncComplete(
+    /*! [in] Result of the query. */
+    int errCode,
+    /*! [in] Value of the variable, or NULL. */
+    DOMString currentVal,
+    /*! [in] The UpnpNonblockParam of the request. */
+    void *Cookie )
+{
+    struct UpnpNonblockParam *Param = ( struct UpnpNonblockParam * )Cookie;
+    UpnpStateVarComplete     *Evt   = UpnpStateVarComplete_new();
+
+    UpnpStateVarComplete_set_ErrCode( Evt, errCode );
+    UpnpStateVarComplete_strcpy_CtrlUrl( Evt, Param->Url );
+    UpnpStateVarComplete_strcpy_StateVarName( Evt, Param->VarName );
+    UpnpStateVarComplete_set_CurrentVal( Evt, currentVal );
+    Param->Fun( UPNP_CONTROL_GET_VAR_COMPLETE, Evt, Param->Cookie );
+    UpnpStateVarComplete_delete( Evt );
+    ixmlFreeDOMString( currentVal );
+    free( Param );
+}
+
 int UpnpSendAction( UpnpClient_Handle Hnd, const char *ActionURL_const, const char *ServiceType_const, const char *DevUDN_const, IXML_Document *Action, IXML_Document **RespNodePtr )
 {
     struct Handle_Info *SInfo       = NULL;
@@ -2747,6 +3452,121 @@ int UpnpSendActionEx( UpnpClient_Handle Hnd, const char *ActionURL_const, const
     return retVal;
 }
 
+/*!
+ * \brief Checks the input arguments of UpnpSendActionArgs() and
+ * UpnpSendActionBind().
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_INVALID_PARAM.
+ */
+static int CheckActionArguments( const char *ActionName, const UpnpActionArgument *InArgs, size_t InCount )
+{
+    size_t i;
+
+    if( ActionName == NULL || *ActionName == '\0' || ( InArgs == NULL && InCount != 0 ) )
+    {
+        return UPNP_E_INVALID_PARAM;
+    }
+    for( i = 0; i < InCount; i++ )
+    {
+        if( InArgs[ i ].name == NULL || *InArgs[ i ].name == '\0' || InArgs[ i ].value == NULL )
+        {
+            return UPNP_E_INVALID_PARAM;
+        }
+    }
+
+    return UPNP_E_SUCCESS;
+}
+
+int UpnpSendActionArgs( UpnpClient_Handle Hnd, const char *ActionURL_const, const char *ServiceType_const, const char *ActionName, const UpnpActionArgument *InArgs, size_t InCount, UpnpActionArgument **OutArgs, size_t *OutCount )
+{
+    struct Handle_Info *SInfo       = NULL;
+    int                 retVal      = 0;
+    char               *ActionURL   = ( char * )ActionURL_const;
+    char               *ServiceType = ( char * )ServiceType_const;
+
+    if( UpnpSdkInit != 1 )
+    {
+        return UPNP_E_FINISH;
+    }
+
+    UpnpPrintf( UPNP_ALL, API, __FILE__, __LINE__, "Inside UpnpSendActionArgs\n" );
+
+    HandleReadLock( __FILE__, __LINE__ );
+    switch( GetHandleInfo( Hnd, &SInfo ) )
+    {
+        case HND_CLIENT:
+            break;
+        default:
+            HandleUnlock( __FILE__, __LINE__ );
+            return UPNP_E_INVALID_HANDLE;
+    }
+    HandleUnlock( __FILE__, __LINE__ );
+
+    if( ActionURL == NULL || ServiceType == NULL || OutArgs == NULL || OutCount == NULL )
+    {
+        return UPNP_E_INVALID_PARAM;
+    }
+    if( CheckActionArguments( ActionName, InArgs, InCount ) != UPNP_E_SUCCESS )
+    {
+        return UPNP_E_INVALID_PARAM;
+    }
+
+    retVal = SoapSendActionArgs( ActionURL, ServiceType, ActionName, InArgs, InCount, OutArgs, OutCount );
+
+    UpnpPrintf( UPNP_ALL, API, __FILE__, __LINE__, "Exiting UpnpSendActionArgs\n" );
+
+    return retVal;
+}
+
+int UpnpSendActionBind( UpnpClient_Handle Hnd, const char *ActionURL_const, const char *ServiceType_const, const char *ActionName, const UpnpActionArgument *InArgs, size_t InCount, const UpnpArgumentBinding *Bindings, size_t BindingCount, void *Out )
+{
+    struct Handle_Info *SInfo       = NULL;
+    int                 retVal      = 0;
+    char               *ActionURL   = ( char * )ActionURL_const;
+    char               *ServiceType = ( char * )ServiceType_const;
+    size_t              i;
+
+    if( UpnpSdkInit != 1 )
+    {
+        return UPNP_E_FINISH;
+    }
+
+    UpnpPrintf( UPNP_ALL, API, __FILE__, __LINE__, "Inside UpnpSendActionBind\n" );
+
+    HandleReadLock( __FILE__, __LINE__ );
+    switch( GetHandleInfo( Hnd, &SInfo ) )
+    {
+        case HND_CLIENT:
+            break;
+        default:
+            HandleUnlock( __FILE__, __LINE__ );
+            return UPNP_E_INVALID_HANDLE;
+    }
+    HandleUnlock( __FILE__, __LINE__ );
+
+    if( ActionURL == NULL || ServiceType == NULL || ( ( Bindings == NULL || Out == NULL ) && BindingCount != 0 ) )
+    {
+        return UPNP_E_INVALID_PARAM;
+    }
+    if( CheckActionArguments( ActionName, InArgs, InCount ) != UPNP_E_SUCCESS )
+    {
+        return UPNP_E_INVALID_PARAM;
+    }
+    for( i = 0; i < BindingCount; i++ )
+    {
+        if( Bindings[ i ].name == NULL || ( int )Bindings[ i ].type < UPNP_ARG_STRING || ( int )Bindings[ i ].type > UPNP_ARG_BOOLEAN )
+        {
+            return UPNP_E_INVALID_PARAM;
+        }
+    }
+
+    retVal = SoapSendActionBind( ActionURL, ServiceType, ActionName, InArgs, InCount, Bindings, BindingCount, Out );
+
+    UpnpPrintf( UPNP_ALL, API, __FILE__, __LINE__, "Exiting UpnpSendActionBind\n" );
+
+    return retVal;
+}
+
 int UpnpSendActionAsync( UpnpClient_Handle Hnd, const char *ActionURL_const, const char *ServiceType_const, const char *DevUDN_const, IXML_Document *Act, Upnp_FunPtr Fun, const void *Cookie_const )
 {
     int                       rc;
@@ -2825,6 +3645,14 @@ int UpnpSendActionAsync( UpnpClient_Handle Hnd, const char *ActionURL_const, con
     Param->Cookie = ( void * )Cookie_const;
     Param->Fun    = Fun;
 
+    /* No thread waits for the device, unless the request cannot be started:
+     * then a thread sends it the blocking way and reports the error. */
+    if( SoapSendActionAsync( Param->Url, Param->ServiceType, NULL, Param->Act, UpnpActionAsyncComplete, ( free_routine )free_action_arg, Param ) == UPNP_E_SUCCESS )
+    {
+        UpnpPrintf( UPNP_ALL, API, __FILE__, __LINE__, "Exiting UpnpSendActionAsync \n" );
+        return UPNP_E_SUCCESS;
+    }
+
     TPJobInit( &job, ( start_routine )UpnpThreadDistribution, Param );
     TPJobSetFreeFunction( &job, ( free_routine )free_action_arg );
 
@@ -2946,6 +3774,12 @@ int UpnpSendActionExAsync( UpnpClient_Handle Hnd, const char *ActionURL_const, c
     Param->Cookie = ( void * )Cookie_const;
     Param->Fun    = Fun;
 
+    if( SoapSendActionAsync( Param->Url, Param->ServiceType, Param->Header, Param->Act, UpnpActionAsyncComplete, ( free_routine )free_action_arg, Param ) == UPNP_E_SUCCESS )
+    {
+        UpnpPrintf( UPNP_ALL, API, __FILE__, __LINE__, "Exiting UpnpSendActionAsync\n" );
+        return UPNP_E_SUCCESS;
+    }
+
     TPJobInit( &job, ( start_routine )UpnpThreadDistribution, Param );
     TPJobSetFreeFunction( &job, ( free_routine )free_action_arg );
 
@@ -3009,6 +3843,12 @@ int UpnpGetServiceVarStatusAsync( UpnpClient_Handle Hnd, const char *ActionURL_c
     Param->Fun    = Fun;
     Param->Cookie = ( void * )Cookie_const;
 
+    if( SoapGetServiceVarStatusAsync( Param->Url, Param->VarName, UpnpStateVarAsyncComplete, ( free_routine )free, Param ) == UPNP_E_SUCCESS )
+    {
+        UpnpPrintf( UPNP_ALL, API, __FILE__, __LINE__, "Exiting UpnpGetServiceVarStatusAsync\n" );
+        return UPNP_E_SUCCESS;
+    }
+
     TPJobInit( &job, ( start_routine )UpnpThreadDistribution, Param );
     TPJobSetFreeFunction( &job, ( free_routine )free );
 
@@ -3504,10 +4344,23 @@ int UpnpGetIfInfo( const char *IfName )
     /* cycle through available interfaces and their addresses. */
     for( ifa = ifap; ifa != NULL; ifa = ifa->ifa_next )
     {
-        /* Skip LOOPBACK interfaces, DOWN interfaces, */
-        /* interfaces without address (e.g. bonded)*/
-        /* and interfaces that don't support MULTICAST. */
-        if( !ifa->ifa_addr || ( ifa->ifa_flags & IFF_LOOPBACK ) || ( !( ifa->ifa_flags & IFF_UP ) ) || ( !( ifa->ifa_flags & IFF_MULTICAST ) ) )
+        /* Skip DOWN interfaces and interfaces without address */
+        /* (e.g. bonded). Skip LOOPBACK interfaces and interfaces */
+        /* that don't support MULTICAST unless the loopback */
+        /* interface was asked for by name, which is how a device */
+        /* and its control points are tested on a single host. */
+        if( !ifa->ifa_addr || ( !( ifa->ifa_flags & IFF_UP ) ) )
+        {
+            continue;
+        }
+        if( ifa->ifa_flags & IFF_LOOPBACK )
+        {
+            if( IfName == NULL )
+            {
+                continue;
+            }
+        }
+        else if( !( ifa->ifa_flags & IFF_MULTICAST ) )
         {
             continue;
         }
@@ -3665,9 +4518,8 @@ void UpnpThreadDistribution( struct UpnpNonblockParam *Param )
 #    if EXCLUDE_SOAP == 0
         case ACTION:
         {
-            UpnpActionComplete *Evt          = UpnpActionComplete_new();
-            IXML_Document      *actionResult = NULL;
-            int                 errCode;
+            IXML_Document *actionResult = NULL;
+            int            errCode;
             if( Param->Header )
             {
                 errCode = SoapSendActionEx( Param->Url, Param->ServiceType, Param->Header, Param->Act, &actionResult );
@@ -3676,28 +4528,14 @@ void UpnpThreadDistribution( struct UpnpNonblockParam *Param )
             {
                 errCode = SoapSendAction( Param->Url, Param->ServiceType, Param->Act, &actionResult );
             }
-            UpnpActionComplete_set_ErrCode( Evt, errCode );
-            UpnpActionComplete_set_ActionRequest( Evt, Param->Act );
-            UpnpActionComplete_set_ActionResult( Evt, actionResult );
-            UpnpActionComplete_strcpy_CtrlUrl( Evt, Param->Url );
-            Param->Fun( UPNP_CONTROL_ACTION_COMPLETE, Evt, Param->Cookie );
-            UpnpActionComplete_delete( Evt );
-            ixmlDocument_free( actionResult );
-            free_action_arg( ( job_arg * )Param );
+            UpnpActionAsyncComplete( errCode, actionResult, Param );
             break;
         }
         case STATUS:
         {
-            UpnpStateVarComplete *Evt        = UpnpStateVarComplete_new();
-            DOMString             currentVal = NULL;
-            int                   errCode    = SoapGetServiceVarStatus( Param->Url, Param->VarName, &currentVal );
-            UpnpStateVarComplete_set_ErrCode( Evt, errCode );
-            UpnpStateVarComplete_strcpy_CtrlUrl( Evt, Param->Url );
-            UpnpStateVarComplete_strcpy_StateVarName( Evt, Param->VarName );
-            UpnpStateVarComplete_set_CurrentVal( Evt, currentVal );
-            Param->Fun( UPNP_CONTROL_GET_VAR_COMPLETE, Evt, Param->Cookie );
-            free( Param );
-            UpnpStateVarComplete_delete( Evt );
+            DOMString currentVal = NULL;
+            int       errCode    = SoapGetServiceVarStatus( Param->Url, Param->VarName, &currentVal );
+            UpnpStateVarAsyncComplete( errCode, currentVal, Param );
             break;
         }
 #    endif /* EXCLUDE_SOAP == 0 */
@@ -3879,18 +4717,6 @@ int PrintHandleInfo( UpnpClient_Handle Hnd )
     return UPNP_E_SUCCESS;
 }
 
-#ifdef INCLUDE_DEVICE_APIS
-#    if EXCLUDE_SSDP == 0
-void AutoAdvertise( void *input )
-{
-    job_arg *arg = ( job_arg * )input;
-
-    UpnpSendAdvertisement( arg->advertise.handle, *( ( int * )arg->advertise.Event ) );
-    free_advertise_arg( arg );
-}
-#    endif /* EXCLUDE_SSDP == 0 */
-#endif     /* INCLUDE_DEVICE_APIS */
-
 #ifdef INTERNAL_WEB_SERVER
 int UpnpSetWebServerRootDir( const char *rootDir )
 {
@@ -3927,6 +4753,10 @@ int UpnpAddVirtualDir( const char *newDirName, const void *cookie, const void **
     virtualDirList *pLast;
     virtualDirList *pCurVirtualDir;
     char            dirName[ NAME_SIZE ];
+#ifdef INTERNAL_WEB_SERVER
+    const void     *prevCookie;
+    int             ret_code;
+#endif /* INTERNAL_WEB_SERVER */
 
     memset( dirName, 0, sizeof( dirName ) );
     if( UpnpSdkInit != 1 )
@@ -3960,10 +4790,25 @@ int UpnpAddVirtualDir( const char *newDirName, const void *cookie, const void **
         /* already has this entry */
         if( strcmp( pCurVirtualDir->dirName, dirName ) == 0 )
         {
+#ifdef INTERNAL_WEB_SERVER
+            prevCookie = pCurVirtualDir->cookie;
+            pCurVirtualDir->cookie = cookie;
+            ret_code = web_server_update_virtual_dirs();
+            if( ret_code != UPNP_E_SUCCESS )
+            {
+                /* the web server still serves the previous cookie */
+                pCurVirtualDir->cookie = prevCookie;
+                return ret_code;
+            }
+            if( oldcookie != NULL )
+                *oldcookie = prevCookie;
+            return UPNP_E_SUCCESS;
+#else
             if( oldcookie != NULL )
                 *oldcookie = pCurVirtualDir->cookie;
             pCurVirtualDir->cookie = cookie;
             return UPNP_E_SUCCESS;
+#endif /* INTERNAL_WEB_SERVER */
         }
 
         pCurVirtualDir = pCurVirtualDir->next;
@@ -3982,6 +4827,7 @@ int UpnpAddVirtualDir( const char *newDirName, const void *cookie, const void **
     strncpy( pNewVirtualDir->dirName, dirName, sizeof( pNewVirtualDir->dirName ) - 1 );
     *( pNewVirtualDir->dirName + strlen( dirName ) ) = 0;
 
+    pLast = NULL;
     if( pVirtualDirList == NULL )
     { /* first virtual dir */
         pVirtualDirList = pNewVirtualDir;
@@ -3996,7 +4842,21 @@ int UpnpAddVirtualDir( const char *newDirName, const void *cookie, const void **
         pLast->next = pNewVirtualDir;
     }
 
+#ifdef INTERNAL_WEB_SERVER
+    ret_code = web_server_update_virtual_dirs();
+    if( ret_code != UPNP_E_SUCCESS )
+    {
+        /* not in the index of the web server, do not list it either */
+        if( pLast == NULL )
+            pVirtualDirList = NULL;
+        else
+            pLast->next = NULL;
+        free( pNewVirtualDir );
+    }
+    return ret_code;
+#else
     return UPNP_E_SUCCESS;
+#endif /* INTERNAL_WEB_SERVER */
 }
 
 int UpnpRemoveVirtualDir( const char *dirName )
@@ -4026,6 +4886,9 @@ int UpnpRemoveVirtualDir( const char *dirName )
         pPrev           = pVirtualDirList;
         pVirtualDirList = pVirtualDirList->next;
         free( pPrev );
+#ifdef INTERNAL_WEB_SERVER
+        web_server_update_virtual_dirs();
+#endif /* INTERNAL_WEB_SERVER */
         return UPNP_E_SUCCESS;
     }
 
@@ -4049,7 +4912,12 @@ int UpnpRemoveVirtualDir( const char *dirName )
     }
 
     if( found == 1 )
+    {
+#ifdef INTERNAL_WEB_SERVER
+        web_server_update_virtual_dirs();
+#endif /* INTERNAL_WEB_SERVER */
         return UPNP_E_SUCCESS;
+    }
     else
         return UPNP_E_INVALID_PARAM;
 }
@@ -4075,6 +4943,9 @@ void UpnpRemoveAllVirtualDirs( void )
     }
 
     pVirtualDirList = NULL;
+#ifdef INTERNAL_WEB_SERVER
+    web_server_update_virtual_dirs();
+#endif /* INTERNAL_WEB_SERVER */
 }
 
 int UpnpEnableWebserver( int enable )
@@ -4133,6 +5004,54 @@ void UpnpSetAllowLiteralHostRedirection( int enable )
     gAllowLiteralHostRedirection = enable;
 }
 
+void UpnpSetHostResolver( UpnpHostResolver resolver, void *cookie )
+{
+    resolver_SetHostResolver( resolver, cookie );
+}
+
+void UpnpSetAsyncHostResolution( int enable )
+{
+    resolver_SetAsync( enable );
+}
+
+int UpnpSetThreadPoolPlacement( Upnp_ThreadPool pool, const char *cpus, int numaNode, int localJobs )
+{
+    ThreadPoolAttr attr;
+
+    if( UpnpSdkInit == 1 )
+    {
+        return UPNP_E_INIT;
+    }
+    if( pool < UPNP_THREADPOOL_SEND || pool > UPNP_THREADPOOL_TIMER )
+    {
+        return UPNP_E_INVALID_PARAM;
+    }
+    TPAttrInit( &attr );
+    if( TPAttrSetCpuAffinity( &attr, cpus ) != 0 ||
+        TPAttrSetNumaNode( &attr, numaNode ) != 0 )
+    {
+        return UPNP_E_INVALID_PARAM;
+    }
+    TPAttrSetLocalJobs( &attr, localJobs );
+    gThreadPoolPlacement[ pool ] = attr.placement;
+    gThreadPoolPlaced[ pool ] = 1;
+
+    return UPNP_E_SUCCESS;
+}
+
+int UpnpSetMiniServerShards( int shards )
+{
+    if( UpnpSdkInit == 1 )
+    {
+        return UPNP_E_INIT;
+    }
+#if EXCLUDE_MINISERVER == 0
+    return SetMiniServerShards( shards );
+#else
+    return shards == 1 ? UPNP_E_SUCCESS : UPNP_E_INVALID_PARAM;
+#endif
+}
+
 int UpnpVirtualDir_set_GetInfoCallback( VDCallback_GetInfo callback )
 {
     int ret = UPNP_E_SUCCESS;
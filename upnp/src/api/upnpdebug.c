@@ -38,6 +38,7 @@
 #include "ithread.h"
 #include "ixml.h"
 #include "upnp.h"
+#include "upnpatomic.h"
 #include "upnpdebug.h"
 
 #include <errno.h>
@@ -64,6 +65,56 @@ static int initwascalled;
 /* Name of the output file. We keep a copy */
 static char *fileName;
 
+/*! A message waiting for the asynchronous log writer. */
+typedef struct
+{
+	time_t when;
+	unsigned long thread;
+	const char *file;
+	int line;
+	Upnp_LogLevel level;
+	Dbg_Module module;
+	char msg[LOG_ASYNC_MSG_SIZE];
+} LogRecord;
+
+/*! Single producer, single consumer ring of messages owned by one thread. */
+typedef struct LogRing
+{
+	/*! Next slot to fill, only advanced by the owner thread. */
+	upnp_atomic_t head;
+	/*! Next slot to write out, only advanced by the writer thread. */
+	upnp_atomic_t tail;
+	/*! Set when the owner thread has exited. */
+	upnp_atomic_t orphan;
+	/*! Set by the owner thread while it queues a message. */
+	upnp_atomic_t busy;
+	/*! Next ring, protected by gLogRingsMutex. */
+	struct LogRing *next;
+	LogRecord slots[LOG_ASYNC_RING_SLOTS];
+} LogRing;
+
+/* Set if the user called UpnpSetLogAsync() with a nonzero value */
+static int asyncwascalled;
+/* Set while the writer thread runs, UpnpPrintf() reads it without lock */
+static upnp_atomic_t asyncRunning;
+/* Never deleted, so that the ring of a thread is freed when it exits even
+ * after UpnpCloseLog() */
+static ithread_key_t gLogRingKey;
+static int gLogRingKeyCreated;
+static ithread_t gLogWriter;
+static upnp_atomic_t gLogStop;
+static upnp_atomic_t gLogDropped;
+/* Number of dropped messages already reported in the log */
+static unsigned long gLogDropReported;
+/* All the rings. A ring is only freed once its thread has exited. */
+static LogRing *gLogRings;
+/* Protects gLogRings. Never destroyed, as an exiting thread may free its
+ * ring after UpnpCloseLog(). */
+static ithread_mutex_t gLogRingsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void *UpnpLogWriter(void *arg);
+static void UpnpLogRingExit(void *arg);
+
 /* This is called from UpnpInit2(). So the user must call setLogFileName()
  * before. This can be called again, for example to rotate the log
  * file, and we try to avoid multiple calls to the mutex init, with a
@@ -79,6 +130,8 @@ int UpnpInitLog(void)
 		return UPNP_E_SUCCESS;
 	}
 
+	/* The writer thread may be writing to the file being rotated. */
+	ithread_mutex_lock(&GlobalDebugMutex);
 	if (fp) {
 		if (is_stderr == 0) {
 			fclose(fp);
@@ -108,6 +161,22 @@ int UpnpInitLog(void)
 		fp = stderr;
 		is_stderr = 1;
 	}
+	ithread_mutex_unlock(&GlobalDebugMutex);
+	if (asyncwascalled && !upnp_atomic_load(&asyncRunning)) {
+		if (!gLogRingKeyCreated) {
+			if (ithread_key_create(&gLogRingKey, UpnpLogRingExit) !=
+				0) {
+				return UPNP_E_INIT_FAILED;
+			}
+			gLogRingKeyCreated = 1;
+		}
+		upnp_atomic_store(&gLogStop, 0);
+		if (ithread_create(&gLogWriter, NULL, UpnpLogWriter, NULL) !=
+			0) {
+			return UPNP_E_INIT_FAILED;
+		}
+		upnp_atomic_store(&asyncRunning, 1);
+	}
 	return UPNP_E_SUCCESS;
 }
 
@@ -117,12 +186,48 @@ void UpnpSetLogLevel(Upnp_LogLevel log_level)
 	setlogwascalled = 1;
 }
 
+void UpnpSetLogAsync(int enable) { asyncwascalled = enable != 0; }
+
+unsigned long UpnpGetLogDropCount(void)
+{
+	return (unsigned long)upnp_atomic_load(&gLogDropped);
+}
+
 void UpnpCloseLog(void)
 {
+	LogRing *ring;
+	int busy;
+
 	if (!initwascalled) {
 		return;
 	}
 
+	if (upnp_atomic_load(&asyncRunning)) {
+		/* New messages take the synchronous path from now on, wait for
+		 * the threads still queuing one to their ring. A thread only
+		 * marks its ring busy once after this. */
+		upnp_atomic_store(&asyncRunning, 0);
+		do {
+			busy = 0;
+			ithread_mutex_lock(&gLogRingsMutex);
+			for (ring = gLogRings; ring; ring = ring->next) {
+				if (upnp_atomic_load(&ring->busy)) {
+					busy = 1;
+					break;
+				}
+			}
+			ithread_mutex_unlock(&gLogRingsMutex);
+			if (busy) {
+				imillisleep(1);
+			}
+		} while (busy);
+		/* The writer drains all the rings and frees those of the
+		 * exited threads before exiting, the others are kept for
+		 * their thread. */
+		upnp_atomic_store(&gLogStop, 1);
+		ithread_join(gLogWriter, NULL);
+	}
+
 	/* Calling lock() assumes that someone called UpnpInitLog(), but
 	 * this is reasonable as it is called from UpnpInit2(). We risk a
 	 * crash if we do this without a lock.*/
@@ -167,14 +272,27 @@ static int DebugAtThisLevel(Upnp_LogLevel DLevel, Dbg_Module Module)
 		       (Module == HTTP && DEBUG_HTTP));
 }
 
-static void UpnpDisplayFileAndLine(FILE *fp,
+/*!
+ * \brief Returns an identifier of the calling thread for the log header.
+ */
+static unsigned long UpnpLogThreadId(void)
+{
+#ifdef __PTW32_DLLPORT
+	return *(unsigned long int *)ithread_self().p;
+#else
+	return (unsigned long int)ithread_self();
+#endif
+}
+
+static void UpnpDisplayHeader(FILE *fp,
+	time_t now,
+	unsigned long thread,
 	const char *DbgFileName,
 	int DbgLineNo,
 	Upnp_LogLevel DLevel,
 	Dbg_Module Module)
 {
 	char timebuf[26];
-	time_t now = time(NULL);
 	const char *smod;
 #if 0
 	char *slev;
@@ -245,17 +363,190 @@ static void UpnpDisplayFileAndLine(FILE *fp,
 		timebuf,
 		smod,
 		slev,
-#ifdef __PTW32_DLLPORT
-		*(unsigned long int *)ithread_self().p
-#else
-		(unsigned long int)ithread_self()
-#endif
-		,
+		thread,
 		DbgFileName,
 		DbgLineNo);
+}
+
+static void UpnpDisplayFileAndLine(FILE *fp,
+	const char *DbgFileName,
+	int DbgLineNo,
+	Upnp_LogLevel DLevel,
+	Dbg_Module Module)
+{
+	UpnpDisplayHeader(fp,
+		time(NULL),
+		UpnpLogThreadId(),
+		DbgFileName,
+		DbgLineNo,
+		DLevel,
+		Module);
 	fflush(fp);
 }
 
+/*!
+ * \brief Marks the ring of an exiting thread so that the writer frees it once
+ * it is drained, or frees it if the writer is stopped.
+ */
+static void UpnpLogRingExit(void *arg)
+{
+	LogRing *ring = (LogRing *)arg;
+	LogRing **prev;
+
+	ithread_mutex_lock(&gLogRingsMutex);
+	if (upnp_atomic_load(&asyncRunning)) {
+		upnp_atomic_store(&ring->orphan, 1);
+	} else {
+		/* Drained when the writer stopped. */
+		for (prev = &gLogRings; *prev; prev = &(*prev)->next) {
+			if (*prev == ring) {
+				*prev = ring->next;
+				break;
+			}
+		}
+		free(ring);
+	}
+	ithread_mutex_unlock(&gLogRingsMutex);
+}
+
+/*!
+ * \brief Queues a message in the ring of the calling thread, or drops it if
+ * the ring is full.
+ *
+ * \return 0, or -1 if the writer is stopped and the message is not queued.
+ */
+static int UpnpPrintfAsync(Upnp_LogLevel DLevel,
+	Dbg_Module Module,
+	const char *DbgFileName,
+	int DbgLineNo,
+	const char *FmtStr,
+	va_list ArgList)
+{
+	LogRing *ring;
+	LogRecord *rec;
+	unsigned long head;
+
+	ring = (LogRing *)ithread_getspecific(gLogRingKey);
+	if (ring == NULL) {
+		ring = (LogRing *)calloc((size_t)1, sizeof(LogRing));
+		if (ring == NULL) {
+			upnp_atomic_inc(&gLogDropped);
+			return 0;
+		}
+		ithread_mutex_lock(&gLogRingsMutex);
+		ring->next = gLogRings;
+		gLogRings = ring;
+		ithread_mutex_unlock(&gLogRingsMutex);
+		ithread_setspecific(gLogRingKey, ring);
+	}
+	/* Checked again once busy, UpnpCloseLog() stops the writer only
+	 * when no ring is busy. */
+	upnp_atomic_store(&ring->busy, 1);
+	if (!upnp_atomic_load(&asyncRunning)) {
+		upnp_atomic_store(&ring->busy, 0);
+		return -1;
+	}
+	head = (unsigned long)upnp_atomic_load(&ring->head);
+	if (head - (unsigned long)upnp_atomic_load(&ring->tail) >=
+		LOG_ASYNC_RING_SLOTS) {
+		upnp_atomic_inc(&gLogDropped);
+		upnp_atomic_store(&ring->busy, 0);
+		return 0;
+	}
+	rec = &ring->slots[head % LOG_ASYNC_RING_SLOTS];
+	rec->when = time(NULL);
+	rec->thread = UpnpLogThreadId();
+	rec->file = DbgFileName;
+	rec->line = DbgLineNo;
+	rec->level = DLevel;
+	rec->module = Module;
+	vsnprintf(rec->msg, sizeof(rec->msg), FmtStr, ArgList);
+	upnp_atomic_store(&ring->head, (long)(head + 1));
+	upnp_atomic_store(&ring->busy, 0);
+
+	return 0;
+}
+
+/*!
+ * \brief Writes out all the queued messages and frees the rings of exited
+ * threads.
+ *
+ * \return The number of messages written.
+ */
+static int UpnpLogDrain(void)
+{
+	LogRing **prev;
+	LogRing *ring;
+	LogRecord *rec;
+	unsigned long tail;
+	unsigned long dropped;
+	int written = 0;
+
+	ithread_mutex_lock(&GlobalDebugMutex);
+	ithread_mutex_lock(&gLogRingsMutex);
+	prev = &gLogRings;
+	while ((ring = *prev) != NULL) {
+		int orphan = (int)upnp_atomic_load(&ring->orphan);
+
+		tail = (unsigned long)upnp_atomic_load(&ring->tail);
+		while (tail != (unsigned long)upnp_atomic_load(&ring->head)) {
+			rec = &ring->slots[tail % LOG_ASYNC_RING_SLOTS];
+			if (fp) {
+				UpnpDisplayHeader(fp,
+					rec->when,
+					rec->thread,
+					rec->file,
+					rec->line,
+					rec->level,
+					rec->module);
+				fputs(rec->msg, fp);
+			}
+			upnp_atomic_store(&ring->tail, (long)++tail);
+			written++;
+		}
+		if (orphan) {
+			*prev = ring->next;
+			free(ring);
+		} else {
+			prev = &ring->next;
+		}
+	}
+	ithread_mutex_unlock(&gLogRingsMutex);
+	dropped = (unsigned long)upnp_atomic_load(&gLogDropped);
+	if (dropped != gLogDropReported && fp) {
+		fprintf(fp,
+			"UPNP: %lu log messages dropped\n",
+			dropped - gLogDropReported);
+		gLogDropReported = dropped;
+		written++;
+	}
+	if (written && fp) {
+		fflush(fp);
+	}
+	ithread_mutex_unlock(&GlobalDebugMutex);
+
+	return written;
+}
+
+/*!
+ * \brief Log writer thread, runs until UpnpCloseLog().
+ */
+static void *UpnpLogWriter(void *arg)
+{
+	int stop;
+
+	(void)arg;
+	do {
+		stop = (int)upnp_atomic_load(&gLogStop);
+		if (UpnpLogDrain() == 0 && !stop) {
+			imillisleep(LOG_ASYNC_FLUSH_INTERVAL);
+		}
+	} while (!stop);
+	UpnpLogDrain();
+
+	return NULL;
+}
+
 void UpnpPrintf(Upnp_LogLevel DLevel,
 	Dbg_Module Module,
 	const char *DbgFileName,
@@ -266,6 +557,7 @@ void UpnpPrintf(Upnp_LogLevel DLevel,
 	/*fprintf(stderr, "UpnpPrintf: fp %p level %d glev %d mod %d DEBUG_ALL
 	  %d\n", fp, DLevel, g_log_level, Module, DEBUG_ALL);*/
 	va_list ArgList;
+	int ret;
 
 	if (!initwascalled) {
 		return;
@@ -273,6 +565,18 @@ void UpnpPrintf(Upnp_LogLevel DLevel,
 
 	if (!DebugAtThisLevel(DLevel, Module))
 		return;
+	if (upnp_atomic_load(&asyncRunning)) {
+		if (!DbgFileName) {
+			return;
+		}
+		va_start(ArgList, FmtStr);
+		ret = UpnpPrintfAsync(
+			DLevel, Module, DbgFileName, DbgLineNo, FmtStr, ArgList);
+		va_end(ArgList);
+		if (ret == 0) {
+			return;
+		}
+	}
 	ithread_mutex_lock(&GlobalDebugMutex);
 	if (fp == NULL) {
 		ithread_mutex_unlock(&GlobalDebugMutex);
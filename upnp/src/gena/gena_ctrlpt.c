@@ -42,6 +42,7 @@
 		#include "UpnpEventSubscribe.h"
 		#include "client_table.h"
 		#include "gena.h"
+		#include "httpasync.h"
 		#include "httpparser.h"
 		#include "httpreadwrite.h"
 		#include "parsetools.h"
@@ -53,6 +54,12 @@
 
 extern ithread_mutex_t GlobalClientSubscribeMutex;
 
+struct GENA_ASYNC_SUBSCRIBE;
+
+/*! Asynchronous subscriptions waiting for their response, protected by
+ * GlobalClientSubscribeMutex. */
+static struct GENA_ASYNC_SUBSCRIBE *gSubscribesPending;
+
 typedef struct
 {
 	int handle;
@@ -275,7 +282,8 @@ static int gena_unsubscribe(
 		request.length,
 		HTTPMETHOD_UNSUBSCRIBE,
 		HTTP_DEFAULT_TIMEOUT,
-		response);
+		response,
+		0);
 	membuffer_destroy(&request);
 	if (return_code != 0) {
 		httpmsg_destroy(&response->msg);
@@ -290,48 +298,38 @@ static int gena_unsubscribe(
 }
 
 /*!
- * \brief Subscribes or renew subscription.
+ * \brief Makes a SUBSCRIBE request, for a subscription or a renewal.
  *
  * \return 0 if successful, otherwise returns the appropriate error code.
  */
-static int gena_subscribe(
+static int gena_make_subscribe(
 	/*! [in] URL of service to subscribe. */
 	const UpnpString *url,
-	/*! [in,out] Subscription time desired (in secs). */
-	int *timeout,
+	/*! [in] Subscription time desired (in secs), -1 for infinite. */
+	int timeout,
 	/*! [in] for renewal, this contains a currently held subscription SID.
 	 * For first time subscription, this must be NULL. */
 	const UpnpString *renewal_sid,
-	/*! [out] SID returned by the subscription or renew msg. */
-	UpnpString *sid)
+	/*! [out] The request, initialized by the caller. */
+	membuffer *request,
+	/*! [out] Destination of the request. */
+	uri_type *dest_url)
 {
 	int return_code;
-	parse_status_t parse_ret = 0;
-	int local_timeout = CP_MINIMUM_SUBSCRIPTION_TIME;
-	memptr sid_hdr;
-	memptr timeout_hdr;
 	char timeout_str[25];
-	membuffer request;
-	uri_type dest_url;
-	http_parser_t response;
 	int rc = 0;
 
-	UpnpString_clear(sid);
-
 	/* request timeout to string */
-	if (timeout == NULL) {
-		timeout = &local_timeout;
-	}
-	if (*timeout < 0) {
+	if (timeout < 0) {
 		memset(timeout_str, 0, sizeof(timeout_str));
 		strncpy(timeout_str, "infinite", sizeof(timeout_str) - 1);
-	} else if (*timeout < CP_MINIMUM_SUBSCRIPTION_TIME) {
+	} else if (timeout < CP_MINIMUM_SUBSCRIPTION_TIME) {
 		rc = snprintf(timeout_str,
 			sizeof(timeout_str),
 			"%d",
 			CP_MINIMUM_SUBSCRIPTION_TIME);
 	} else {
-		rc = snprintf(timeout_str, sizeof(timeout_str), "%d", *timeout);
+		rc = snprintf(timeout_str, sizeof(timeout_str), "%d", timeout);
 	}
 	if (rc < 0 || (unsigned int)rc >= sizeof(timeout_str))
 		return UPNP_E_OUTOF_MEMORY;
@@ -339,35 +337,34 @@ static int gena_subscribe(
 	/* parse url */
 	return_code = http_FixStrUrl(UpnpString_get_String(url),
 		UpnpString_get_Length(url),
-		&dest_url);
+		dest_url);
 	if (return_code != 0) {
 		return return_code;
 	}
 
 	/* make request msg */
-	membuffer_init(&request);
-	request.size_inc = 30;
+	request->size_inc = 30;
 	if (renewal_sid) {
 		/* renew subscription */
-		return_code = http_MakeMessage(&request,
+		return_code = http_MakeMessage(request,
 			1,
 			1,
 			"q"
 			"ssc"
 			"sscc",
 			HTTPMETHOD_SUBSCRIBE,
-			&dest_url,
+			dest_url,
 			"SID: ",
 			UpnpString_get_String(renewal_sid),
 			"TIMEOUT: Second-",
 			timeout_str);
 	} else {
 		/* subscribe */
-		if (dest_url.hostport.IPaddress.ss_family == AF_INET6) {
+		if (dest_url->hostport.IPaddress.ss_family == AF_INET6) {
 			struct sockaddr_in6 *DestAddr6 =
-				(struct sockaddr_in6 *)&dest_url.hostport
+				(struct sockaddr_in6 *)&dest_url->hostport
 					.IPaddress;
-			return_code = http_MakeMessage(&request,
+			return_code = http_MakeMessage(request,
 				1,
 				1,
 				"q"
@@ -375,7 +372,7 @@ static int gena_subscribe(
 				"sc"
 				"sscc",
 				HTTPMETHOD_SUBSCRIBE,
-				&dest_url,
+				dest_url,
 				"CALLBACK: <http://[",
 				(IN6_IS_ADDR_LINKLOCAL(&DestAddr6->sin6_addr) ||
 					strlen(gIF_IPV6_ULA_GUA) == 0)
@@ -391,7 +388,7 @@ static int gena_subscribe(
 				"TIMEOUT: Second-",
 				timeout_str);
 		} else {
-			return_code = http_MakeMessage(&request,
+			return_code = http_MakeMessage(request,
 				1,
 				1,
 				"q"
@@ -399,7 +396,7 @@ static int gena_subscribe(
 				"sc"
 				"sscc",
 				HTTPMETHOD_SUBSCRIBE,
-				&dest_url,
+				dest_url,
 				"CALLBACK: <http://",
 				gIF_IPV4,
 				":",
@@ -410,38 +407,37 @@ static int gena_subscribe(
 				timeout_str);
 		}
 	}
-	if (return_code != 0) {
-		return return_code;
-	}
 
-	/* send request and get reply */
-	return_code = http_RequestAndResponse(&dest_url,
-		request.buf,
-		request.length,
-		HTTPMETHOD_SUBSCRIBE,
-		HTTP_DEFAULT_TIMEOUT,
-		&response);
-	membuffer_destroy(&request);
-
-	if (return_code != 0) {
-		httpmsg_destroy(&response.msg);
+	return return_code;
+}
 
-		return return_code;
-	}
-	if (response.msg.status_code != HTTP_OK) {
-		httpmsg_destroy(&response.msg);
+/*!
+ * \brief Reads the SID and the timeout granted from a SUBSCRIBE response.
+ *
+ * \return 0 if successful, otherwise returns the appropriate error code.
+ */
+static int gena_subscribe_response(
+	/*! [in] The SUBSCRIBE response from the device. */
+	http_parser_t *response,
+	/*! [out] Subscription time granted (in secs), -1 for infinite. */
+	int *timeout,
+	/*! [out] SID returned by the subscription or renew msg. */
+	UpnpString *sid)
+{
+	parse_status_t parse_ret = 0;
+	memptr sid_hdr;
+	memptr timeout_hdr;
 
+	if (response->msg.status_code != HTTP_OK) {
 		return UPNP_E_SUBSCRIBE_UNACCEPTED;
 	}
 
 	/* get SID and TIMEOUT */
-	if (httpmsg_find_hdr(&response.msg, HDR_SID, &sid_hdr) == NULL ||
+	if (httpmsg_find_hdr(&response->msg, HDR_SID, &sid_hdr) == NULL ||
 		sid_hdr.length == 0 ||
-		httpmsg_find_hdr(&response.msg, HDR_TIMEOUT, &timeout_hdr) ==
+		httpmsg_find_hdr(&response->msg, HDR_TIMEOUT, &timeout_hdr) ==
 			NULL ||
 		timeout_hdr.length == 0) {
-		httpmsg_destroy(&response.msg);
-
 		return UPNP_E_BAD_RESPONSE;
 	}
 
@@ -453,21 +449,72 @@ static int gena_subscribe(
 	} else if (memptr_cmp_nocase(&timeout_hdr, "Second-infinite") == 0) {
 		*timeout = -1;
 	} else {
-		httpmsg_destroy(&response.msg);
-
 		return UPNP_E_BAD_RESPONSE;
 	}
 
 	/* save SID */
 	UpnpString_set_StringN(sid, sid_hdr.buf, sid_hdr.length);
 	if (UpnpString_get_String(sid) == NULL) {
+		return UPNP_E_OUTOF_MEMORY;
+	}
+
+	return UPNP_E_SUCCESS;
+}
+
+/*!
+ * \brief Subscribes or renew subscription.
+ *
+ * \return 0 if successful, otherwise returns the appropriate error code.
+ */
+static int gena_subscribe(
+	/*! [in] URL of service to subscribe. */
+	const UpnpString *url,
+	/*! [in,out] Subscription time desired (in secs). */
+	int *timeout,
+	/*! [in] for renewal, this contains a currently held subscription SID.
+	 * For first time subscription, this must be NULL. */
+	const UpnpString *renewal_sid,
+	/*! [out] SID returned by the subscription or renew msg. */
+	UpnpString *sid)
+{
+	int return_code;
+	int local_timeout = CP_MINIMUM_SUBSCRIPTION_TIME;
+	membuffer request;
+	uri_type dest_url;
+	http_parser_t response;
+
+	UpnpString_clear(sid);
+
+	if (timeout == NULL) {
+		timeout = &local_timeout;
+	}
+	membuffer_init(&request);
+	return_code = gena_make_subscribe(
+		url, *timeout, renewal_sid, &request, &dest_url);
+	if (return_code != 0) {
+		membuffer_destroy(&request);
+		return return_code;
+	}
+
+	/* send request and get reply */
+	return_code = http_RequestAndResponse(&dest_url,
+		request.buf,
+		request.length,
+		HTTPMETHOD_SUBSCRIBE,
+		HTTP_DEFAULT_TIMEOUT,
+		&response,
+		0);
+	membuffer_destroy(&request);
+
+	if (return_code != 0) {
 		httpmsg_destroy(&response.msg);
 
-		return UPNP_E_OUTOF_MEMORY;
+		return return_code;
 	}
+	return_code = gena_subscribe_response(&response, timeout, sid);
 	httpmsg_destroy(&response.msg);
 
-	return UPNP_E_SUCCESS;
+	return return_code;
 }
 
 int genaUnregisterClient(UpnpClient_Handle client_handle)
@@ -564,25 +611,83 @@ exit_function:
 		#endif /* INCLUDE_CLIENT_APIS */
 
 		#ifdef INCLUDE_CLIENT_APIS
-int genaSubscribe(UpnpClient_Handle client_handle,
+/*!
+ * \brief Adds a subscription accepted by the service to the subscription
+ * list of the client and schedules its renewal. Must be called with the
+ * handle lock held.
+ *
+ * \return UPNP_E_SUCCESS, or the appropriate error code.
+ */
+static int gena_add_subscription(
+	/*! [in] The client handle. */
+	UpnpClient_Handle client_handle,
+	/*! [in] Event URL of the service. */
 	const UpnpString *PublisherURL,
-	int *TimeOut,
+	/*! [in] Duration granted by the service, -1 for infinite. */
+	int TimeOut,
+	/*! [in] SID returned by the service. */
+	const UpnpString *ActualSID,
+	/*! [out] SID of the subscription for the client. */
 	UpnpString *out_sid)
 {
-	int return_code = GENA_SUCCESS;
-	GenlibClientSubscription *newSubscription =
-		GenlibClientSubscription_new();
+	int return_code;
+	GenlibClientSubscription *newSubscription;
 	uuid_upnp uid;
 	Upnp_SID temp_sid;
 	Upnp_SID temp_sid2;
-	UpnpString *ActualSID = UpnpString_new();
-	UpnpString *EventURL = UpnpString_new();
 	struct Handle_Info *handle_info;
 	int rc = 0;
 
 	memset(temp_sid, 0, sizeof(temp_sid));
 	memset(temp_sid2, 0, sizeof(temp_sid2));
 
+	if (GetHandleInfo(client_handle, &handle_info) != HND_CLIENT) {
+		return GENA_E_BAD_HANDLE;
+	}
+
+	/* generate client SID */
+	uuid_create(&uid);
+	upnp_uuid_unpack(&uid, temp_sid);
+	rc = snprintf(temp_sid2, sizeof(temp_sid2), "uuid:%s", temp_sid);
+	if (rc < 0 || (unsigned int)rc >= sizeof(temp_sid2)) {
+		return UPNP_E_OUTOF_MEMORY;
+	}
+	UpnpString_set_String(out_sid, temp_sid2);
+
+	/* fill subscription */
+	newSubscription = GenlibClientSubscription_new();
+	if (newSubscription == NULL) {
+		return UPNP_E_OUTOF_MEMORY;
+	}
+	GenlibClientSubscription_set_RenewEventId(newSubscription, -1);
+	GenlibClientSubscription_set_SID(newSubscription, out_sid);
+	GenlibClientSubscription_set_ActualSID(newSubscription, ActualSID);
+	GenlibClientSubscription_set_EventURL(newSubscription, PublisherURL);
+	GenlibClientSubscription_set_Next(
+		newSubscription, handle_info->ClientSubList);
+	handle_info->ClientSubList = newSubscription;
+
+	/* schedule expiration event */
+	return_code =
+		ScheduleGenaAutoRenew(client_handle, TimeOut, newSubscription);
+	if (return_code != UPNP_E_SUCCESS) {
+		handle_info->ClientSubList =
+			GenlibClientSubscription_get_Next(newSubscription);
+		GenlibClientSubscription_delete(newSubscription);
+	}
+
+	return return_code;
+}
+
+int genaSubscribe(UpnpClient_Handle client_handle,
+	const UpnpString *PublisherURL,
+	int *TimeOut,
+	UpnpString *out_sid)
+{
+	int return_code = GENA_SUCCESS;
+	UpnpString *ActualSID = UpnpString_new();
+	struct Handle_Info *handle_info;
+
 	UpnpPrintf(
 		UPNP_INFO, GENA, __FILE__, __LINE__, "GENA SUBSCRIBE BEGIN\n");
 
@@ -612,48 +717,227 @@ int genaSubscribe(UpnpClient_Handle client_handle,
 		goto error_handler;
 	}
 
-	if (GetHandleInfo(client_handle, &handle_info) != HND_CLIENT) {
-		return_code = GENA_E_BAD_HANDLE;
-		goto error_handler;
+	return_code = gena_add_subscription(
+		client_handle, PublisherURL, *TimeOut, ActualSID, out_sid);
+
+error_handler:
+	UpnpString_delete(ActualSID);
+	HandleUnlock(__FILE__, __LINE__);
+	SubscribeUnlock();
+
+	return return_code;
+}
+
+/*! State of an asynchronous subscription. */
+typedef struct GENA_ASYNC_SUBSCRIBE
+{
+	UpnpClient_Handle client_handle;
+	UpnpString *PublisherURL;
+	/*! Duration requested, then granted. */
+	int TimeOut;
+	/*! Linked in gSubscribesPending. */
+	int pending;
+	struct GENA_ASYNC_SUBSCRIBE *next;
+	membuffer request;
+	uri_type url;
+	gena_subscribe_callback callback;
+	free_routine free_cookie;
+	void *cookie;
+} gena_async_subscribe;
+
+/*!
+ * \brief Stops counting an asynchronous subscription as pending and wakes up
+ * the notifications waiting for it.
+ */
+static void gena_async_subscribe_done(
+	/*! [in] The subscription. */
+	gena_async_subscribe *req)
+{
+	gena_async_subscribe **link;
+
+	if (req->pending) {
+		req->pending = 0;
+		for (link = &gSubscribesPending; *link != req;
+			link = &(*link)->next) {
+		}
+		*link = req->next;
+		ithread_cond_broadcast(&GlobalClientSubscribeCond);
 	}
+}
 
-	/* generate client SID */
-	uuid_create(&uid);
-	upnp_uuid_unpack(&uid, temp_sid);
-	rc = snprintf(temp_sid2, sizeof(temp_sid2), "uuid:%s", temp_sid);
-	if (rc < 0 || (unsigned int)rc >= sizeof(temp_sid2)) {
-		return_code = UPNP_E_OUTOF_MEMORY;
-		goto error_handler;
+/*!
+ * \brief Tells whether an asynchronous subscription of a client is waiting
+ * for the response of a host.
+ *
+ * \return 1 if one is, 0 otherwise.
+ */
+static int gena_async_subscribe_pending(
+	/*! [in] The client handle. */
+	UpnpClient_Handle client_handle,
+	/*! [in] Address of the host, the port is ignored. */
+	const struct sockaddr_storage *host)
+{
+	const gena_async_subscribe *req;
+	const struct sockaddr_in *a4;
+	const struct sockaddr_in6 *a6;
+	const struct sockaddr_in *h4 = (const struct sockaddr_in *)host;
+	const struct sockaddr_in6 *h6 = (const struct sockaddr_in6 *)host;
+
+	for (req = gSubscribesPending; req != NULL; req = req->next) {
+		if (req->client_handle != client_handle ||
+			req->url.hostport.IPaddress.ss_family !=
+				host->ss_family)
+			continue;
+		a4 = (const struct sockaddr_in *)&req->url.hostport.IPaddress;
+		a6 = (const struct sockaddr_in6 *)&req->url.hostport.IPaddress;
+		if (host->ss_family == AF_INET6) {
+			if (!memcmp(&a6->sin6_addr,
+				    &h6->sin6_addr,
+				    sizeof(a6->sin6_addr)))
+				return 1;
+		} else if (a4->sin_addr.s_addr == h4->sin_addr.s_addr) {
+			return 1;
+		}
 	}
-	UpnpString_set_String(out_sid, temp_sid2);
 
-	/* create event url */
-	UpnpString_assign(EventURL, PublisherURL);
+	return 0;
+}
 
-	/* fill subscription */
-	if (newSubscription == NULL) {
-		return_code = UPNP_E_OUTOF_MEMORY;
-		goto error_handler;
+/*!
+ * \brief Frees an asynchronous subscription, and its cookie unless the
+ * callback took it.
+ */
+static void gena_async_subscribe_free(
+	/*! [in] The gena_async_subscribe. */
+	void *arg)
+{
+	gena_async_subscribe *req = (gena_async_subscribe *)arg;
+
+	if (req->pending) {
+		SubscribeLock();
+		gena_async_subscribe_done(req);
+		SubscribeUnlock();
 	}
-	GenlibClientSubscription_set_RenewEventId(newSubscription, -1);
-	GenlibClientSubscription_set_SID(newSubscription, out_sid);
-	GenlibClientSubscription_set_ActualSID(newSubscription, ActualSID);
-	GenlibClientSubscription_set_EventURL(newSubscription, EventURL);
-	GenlibClientSubscription_set_Next(
-		newSubscription, handle_info->ClientSubList);
-	handle_info->ClientSubList = newSubscription;
+	if (req->free_cookie)
+		req->free_cookie(req->cookie);
+	UpnpString_delete(req->PublisherURL);
+	membuffer_destroy(&req->request);
+	free(req);
+}
 
-	/* schedule expiration event */
-	return_code =
-		ScheduleGenaAutoRenew(client_handle, *TimeOut, newSubscription);
+/*!
+ * \brief Completion of the SUBSCRIBE request of an asynchronous
+ * subscription.
+ *
+ * Does what genaSubscribe() does after its HTTP request, then calls the
+ * callback.
+ */
+static void gena_async_subscribe_response(
+	/*! [in] Result of the HTTP request. */
+	int ret_code,
+	/*! [in] Response from the service. */
+	http_parser_t *response,
+	/*! [in] The gena_async_subscribe. */
+	void *arg)
+{
+	gena_async_subscribe *req = (gena_async_subscribe *)arg;
+	UpnpString *ActualSID = UpnpString_new();
+	UpnpString *out_sid = UpnpString_new();
+	int return_code = ret_code;
 
-error_handler:
+	if (return_code == UPNP_E_SUCCESS) {
+		return_code =
+			gena_subscribe_response(response, &req->TimeOut, ActualSID);
+	}
+	SubscribeLock();
+	if (return_code == UPNP_E_SUCCESS) {
+		HandleLock(__FILE__, __LINE__);
+		return_code = gena_add_subscription(req->client_handle,
+			req->PublisherURL,
+			req->TimeOut,
+			ActualSID,
+			out_sid);
+		HandleUnlock(__FILE__, __LINE__);
+	} else {
+		UpnpPrintf(UPNP_CRITICAL,
+			GENA,
+			__FILE__,
+			__LINE__,
+			"SUBSCRIBE FAILED in transfer error code: %d "
+			"returned\n",
+			return_code);
+	}
+	gena_async_subscribe_done(req);
+	SubscribeUnlock();
+	if (return_code != UPNP_E_SUCCESS) {
+		UpnpString_clear(out_sid);
+	}
+	req->callback(return_code, out_sid, req->TimeOut, req->cookie);
+	/* the callback owns the cookie now */
+	req->free_cookie = NULL;
+	gena_async_subscribe_free(req);
 	UpnpString_delete(ActualSID);
-	UpnpString_delete(EventURL);
-	if (return_code != UPNP_E_SUCCESS)
-		GenlibClientSubscription_delete(newSubscription);
+	UpnpString_delete(out_sid);
+}
+
+int genaSubscribeAsync(UpnpClient_Handle client_handle,
+	const UpnpString *PublisherURL,
+	int TimeOut,
+	gena_subscribe_callback callback,
+	free_routine free_cookie,
+	void *cookie)
+{
+	gena_async_subscribe *req;
+	struct Handle_Info *handle_info;
+	int return_code;
+
+	HandleReadLock(__FILE__, __LINE__);
+	if (GetHandleInfo(client_handle, &handle_info) != HND_CLIENT) {
+		HandleUnlock(__FILE__, __LINE__);
+		return GENA_E_BAD_HANDLE;
+	}
 	HandleUnlock(__FILE__, __LINE__);
-	SubscribeUnlock();
+
+	req = (gena_async_subscribe *)malloc(sizeof(gena_async_subscribe));
+	if (req == NULL)
+		return UPNP_E_OUTOF_MEMORY;
+	memset(req, 0, sizeof(gena_async_subscribe));
+	membuffer_init(&req->request);
+	req->client_handle = client_handle;
+	req->TimeOut = TimeOut;
+	req->PublisherURL = UpnpString_dup(PublisherURL);
+	if (req->PublisherURL == NULL) {
+		return_code = UPNP_E_OUTOF_MEMORY;
+	} else {
+		return_code = gena_make_subscribe(
+			PublisherURL, TimeOut, NULL, &req->request, &req->url);
+	}
+	if (return_code == UPNP_E_SUCCESS) {
+		req->callback = callback;
+		req->free_cookie = free_cookie;
+		req->cookie = cookie;
+		/* an event may arrive before the response, it waits until
+		 * the subscription is added */
+		SubscribeLock();
+		req->pending = 1;
+		req->next = gSubscribesPending;
+		gSubscribesPending = req;
+		SubscribeUnlock();
+		return_code = http_AsyncRequest(&req->url,
+			req->request.buf,
+			req->request.length,
+			HTTPMETHOD_SUBSCRIBE,
+			HTTP_DEFAULT_TIMEOUT,
+			0,
+			gena_async_subscribe_response,
+			gena_async_subscribe_free,
+			req);
+	}
+	if (return_code != UPNP_E_SUCCESS) {
+		/* the cookie stays with the caller */
+		req->free_cookie = NULL;
+		gena_async_subscribe_free(req);
+	}
 
 	return return_code;
 }
@@ -769,6 +1053,9 @@ void gena_process_notification_event(SOCKINFO *info, http_message_t *event)
 	UpnpClient_Handle client_handle;
 	UpnpClient_Handle client_handle_start;
 	int err_ret = HTTP_PRECONDITION_FAILED;
+	struct timeval now;
+	struct timespec deadline;
+	int timed_out;
 
 	memptr sid_hdr;
 	memptr nt_hdr, nts_hdr;
@@ -806,7 +1093,7 @@ void gena_process_notification_event(SOCKINFO *info, http_message_t *event)
 
 	/* parse the content (should be XML) */
 	if (!has_xml_content_type(event) || event->msg.length == 0 ||
-		ixmlParseBufferEx(event->entity.buf, &ChangedVars) !=
+		httpmsg_get_xml_doc(event, &ChangedVars) !=
 			IXML_SUCCESS) {
 		error_respond(info, HTTP_BAD_REQUEST, event);
 		goto exit_function;
@@ -856,22 +1143,37 @@ void gena_process_notification_event(SOCKINFO *info, http_message_t *event)
 				/* get HandleLock again */
 				HandleLock(__FILE__, __LINE__);
 
-				if (GetHandleInfo(client_handle,
-					    &handle_info) != HND_CLIENT) {
-					SubscribeUnlock();
+				gettimeofday(&now, NULL);
+				deadline.tv_sec =
+					now.tv_sec + GENA_PENDING_NOTIFY_WAIT;
+				deadline.tv_nsec = (long)now.tv_usec * 1000;
+				timed_out = 0;
+				while (GetHandleInfo(client_handle,
+					       &handle_info) == HND_CLIENT) {
+					subscription = GetClientSubActualSID(
+						handle_info->ClientSubList,
+						&sid);
+					if (subscription != NULL || timed_out ||
+						!gena_async_subscribe_pending(
+							client_handle,
+							&info->foreign_sockaddr)) {
+						break;
+					}
+					/* wait, for a short while, for the
+					 * asynchronous subscriptions in
+					 * progress with the sender */
 					HandleUnlock(__FILE__, __LINE__);
-					continue;
+					timed_out = ithread_cond_timedwait(
+							    &GlobalClientSubscribeCond,
+							    &GlobalClientSubscribeMutex,
+							    &deadline) == ETIMEDOUT;
+					HandleLock(__FILE__, __LINE__);
 				}
-
-				subscription = GetClientSubActualSID(
-					handle_info->ClientSubList, &sid);
+				SubscribeUnlock();
 				if (subscription == NULL) {
-					SubscribeUnlock();
 					HandleUnlock(__FILE__, __LINE__);
 					continue;
 				}
-
-				SubscribeUnlock();
 			} else {
 				HandleUnlock(__FILE__, __LINE__);
 				continue;
@@ -43,8 +43,10 @@
 
 		#include <assert.h>
 
+		#include "FreeList.h"
 		#include "gena.h"
 		#include "httpreadwrite.h"
+		#include "metrics.h"
 		#include "posix_overwrites.h" // IWYU pragma: keep
 		#include "ssdplib.h"
 		#include "statcodes.h"
@@ -138,9 +140,161 @@ static int GeneratePropertySet(
 	return XML_SUCCESS;
 }
 
+/*! Free list of the jobs queued on subscriptions. */
+static FreeList gNotifyJobList;
+/*! Free list of notify_thread_struct. Kept apart from the jobs since the
+ * job in a subscription queue and its argument are freed separately. */
+static FreeList gNotifyStructList;
+/*! Number of items of gNotifyJobList and gNotifyStructList in use. */
+static int gNotifyJobsInUse;
+static int gNotifyStructsInUse;
+/*! Protects gNotifyJobList, gNotifyStructList and their use counts. */
+static ithread_mutex_t gNotifyPoolMutex;
+
+int genaNotifyPoolInit(void)
+{
+	if (ithread_mutex_init(&gNotifyPoolMutex, NULL) != 0)
+		return UPNP_E_INIT_FAILED;
+	FreeListInit(&gNotifyJobList,
+		sizeof(ThreadPoolJob),
+		NOTIFY_FREE_LIST_SIZE);
+	FreeListInit(&gNotifyStructList,
+		sizeof(notify_thread_struct),
+		NOTIFY_FREE_LIST_SIZE);
+	gNotifyJobsInUse = 0;
+	gNotifyStructsInUse = 0;
+
+	return UPNP_E_SUCCESS;
+}
+
+/*!
+ * \brief Takes an item from a notify free list. The list grows to keep as
+ * many items as were ever in use at once, so that the next event fanned out
+ * to every subscriber finds them there. The caller holds gNotifyPoolMutex.
+ *
+ * \return The item, or NULL if out of memory.
+ */
+static void *notify_pool_alloc(
+	/*! [in] Free list. */
+	FreeList *list,
+	/*! [in,out] Number of items of the list in use. */
+	int *inUse)
+{
+	void *item = FreeListAlloc(list);
+
+	if (item == NULL)
+		return NULL;
+	++*inUse;
+	/* FreeListFree() keeps one item less than the max size */
+	if (*inUse >= list->maxFreeListLength)
+		FreeListSetMaxLength(list, *inUse + 1);
+
+	return item;
+}
+
+/*!
+ * \brief Returns an item taken with notify_pool_alloc(). The caller holds
+ * gNotifyPoolMutex.
+ */
+static void notify_pool_free(
+	/*! [in] Free list. */
+	FreeList *list,
+	/*! [in,out] Number of items of the list in use. */
+	int *inUse,
+	/*! [in] Item. */
+	void *item)
+{
+	--*inUse;
+	FreeListFree(list, item);
+}
+
+void genaNotifyPoolDestroy(void)
+{
+	FreeListDestroy(&gNotifyJobList);
+	FreeListDestroy(&gNotifyStructList);
+	ithread_mutex_destroy(&gNotifyPoolMutex);
+}
+
+/*!
+ * \brief Allocates a zeroed job for a subscription queue.
+ *
+ * \return The job, or NULL if out of memory.
+ */
+static ThreadPoolJob *alloc_notify_job(void)
+{
+	ThreadPoolJob *job;
+
+	ithread_mutex_lock(&gNotifyPoolMutex);
+	job = (ThreadPoolJob *)notify_pool_alloc(
+		&gNotifyJobList, &gNotifyJobsInUse);
+	ithread_mutex_unlock(&gNotifyPoolMutex);
+	if (job)
+		memset(job, 0, sizeof(ThreadPoolJob));
+
+	return job;
+}
+
+/*!
+ * \brief Returns a job allocated by alloc_notify_job() to the free list.
+ *
+ * Also used as the free function of the subscription queues.
+ */
+static void free_notify_job(
+	/*! [in] Job, may be NULL. */
+	void *job)
+{
+	if (job == NULL)
+		return;
+	ithread_mutex_lock(&gNotifyPoolMutex);
+	notify_pool_free(&gNotifyJobList, &gNotifyJobsInUse, job);
+	ithread_mutex_unlock(&gNotifyPoolMutex);
+}
+
 /*!
- * \brief Frees memory used in notify_threads if the reference count is 0,
- * otherwise decrements the refrence count.
+ * \brief Drops a reference on an event, freeing it with the last one.
+ */
+static void release_notify_event(
+	/*! [in] Event. */
+	notify_event *event)
+{
+	if (upnp_atomic_dec(&event->reference_count) == 0)
+		free(event);
+}
+
+/*!
+ * \brief Allocates the argument of the notify job of one subscriber.
+ *
+ * \return The structure, holding a reference on \b event, or NULL if out of
+ * 	memory.
+ */
+static notify_thread_struct *new_notify_struct(
+	/*! [in] Event to send. */
+	notify_event *event,
+	/*! [in] Subscription ID. */
+	const Upnp_SID sid,
+	/*! [in] Device handle. */
+	UpnpDevice_Handle device_handle)
+{
+	notify_thread_struct *p;
+
+	ithread_mutex_lock(&gNotifyPoolMutex);
+	p = (notify_thread_struct *)notify_pool_alloc(
+		&gNotifyStructList, &gNotifyStructsInUse);
+	ithread_mutex_unlock(&gNotifyPoolMutex);
+	if (p == NULL)
+		return NULL;
+	upnp_atomic_inc(&event->reference_count);
+	p->event = event;
+	memset(p->sid, 0, sizeof(p->sid));
+	strncpy(p->sid, sid, sizeof(p->sid) - 1);
+	p->ctime = time(0);
+	p->device_handle = device_handle;
+
+	return p;
+}
+
+/*!
+ * \brief Frees a notify structure and drops its reference on the event.
  */
 static void free_notify_struct(
 	/*! [in] Notify structure. */
@@ -148,107 +302,160 @@ static void free_notify_struct(
 {
 	notify_thread_struct *p = input;
 
-	(*p->reference_count)--;
-	if (*p->reference_count == 0) {
-		free(p->headers);
-		ixmlFreeDOMString(p->propertySet);
-		free(p->servId);
-		free(p->UDN);
-		free(p->reference_count);
-	}
-	free(p);
+	release_notify_event(p->event);
+	ithread_mutex_lock(&gNotifyPoolMutex);
+	notify_pool_free(&gNotifyStructList, &gNotifyStructsInUse, p);
+	ithread_mutex_unlock(&gNotifyPoolMutex);
 }
 
 /*!
- * \brief Sends the notify message and returns a reply.
+ * \brief Sends the notify message on a connection and reads the reply.
  *
  * \return on success returns UPNP_E_SUCCESS, otherwise returns a UPNP error.
  *
- * \note called by genaNotify
+ * \note called by notify_send_and_recv
  */
-static UPNP_INLINE int notify_send_and_recv(
-	/*! [in] subscription callback URL (URL of the control point). */
-	uri_type *destination_url,
-	/*! [in] Common HTTP headers. */
-	membuffer *mid_msg,
-	/*! [in] The evented XML. */
-	char *propertySet,
+static int notify_exchange(
+	/*! [in] Connection to the control point, closed on return. */
+	SOCKET conn_fd,
+	/*! [in] URL connected to. */
+	uri_type *url,
+	/*! [in] Subscription ID. */
+	const char *sid,
+	/*! [in] Event key of this event. */
+	int eventKey,
+	/*! [in] The event, for the shared headers and the body. */
+	const notify_event *event,
+	/*! [in] Seconds to wait for sending and for the answer, each. */
+	int timeoutSecs,
 	/*! [out] The response from the control point. */
 	http_parser_t *response)
 {
-	uri_type url;
-	SOCKET conn_fd;
 	membuffer start_msg;
+	sock_buffer bufs[2];
 	int ret_code;
 	int err_code;
 	int timeout;
 	SOCKINFO info;
-	const char *CRLF = "\r\n";
 
-	/* connect */
-	UpnpPrintf(UPNP_ALL,
-		GENA,
-		__FILE__,
-		__LINE__,
-		"gena notify to: %.*s\n",
-		(int)destination_url->hostport.text.size,
-		destination_url->hostport.text.buff);
-
-	conn_fd = http_Connect(destination_url, &url);
-	if (conn_fd < 0)
-		/* return UPNP error */
-		return UPNP_E_SOCKET_CONNECT;
 	ret_code = sock_init(&info, conn_fd);
 	if (ret_code) {
 		sock_destroy(&info, SD_BOTH);
 		return ret_code;
 	}
-	/* make start line and HOST header */
+	/* make start line, HOST, SID and SEQ, the rest of the message is
+	 * shared by all subscribers */
 	membuffer_init(&start_msg);
 	if (http_MakeMessage(&start_msg,
 		    1,
 		    1,
 		    "q"
-		    "s",
+		    "ssc"
+		    "sdc",
 		    HTTPMETHOD_NOTIFY,
-		    &url,
-		    mid_msg->buf) != 0) {
+		    url,
+		    "SID: ",
+		    sid,
+		    "SEQ: ",
+		    eventKey) != 0) {
 		membuffer_destroy(&start_msg);
 		sock_destroy(&info, SD_BOTH);
 		return UPNP_E_OUTOF_MEMORY;
 	}
-	timeout = GENA_NOTIFICATION_SENDING_TIMEOUT;
-	/* send msg (note: end of notification will contain "\r\n" twice) */
-	ret_code = http_SendMessage(&info,
-		&timeout,
-		"bbb",
-		start_msg.buf,
-		start_msg.length,
-		propertySet,
-		strlen(propertySet),
-		CRLF,
-		strlen(CRLF));
-	if (ret_code) {
-		membuffer_destroy(&start_msg);
+	bufs[0].buf = start_msg.buf;
+	bufs[0].length = start_msg.length;
+	bufs[1].buf = event->message;
+	bufs[1].length = event->messageLength;
+	timeout = timeoutSecs;
+	ret_code = sock_write_gather(&info, bufs, 2, &timeout);
+	membuffer_destroy(&start_msg);
+	if (ret_code < 0) {
 		sock_destroy(&info, SD_BOTH);
 		return ret_code;
 	}
-	timeout = GENA_NOTIFICATION_ANSWERING_TIMEOUT;
+	timeout = timeoutSecs;
 	ret_code = http_RecvMessage(
-		&info, response, HTTPMETHOD_NOTIFY, &timeout, &err_code);
+		&info, response, HTTPMETHOD_NOTIFY, &timeout, &err_code, 0);
 	if (ret_code) {
-		membuffer_destroy(&start_msg);
 		sock_destroy(&info, SD_BOTH);
 		httpmsg_destroy(&response->msg);
 		return ret_code;
 	}
 	/* should shutdown completely when closing socket */
 	sock_destroy(&info, SD_BOTH);
-	membuffer_destroy(&start_msg);
 
 	return UPNP_E_SUCCESS;
 }
 
+/*!
+ * \brief Sends the notify message and returns a reply.
+ *
+ * \return on success returns UPNP_E_SUCCESS, otherwise returns a UPNP error.
+ *
+ * \note called by genaNotify
+ */
+static UPNP_INLINE int notify_send_and_recv(
+	/*! [in] Delivery URLs of the subscription (URLs of the control point),
+	 * the first one to accept the connection is used. If the notification
+	 * fails on it, the others are tried the same way. */
+	URL_list *urls,
+	/*! [in] Subscription ID. */
+	const char *sid,
+	/*! [in] Event key of this event. */
+	int eventKey,
+	/*! [in] The event, for the shared headers and the body. */
+	const notify_event *event,
+	/*! [in] Seconds to wait for the connection, for sending and for the
+	 * answer, each. */
+	int timeoutSecs,
+	/*! [out] The response from the control point. */
+	http_parser_t *response)
+{
+	uri_type left[HTTP_CONNECT_FIRST_MAX];
+	uri_type url;
+	size_t count;
+	size_t winner;
+	SOCKET conn_fd;
+	int ret_code = UPNP_E_SOCKET_CONNECT;
+
+	count = urls->size;
+	if (count > HTTP_CONNECT_FIRST_MAX)
+		count = HTTP_CONNECT_FIRST_MAX;
+	memcpy(left, urls->parsedURLs, count * sizeof(uri_type));
+	while (count > 0) {
+		/* connect */
+		UpnpPrintf(UPNP_ALL,
+			GENA,
+			__FILE__,
+			__LINE__,
+			"gena notify to: %.*s (%d URLs)\n",
+			(int)left[0].hostport.text.size,
+			left[0].hostport.text.buff,
+			(int)count);
+		conn_fd = http_ConnectFirst(
+			left, count, timeoutSecs, &url, &winner);
+		if (conn_fd < 0)
+			/* return UPNP error */
+			return UPNP_E_SOCKET_CONNECT;
+		ret_code = notify_exchange(conn_fd,
+			&url,
+			sid,
+			eventKey,
+			event,
+			timeoutSecs,
+			response);
+		if (ret_code == UPNP_E_SUCCESS)
+			break;
+		/* try the other URLs */
+		count--;
+		memmove(&left[winner],
+			&left[winner + 1],
+			(count - winner) * sizeof(uri_type));
+	}
+
+	return ret_code;
+}
+
 /*!
  * \brief Function to Notify a particular subscription of a particular event.
  *
@@ -261,45 +468,24 @@ static UPNP_INLINE int notify_send_and_recv(
  * 	appropriate error code.
  */
 static int genaNotify(
-	/*! [in] Null terminated, includes all headers (including \\r\\n) except
-	   SID and SEQ. */
-	char *headers,
-	/*! [in] The evented XML. */
-	char *propertySet,
-	/*! [in] subscription to be Notified, assumes this is valid for life of
-	   function. */
-	subscription *sub)
+	/*! [in] The event to send. */
+	const notify_event *event,
+	/*! [in] Subscription ID. */
+	const char *sid,
+	/*! [in] Event key of this event. */
+	int eventKey,
+	/*! [in] Delivery URLs of the subscription, held by the caller for the
+	   life of the function. */
+	URL_list *urls,
+	/*! [in] Timeout in seconds, see notify_send_and_recv(). */
+	int timeoutSecs)
 {
-	size_t i;
-	membuffer mid_msg;
-	uri_type *url;
 	http_parser_t response;
-	int return_code = -1;
+	int return_code;
+	int64_t start = upnp_clock_usec();
 
-	membuffer_init(&mid_msg);
-	if (http_MakeMessage(&mid_msg,
-		    1,
-		    1,
-		    "s"
-		    "ssc"
-		    "sdcc",
-		    headers,
-		    "SID: ",
-		    sub->sid,
-		    "SEQ: ",
-		    sub->ToSendEventKey) != 0) {
-		membuffer_destroy(&mid_msg);
-		return UPNP_E_OUTOF_MEMORY;
-	}
-	/* send a notify to each url until one goes thru */
-	for (i = 0; i < sub->DeliveryURLs.size; i++) {
-		url = &sub->DeliveryURLs.parsedURLs[i];
-		return_code = notify_send_and_recv(
-			url, &mid_msg, propertySet, &response);
-		if (return_code == UPNP_E_SUCCESS)
-			break;
-	}
-	membuffer_destroy(&mid_msg);
+	return_code = notify_send_and_recv(
+		urls, sid, eventKey, event, timeoutSecs, &response);
 	if (return_code == UPNP_E_SUCCESS) {
 		if (response.msg.status_code == HTTP_OK)
 			return_code = GENA_SUCCESS;
@@ -314,15 +500,106 @@ static int genaNotify(
 		}
 		httpmsg_destroy(&response.msg);
 	}
+	upnp_histogram_since(&gUpnpMetrics.notifyDelivery, start);
+	if (return_code != GENA_SUCCESS)
+		upnp_metrics_inc(&gUpnpMetrics.notifyFailures);
 
 	return return_code;
 }
 
+/*!
+ * \brief Returns the timeout to use for the next notification to a
+ * subscriber, from the round trip times measured so far.
+ *
+ * \return The timeout in seconds.
+ */
+static int notify_timeout(
+	/*! [in] Subscription. */
+	const subscription *sub)
+{
+	int64_t rto;
+	int maxTimeout = GENA_NOTIFICATION_SENDING_TIMEOUT;
+
+	if (GENA_NOTIFICATION_ANSWERING_TIMEOUT > maxTimeout)
+		maxTimeout = GENA_NOTIFICATION_ANSWERING_TIMEOUT;
+	if (sub->srtt == 0)
+		/* never answered, no estimate yet */
+		return maxTimeout;
+	rto = sub->srtt + 4 * sub->rttvar;
+	/* round up to whole seconds */
+	rto = (rto + 999999) / 1000000;
+	if (rto < GENA_NOTIFICATION_MIN_TIMEOUT)
+		return GENA_NOTIFICATION_MIN_TIMEOUT;
+	if (rto > maxTimeout)
+		return maxTimeout;
+
+	return (int)rto;
+}
+
+/*!
+ * \brief Records the outcome of a delivery in the health of a subscriber.
+ *
+ * Answers update the round trip time estimate the same way TCP does (RFC
+ * 6298). Transport failures count up to GENA_BREAKER_THRESHOLD, from which
+ * further deliveries are held back with an exponential backoff.
+ */
+static void notify_update_health(
+	/*! [in,out] Subscription. */
+	subscription *sub,
+	/*! [in] Result of genaNotify(). */
+	int return_code,
+	/*! [in] Time the delivery took, in microseconds. */
+	int64_t rtt)
+{
+	int64_t delta;
+	int backoff;
+	int shift;
+
+	if (return_code == GENA_SUCCESS ||
+		return_code == GENA_E_NOTIFY_UNACCEPTED ||
+		return_code == GENA_E_NOTIFY_UNACCEPTED_REMOVE_SUB) {
+		/* the control point answered */
+		sub->failures = 0;
+		sub->retryAt = 0;
+		if (rtt <= 0)
+			rtt = 1;
+		if (sub->srtt == 0) {
+			sub->srtt = rtt;
+			sub->rttvar = rtt / 2;
+		} else {
+			delta = sub->srtt - rtt;
+			if (delta < 0)
+				delta = -delta;
+			sub->rttvar = (3 * sub->rttvar + delta) / 4;
+			sub->srtt = (7 * sub->srtt + rtt) / 8;
+		}
+		return;
+	}
+	sub->failures++;
+	if (sub->failures < GENA_BREAKER_THRESHOLD)
+		return;
+	shift = sub->failures - GENA_BREAKER_THRESHOLD;
+	backoff = GENA_BREAKER_MAX_BACKOFF;
+	if (shift < 16 && (GENA_BREAKER_MIN_BACKOFF << shift) <
+				  GENA_BREAKER_MAX_BACKOFF)
+		backoff = GENA_BREAKER_MIN_BACKOFF << shift;
+	sub->retryAt = upnp_clock_usec() + (int64_t)backoff * 1000000;
+	UpnpPrintf(UPNP_INFO,
+		GENA,
+		__FILE__,
+		__LINE__,
+		"gena notify to %s failed %d times, holding back for %d s\n",
+		sub->sid,
+		sub->failures,
+		backoff);
+}
+
 /*!
  * \brief Thread job to Notify a control point.
  *
- * It validates the subscription and copies the subscription. Also make sure
- * that events are sent in order.
+ * It validates the subscription and takes a reference on its delivery URLs,
+ * so that HandleLock can be released while sending. Also make sure that
+ * events are sent in order.
  *
  * \note calls the genaNotify to do the actual work.
  */
@@ -333,9 +610,15 @@ static void genaNotifyThread(
 {
 	subscription *sub;
 	service_info *service;
-	subscription sub_copy;
+	subscription_urls *urls;
+	int eventKey;
 	notify_thread_struct *in = (notify_thread_struct *)input;
 	int return_code;
+	int timeoutSecs;
+	int64_t start;
+	int64_t rtt;
+	int64_t delay;
+	ThreadPoolJob job;
 	struct Handle_Info *handle_info;
 
 	/* This should be a HandleLock and not a HandleReadLock otherwise if
@@ -352,21 +635,48 @@ static void genaNotifyThread(
 		return;
 	}
 
-	if (!(service = FindServiceId(
-		      &handle_info->ServiceTable, in->servId, in->UDN)) ||
+	if (!(service = FindServiceId(&handle_info->ServiceTable,
+		      in->event->servId,
+		      in->event->UDN)) ||
 		!service->active ||
-		!(sub = GetSubscriptionSID(in->sid, service)) ||
-		copy_subscription(sub, &sub_copy) != HTTP_SUCCESS) {
+		!(sub = GetSubscriptionSID(in->sid, service))) {
 		free_notify_struct(in);
 		HandleUnlock(__FILE__, __LINE__);
 		return;
 	}
+	start = upnp_clock_usec();
+	if (sub->retryAt > start) {
+		/* The subscriber has been failing, park the event until its
+		 * backoff ends. It stays at the head of sub->outgoing so the
+		 * events raised meanwhile queue up behind it. */
+		delay = (sub->retryAt - start + 999999) / 1000000;
+		memset(&job, 0, sizeof(job));
+		TPJobInit(&job, (start_routine)genaNotifyThread, in);
+		TPJobSetFreeFunction(&job, (free_routine)free_notify_struct);
+		TPJobSetPriority(&job, MED_PRIORITY);
+		if (TimerThreadSchedule(&gTimerThread,
+			    (time_t)delay,
+			    REL_SEC,
+			    &job,
+			    SHORT_TERM,
+			    NULL) == UPNP_E_SUCCESS) {
+			HandleUnlock(__FILE__, __LINE__);
+			return;
+		}
+		/* timer thread is gone, try now */
+	}
+	urls = holdSubscriptionURLs(sub->DeliveryURLs);
+	eventKey = sub->ToSendEventKey;
+	timeoutSecs = notify_timeout(sub);
 
 	HandleUnlock(__FILE__, __LINE__);
 
 	/* send the notify */
-	return_code = genaNotify(in->headers, in->propertySet, &sub_copy);
-	freeSubscription(&sub_copy);
+	start = upnp_clock_usec();
+	return_code = genaNotify(
+		in->event, in->sid, eventKey, &urls->list, timeoutSecs);
+	rtt = upnp_clock_usec() - start;
+	releaseSubscriptionURLs(urls);
 	HandleLock(__FILE__, __LINE__);
 	if (GetHandleInfo(in->device_handle, &handle_info) != HND_DEVICE) {
 		free_notify_struct(in);
@@ -374,14 +684,16 @@ static void genaNotifyThread(
 		return;
 	}
 	/* validate context */
-	if (!(service = FindServiceId(
-		      &handle_info->ServiceTable, in->servId, in->UDN)) ||
+	if (!(service = FindServiceId(&handle_info->ServiceTable,
+		      in->event->servId,
+		      in->event->UDN)) ||
 		!service->active ||
 		!(sub = GetSubscriptionSID(in->sid, service))) {
 		free_notify_struct(in);
 		HandleUnlock(__FILE__, __LINE__);
 		return;
 	}
+	notify_update_health(sub, return_code, rtt);
 	sub->ToSendEventKey++;
 	if (sub->ToSendEventKey < 0)
 		/* wrap to 1 for overflow */
@@ -413,55 +725,67 @@ static void genaNotifyThread(
 }
 
 /*!
- * \brief Allocates the GENA header.
+ * \brief Creates the shared part of an event, with one reference held by
+ * the caller.
  *
- * \note The header must be destroyed after with a call to free(), otherwise
- * there will be a memory leak.
+ * The headers common to all subscribers and the body are rendered here,
+ * once per event, in the same allocation as the event.
  *
- * \return The constructed header.
+ * \return The event, or NULL if out of memory.
  */
-static char *AllocGenaHeaders(
-	/*! [in] The property set string. */
-	const DOMString propertySet)
+static notify_event *new_notify_event(
+	/*! [in] Device UDN. */
+	const char *UDN,
+	/*! [in] Service ID. */
+	const char *servId,
+	/*! [in] The evented XML, always freed by this function. */
+	DOMString propertySet)
 {
-	static const char *HEADER_LINE_1 =
-		"CONTENT-TYPE: text/xml; charset=\"utf-8\"\r\n";
-	static const char *HEADER_LINE_2A = "CONTENT-LENGTH: ";
-	static const char *HEADER_LINE_2B = "\r\n";
-	static const char *HEADER_LINE_3 = "NT: upnp:event\r\n";
-	static const char *HEADER_LINE_4 = "NTS: upnp:propchange\r\n";
-	char *headers = NULL;
-	size_t headers_size = 0;
-	int line = 0;
-	int rc = 0;
-
-	headers_size = strlen(HEADER_LINE_1) + strlen(HEADER_LINE_2A) +
-		       MAX_CONTENT_LENGTH + strlen(HEADER_LINE_2B) +
-		       strlen(HEADER_LINE_3) + strlen(HEADER_LINE_4) + 1;
-	headers = (char *)malloc(headers_size);
-	if (headers == NULL) {
-		line = __LINE__;
+	static const char *HEADERS =
+		"CONTENT-TYPE: text/xml; charset=\"utf-8\"\r\n"
+		"CONTENT-LENGTH: %" PRIzu "\r\n"
+		"NT: upnp:event\r\n"
+		"NTS: upnp:propchange\r\n"
+		"\r\n";
+	size_t udnSize = strlen(UDN) + 1;
+	size_t servIdSize = strlen(servId) + 1;
+	size_t propertySetLength = strlen(propertySet);
+	/* the body is the property set followed by CRLF */
+	size_t bodyLength = propertySetLength + 2;
+	size_t messageSize = strlen(HEADERS) + MAX_CONTENT_LENGTH + bodyLength;
+	notify_event *event;
+	int rc;
+
+	event = (notify_event *)malloc(
+		sizeof(notify_event) + messageSize + udnSize + servIdSize);
+	if (event == NULL)
+		goto ExitFunction;
+	event->message = (char *)(event + 1);
+	rc = snprintf(event->message, messageSize, HEADERS, bodyLength);
+	if (rc < 0 || (size_t)rc + bodyLength >= messageSize) {
+		free(event);
+		event = NULL;
 		goto ExitFunction;
 	}
-	rc = snprintf(headers,
-		headers_size,
-		"%s%s%" PRIzu "%s%s%s",
-		HEADER_LINE_1,
-		HEADER_LINE_2A,
-		strlen(propertySet) + 2,
-		HEADER_LINE_2B,
-		HEADER_LINE_3,
-		HEADER_LINE_4);
+	memcpy(event->message + rc, propertySet, propertySetLength);
+	memcpy(event->message + rc + propertySetLength, "\r\n", 2);
+	event->messageLength = (size_t)rc + bodyLength;
+	event->UDN = event->message + messageSize;
+	memcpy(event->UDN, UDN, udnSize);
+	event->servId = event->UDN + udnSize;
+	memcpy(event->servId, servId, servIdSize);
+	upnp_atomic_store(&event->reference_count, 1);
 
 ExitFunction:
-	if (headers == NULL || rc < 0 || (unsigned int)rc >= headers_size) {
+	if (event == NULL)
 		UpnpPrintf(UPNP_ALL,
 			GENA,
 			__FILE__,
-			line,
-			"AllocGenaHeaders(): Error UPNP_E_OUTOF_MEMORY\n");
-	}
-	return headers;
+			__LINE__,
+			"new_notify_event(): Error UPNP_E_OUTOF_MEMORY\n");
+	ixmlFreeDOMString(propertySet);
+
+	return event;
 }
 
 void freeSubscriptionQueuedEvents(subscription *sub)
@@ -481,7 +805,7 @@ void freeSubscriptionQueuedEvents(subscription *sub)
 				free_notify_struct(
 					(notify_thread_struct *)job->arg);
 			}
-			free(node->item);
+			free_notify_job(node->item);
 			ListDelNode(&sub->outgoing, node, 0);
 			node = ListHead(&sub->outgoing);
 		}
@@ -498,10 +822,7 @@ static int genaInitNotifyCommon(UpnpDevice_Handle device_handle,
 	int ret = GENA_SUCCESS;
 	int line = 0;
 
-	int *reference_count = NULL;
-	char *UDN_copy = NULL;
-	char *servId_copy = NULL;
-	char *headers = NULL;
+	notify_event *event = NULL;
 	notify_thread_struct *thread_struct = NULL;
 
 	subscription *sub = NULL;
@@ -515,34 +836,19 @@ static int genaInitNotifyCommon(UpnpDevice_Handle device_handle,
 		__LINE__,
 		"GENA BEGIN INITIAL NOTIFY COMMON\n");
 
-	job = (ThreadPoolJob *)malloc(sizeof(ThreadPoolJob));
-	if (job == NULL) {
-		line = __LINE__;
-		ret = UPNP_E_OUTOF_MEMORY;
-		goto ExitFunction;
-	}
-	memset(job, 0, sizeof(ThreadPoolJob));
-
-	reference_count = (int *)malloc(sizeof(int));
-	if (reference_count == NULL) {
-		line = __LINE__;
-		ret = UPNP_E_OUTOF_MEMORY;
-		goto ExitFunction;
-	}
-	*reference_count = 0;
-
-	UDN_copy = strdup(UDN);
-	if (UDN_copy == NULL) {
-		line = __LINE__;
-		ret = UPNP_E_OUTOF_MEMORY;
-		goto ExitFunction;
-	}
-
-	servId_copy = strdup(servId);
-	if (servId_copy == NULL) {
-		line = __LINE__;
-		ret = UPNP_E_OUTOF_MEMORY;
-		goto ExitFunction;
+	event = new_notify_event(UDN, servId, propertySet);
+	job = alloc_notify_job();
+	if (event == NULL || job == NULL) {
+		if (event)
+			release_notify_event(event);
+		free_notify_job(job);
+		UpnpPrintf(UPNP_INFO,
+			GENA,
+			__FILE__,
+			__LINE__,
+			"GENA END INITIAL NOTIFY COMMON, ret = %d\n",
+			UPNP_E_OUTOF_MEMORY);
+		return UPNP_E_OUTOF_MEMORY;
 	}
 
 	HandleLock(__FILE__, __LINE__);
@@ -581,34 +887,13 @@ static int genaInitNotifyCommon(UpnpDevice_Handle device_handle,
 		sid);
 	sub->active = 1;
 
-	headers = AllocGenaHeaders(propertySet);
-	if (headers == NULL) {
-		line = __LINE__;
-		ret = UPNP_E_OUTOF_MEMORY;
-		goto ExitFunction;
-	}
-
 	/* schedule thread for initial notification */
 
-	thread_struct =
-		(notify_thread_struct *)malloc(sizeof(notify_thread_struct));
+	thread_struct = new_notify_struct(event, sid, device_handle);
 	if (thread_struct == NULL) {
 		line = __LINE__;
 		ret = UPNP_E_OUTOF_MEMORY;
 	} else {
-		*reference_count = 1;
-		thread_struct->servId = servId_copy;
-		thread_struct->UDN = UDN_copy;
-		thread_struct->headers = headers;
-		thread_struct->propertySet = propertySet;
-		memset(thread_struct->sid, 0, sizeof(thread_struct->sid));
-		strncpy(thread_struct->sid,
-			sid,
-			sizeof(thread_struct->sid) - 1);
-		thread_struct->ctime = time(0);
-		thread_struct->reference_count = reference_count;
-		thread_struct->device_handle = device_handle;
-
 		TPJobInit(job, (start_routine)genaNotifyThread, thread_struct);
 		TPJobSetFreeFunction(job, (free_routine)free_notify_struct);
 		TPJobSetPriority(job, MED_PRIORITY);
@@ -635,14 +920,11 @@ static int genaInitNotifyCommon(UpnpDevice_Handle device_handle,
 
 ExitFunction:
 	if (ret != GENA_SUCCESS) {
-		free(job);
-		free(thread_struct);
-		free(headers);
-		ixmlFreeDOMString(propertySet);
-		free(servId_copy);
-		free(UDN_copy);
-		free(reference_count);
+		free_notify_job(job);
+		if (thread_struct)
+			free_notify_struct(thread_struct);
 	}
+	release_notify_event(event);
 
 	HandleUnlock(__FILE__, __LINE__);
 
@@ -788,7 +1070,7 @@ static void maybeDiscardEvents(LinkedList *listp)
 		if (ListSize(listp) > g_UpnpSdkEQMaxLen ||
 			now - ntsp->ctime > g_UpnpSdkEQMaxAge) {
 			free_notify_struct(ntsp);
-			free(node->item);
+			free_notify_job(node->item);
 			ListDelNode(listp, node, 0);
 		} else {
 			/* If the list is smaller than the max and the oldest
@@ -807,10 +1089,7 @@ static int genaNotifyAllCommon(UpnpDevice_Handle device_handle,
 	int ret = GENA_SUCCESS;
 	int line = 0;
 
-	int *reference_count = NULL;
-	char *UDN_copy = NULL;
-	char *servId_copy = NULL;
-	char *headers = NULL;
+	notify_event *event = NULL;
 	notify_thread_struct *thread_s = NULL;
 
 	subscription *finger = NULL;
@@ -823,34 +1102,17 @@ static int genaNotifyAllCommon(UpnpDevice_Handle device_handle,
 		__LINE__,
 		"GENA BEGIN NOTIFY ALL COMMON\n");
 
-	/* Keep this allocation first */
-	reference_count = (int *)malloc(sizeof(int));
-	if (reference_count == NULL) {
-		line = __LINE__;
-		ret = UPNP_E_OUTOF_MEMORY;
-		goto ExitFunction;
-	}
-	*reference_count = 0;
-
-	UDN_copy = strdup(UDN);
-	if (UDN_copy == NULL) {
-		line = __LINE__;
-		ret = UPNP_E_OUTOF_MEMORY;
-		goto ExitFunction;
-	}
-
-	servId_copy = strdup(servId);
-	if (servId_copy == NULL) {
-		line = __LINE__;
-		ret = UPNP_E_OUTOF_MEMORY;
-		goto ExitFunction;
-	}
-
-	headers = AllocGenaHeaders(propertySet);
-	if (headers == NULL) {
-		line = __LINE__;
-		ret = UPNP_E_OUTOF_MEMORY;
-		goto ExitFunction;
+	/* One shared event for all the subscribers, the per subscriber
+	 * jobs come from the free lists. */
+	event = new_notify_event(UDN, servId, propertySet);
+	if (event == NULL) {
+		UpnpPrintf(UPNP_INFO,
+			GENA,
+			__FILE__,
+			__LINE__,
+			"GENA END NOTIFY ALL COMMON, ret = %d\n",
+			UPNP_E_OUTOF_MEMORY);
+		return UPNP_E_OUTOF_MEMORY;
 	}
 
 	HandleLock(__FILE__, __LINE__);
@@ -867,37 +1129,22 @@ static int genaNotifyAllCommon(UpnpDevice_Handle device_handle,
 				ThreadPoolJob *job = NULL;
 				ListNode *node;
 
-				thread_s = (notify_thread_struct *)malloc(
-					sizeof(notify_thread_struct));
+				thread_s = new_notify_struct(
+					event, finger->sid, device_handle);
 				if (thread_s == NULL) {
 					line = __LINE__;
 					ret = UPNP_E_OUTOF_MEMORY;
 					break;
 				}
 
-				(*reference_count)++;
-				thread_s->reference_count = reference_count;
-				thread_s->UDN = UDN_copy;
-				thread_s->servId = servId_copy;
-				thread_s->headers = headers;
-				thread_s->propertySet = propertySet;
-				strncpy(thread_s->sid,
-					finger->sid,
-					sizeof thread_s->sid);
-				thread_s->sid[sizeof thread_s->sid - 1] = 0;
-				thread_s->ctime = time(0);
-				thread_s->device_handle = device_handle;
-
 				maybeDiscardEvents(&finger->outgoing);
-				job = (ThreadPoolJob *)malloc(
-					sizeof(ThreadPoolJob));
+				job = alloc_notify_job();
 				if (!job) {
-					free(thread_s);
+					free_notify_struct(thread_s);
 					line = __LINE__;
 					ret = UPNP_E_OUTOF_MEMORY;
 					break;
 				}
-				memset(job, 0, sizeof(ThreadPoolJob));
 				TPJobInit(job,
 					(start_routine)genaNotifyThread,
 					thread_s);
@@ -933,18 +1180,9 @@ static int genaNotifyAllCommon(UpnpDevice_Handle device_handle,
 		}
 	}
 
-ExitFunction:
-	/* The only case where we want to free memory here is if the
-	   struct was never queued. Else, let the normal cleanup take place.
-	   reference_count is allocated first so it's ok to do nothing if it's 0
-	*/
-	if (reference_count && *reference_count == 0) {
-		free(headers);
-		ixmlFreeDOMString(propertySet);
-		free(servId_copy);
-		free(UDN_copy);
-		free(reference_count);
-	}
+	/* Drop the reference of this function, the event is freed here if
+	   it was never queued. */
+	release_notify_event(event);
 
 	HandleUnlock(__FILE__, __LINE__);
 
@@ -1094,6 +1332,7 @@ static int respond_ok(
 		    "S"
 		    "N"
 		    "Xc"
+		    "C"
 		    "ssc"
 		    "scc",
 		    HTTP_OK,
@@ -1431,12 +1670,17 @@ void gena_process_subscription_request(SOCKINFO *info, http_message_t *request)
 	}
 	sub->ToSendEventKey = 0;
 	sub->active = 0;
+	sub->srtt = 0;
+	sub->rttvar = 0;
+	sub->failures = 0;
+	sub->retryAt = 0;
 	sub->next = NULL;
-	sub->DeliveryURLs.size = 0;
-	sub->DeliveryURLs.URLs = NULL;
-	sub->DeliveryURLs.parsedURLs = NULL;
-	if (ListInit(&sub->outgoing, 0, free) != 0) {
+	sub->DeliveryURLs = newSubscriptionURLs();
+	if (sub->DeliveryURLs == NULL ||
+		ListInit(&sub->outgoing, 0, free_notify_job) != 0) {
 		error_respond(info, HTTP_INTERNAL_SERVER_ERROR, request);
+		releaseSubscriptionURLs(sub->DeliveryURLs);
+		free(sub);
 		HandleUnlock(__FILE__, __LINE__);
 		goto exit_function;
 	}
@@ -1448,7 +1692,7 @@ void gena_process_subscription_request(SOCKINFO *info, http_message_t *request)
 		HandleUnlock(__FILE__, __LINE__);
 		goto exit_function;
 	}
-	return_code = create_url_list(&callback_hdr, &sub->DeliveryURLs);
+	return_code = create_url_list(&callback_hdr, &sub->DeliveryURLs->list);
 	if (return_code == 0) {
 		error_respond(info, HTTP_PRECONDITION_FAILED, request);
 		freeSubscriptionList(sub);
@@ -1461,7 +1705,8 @@ void gena_process_subscription_request(SOCKINFO *info, http_message_t *request)
 		HandleUnlock(__FILE__, __LINE__);
 		goto exit_function;
 	}
-	return_code = gena_validate_delivery_urls(info, &sub->DeliveryURLs);
+	return_code =
+		gena_validate_delivery_urls(info, &sub->DeliveryURLs->list);
 	if (return_code != 0) {
 		error_respond(info, HTTP_PRECONDITION_FAILED, request);
 		freeSubscriptionList(sub);
@@ -30,6 +30,10 @@
  *
  **************************************************************************/
 
+#ifndef _GNU_SOURCE
+	#define _GNU_SOURCE /* For sched_setaffinity() in sched.h */
+#endif
+
 #include "config.h"
 
 #if EXCLUDE_MINISERVER == 0
@@ -64,10 +68,22 @@
 	#include <stdlib.h>
 	#include <string.h>
 	#include <sys/types.h>
+	#ifdef __linux__
+		#include <sched.h>
+	#endif
 
 	/*! . */
 	#define APPLICATION_LISTENING_PORT 49152
 
+	/* Socket option spreading the connections over the listeners sharing
+	 * a port. The SO_REUSEPORT of the other BSDs hands them all to the
+	 * last listener. */
+	#if defined(SO_REUSEPORT_LB)
+		#define MINISERVER_SO_REUSEPORT SO_REUSEPORT_LB
+	#elif defined(SO_REUSEPORT) && defined(__linux__)
+		#define MINISERVER_SO_REUSEPORT SO_REUSEPORT
+	#endif
+
 struct mserv_request_t
 {
 	/*! Connection handle. */
@@ -94,6 +110,13 @@ uint16_t miniStopSockPort;
  * module vars
  */
 static MiniServerState gMServState = MSERV_IDLE;
+/*! Number of HTTP listener shards of the next miniserver started. */
+static int gMServShards =
+	#ifdef MINISERVER_SO_REUSEPORT
+	MINISERVER_LISTENER_SHARDS;
+	#else
+	1;
+	#endif
 	#ifdef INTERNAL_WEB_SERVER
 static MiniServerCallback gGetCallback = NULL;
 static MiniServerCallback gSoapCallback = NULL;
@@ -415,8 +438,12 @@ static void handle_request(
 		return;
 	}
 	/* read */
-	ret_code = http_RecvMessage(
-		&info, &parser, HTTPMETHOD_UNKNOWN, &timeout, &http_error_code);
+	ret_code = http_RecvMessage(&info,
+		&parser,
+		HTTPMETHOD_UNKNOWN,
+		&timeout,
+		&http_error_code,
+		1);
 	if (ret_code != 0) {
 		goto error_handler;
 	}
@@ -607,12 +634,213 @@ static int receive_from_stopSock(SOCKET ssock, fd_set *set)
 	return 0;
 }
 
+	#if defined(__linux__) && defined(CPU_SET)
+/*!
+ * \brief Binds the calling thread to one of the processors it may run on,
+ * picked by \b index.
+ *
+ * \return Non-zero if the binding changed, \b saved then holds the one to
+ * 	restore.
+ */
+static int bind_shard_thread(
+	/*! [in] Index of the shard. */
+	int index,
+	/*! [out] Previous binding of the thread. */
+	cpu_set_t *saved)
+{
+	cpu_set_t set;
+	int count;
+	int cpu;
+
+	if (sched_getaffinity(0, sizeof *saved, saved) != 0) {
+		return 0;
+	}
+	count = CPU_COUNT(saved);
+	if (count <= 1) {
+		return 0;
+	}
+	index %= count;
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, saved) && index-- == 0) {
+			break;
+		}
+	}
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+
+	return sched_setaffinity(0, sizeof set, &set) == 0;
+}
+	#endif
+
+/*!
+ * \brief Accepts the connections of one HTTP listener shard until the
+ * miniserver stops.
+ */
+static void RunMiniServerShard(
+	/*! [in] The shard. */
+	MiniServerShard *shard)
+{
+	char errorBuffer[ERROR_BUFFER_LEN];
+	fd_set rdSet;
+	SOCKET maxSock;
+	int ret;
+	#if defined(__linux__) && defined(CPU_SET)
+	cpu_set_t saved;
+	int bound = bind_shard_thread(shard->index, &saved);
+	#endif
+
+	maxSock = 0;
+	maxSock = max(maxSock, shard->sock4);
+	maxSock = max(maxSock, shard->sock6);
+	maxSock = max(maxSock, shard->sock6UlaGua);
+	maxSock = max(maxSock, shard->stopSock);
+	++maxSock;
+
+	/* The stop socket is only watched to be woken up, RunMiniServer()
+	 * reads it. */
+	while (gMServState != (MiniServerState)MSERV_STOPPING) {
+		FD_ZERO(&rdSet);
+		FD_SET(shard->stopSock, &rdSet);
+		fdset_if_valid(shard->sock4, &rdSet);
+		fdset_if_valid(shard->sock6, &rdSet);
+		fdset_if_valid(shard->sock6UlaGua, &rdSet);
+		ret = select((int)maxSock, &rdSet, NULL, NULL, NULL);
+		if (ret == SOCKET_ERROR) {
+			if (errno != EINTR) {
+				strerror_r(errno, errorBuffer, ERROR_BUFFER_LEN);
+				UpnpPrintf(UPNP_CRITICAL,
+					MSERV,
+					__FILE__,
+					__LINE__,
+					"Error in select(): %s\n",
+					errorBuffer);
+			}
+			continue;
+		}
+		web_server_accept(shard->sock4, &rdSet);
+		web_server_accept(shard->sock6, &rdSet);
+		web_server_accept(shard->sock6UlaGua, &rdSet);
+	}
+	sock_close(shard->sock4);
+	sock_close(shard->sock6);
+	sock_close(shard->sock6UlaGua);
+	shard->sock4 = INVALID_SOCKET;
+	shard->sock6 = INVALID_SOCKET;
+	shard->sock6UlaGua = INVALID_SOCKET;
+	#if defined(__linux__) && defined(CPU_SET)
+	/* The thread goes back to the pool. */
+	if (bound) {
+		sched_setaffinity(0, sizeof saved, &saved);
+	}
+	#endif
+	shard->running = 0;
+}
+
+/*!
+ * \brief Closes the listeners of the HTTP listener shards and frees them.
+ */
+static void close_shards(
+	/*! [in] Socket Array. */
+	MiniServerSockArray *miniSock)
+{
+	int i;
+
+	if (!miniSock->shards) {
+		return;
+	}
+	for (i = 0; i < miniSock->shardCount; i++) {
+		sock_close(miniSock->shards[i].sock4);
+		sock_close(miniSock->shards[i].sock6);
+		sock_close(miniSock->shards[i].sock6UlaGua);
+	}
+	free(miniSock->shards);
+	miniSock->shards = NULL;
+	miniSock->shardCount = 0;
+}
+
+/*!
+ * \brief Waits for the threads of the HTTP listener shards to end, then
+ * closes and frees the shards. gMServState must be MSERV_STOPPING.
+ */
+static void stop_shards(
+	/*! [in] Socket Array. */
+	MiniServerSockArray *miniSock)
+{
+	struct sockaddr_in stopAddr;
+	const char *buf = "ShutDown";
+	int i;
+
+	if (!miniSock->shards) {
+		return;
+	}
+	/* Nobody reads the stop socket any more, the datagram keeps it
+	 * readable until every shard has seen it. */
+	memset(&stopAddr, 0, sizeof(stopAddr));
+	stopAddr.sin_family = (sa_family_t)AF_INET;
+	inet_pton(AF_INET, "127.0.0.1", &stopAddr.sin_addr);
+	stopAddr.sin_port = htons(miniSock->stopPort);
+	sendto(miniSock->miniServerStopSock,
+		buf,
+		strlen(buf),
+		0,
+		(struct sockaddr *)&stopAddr,
+		sizeof(stopAddr));
+	for (i = 0; i < miniSock->shardCount; i++) {
+		while (miniSock->shards[i].running) {
+			imillisleep(1);
+		}
+	}
+	close_shards(miniSock);
+}
+
+/*!
+ * \brief Starts one thread per HTTP listener shard.
+ *
+ * \return UPNP_E_SUCCESS, or UPNP_E_OUTOF_MEMORY if a thread could not be
+ * 	started, the shards are then closed.
+ */
+static int start_shards(
+	/*! [in] Socket Array. */
+	MiniServerSockArray *miniSock)
+{
+	ThreadPoolJob job;
+	MiniServerShard *shard;
+	int i;
+
+	memset(&job, 0, sizeof(job));
+	for (i = 0; i < miniSock->shardCount; i++) {
+		shard = &miniSock->shards[i];
+		shard->stopSock = miniSock->miniServerStopSock;
+		shard->running = 1;
+		TPJobInit(&job, (start_routine)RunMiniServerShard, shard);
+		TPJobSetPriority(&job, MED_PRIORITY);
+		if (ThreadPoolAddPersistent(&gMiniServerThreadPool, &job, NULL) <
+			0) {
+			shard->running = 0;
+			UpnpPrintf(UPNP_CRITICAL,
+				MSERV,
+				__FILE__,
+				__LINE__,
+				"miniserver: cannot start listener shard %d\n",
+				i);
+			gMServState = MSERV_STOPPING;
+			stop_shards(miniSock);
+			gMServState = MSERV_IDLE;
+			return UPNP_E_OUTOF_MEMORY;
+		}
+	}
+
+	return UPNP_E_SUCCESS;
+}
+
 /*!
  * \brief Run the miniserver.
  *
  * The MiniServer accepts a new request and schedules a thread to handle the
  * new request. Checks for socket state and invokes appropriate read and
- * shutdown actions for the Miniserver and SSDP sockets.
+ * shutdown actions for the Miniserver and SSDP sockets. When the HTTP
+ * listeners are sharded, their threads accept the connections and are
+ * waited for before the sockets are closed.
  */
 static void RunMiniServer(
 	/*! [in] Socket Array. */
@@ -686,6 +914,9 @@ static void RunMiniServer(
 				miniSock->miniServerStopSock, &rdSet);
 		}
 	}
+	/* The shards use the stop socket until they end. */
+	gMServState = MSERV_STOPPING;
+	stop_shards(miniSock);
 	/* Close all sockets. */
 	sock_close(miniSock->miniServerSock4);
 	sock_close(miniSock->miniServerSock6);
@@ -981,6 +1212,185 @@ error:
 	return ret_val;
 }
 
+/*!
+ * \brief Lets more listeners bind the port of the socket, see
+ * MINISERVER_LISTENER_SHARDS.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_SOCKET_ERROR.
+ */
+static int set_reuseport(
+	/*! [in] Socket descriptor. */
+	SOCKET fd)
+{
+		#ifdef MINISERVER_SO_REUSEPORT
+	char errorBuffer[ERROR_BUFFER_LEN];
+	int onOff = 1;
+
+	if (setsockopt(fd,
+		    SOL_SOCKET,
+		    MINISERVER_SO_REUSEPORT,
+		    (const char *)&onOff,
+		    sizeof(onOff)) == SOCKET_ERROR) {
+		strerror_r(errno, errorBuffer, ERROR_BUFFER_LEN);
+		UpnpPrintf(UPNP_INFO,
+			MSERV,
+			__FILE__,
+			__LINE__,
+			"set_reuseport(): unable to set SO_REUSEPORT: %s\n",
+			errorBuffer);
+		return UPNP_E_SOCKET_ERROR;
+	}
+
+	return UPNP_E_SUCCESS;
+		#else
+	(void)fd;
+
+	return UPNP_E_SOCKET_ERROR;
+		#endif
+}
+
+/*!
+ * \brief Opens the listener of one more shard on the address and port of
+ * \b first, without looking for a free port.
+ *
+ * \return
+ *	\li UPNP_E_OUTOF_SOCKET: Failed to create a socket.
+ *	\li UPNP_E_SOCKET_ERROR: SO_REUSEPORT could not be set.
+ *	\li UPNP_E_SOCKET_BIND: Bind() failed.
+ *	\li UPNP_E_LISTEN: Listen() failed.
+ *	\li UPNP_E_SUCCESS: Success.
+ */
+static int do_bind_listen_shard(
+	/*! [out] The new listener. */
+	struct s_SocketStuff *s,
+	/*! [in] Listener of the first shard, SO_REUSEPORT already set. */
+	const struct s_SocketStuff *first)
+{
+	char errorBuffer[ERROR_BUFFER_LEN];
+	int ret_val;
+
+	if (init_socket_suff(s, first->text_addr, first->ip_version) ||
+		s->fd == INVALID_SOCKET) {
+		return UPNP_E_OUTOF_SOCKET;
+	}
+	ret_val = set_reuseport(s->fd);
+	if (ret_val) {
+		goto error;
+	}
+	switch (s->ip_version) {
+	case 4:
+		s->serverAddr4->sin_port = htons(first->actual_port);
+		break;
+	case 6:
+		s->serverAddr6->sin6_scope_id =
+			first->serverAddr6->sin6_scope_id;
+		s->serverAddr6->sin6_port = htons(first->actual_port);
+		break;
+	}
+	if (bind(s->fd, s->serverAddr, s->address_len) == SOCKET_ERROR) {
+		strerror_r(errno, errorBuffer, ERROR_BUFFER_LEN);
+		UpnpPrintf(UPNP_INFO,
+			MSERV,
+			__FILE__,
+			__LINE__,
+			"do_bind_listen_shard(): Error in IPv%d bind(): %s\n",
+			s->ip_version,
+			errorBuffer);
+		ret_val = UPNP_E_SOCKET_BIND;
+		goto error;
+	}
+	ret_val = do_listen(s);
+	if (ret_val) {
+		goto error;
+	}
+
+	return UPNP_E_SUCCESS;
+
+error:
+	sock_close(s->fd);
+	s->fd = INVALID_SOCKET;
+
+	return ret_val;
+}
+
+/*!
+ * \brief Opens the listeners of the other shards on the ports of the
+ * listeners just opened, which become the ones of the first shard.
+ *
+ * The port search of the first listeners is done without SO_REUSEPORT, so
+ * that a port is never shared with another process.
+ *
+ * \return UPNP_E_SUCCESS, or an error code of do_bind_listen_shard() or
+ * 	UPNP_E_OUTOF_MEMORY. The listeners of the first shard are then left
+ * 	to the caller.
+ */
+static int get_miniserver_shards(
+	/*! [in,out] Socket Array. */
+	MiniServerSockArray *out,
+	/*! [in] First IPv4 listener. */
+	struct s_SocketStuff *ss4,
+	/*! [in] First IPv6 LLA listener. */
+	struct s_SocketStuff *ss6,
+	/*! [in] First IPv6 ULA or GUA listener. */
+	struct s_SocketStuff *ss6UlaGua)
+{
+	struct s_SocketStuff *first[3];
+	struct s_SocketStuff s;
+	MiniServerShard *shards;
+	SOCKET *sock;
+	int ret_val;
+	int i;
+	int j;
+
+	shards = (MiniServerShard *)malloc(
+		(size_t)gMServShards * sizeof(MiniServerShard));
+	if (!shards) {
+		return UPNP_E_OUTOF_MEMORY;
+	}
+	for (i = 0; i < gMServShards; i++) {
+		shards[i].index = i;
+		shards[i].sock4 = INVALID_SOCKET;
+		shards[i].sock6 = INVALID_SOCKET;
+		shards[i].sock6UlaGua = INVALID_SOCKET;
+		shards[i].stopSock = INVALID_SOCKET;
+		shards[i].running = 0;
+	}
+	out->shards = shards;
+	out->shardCount = gMServShards;
+	first[0] = ss4;
+	first[1] = ss6;
+	first[2] = ss6UlaGua;
+	for (j = 0; j < 3; j++) {
+		if (first[j]->fd == INVALID_SOCKET) {
+			continue;
+		}
+		ret_val = set_reuseport(first[j]->fd);
+		if (ret_val) {
+			goto error;
+		}
+		for (i = 1; i < gMServShards; i++) {
+			ret_val = do_bind_listen_shard(&s, first[j]);
+			if (ret_val) {
+				goto error;
+			}
+			sock = j == 0   ? &shards[i].sock4
+			       : j == 1 ? &shards[i].sock6
+					: &shards[i].sock6UlaGua;
+			*sock = s.fd;
+		}
+	}
+	shards[0].sock4 = ss4->fd;
+	shards[0].sock6 = ss6->fd;
+	shards[0].sock6UlaGua = ss6UlaGua->fd;
+
+	return UPNP_E_SUCCESS;
+
+error:
+	close_shards(out);
+
+	return ret_val;
+}
+
 /*!
  * \brief Creates a STREAM socket, binds to INADDR_ANY and listens for
  * incoming connecttions. Returns the actual port which the sockets
@@ -1083,6 +1493,23 @@ static int get_miniserver_sockets(
 		__FILE__,
 		__LINE__,
 		"get_miniserver_sockets: bind successful\n");
+	if (gMServShards > 1) {
+		ret_val = get_miniserver_shards(out, &ss4, &ss6, &ss6UlaGua);
+		if (ret_val) {
+			goto error;
+		}
+		UpnpPrintf(UPNP_INFO,
+			MSERV,
+			__FILE__,
+			__LINE__,
+			"get_miniserver_sockets: %d listener shards\n",
+			gMServShards);
+		out->miniServerPort4 = ss4.actual_port;
+		out->miniServerPort6 = ss6.actual_port;
+		out->miniServerPort6UlaGua = ss6UlaGua.actual_port;
+
+		return UPNP_E_SUCCESS;
+	}
 	out->miniServerPort4 = ss4.actual_port;
 	out->miniServerPort6 = ss6.actual_port;
 	out->miniServerPort6UlaGua = ss6UlaGua.actual_port;
@@ -1181,6 +1608,8 @@ static UPNP_INLINE void InitMiniServerSockArray(MiniServerSockArray *miniSocket)
 	miniSocket->ssdpReqSock4 = INVALID_SOCKET;
 	miniSocket->ssdpReqSock6 = INVALID_SOCKET;
 	#endif /* INCLUDE_CLIENT_APIS */
+	miniSocket->shardCount = 0;
+	miniSocket->shards = NULL;
 }
 
 int StartMiniServer(
@@ -1229,6 +1658,7 @@ int StartMiniServer(
 		sock_close(miniSocket->miniServerSock4);
 		sock_close(miniSocket->miniServerSock6);
 		sock_close(miniSocket->miniServerSock6UlaGua);
+		close_shards(miniSocket);
 		free(miniSocket);
 		return ret_code;
 	}
@@ -1239,6 +1669,22 @@ int StartMiniServer(
 		sock_close(miniSocket->miniServerSock6);
 		sock_close(miniSocket->miniServerSock6UlaGua);
 		sock_close(miniSocket->miniServerStopSock);
+		close_shards(miniSocket);
+		free(miniSocket);
+		return ret_code;
+	}
+	/* HTTP listener shards, RunMiniServer() then only reads the SSDP
+	 * sockets. */
+	ret_code = start_shards(miniSocket);
+	if (ret_code != UPNP_E_SUCCESS) {
+		sock_close(miniSocket->miniServerStopSock);
+		sock_close(miniSocket->ssdpSock4);
+		sock_close(miniSocket->ssdpSock6);
+		sock_close(miniSocket->ssdpSock6UlaGua);
+	#ifdef INCLUDE_CLIENT_APIS
+		sock_close(miniSocket->ssdpReqSock4);
+		sock_close(miniSocket->ssdpReqSock6);
+	#endif /* INCLUDE_CLIENT_APIS */
 		free(miniSocket);
 		return ret_code;
 	}
@@ -1247,6 +1693,9 @@ int StartMiniServer(
 	TPJobSetFreeFunction(&job, (free_routine)free);
 	ret_code = ThreadPoolAddPersistent(&gMiniServerThreadPool, &job, NULL);
 	if (ret_code < 0) {
+		gMServState = MSERV_STOPPING;
+		stop_shards(miniSocket);
+		gMServState = MSERV_IDLE;
 		sock_close(miniSocket->miniServerSock4);
 		sock_close(miniSocket->miniServerSock6);
 		sock_close(miniSocket->miniServerSock6UlaGua);
@@ -1293,6 +1742,30 @@ int StartMiniServer(
 	return UPNP_E_SUCCESS;
 }
 
+int SetMiniServerShards(int shards)
+{
+	if (shards < 1 || shards > MINISERVER_MAX_LISTENER_SHARDS) {
+		return UPNP_E_INVALID_PARAM;
+	}
+	#ifndef MINISERVER_SO_REUSEPORT
+	if (shards > 1) {
+		return UPNP_E_INVALID_PARAM;
+	}
+	#endif
+	gMServShards = shards;
+
+	return UPNP_E_SUCCESS;
+}
+
+int GetMiniServerShardThreads(void)
+{
+	#ifdef INTERNAL_WEB_SERVER
+	return gMServShards > 1 ? gMServShards : 0;
+	#else
+	return 0;
+	#endif
+}
+
 int StopMiniServer()
 {
 	char errorBuffer[ERROR_BUFFER_LEN];
@@ -0,0 +1,692 @@
+/**************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * - Neither name of Intel Corporation nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+/*!
+ * \file
+ *
+ * \brief Event loop of the asynchronous HTTP client.
+ */
+
+#include "config.h"
+
+#include "httpasync.h"
+
+#include "UpnpInet.h"
+#include "UpnpStdInt.h" /* for ssize_t */
+#include "httpconnpool.h"
+#include "ithread.h"
+#include "metrics.h"
+#include "sock.h"
+#include "unixutil.h" /* for socklen_t */
+#include "upnp.h"
+#include "upnpapi.h"
+#include "upnpdebug.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+	#define poll WSAPoll
+#else
+	#include <arpa/inet.h>
+	#include <poll.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+	#define MSG_NOSIGNAL 0
+#endif
+
+/*! Size of the buffer responses are read into. */
+#define HTTP_ASYNC_READ_SIZE 4096
+
+/*! Milliseconds before the loop posts again the callbacks the full job
+ * queue of the receive thread pool refused. */
+#define HTTP_ASYNC_REPOST_MS 10
+
+typedef enum
+{
+	ASYNC_CONNECTING,
+	ASYNC_SENDING,
+	ASYNC_RECEIVING
+} http_async_state;
+
+typedef struct HTTP_ASYNC_REQUEST
+{
+	SOCKET sock;
+	http_async_state state;
+	/*! Destination address. */
+	struct sockaddr_storage address;
+	const char *request;
+	size_t request_length;
+	/*! Bytes of the request already sent. */
+	size_t sent;
+	http_method_t method;
+	int timeout_secs;
+	/*! Parse the XML body of the response while it is received. */
+	int push_xml;
+	/*! upnp_clock_usec() time at which the request times out, set when
+	 * it is started. */
+	int64_t deadline;
+	/*! The response has no length, it ends with the connection. */
+	int ok_on_close;
+	/*! The connection was taken from the keep-alive pool. */
+	int reused;
+	/*! The server closed or reset the connection. */
+	int closed;
+	int ret_code;
+	http_parser_t response;
+	http_async_callback callback;
+	free_routine free_cookie;
+	void *cookie;
+	struct HTTP_ASYNC_REQUEST *next;
+} http_async_request;
+
+typedef enum
+{
+	ASYNC_IDLE,
+	ASYNC_RUNNING,
+	ASYNC_STOPPING
+} http_async_loop_state;
+
+/*! Protects the queue and the state. */
+static ithread_mutex_t gAsyncMutex;
+/*! Requests queued by http_AsyncRequest(), not started yet. */
+static http_async_request *gAsyncQueueHead = NULL;
+static http_async_request *gAsyncQueueTail = NULL;
+static volatile http_async_loop_state gAsyncState = ASYNC_IDLE;
+/*! Loopback datagram socket the loop polls to be woken up. */
+static SOCKET gAsyncWakeSock = INVALID_SOCKET;
+static struct sockaddr_in gAsyncWakeAddr;
+
+/*!
+ * \brief Tells whether the last socket call failed only because it would
+ * have blocked.
+ */
+static int async_would_block(void)
+{
+#ifdef _WIN32
+	int err = WSAGetLastError();
+
+	return err == WSAEWOULDBLOCK || err == WSAEINPROGRESS;
+#else
+	return errno == EWOULDBLOCK || errno == EAGAIN || errno == EINPROGRESS;
+#endif
+}
+
+/*!
+ * \brief Tells whether the last socket call failed because the peer reset
+ * the connection.
+ */
+static int async_was_reset(void)
+{
+#ifdef _WIN32
+	return WSAGetLastError() == WSAECONNRESET;
+#else
+	return errno == ECONNRESET;
+#endif
+}
+
+/*!
+ * \brief Wakes up the loop from poll().
+ */
+static void async_wake(void)
+{
+	char c = 0;
+
+	sendto(gAsyncWakeSock,
+		&c,
+		1,
+		0,
+		(struct sockaddr *)&gAsyncWakeAddr,
+		sizeof(gAsyncWakeAddr));
+}
+
+/*!
+ * \brief Frees a request whose callback was not called, releasing the
+ * cookie.
+ */
+static void async_drop(
+	/*! [in] Request. */
+	void *arg)
+{
+	http_async_request *req = (http_async_request *)arg;
+
+	if (req->free_cookie)
+		req->free_cookie(req->cookie);
+	httpmsg_destroy(&req->response.msg);
+	free(req);
+}
+
+/*!
+ * \brief Thread pool job calling the callback of a finished request.
+ */
+static void async_complete(
+	/*! [in] Request. */
+	void *arg)
+{
+	http_async_request *req = (http_async_request *)arg;
+
+	req->callback(req->ret_code, &req->response, req->cookie);
+	httpmsg_destroy(&req->response.msg);
+	free(req);
+}
+
+/*!
+ * \brief Hands a finished request to the receive thread pool for the
+ * callback.
+ *
+ * \return 0, or an error if the job queue is full.
+ */
+static int async_post(
+	/*! [in] Request, with ret_code set. */
+	http_async_request *req)
+{
+	ThreadPoolJob job;
+
+	memset(&job, 0, sizeof(job));
+	TPJobInit(&job, (start_routine)async_complete, req);
+	TPJobSetFreeFunction(&job, (free_routine)async_drop);
+	TPJobSetPriority(&job, MED_PRIORITY);
+
+	return ThreadPoolAdd(&gRecvThreadPool, &job, NULL);
+}
+
+/*!
+ * \brief Gives the connection of a finished request back to the keep-alive
+ * pool, or closes it, and hands the request to the receive thread pool for
+ * the callback.
+ *
+ * The callback never runs on the loop, where it could stall the other
+ * requests or wait for the loop to stop. A request the full job queue
+ * refuses is kept in \b unposted, to be posted again.
+ */
+static void async_finish(
+	/*! [in] Request, with ret_code set. */
+	http_async_request *req,
+	/*! [in,out] Requests waiting to be posted. */
+	http_async_request **unposted)
+{
+	if (req->sock != INVALID_SOCKET) {
+		if (req->ret_code == UPNP_E_SUCCESS &&
+			http_ConnPoolReusable(&req->response) &&
+			sock_make_blocking(req->sock) == 0)
+			http_ConnPoolPut(&req->address, req->sock);
+		else
+			sock_close(req->sock);
+		req->sock = INVALID_SOCKET;
+	}
+	if (req->ret_code == UPNP_E_SUCCESS) {
+		UpnpPrintf(UPNP_INFO,
+			HTTP,
+			__FILE__,
+			__LINE__,
+			"<<< (RECVD) <<<\n%s\n-----------------\n",
+			req->response.msg.msg.buf);
+	}
+	if (async_post(req) != 0) {
+		req->next = *unposted;
+		*unposted = req;
+	}
+}
+
+/*!
+ * \brief Opens the connection of a request, or takes one from the
+ * keep-alive pool.
+ *
+ * \return 0 if the connection is made or in progress, -1 if the request
+ * 	failed, with ret_code set.
+ */
+static int async_start(
+	/*! [in,out] Request. */
+	http_async_request *req,
+	/*! [in] Make a new connection, do not look into the pool. */
+	int fresh)
+{
+	socklen_t len;
+#ifdef SO_NOSIGPIPE
+	int set = 1;
+#endif
+
+	req->deadline = upnp_clock_usec() + (int64_t)req->timeout_secs * 1000000;
+	req->sock = fresh ? INVALID_SOCKET : http_ConnPoolGet(&req->address);
+	req->reused = req->sock != INVALID_SOCKET;
+	if (!req->reused)
+		req->sock = socket((int)req->address.ss_family, SOCK_STREAM, 0);
+	if (req->sock == INVALID_SOCKET) {
+		req->ret_code = UPNP_E_SOCKET_ERROR;
+		return -1;
+	}
+#ifdef SO_NOSIGPIPE
+	setsockopt(req->sock, SOL_SOCKET, SO_NOSIGPIPE, &set, sizeof(set));
+#endif
+	if (sock_make_no_blocking(req->sock) == -1) {
+		req->ret_code = UPNP_E_SOCKET_ERROR;
+		return -1;
+	}
+	if (req->reused) {
+		req->state = ASYNC_SENDING;
+		return 0;
+	}
+	len = (socklen_t)(req->address.ss_family == AF_INET6
+				  ? sizeof(struct sockaddr_in6)
+				  : sizeof(struct sockaddr_in));
+	if (connect(req->sock, (struct sockaddr *)&req->address, len) == 0) {
+		req->state = ASYNC_SENDING;
+	} else if (async_would_block()) {
+		req->state = ASYNC_CONNECTING;
+	} else {
+		req->ret_code = UPNP_E_SOCKET_CONNECT;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*!
+ * \brief Advances a request after its socket became ready.
+ *
+ * \return 1 when the request is finished, with ret_code set, 0 when it
+ * 	waits for the socket again.
+ */
+static int async_step(
+	/*! [in,out] Request. */
+	http_async_request *req)
+{
+	char buf[HTTP_ASYNC_READ_SIZE];
+	ssize_t num;
+	int valopt;
+	socklen_t len;
+
+	if (req->state == ASYNC_CONNECTING) {
+		valopt = 0;
+		len = sizeof(valopt);
+		if (getsockopt(req->sock,
+			    SOL_SOCKET,
+			    SO_ERROR,
+			    (void *)&valopt,
+			    &len) != 0 ||
+			valopt != 0) {
+			req->ret_code = UPNP_E_SOCKET_CONNECT;
+			return 1;
+		}
+		req->state = ASYNC_SENDING;
+	}
+	if (req->state == ASYNC_SENDING) {
+		while (req->sent < req->request_length) {
+			num = send(req->sock,
+				req->request + req->sent,
+				req->request_length - req->sent,
+				MSG_NOSIGNAL);
+			if (num < 0) {
+				if (async_would_block())
+					return 0;
+				req->ret_code = UPNP_E_SOCKET_WRITE;
+				return 1;
+			}
+			req->sent += (size_t)num;
+		}
+		req->state = ASYNC_RECEIVING;
+		return 0;
+	}
+	/* ASYNC_RECEIVING */
+	while (1) {
+		num = recv(req->sock, buf, sizeof(buf), 0);
+		if (num < 0) {
+			if (async_would_block())
+				return 0;
+			req->closed = async_was_reset();
+			req->ret_code = UPNP_E_SOCKET_READ;
+			return 1;
+		}
+		if (num == 0) {
+			req->closed = 1;
+			req->ret_code = req->ok_on_close ? UPNP_E_SUCCESS
+							 : UPNP_E_BAD_HTTPMSG;
+			return 1;
+		}
+		switch (parser_append(&req->response, buf, (size_t)num)) {
+		case PARSE_SUCCESS:
+			if (g_maxContentLength > 0 &&
+				req->response.content_length >
+					(unsigned int)g_maxContentLength)
+				req->ret_code = UPNP_E_OUTOF_BOUNDS;
+			else
+				req->ret_code = UPNP_E_SUCCESS;
+			return 1;
+		case PARSE_FAILURE:
+		case PARSE_NO_MATCH:
+			req->ret_code = UPNP_E_BAD_HTTPMSG;
+			return 1;
+		case PARSE_INCOMPLETE_ENTITY:
+			/* read until close */
+			req->ok_on_close = 1;
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+/*!
+ * \brief Starts a failed request again on a new connection if it failed on
+ * a pooled one because the server had closed the idle connection: the
+ * request could not be sent, or the connection was closed or reset before
+ * any part of the response arrived. A timeout is never retried, the server
+ * may still be running the request.
+ *
+ * \return 1 if the request was started again, 0 if it is finished.
+ */
+static int async_retry(
+	/*! [in,out] Request, with ret_code set. */
+	http_async_request *req)
+{
+	if (!req->reused || req->ret_code == UPNP_E_SUCCESS ||
+		req->response.msg.msg.length > 0)
+		return 0;
+	if (req->ret_code != UPNP_E_SOCKET_WRITE && !req->closed)
+		return 0;
+	sock_close(req->sock);
+	req->sent = 0;
+	req->ok_on_close = 0;
+	req->closed = 0;
+	httpmsg_destroy(&req->response.msg);
+	parser_response_init(&req->response, req->method);
+	req->response.push_xml = req->push_xml;
+
+	return async_start(req, 1) == 0;
+}
+
+/*!
+ * \brief Takes the first queued request, the caller holds gAsyncMutex.
+ */
+static http_async_request *async_dequeue(void)
+{
+	http_async_request *req = gAsyncQueueHead;
+
+	if (req) {
+		gAsyncQueueHead = req->next;
+		if (gAsyncQueueHead == NULL)
+			gAsyncQueueTail = NULL;
+		req->next = NULL;
+	}
+
+	return req;
+}
+
+/*!
+ * \brief The event loop, a persistent job of the send thread pool.
+ */
+static void async_loop(
+	/*! [in] Unused. */
+	void *arg)
+{
+	http_async_request **active;
+	struct pollfd *fds;
+	http_async_request *req;
+	http_async_request *unposted = NULL;
+	http_async_request *pending;
+	size_t count = 0;
+	size_t i;
+	int stop = 0;
+	int64_t now;
+	int64_t wait;
+	int timeout;
+	int ret;
+	char buf[64];
+
+	(void)arg;
+	active = (http_async_request **)malloc(
+		HTTP_ASYNC_MAX_CONNECTIONS * sizeof(*active));
+	fds = (struct pollfd *)malloc(
+		(HTTP_ASYNC_MAX_CONNECTIONS + 1) * sizeof(*fds));
+	if (active == NULL || fds == NULL) {
+		UpnpPrintf(UPNP_CRITICAL,
+			HTTP,
+			__FILE__,
+			__LINE__,
+			"http async: out of memory, loop not started\n");
+		goto exit_function;
+	}
+	while (1) {
+		ithread_mutex_lock(&gAsyncMutex);
+		stop = gAsyncState != ASYNC_RUNNING;
+		ithread_mutex_unlock(&gAsyncMutex);
+		if (stop)
+			break;
+		/* post again the callbacks refused last time */
+		pending = unposted;
+		unposted = NULL;
+		while (pending) {
+			req = pending;
+			pending = req->next;
+			req->next = NULL;
+			if (async_post(req) != 0) {
+				req->next = unposted;
+				unposted = req;
+			}
+		}
+		/* start queued requests */
+		while (count < HTTP_ASYNC_MAX_CONNECTIONS) {
+			ithread_mutex_lock(&gAsyncMutex);
+			req = async_dequeue();
+			ithread_mutex_unlock(&gAsyncMutex);
+			if (req == NULL)
+				break;
+			if (async_start(req, 0) == 0)
+				active[count++] = req;
+			else
+				async_finish(req, &unposted);
+		}
+		/* wait for the sockets or the next deadline */
+		now = upnp_clock_usec();
+		timeout = -1;
+		fds[0].fd = gAsyncWakeSock;
+		fds[0].events = POLLIN;
+		fds[0].revents = 0;
+		for (i = 0; i < count; i++) {
+			req = active[i];
+			fds[i + 1].fd = req->sock;
+			fds[i + 1].events =
+				req->state == ASYNC_RECEIVING ? POLLIN : POLLOUT;
+			fds[i + 1].revents = 0;
+			wait = (req->deadline - now + 999) / 1000;
+			if (wait < 0)
+				wait = 0;
+			if (timeout < 0 || wait < timeout)
+				timeout = (int)wait;
+		}
+		if (unposted &&
+			(timeout < 0 || timeout > HTTP_ASYNC_REPOST_MS))
+			timeout = HTTP_ASYNC_REPOST_MS;
+		ret = poll(fds, (unsigned long)count + 1, timeout);
+		if (ret < 0) {
+			if (errno != EINTR)
+				imillisleep(10);
+			continue;
+		}
+		if (fds[0].revents) {
+			while (recv(gAsyncWakeSock, buf, sizeof(buf), 0) > 0) {
+			}
+		}
+		/* backwards, so that moving the last request into a finished
+		 * request's slot does not skip anything */
+		now = upnp_clock_usec();
+		for (i = count; i-- > 0;) {
+			req = active[i];
+			if (fds[i + 1].revents) {
+				if (!async_step(req) || async_retry(req))
+					continue;
+			} else if (req->deadline > now) {
+				continue;
+			} else {
+				req->ret_code = req->state == ASYNC_CONNECTING
+							? UPNP_E_SOCKET_CONNECT
+							: UPNP_E_TIMEDOUT;
+			}
+			async_finish(req, &unposted);
+			active[i] = active[--count];
+		}
+	}
+
+exit_function:
+	/* drop what is left */
+	for (i = 0; i < count; i++) {
+		sock_close(active[i]->sock);
+		async_drop(active[i]);
+	}
+	while ((req = unposted) != NULL) {
+		unposted = req->next;
+		async_drop(req);
+	}
+	ithread_mutex_lock(&gAsyncMutex);
+	while ((req = async_dequeue()) != NULL)
+		async_drop(req);
+	gAsyncState = ASYNC_IDLE;
+	ithread_mutex_unlock(&gAsyncMutex);
+	free(active);
+	free(fds);
+}
+
+int http_AsyncInit(void)
+{
+	socklen_t len = sizeof(gAsyncWakeAddr);
+	ThreadPoolJob job;
+
+	if (gAsyncState != ASYNC_IDLE)
+		return UPNP_E_INIT;
+	gAsyncWakeSock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (gAsyncWakeSock == INVALID_SOCKET)
+		return UPNP_E_OUTOF_SOCKET;
+	memset(&gAsyncWakeAddr, 0, sizeof(gAsyncWakeAddr));
+	gAsyncWakeAddr.sin_family = (sa_family_t)AF_INET;
+	inet_pton(AF_INET, "127.0.0.1", &gAsyncWakeAddr.sin_addr);
+	if (bind(gAsyncWakeSock,
+		    (struct sockaddr *)&gAsyncWakeAddr,
+		    sizeof(gAsyncWakeAddr)) == SOCKET_ERROR ||
+		getsockname(gAsyncWakeSock,
+			(struct sockaddr *)&gAsyncWakeAddr,
+			&len) == SOCKET_ERROR ||
+		sock_make_no_blocking(gAsyncWakeSock) == -1) {
+		sock_close(gAsyncWakeSock);
+		gAsyncWakeSock = INVALID_SOCKET;
+		return UPNP_E_SOCKET_BIND;
+	}
+	ithread_mutex_init(&gAsyncMutex, NULL);
+	gAsyncState = ASYNC_RUNNING;
+	memset(&job, 0, sizeof(job));
+	TPJobInit(&job, (start_routine)async_loop, NULL);
+	TPJobSetPriority(&job, MED_PRIORITY);
+	if (ThreadPoolAddPersistent(&gSendThreadPool, &job, NULL) != 0) {
+		gAsyncState = ASYNC_IDLE;
+		ithread_mutex_destroy(&gAsyncMutex);
+		sock_close(gAsyncWakeSock);
+		gAsyncWakeSock = INVALID_SOCKET;
+		return UPNP_E_OUTOF_MEMORY;
+	}
+
+	return UPNP_E_SUCCESS;
+}
+
+void http_AsyncShutdown(void)
+{
+	if (gAsyncState == ASYNC_IDLE)
+		return;
+	ithread_mutex_lock(&gAsyncMutex);
+	gAsyncState = ASYNC_STOPPING;
+	ithread_mutex_unlock(&gAsyncMutex);
+	while (gAsyncState != ASYNC_IDLE) {
+		async_wake();
+		imillisleep(10);
+	}
+	ithread_mutex_destroy(&gAsyncMutex);
+	sock_close(gAsyncWakeSock);
+	gAsyncWakeSock = INVALID_SOCKET;
+}
+
+int http_AsyncRequest(const uri_type *destination,
+	const char *request,
+	size_t request_length,
+	http_method_t req_method,
+	int timeout_secs,
+	int push_xml,
+	http_async_callback callback,
+	free_routine free_cookie,
+	void *cookie)
+{
+	http_async_request *req;
+	int wake;
+
+	req = (http_async_request *)malloc(sizeof(http_async_request));
+	if (req == NULL)
+		return UPNP_E_OUTOF_MEMORY;
+	memset(req, 0, sizeof(http_async_request));
+	req->sock = INVALID_SOCKET;
+	memcpy(&req->address,
+		&destination->hostport.IPaddress,
+		sizeof(req->address));
+	req->request = request;
+	req->request_length = request_length;
+	req->method = req_method;
+	req->timeout_secs = timeout_secs;
+	req->push_xml = push_xml;
+	req->callback = callback;
+	req->free_cookie = free_cookie;
+	req->cookie = cookie;
+	parser_response_init(&req->response, req_method);
+	req->response.push_xml = push_xml;
+
+	if (gAsyncState != ASYNC_RUNNING) {
+		httpmsg_destroy(&req->response.msg);
+		free(req);
+		return UPNP_E_FINISH;
+	}
+	ithread_mutex_lock(&gAsyncMutex);
+	if (gAsyncState != ASYNC_RUNNING) {
+		ithread_mutex_unlock(&gAsyncMutex);
+		httpmsg_destroy(&req->response.msg);
+		free(req);
+		return UPNP_E_FINISH;
+	}
+	/* only the first request queued needs to wake the loop up, the
+	 * others are picked up with it */
+	wake = gAsyncQueueHead == NULL;
+	if (gAsyncQueueTail)
+		gAsyncQueueTail->next = req;
+	else
+		gAsyncQueueHead = req;
+	gAsyncQueueTail = req;
+	ithread_mutex_unlock(&gAsyncMutex);
+	if (wake)
+		async_wake();
+
+	return UPNP_E_SUCCESS;
+}
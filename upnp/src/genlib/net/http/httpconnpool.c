@@ -0,0 +1,278 @@
+/**************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * - Neither name of Intel Corporation nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+/*!
+ * \file
+ *
+ * \brief Pool of idle keep-alive client connections.
+ */
+
+#include "config.h"
+
+#include "httpconnpool.h"
+
+#include "UpnpStdInt.h" /* for int64_t */
+#include "ithread.h"
+#include "metrics.h"
+#include "sock.h"
+#include "upnp.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+	#include <winsock2.h>
+#else
+	#include <sys/select.h>
+#endif
+
+typedef struct HTTP_POOLED_CONNECTION
+{
+	SOCKET sock;
+	struct sockaddr_storage address;
+	/*! upnp_clock_usec() time at which it was put into the pool. */
+	int64_t since;
+} http_pooled_connection;
+
+/*! Protects the pool. */
+static ithread_mutex_t gConnPoolMutex;
+static int gConnPoolInitialized = 0;
+/*! Idle connections, in the order they were put into the pool. */
+static http_pooled_connection gConnPool[HTTP_POOL_MAX_IDLE];
+static size_t gConnPoolCount = 0;
+
+/*!
+ * \brief Compares the family, address and port of two destinations.
+ *
+ * \return 1 if they are the same.
+ */
+static int pool_same_address(
+	/*! [in] First address. */
+	const struct sockaddr_storage *a,
+	/*! [in] Second address. */
+	const struct sockaddr_storage *b)
+{
+	const struct sockaddr_in *a4;
+	const struct sockaddr_in *b4;
+	const struct sockaddr_in6 *a6;
+	const struct sockaddr_in6 *b6;
+
+	if (a->ss_family != b->ss_family)
+		return 0;
+	switch (a->ss_family) {
+	case AF_INET:
+		a4 = (const struct sockaddr_in *)a;
+		b4 = (const struct sockaddr_in *)b;
+		return a4->sin_port == b4->sin_port &&
+		       a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+	case AF_INET6:
+		a6 = (const struct sockaddr_in6 *)a;
+		b6 = (const struct sockaddr_in6 *)b;
+		return a6->sin6_port == b6->sin6_port &&
+		       a6->sin6_scope_id == b6->sin6_scope_id &&
+		       memcmp(&a6->sin6_addr,
+			       &b6->sin6_addr,
+			       sizeof(a6->sin6_addr)) == 0;
+	default:
+		return 0;
+	}
+}
+
+/*!
+ * \brief Tells whether an idle connection can be read from, which means
+ * the server closed it or sent something unexpected.
+ *
+ * \return 1 if the connection is no longer usable.
+ */
+static int pool_is_stale(
+	/*! [in] Idle socket. */
+	SOCKET sock)
+{
+	fd_set readSet;
+	struct timeval timeout;
+
+	FD_ZERO(&readSet);
+	FD_SET(sock, &readSet);
+	timeout.tv_sec = 0;
+	timeout.tv_usec = 0;
+
+	return select((int)sock + 1, &readSet, NULL, NULL, &timeout) != 0;
+}
+
+/*!
+ * \brief Closes the connection in a slot and removes it, keeping the order
+ * of the others. The caller holds gConnPoolMutex.
+ */
+static void pool_remove(
+	/*! [in] Slot. */
+	size_t i)
+{
+	SOCKINFO info;
+
+	sock_init(&info, gConnPool[i].sock);
+	sock_destroy(&info, SD_BOTH);
+	gConnPoolCount--;
+	memmove(&gConnPool[i],
+		&gConnPool[i + 1],
+		(gConnPoolCount - i) * sizeof(gConnPool[0]));
+}
+
+/*!
+ * \brief Closes the connections idle for too long. The caller holds
+ * gConnPoolMutex.
+ */
+static void pool_expire(
+	/*! [in] upnp_clock_usec() time. */
+	int64_t now)
+{
+	size_t n = 0;
+
+	/* oldest first */
+	while (n < gConnPoolCount &&
+		now - gConnPool[n].since >=
+			(int64_t)HTTP_POOL_IDLE_TIMEOUT * 1000000)
+		n++;
+	while (n-- > 0)
+		pool_remove(0);
+}
+
+int http_ConnPoolInit(void)
+{
+	if (!gConnPoolInitialized) {
+		ithread_mutex_init(&gConnPoolMutex, NULL);
+		gConnPoolCount = 0;
+		gConnPoolInitialized = 1;
+	}
+
+	return UPNP_E_SUCCESS;
+}
+
+void http_ConnPoolShutdown(void)
+{
+	if (!gConnPoolInitialized)
+		return;
+	ithread_mutex_lock(&gConnPoolMutex);
+	while (gConnPoolCount > 0)
+		pool_remove(gConnPoolCount - 1);
+	gConnPoolInitialized = 0;
+	ithread_mutex_unlock(&gConnPoolMutex);
+	ithread_mutex_destroy(&gConnPoolMutex);
+}
+
+SOCKET http_ConnPoolGet(const struct sockaddr_storage *address)
+{
+	SOCKET sock = INVALID_SOCKET;
+	size_t i;
+
+	if (!gConnPoolInitialized)
+		return INVALID_SOCKET;
+	ithread_mutex_lock(&gConnPoolMutex);
+	pool_expire(upnp_clock_usec());
+	/* newest first, the least likely to have been closed by the
+	 * server */
+	for (i = gConnPoolCount; i-- > 0;) {
+		if (!pool_same_address(&gConnPool[i].address, address))
+			continue;
+		if (pool_is_stale(gConnPool[i].sock)) {
+			pool_remove(i);
+			continue;
+		}
+		sock = gConnPool[i].sock;
+		gConnPoolCount--;
+		memmove(&gConnPool[i],
+			&gConnPool[i + 1],
+			(gConnPoolCount - i) * sizeof(gConnPool[0]));
+		break;
+	}
+	ithread_mutex_unlock(&gConnPoolMutex);
+
+	return sock;
+}
+
+void http_ConnPoolPut(const struct sockaddr_storage *address, SOCKET sock)
+{
+	SOCKINFO info;
+	size_t oldest = 0;
+	size_t same = 0;
+	size_t i;
+	int64_t now;
+
+	if (!gConnPoolInitialized) {
+		sock_init(&info, sock);
+		sock_destroy(&info, SD_BOTH);
+		return;
+	}
+	now = upnp_clock_usec();
+	ithread_mutex_lock(&gConnPoolMutex);
+	pool_expire(now);
+	for (i = 0; i < gConnPoolCount; i++) {
+		if (pool_same_address(&gConnPool[i].address, address)) {
+			if (same == 0)
+				oldest = i;
+			same++;
+		}
+	}
+	if (same >= HTTP_POOL_MAX_IDLE_PER_HOST)
+		pool_remove(oldest);
+	else if (gConnPoolCount >= HTTP_POOL_MAX_IDLE)
+		pool_remove(0);
+	gConnPool[gConnPoolCount].sock = sock;
+	memcpy(&gConnPool[gConnPoolCount].address, address, sizeof(*address));
+	gConnPool[gConnPoolCount].since = now;
+	gConnPoolCount++;
+	ithread_mutex_unlock(&gConnPoolMutex);
+}
+
+int http_ConnPoolReusable(http_parser_t *response)
+{
+	http_header_t *header;
+	const char *value;
+	size_t length;
+	size_t i;
+
+	if (response->position != POS_COMPLETE ||
+		response->ent_position == ENTREAD_UNTIL_CLOSE)
+		return 0;
+	if (response->msg.major_version < 1 ||
+		(response->msg.major_version == 1 &&
+			response->msg.minor_version < 1))
+		return 0;
+	header = httpmsg_find_hdr_str(&response->msg, "CONNECTION");
+	if (header) {
+		value = header->value.buf;
+		length = header->value.length;
+		for (i = 0; i + 5 <= length; i++) {
+			if (strncasecmp(value + i, "close", 5) == 0)
+				return 0;
+		}
+	}
+
+	return 1;
+}
@@ -43,6 +43,7 @@
 #include "config.h"
 
 #include "httpparser.h"
+#include "parsetools.h"
 #include "statcodes.h"
 #include "strintmap.h"
 #include "unixutil.h"
@@ -400,6 +401,7 @@ void httpmsg_init(http_message_t *msg)
 	msg->initialized = 1;
 	msg->entity.buf = NULL;
 	msg->entity.length = (size_t)0;
+	msg->xml_parser = NULL;
 	ListInit(&msg->headers, httpmsg_compare, httpheader_free);
 	membuffer_init(&msg->msg);
 	membuffer_init(&msg->status_msg);
@@ -426,10 +428,28 @@ void httpmsg_destroy(http_message_t *msg)
 		membuffer_destroy(&msg->msg);
 		membuffer_destroy(&msg->status_msg);
 		free(msg->urlbuf);
+		ixmlPushParser_free(msg->xml_parser);
+		msg->xml_parser = NULL;
 		msg->initialized = 0;
 	}
 }
 
+int httpmsg_get_xml_doc(http_message_t *msg, IXML_Document **doc)
+{
+	int rc;
+
+	assert(msg != NULL);
+
+	if (msg->xml_parser == NULL) {
+		return ixmlParseBufferEx(msg->entity.buf, doc);
+	}
+	rc = ixmlPushParser_finish(msg->xml_parser, doc);
+	ixmlPushParser_free(msg->xml_parser);
+	msg->xml_parser = NULL;
+
+	return rc;
+}
+
 /************************************************************************
  * Function :	httpmsg_find_hdr_str
  *
@@ -1824,6 +1844,33 @@ static UPNP_INLINE parse_status_t parser_parse_entity_until_close(
 	return PARSE_INCOMPLETE_ENTITY; /* add anything */
 }
 
+/*!
+ * \brief Creates the XML parser the body is given to while it is received,
+ * if the caller asked for it and the message is a SOAP action, a SOAP
+ * response or an event with an XML body.
+ *
+ * When the XML parser cannot be created, the body is kept in the message.
+ */
+static void parser_start_xml(
+	/*! [in,out] HTTP Parser object. */
+	http_parser_t *parser)
+{
+	http_message_t *hmsg = &parser->msg;
+
+	if (!parser->push_xml || !has_xml_content_type(hmsg)) {
+		return;
+	}
+	/* other requests go to the web server, which needs the body */
+	if (hmsg->is_request && hmsg->method != SOAPMETHOD_POST &&
+		hmsg->method != HTTPMETHOD_MPOST &&
+		hmsg->method != HTTPMETHOD_NOTIFY) {
+		return;
+	}
+	if (ixmlPushParser_create(&hmsg->xml_parser) != IXML_SUCCESS) {
+		hmsg->xml_parser = NULL;
+	}
+}
+
 /************************************************************************
  * Function: parser_get_entity_read_method
  *
@@ -1892,6 +1939,8 @@ parse_status_t parser_get_entity_read_method(http_parser_t *parser)
 		}
 	}
 
+	parser_start_xml(parser);
+
 	/* * transfer-encoding -- used to indicate chunked data */
 	if (httpmsg_find_hdr(hmsg, HDR_TRANSFER_ENCODING, &hdr_value)) {
 		if (raw_find_str(&hdr_value, "chunked") >= 0) {
@@ -2084,6 +2133,64 @@ parse_status_t parser_parse(http_parser_t *parser)
 	return status;
 }
 
+/*!
+ * \brief Gives the part of the body received since the last call to the XML
+ * parser of the message, and removes it from the raw message buffer.
+ *
+ * Only the body of a message that is still being read is given this way;
+ * XML errors are kept by the XML parser and returned by
+ * httpmsg_get_xml_doc().
+ */
+static void parser_push_entity(
+	/*! [in,out] HTTP Parser object. */
+	http_parser_t *parser)
+{
+	http_message_t *hmsg = &parser->msg;
+	size_t start = parser->entity_start_position;
+	size_t end;
+	size_t length;
+
+	if (hmsg->xml_parser == NULL ||
+		(parser->position != POS_ENTITY &&
+			parser->position != POS_COMPLETE)) {
+		return;
+	}
+	/* end of the body received so far, without the transfer coding */
+	switch (parser->ent_position) {
+	case ENTREAD_USING_CLEN:
+		end = start + parser->content_length - hmsg->amount_discarded;
+		if (end > hmsg->msg.length) {
+			end = hmsg->msg.length;
+		}
+		break;
+	case ENTREAD_USING_CHUNKED:
+	case ENTREAD_CHUNKY_BODY:
+		/* the chunks before the cursor are complete */
+		end = parser->scanner.cursor;
+		break;
+	case ENTREAD_CHUNKY_HEADERS:
+		end = start + hmsg->entity.length - hmsg->amount_discarded;
+		break;
+	case ENTREAD_UNTIL_CLOSE:
+		end = hmsg->msg.length;
+		break;
+	default:
+		return;
+	}
+	if (end <= start) {
+		return;
+	}
+	length = end - start;
+
+	ixmlPushParser_feed(hmsg->xml_parser, hmsg->msg.buf + start, length);
+	membuffer_delete(&hmsg->msg, start, length);
+	if (parser->scanner.cursor >= end) {
+		parser->scanner.cursor -= length;
+	}
+	hmsg->amount_discarded += length;
+	hmsg->entity.buf = hmsg->msg.buf + start;
+}
+
 /************************************************************************
  * Function: parser_append
  *
@@ -2106,6 +2213,7 @@ parse_status_t parser_append(
 	http_parser_t *parser, const char *buf, size_t buf_length)
 {
 	int ret_code;
+	parse_status_t status;
 
 	assert(parser != NULL);
 	assert(buf != NULL);
@@ -2118,7 +2226,13 @@ parse_status_t parser_append(
 		return PARSE_FAILURE;
 	}
 
-	return parser_parse(parser);
+	status = parser_parse(parser);
+	if (status != (parse_status_t)PARSE_FAILURE &&
+		status != (parse_status_t)PARSE_NO_MATCH) {
+		parser_push_entity(parser);
+	}
+
+	return status;
 }
 
 /************************************************************************
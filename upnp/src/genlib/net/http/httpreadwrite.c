@@ -46,7 +46,9 @@
 #include "UpnpInet.h"
 #include "UpnpIntTypes.h"
 #include "UpnpStdInt.h"
+#include "httpconnpool.h"
 #include "membuffer.h"
+#include "metrics.h"
 #include "sock.h"
 #include "statcodes.h"
 #include "unixutil.h"
@@ -56,6 +58,7 @@
 #include "webserver.h"
 
 #include <assert.h>
+#include <errno.h>
 #include <stdarg.h>
 #include <string.h>
 
@@ -178,6 +181,84 @@ static int private_connect(
 #endif /* UPNP_ENABLE_BLOCKING_TCP_CONNECTIONS */
 }
 
+/*!
+ * \brief Opens a blocking connection to an address, taking an idle
+ * keep-alive connection from the pool when there is one.
+ *
+ * \return UPNP_E_SUCCESS, UPNP_E_SOCKET_ERROR or UPNP_E_SOCKET_CONNECT.
+ */
+static int http_ConnectPooled(
+	/*! [in] Destination address. */
+	const struct sockaddr_storage *address,
+	/*! [in] Make a new connection, do not look into the pool. */
+	int fresh,
+	/*! [out] Socket information, initialized with INVALID_SOCKET on
+	 * failure. */
+	SOCKINFO *info,
+	/*! [out] 1 if the connection was taken from the pool, it may have
+	 * been closed by the server meanwhile. */
+	int *reused)
+{
+	SOCKET sock = INVALID_SOCKET;
+	size_t sockaddr_len;
+
+	sock_init(info, INVALID_SOCKET);
+	*reused = 0;
+	if (!fresh) {
+		sock = http_ConnPoolGet(address);
+		if (sock != INVALID_SOCKET) {
+			*reused = 1;
+			return sock_init(info, sock);
+		}
+	}
+	sock = socket((int)address->ss_family, SOCK_STREAM, 0);
+	if (sock == INVALID_SOCKET)
+		return UPNP_E_SOCKET_ERROR;
+	sock_init(info, sock);
+	sockaddr_len = address->ss_family == AF_INET6
+			       ? sizeof(struct sockaddr_in6)
+			       : sizeof(struct sockaddr_in);
+	if (private_connect(sock,
+		    (const struct sockaddr *)address,
+		    (socklen_t)sockaddr_len) == -1) {
+		sock_destroy(info, SD_BOTH);
+		return UPNP_E_SOCKET_CONNECT;
+	}
+
+	return UPNP_E_SUCCESS;
+}
+
+/*!
+ * \brief Tells whether the read of a response on a pooled connection failed
+ * only because the server had closed the connection before answering.
+ *
+ * Such a request can be sent again on a new connection: the server dropped
+ * the idle connection and did not run it. A timeout is not such a failure,
+ * the server may still be running the request.
+ *
+ * \return 1 if the connection was closed or reset before any byte of the
+ * 	response arrived, 0 otherwise.
+ */
+static int http_ClosedUnanswered(
+	/*! [in] Error returned by the read of the response. */
+	int ret_code,
+	/*! [in] The response read. */
+	const http_parser_t *response)
+{
+	if (response->msg.msg.length > 0)
+		return 0;
+	if (ret_code == UPNP_E_BAD_HTTPMSG)
+		/* end of file before the response */
+		return 1;
+	if (ret_code != UPNP_E_SOCKET_ERROR)
+		return 0;
+#ifdef _WIN32
+	return WSAGetLastError() == WSAECONNRESET;
+#else
+	return errno == ECONNRESET;
+#endif
+}
+
 #ifdef _WIN32
 struct tm *http_gmtime_r(const time_t *clock, struct tm *result)
 {
@@ -276,8 +357,13 @@ int http_FixUrl(uri_type *url, uri_type *fixed_url)
 int http_FixStrUrl(const char *urlstr, size_t urlstrlen, uri_type *fixed_url)
 {
 	uri_type url;
+	int ret_code;
 
-	if (parse_uri(urlstr, urlstrlen, &url) != HTTP_SUCCESS) {
+	ret_code = parse_uri(urlstr, urlstrlen, &url);
+	if (ret_code != HTTP_SUCCESS) {
+		/* the host name is being resolved in the background */
+		if (ret_code == UPNP_E_TIMEDOUT)
+			return ret_code;
 		return UPNP_E_INVALID_URL;
 	}
 
@@ -343,6 +429,164 @@ SOCKET http_Connect(uri_type *destination_url, uri_type *url)
 	return connfd;
 }
 
+#ifndef UPNP_ENABLE_BLOCKING_TCP_CONNECTIONS
+SOCKET http_ConnectFirst(uri_type *destination_urls,
+	size_t count,
+	int timeoutSecs,
+	uri_type *url,
+	size_t *index)
+{
+	SOCKET socks[HTTP_CONNECT_FIRST_MAX];
+	uri_type fixed[HTTP_CONNECT_FIRST_MAX];
+	SOCKET connfd = INVALID_SOCKET;
+	size_t winner = 0;
+	size_t pending = 0;
+	size_t opened = 0;
+	size_t i;
+	time_t deadline;
+	socklen_t sockaddr_len;
+	fd_set writeSet;
+	fd_set errorSet;
+	struct timeval timeout;
+	SOCKET maxfd;
+	int valopt;
+	socklen_t len;
+	int ret;
+
+	if (count > HTTP_CONNECT_FIRST_MAX)
+		count = HTTP_CONNECT_FIRST_MAX;
+	if (timeoutSecs < 0 || timeoutSecs > DEFAULT_TCP_CONNECT_TIMEOUT)
+		timeoutSecs = DEFAULT_TCP_CONNECT_TIMEOUT;
+	deadline = time(NULL) + timeoutSecs;
+	/* start all the connections */
+	for (i = 0; i < count; i++) {
+		socks[i] = INVALID_SOCKET;
+		if (connfd != INVALID_SOCKET ||
+			http_FixUrl(&destination_urls[i], &fixed[i]) != 0)
+			continue;
+		socks[i] = socket(
+			(int)fixed[i].hostport.IPaddress.ss_family, SOCK_STREAM, 0);
+		if (socks[i] == INVALID_SOCKET)
+			continue;
+		opened++;
+		sockaddr_len =
+			(socklen_t)(fixed[i].hostport.IPaddress.ss_family ==
+						    AF_INET6
+					    ? sizeof(struct sockaddr_in6)
+					    : sizeof(struct sockaddr_in));
+		if (sock_make_no_blocking(socks[i]) == -1) {
+			UpnpCloseSocket(socks[i]);
+			socks[i] = INVALID_SOCKET;
+			continue;
+		}
+		ret = connect(socks[i],
+			(struct sockaddr *)&fixed[i].hostport.IPaddress,
+			sockaddr_len);
+		if (ret == 0) {
+			/* e.g. loopback, no need to wait */
+			connfd = socks[i];
+			winner = i;
+	#ifdef _WIN32
+		} else if (WSAGetLastError() == WSAEWOULDBLOCK) {
+	#else
+		} else if (errno == EINPROGRESS) {
+	#endif
+			pending++;
+		} else {
+			UpnpCloseSocket(socks[i]);
+			socks[i] = INVALID_SOCKET;
+		}
+	}
+	/* wait for the first one to complete */
+	while (connfd == INVALID_SOCKET && pending > 0) {
+		FD_ZERO(&writeSet);
+		FD_ZERO(&errorSet);
+		maxfd = 0;
+		for (i = 0; i < count; i++) {
+			if (socks[i] == INVALID_SOCKET)
+				continue;
+			FD_SET(socks[i], &writeSet);
+			FD_SET(socks[i], &errorSet);
+			if (socks[i] > maxfd)
+				maxfd = socks[i];
+		}
+		timeout.tv_sec = (long)(deadline - time(NULL));
+		timeout.tv_usec = 0;
+		if (timeout.tv_sec < 0)
+			break;
+		ret = select((int)maxfd + 1, NULL, &writeSet, &errorSet, &timeout);
+		if (ret == 0)
+			break;
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		for (i = 0; i < count && connfd == INVALID_SOCKET; i++) {
+			if (socks[i] == INVALID_SOCKET ||
+				(!FD_ISSET(socks[i], &writeSet) &&
+					!FD_ISSET(socks[i], &errorSet)))
+				continue;
+			valopt = 0;
+			len = sizeof(valopt);
+			if (getsockopt(socks[i],
+				    SOL_SOCKET,
+				    SO_ERROR,
+				    (void *)&valopt,
+				    &len) == 0 &&
+				valopt == 0) {
+				connfd = socks[i];
+				winner = i;
+			} else {
+				UpnpCloseSocket(socks[i]);
+				socks[i] = INVALID_SOCKET;
+				pending--;
+			}
+		}
+	}
+	/* drop the losers */
+	for (i = 0; i < count; i++) {
+		if (socks[i] != INVALID_SOCKET && socks[i] != connfd)
+			UpnpCloseSocket(socks[i]);
+	}
+	if (connfd == INVALID_SOCKET)
+		return (SOCKET)(opened ? UPNP_E_SOCKET_CONNECT
+				       : UPNP_E_OUTOF_SOCKET);
+	if (sock_make_blocking(connfd) == -1) {
+		UpnpCloseSocket(connfd);
+		return (SOCKET)(UPNP_E_SOCKET_CONNECT);
+	}
+	*url = fixed[winner];
+	if (index)
+		*index = winner;
+
+	return connfd;
+}
+#else
+SOCKET http_ConnectFirst(uri_type *destination_urls,
+	size_t count,
+	int timeoutSecs,
+	uri_type *url,
+	size_t *index)
+{
+	SOCKET connfd = (SOCKET)(UPNP_E_SOCKET_CONNECT);
+	size_t i;
+
+	/* blocking connections cannot be raced, try them in turn */
+	(void)timeoutSecs;
+	for (i = 0; i < count && i < HTTP_CONNECT_FIRST_MAX; i++) {
+		connfd = http_Connect(&destination_urls[i], url);
+		if (connfd >= 0) {
+			if (index)
+				*index = i;
+			break;
+		}
+	}
+
+	return connfd;
+}
+#endif /* UPNP_ENABLE_BLOCKING_TCP_CONNECTIONS */
+
 /*!
  * \brief Get the data on the socket and take actions based on the read data to
  * modify the parser objects buffer.
@@ -356,6 +600,9 @@ SOCKET http_Connect(uri_type *destination_url, uri_type *url)
  *	IN http_method_t request_method;	HTTP request method
  *	IN OUT int* timeout_secs;		time out
  *	OUT int* http_error_code;		HTTP error code returned
+ *	IN int push_xml;			1 to parse the XML body of a
+ *						SOAP or GENA message while it
+ *						is received
  *
  * \return
  * 	 UPNP_E_SUCCESS
@@ -365,7 +612,8 @@ int http_RecvMessage(SOCKINFO *info,
 	http_parser_t *parser,
 	http_method_t request_method,
 	int *timeout_secs,
-	int *http_error_code)
+	int *http_error_code,
+	int push_xml)
 {
 	int ret = UPNP_E_SUCCESS;
 	int line = 0;
@@ -374,6 +622,7 @@ int http_RecvMessage(SOCKINFO *info,
 	int ok_on_close = 0;
 	char *buf;
 	size_t buf_len = 1024;
+	int err;
 
 	*http_error_code = HTTP_INTERNAL_SERVER_ERROR;
 	buf = malloc(buf_len);
@@ -386,6 +635,7 @@ int http_RecvMessage(SOCKINFO *info,
 	} else {
 		parser_response_init(parser, request_method);
 	}
+	parser->push_xml = push_xml;
 
 	while (1) {
 		/* Double the bet if needed */
@@ -475,6 +725,8 @@ int http_RecvMessage(SOCKINFO *info,
 	}
 
 ExitFunction:
+	/* The caller may look at the error of a failed read. */
+	err = errno;
 	free(buf);
 	if (ret != UPNP_E_SUCCESS) {
 		UpnpPrintf(UPNP_ALL,
@@ -485,6 +737,7 @@ ExitFunction:
 			ret,
 			*http_error_code);
 	}
+	errno = err;
 
 	return ret;
 }
@@ -741,10 +994,16 @@ ExitFunction:
  *	IN http_method_t req_method;	HTTP Request method
  *	IN int timeout_secs;		time out value
  *	OUT http_parser_t* response;	Parser object to receive the repsonse
+ *	IN int push_xml;		1 to parse the XML body of the response
+ *					while it is received
  *
  * Description:
  *	Initiates socket, connects to the destination, sends a
- *	request and waits for the response from the remote end
+ *	request and waits for the response from the remote end. The
+ *	connection is taken from and given back to the keep-alive pool
+ *	when possible. A request that could not be sent on a pooled
+ *	connection, or whose pooled connection was closed or reset before
+ *	any part of the response arrived, is sent again on a new one.
  *
  * Returns:
  *	UPNP_E_SOCKET_ERROR
@@ -757,51 +1016,53 @@ int http_RequestAndResponse(uri_type *destination,
 	size_t request_length,
 	http_method_t req_method,
 	int timeout_secs,
-	http_parser_t *response)
+	http_parser_t *response,
+	int push_xml)
 {
-	SOCKET tcp_connection;
 	int ret_code;
-	size_t sockaddr_len;
 	int http_error_code;
+	int reused;
+	int fresh = 0;
+	int sent;
+	int timeout;
 	SOCKINFO info;
 
-	tcp_connection = socket(
-		(int)destination->hostport.IPaddress.ss_family, SOCK_STREAM, 0);
-	if (tcp_connection == INVALID_SOCKET) {
-		parser_response_init(response, req_method);
-		return UPNP_E_SOCKET_ERROR;
-	}
-	if (sock_init(&info, tcp_connection) != UPNP_E_SUCCESS) {
-		parser_response_init(response, req_method);
-		ret_code = UPNP_E_SOCKET_ERROR;
-		goto end_function;
-	}
-	/* connect */
-	sockaddr_len = destination->hostport.IPaddress.ss_family == AF_INET6
-			       ? sizeof(struct sockaddr_in6)
-			       : sizeof(struct sockaddr_in);
-	ret_code = private_connect(info.socket,
-		(struct sockaddr *)&(destination->hostport.IPaddress),
-		(socklen_t)sockaddr_len);
-	if (ret_code == -1) {
-		parser_response_init(response, req_method);
-		ret_code = UPNP_E_SOCKET_CONNECT;
-		goto end_function;
-	}
-	/* send request */
-	ret_code = http_SendMessage(
-		&info, &timeout_secs, "b", request, request_length);
-	if (ret_code != 0) {
-		parser_response_init(response, req_method);
-		goto end_function;
+	while (1) {
+		ret_code = http_ConnectPooled(
+			&destination->hostport.IPaddress, fresh, &info, &reused);
+		if (ret_code != UPNP_E_SUCCESS) {
+			parser_response_init(response, req_method);
+			return ret_code;
+		}
+		timeout = timeout_secs;
+		/* send request */
+		ret_code = http_SendMessage(
+			&info, &timeout, "b", request, request_length);
+		sent = ret_code == 0;
+		if (!sent) {
+			parser_response_init(response, req_method);
+		} else {
+			/* recv response */
+			ret_code = http_RecvMessage(&info,
+				response,
+				req_method,
+				&timeout,
+				&http_error_code,
+				push_xml);
+		}
+		if (ret_code == 0 || !reused ||
+			(sent && !http_ClosedUnanswered(ret_code, response)))
+			break;
+		/* the server closed the idle connection, use a new one */
+		sock_destroy(&info, SD_BOTH);
+		httpmsg_destroy(&response->msg);
+		fresh = 1;
 	}
-	/* recv response */
-	ret_code = http_RecvMessage(
-		&info, response, req_method, &timeout_secs, &http_error_code);
-
-end_function:
-	/* should shutdown completely */
-	sock_destroy(&info, SD_BOTH);
+	if (ret_code == 0 && http_ConnPoolReusable(response))
+		http_ConnPoolPut(&destination->hostport.IPaddress, info.socket);
+	else
+		/* should shutdown completely */
+		sock_destroy(&info, SD_BOTH);
 
 	return ret_code;
 }
@@ -874,7 +1135,7 @@ int http_Download(const char *url_str,
 		1,
 		"Q"
 		"s"
-		"bcDCUc",
+		"bcDUc",
 		HTTPMETHOD_GET,
 		url.pathquery.buff,
 		url.pathquery.size,
@@ -903,7 +1164,8 @@ int http_Download(const char *url_str,
 		request.length,
 		HTTPMETHOD_GET,
 		timeout_secs,
-		&response);
+		&response,
+		0);
 
 	if (ret_code != 0) {
 		httpmsg_destroy(&response.msg);
@@ -1043,7 +1305,7 @@ int MakeGenericMessage(http_method_t method,
 				1,
 				1,
 				"s"
-				"bcDCU",
+				"bcDU",
 				"HOST: ",
 				hoststr,
 				hostlen);
@@ -1093,8 +1355,47 @@ typedef struct HTTPCONNECTIONHANDLE
 	http_parser_t response;
 	int requestStarted;
 	int cancel;
+	/*! Address the socket is connected to. */
+	struct sockaddr_storage address;
+	/*! The connection may go back to the keep-alive pool when closed. */
+	int poolable;
+	/*! The connection came from the pool and has not carried a
+	 * response yet. */
+	int reused;
+	/*! Request sent on a pooled connection, kept to send it again on a
+	 * new connection if the server had closed the pooled one. Empty once
+	 * a request body was written. */
+	membuffer retry;
 } http_connection_handle_t;
 
+/*!
+ * \brief Replaces the pooled connection of a handle, which the server
+ * closed, by a new one and sends the request again.
+ *
+ * \return UPNP_E_SUCCESS, or the error of the connection or of the send.
+ */
+static int http_RetryHttpRequest(
+	/*! [in,out] Handle, its retry buffer is released. */
+	http_connection_handle_t *handle,
+	/*! [in] Timeout. */
+	int timeout)
+{
+	int ret_code;
+
+	sock_destroy(&handle->sock_info, SD_BOTH);
+	ret_code = http_ConnectPooled(
+		&handle->address, 1, &handle->sock_info, &handle->reused);
+	if (ret_code == UPNP_E_SUCCESS)
+		ret_code = http_SendMessage(&handle->sock_info,
+			&timeout,
+			"b",
+			handle->retry.buf,
+			handle->retry.length);
+	membuffer_destroy(&handle->retry);
+
+	return ret_code;
+}
+
 /*!
  * \brief Parses already exiting data. If not complete reads more
  * data on the connected socket. The read data is then parsed. The
@@ -1266,8 +1567,6 @@ int http_CancelHttpGet(void *Handle)
 int http_OpenHttpConnection(const char *url_str, void **Handle, int timeout)
 {
 	int ret_code;
-	size_t sockaddr_len;
-	SOCKET tcp_connection;
 	http_connection_handle_t *handle = NULL;
 	uri_type url;
 	(void)timeout; /* Unused parameter */
@@ -1284,30 +1583,26 @@ int http_OpenHttpConnection(const char *url_str, void **Handle, int timeout)
 		return UPNP_E_OUTOF_MEMORY;
 	}
 	handle->requestStarted = 0;
+	handle->cancel = 0;
+	handle->contentLength = 0;
 	memset(&handle->response, 0, sizeof(handle->response));
+	memcpy(&handle->address,
+		&url.hostport.IPaddress,
+		sizeof(handle->address));
+	membuffer_init(&handle->retry);
+	handle->poolable = 1;
+#ifdef UPNP_ENABLE_OPEN_SSL
+	/* TLS sessions are not pooled. */
+	if (token_string_casecmp(&url.scheme, "https") == 0)
+		handle->poolable = 0;
+#endif
 	/* connect to the server */
-	tcp_connection =
-		socket(url.hostport.IPaddress.ss_family, SOCK_STREAM, 0);
-	if (tcp_connection == INVALID_SOCKET) {
-		ret_code = UPNP_E_SOCKET_ERROR;
-		goto errorHandler;
-	}
-	if (sock_init(&handle->sock_info, tcp_connection) != UPNP_E_SUCCESS) {
-		sock_destroy(&handle->sock_info, SD_BOTH);
-		ret_code = UPNP_E_SOCKET_ERROR;
-		goto errorHandler;
-	}
-	sockaddr_len = url.hostport.IPaddress.ss_family == AF_INET6
-			       ? sizeof(struct sockaddr_in6)
-			       : sizeof(struct sockaddr_in);
-	ret_code = private_connect(handle->sock_info.socket,
-		(struct sockaddr *)&(url.hostport.IPaddress),
-		(socklen_t)sockaddr_len);
-	if (ret_code == -1) {
-		sock_destroy(&handle->sock_info, SD_BOTH);
-		ret_code = UPNP_E_SOCKET_CONNECT;
+	ret_code = http_ConnectPooled(&handle->address,
+		!handle->poolable,
+		&handle->sock_info,
+		&handle->reused);
+	if (ret_code != UPNP_E_SUCCESS)
 		goto errorHandler;
-	}
 #ifdef UPNP_ENABLE_OPEN_SSL
 	/* For HTTPS connections start the TLS/SSL handshake. */
 	if (token_string_casecmp(&url.scheme, "https") == 0) {
@@ -1343,6 +1638,7 @@ int http_MakeHttpRequest(Upnp_HttpMethod method,
 	}
 	handle->requestStarted = 1;
 	handle->cancel = 0;
+	handle->contentLength = contentLength;
 	ret_code = MakeGenericMessage((http_method_t)method,
 		url_str,
 		&request,
@@ -1355,6 +1651,20 @@ int http_MakeHttpRequest(Upnp_HttpMethod method,
 	/* send request */
 	ret_code = http_SendMessage(
 		&handle->sock_info, &timeout, "b", request.buf, request.length);
+	membuffer_destroy(&handle->retry);
+	if (handle->reused) {
+		if (ret_code != UPNP_E_SUCCESS) {
+			/* the server closed the pooled connection */
+			handle->retry = request;
+			membuffer_init(&request);
+			ret_code = http_RetryHttpRequest(handle, timeout);
+		} else if (contentLength == 0) {
+			/* the response may still show it was closed */
+			handle->retry = request;
+			membuffer_init(&request);
+		}
+		handle->reused = 0;
+	}
 	membuffer_destroy(&request);
 	httpmsg_destroy(&handle->response.msg);
 	parser_response_init(&handle->response, (http_method_t)method);
@@ -1394,6 +1704,9 @@ int http_WriteHttpRequest(void *Handle, char *buf, size_t *size, int timeout)
 		tempbuf = buf;
 		tempbufSize = *size;
 	}
+	/* the request can no longer be sent again */
+	if (*size)
+		membuffer_destroy(&handle->retry);
 	numWritten =
 		sock_write(&handle->sock_info, tempbuf, tempbufSize, &timeout);
 	if (freeTempbuf)
@@ -1438,11 +1751,25 @@ int http_GetHttpResponse(void *Handle,
 	memptr ctype;
 	http_connection_handle_t *handle = Handle;
 	parse_status_t status;
+	http_method_t method;
 
 	status = ReadResponseLineAndHeaders(&handle->sock_info,
 		&handle->response,
 		&timeout,
 		&http_error_code);
+	if (status != (parse_status_t)PARSE_OK && handle->retry.length > 0 &&
+		http_ClosedUnanswered((int)status, &handle->response)) {
+		/* the server closed the pooled connection unanswered */
+		method = handle->response.msg.request_method;
+		httpmsg_destroy(&handle->response.msg);
+		parser_response_init(&handle->response, method);
+		if (http_RetryHttpRequest(handle, timeout) == UPNP_E_SUCCESS)
+			status = ReadResponseLineAndHeaders(&handle->sock_info,
+				&handle->response,
+				&timeout,
+				&http_error_code);
+	}
+	membuffer_destroy(&handle->retry);
 	if (status != (parse_status_t)PARSE_OK) {
 		ret_code = UPNP_E_BAD_RESPONSE;
 		goto errorHandler;
@@ -1599,9 +1926,17 @@ int http_CloseHttpConnection(void *Handle)
 	http_connection_handle_t *handle = Handle;
 	if (!handle)
 		return UPNP_E_INVALID_PARAM;
-	/*should shutdown completely */
-	sock_destroy(&handle->sock_info, SD_BOTH);
+	if (handle->poolable && !handle->requestStarted && !handle->cancel &&
+		handle->contentLength != UPNP_UNTIL_CLOSE &&
+		handle->sock_info.socket != INVALID_SOCKET &&
+		http_ConnPoolReusable(&handle->response)) {
+		http_ConnPoolPut(&handle->address, handle->sock_info.socket);
+	} else {
+		/*should shutdown completely */
+		sock_destroy(&handle->sock_info, SD_BOTH);
+	}
 	httpmsg_destroy(&handle->response.msg);
+	membuffer_destroy(&handle->retry);
 	free(handle);
 	return UPNP_E_SUCCESS;
 }
@@ -1899,6 +2234,7 @@ int http_MakeMessage(membuffer *buf,
 			/*   e.g.: 'HTTP/1.1 200 OK' code */
 			status_code = (int)va_arg(argp, int);
 			assert(status_code > 0);
+			upnp_metrics_http_status(status_code);
 			rc = snprintf(tempbuf,
 				sizeof(tempbuf),
 				"HTTP/%d.%d %d ",
@@ -2094,7 +2430,7 @@ int MakeGetMessageEx(const char *url_str,
 			"Q"
 			"s"
 			"bc"
-			"GDCUc",
+			"GDUc",
 			HTTPMETHOD_GET,
 			url->pathquery.buff,
 			url->pathquery.size,
@@ -2161,8 +2497,10 @@ int http_OpenHttpGetEx(const char *url_str,
 {
 	int http_error_code;
 	memptr ctype;
-	SOCKET tcp_connection;
-	size_t sockaddr_len;
+	int fresh;
+	int sent;
+	int read_code = (int)PARSE_OK;
+	int remaining;
 	membuffer request;
 	http_connection_handle_t *handle = NULL;
 	uri_type url;
@@ -2208,49 +2546,51 @@ int http_OpenHttpGetEx(const char *url_str,
 			break;
 		}
 		memset(handle, 0, sizeof(*handle));
-		parser_response_init(&handle->response, HTTPMETHOD_GET);
-		tcp_connection = socket(
-			(int)url.hostport.IPaddress.ss_family, SOCK_STREAM, 0);
-		if (tcp_connection == INVALID_SOCKET) {
-			errCode = UPNP_E_SOCKET_ERROR;
-			free(handle);
-			break;
-		}
-		if (sock_init(&handle->sock_info, tcp_connection) !=
-			UPNP_E_SUCCESS) {
+		memcpy(&handle->address,
+			&url.hostport.IPaddress,
+			sizeof(handle->address));
+		membuffer_init(&handle->retry);
+		handle->poolable = 1;
+		fresh = 0;
+		while (1) {
+			parser_response_init(&handle->response, HTTPMETHOD_GET);
+			errCode = http_ConnectPooled(&handle->address,
+				fresh,
+				&handle->sock_info,
+				&handle->reused);
+			if (errCode != UPNP_E_SUCCESS)
+				break;
+			/* send request */
+			remaining = timeout;
+			errCode = http_SendMessage(&handle->sock_info,
+				&remaining,
+				"b",
+				request.buf,
+				request.length);
+			sent = errCode == UPNP_E_SUCCESS;
+			if (sent) {
+				read_code = ReadResponseLineAndHeaders(
+					&handle->sock_info,
+					&handle->response,
+					&remaining,
+					&http_error_code);
+				if (read_code != (int)PARSE_OK)
+					errCode = UPNP_E_BAD_RESPONSE;
+			}
+			if (errCode == UPNP_E_SUCCESS || !handle->reused ||
+				(sent && !http_ClosedUnanswered(
+						 read_code, &handle->response)))
+				break;
+			/* the server closed the idle connection, use a new
+			 * one */
 			sock_destroy(&handle->sock_info, SD_BOTH);
-			errCode = UPNP_E_SOCKET_ERROR;
-			free(handle);
-			break;
+			httpmsg_destroy(&handle->response.msg);
+			fresh = 1;
 		}
-		sockaddr_len = url.hostport.IPaddress.ss_family == AF_INET6
-				       ? sizeof(struct sockaddr_in6)
-				       : sizeof(struct sockaddr_in);
-		errCode = private_connect(handle->sock_info.socket,
-			(struct sockaddr *)&(url.hostport.IPaddress),
-			(socklen_t)sockaddr_len);
-		if (errCode == -1) {
-			sock_destroy(&handle->sock_info, SD_BOTH);
-			errCode = UPNP_E_SOCKET_CONNECT;
-			free(handle);
-			break;
-		}
-		/* send request */
-		errCode = http_SendMessage(&handle->sock_info,
-			&timeout,
-			"b",
-			request.buf,
-			request.length);
+		handle->reused = 0;
 		if (errCode != UPNP_E_SUCCESS) {
 			sock_destroy(&handle->sock_info, SD_BOTH);
-			free(handle);
-			break;
-		}
-		if (ReadResponseLineAndHeaders(&handle->sock_info,
-			    &handle->response,
-			    &timeout,
-			    &http_error_code) != (int)PARSE_OK) {
-			errCode = UPNP_E_BAD_RESPONSE;
+			httpmsg_destroy(&handle->response.msg);
 			free(handle);
 			break;
 		}
@@ -2258,6 +2598,8 @@ int http_OpenHttpGetEx(const char *url_str,
 		if (status != (parse_status_t)PARSE_CONTINUE_1 &&
 			status != (parse_status_t)PARSE_SUCCESS) {
 			errCode = UPNP_E_BAD_RESPONSE;
+			sock_destroy(&handle->sock_info, SD_BOTH);
+			httpmsg_destroy(&handle->response.msg);
 			free(handle);
 			break;
 		}
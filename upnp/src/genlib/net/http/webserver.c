@@ -58,6 +58,7 @@
 	#include "unixutil.h"
 	#include "upnp.h"
 	#include "upnpapi.h"
+	#include "upnpatomic.h"
 	#include "upnputil.h"
 
 	#include <assert.h>
@@ -97,8 +98,58 @@ struct xml_alias_t
 	membuffer doc;
 	/*! . */
 	time_t last_modified;
+	/*! Reference count shared by all the copies of this alias. */
+	upnp_atomic_t *ct;
+};
+
+/*! Node of the list of XML documents served from memory. */
+struct xml_alias_list_t
+{
 	/*! . */
-	int *ct;
+	struct xml_alias_t alias;
+	/*! . */
+	struct xml_alias_list_t *next;
+};
+
+/*! Entry of the path index of a web_namespace_t. */
+struct web_path_entry_t
+{
+	/*! Virtual directory name or alias name. */
+	const char *name;
+	/*! Length of name. */
+	size_t len;
+	/*! Position of the virtual directory in pVirtualDirList. */
+	size_t order;
+	/*! Cookie registered with the virtual directory. */
+	const void *cookie;
+	/*! Alias, only valid in the alias index. */
+	struct xml_alias_t alias;
+	/*! Next entry in the same bucket. */
+	struct web_path_entry_t *next;
+};
+
+/*!
+ * Immutable snapshot of the virtual directories and aliases. Requests take a
+ * reference on the current snapshot and then look paths up without holding
+ * lock but the short one taking the reference. Updates build a new snapshot
+ * and swap it in.
+ */
+struct web_namespace_t
+{
+	/*! . */
+	upnp_atomic_t refs;
+	/*! Number of buckets of each index (power of 2). */
+	size_t buckets;
+	/*! Virtual directories hashed by name. */
+	struct web_path_entry_t **vdirs;
+	/*! Aliases hashed by name. */
+	struct web_path_entry_t **aliases;
+	/*! Storage for all the entries. */
+	struct web_path_entry_t *entries;
+	/*! Number of virtual directory entries at the start of entries. */
+	size_t vdirCount;
+	/*! Number of alias entries following the virtual directory ones. */
+	size_t aliasCount;
 };
 
 static const char *gMediaTypes[] = {
@@ -234,9 +285,14 @@ membuffer gDocumentRootDir;
 /*! Global variable. A string which is set in the header field. */
 membuffer gWebserverCorsString;
 
-/*! XML document. */
-static struct xml_alias_t gAliasDoc;
+/*! XML documents served from memory, protected by gWebMutex. */
+static struct xml_alias_list_t *gAliasList;
 static ithread_mutex_t gWebMutex;
+/*! Current namespace snapshot, read and swapped under gWebNamespaceLock. */
+static struct web_namespace_t *gWebNamespace;
+/*! Only held to read gWebNamespace and take a reference on it, or to swap
+ * it, so that a snapshot is not released under a reader. */
+static ithread_mutex_t gWebNamespaceLock;
 extern str_int_entry Http_Header_Names[NUM_HTTP_HEADER_NAMES];
 
 /*!
@@ -356,20 +412,6 @@ static UPNP_INLINE int get_content_type(
 	return 0;
 }
 
-/*!
- * \brief Initialize the global XML document. Allocate buffers for the XML
- * document.
- */
-static UPNP_INLINE void glob_alias_init(void)
-{
-	struct xml_alias_t *alias = &gAliasDoc;
-
-	membuffer_init(&alias->doc);
-	membuffer_init(&alias->name);
-	alias->ct = NULL;
-	alias->last_modified = 0;
-}
-
 /*!
  * \brief Check for the validity of the XML object buffer.
  *
@@ -383,42 +425,274 @@ static UPNP_INLINE int is_valid_alias(
 }
 
 /*!
- * \brief Copy the contents of the global XML document into the local output
- * parameter.
+ * \brief Copy an XML alias into the output parameter and take a reference
+ * on its buffers. The caller must already hold a reference on it.
  */
 static void alias_grab(
+	/*! [in] XML alias object. */
+	const struct xml_alias_t *src,
 	/*! [out] XML alias object. */
 	struct xml_alias_t *alias)
 {
-	ithread_mutex_lock(&gWebMutex);
-	assert(is_valid_alias(&gAliasDoc));
-	memcpy(alias, &gAliasDoc, sizeof(struct xml_alias_t));
-	*alias->ct = *alias->ct + 1;
-	ithread_mutex_unlock(&gWebMutex);
+	assert(is_valid_alias(src));
+	memcpy(alias, src, sizeof(struct xml_alias_t));
+	upnp_atomic_inc(alias->ct);
 }
 
 /*!
  * \brief Release the XML document referred to by the input parameter. Free
- * the allocated buffers associated with this object.
+ * the allocated buffers associated with this object when the last reference
+ * is dropped.
  */
 static void alias_release(
 	/*! [in] XML alias object. */
 	struct xml_alias_t *alias)
 {
-	ithread_mutex_lock(&gWebMutex);
 	/* ignore invalid alias */
 	if (!is_valid_alias(alias)) {
-		ithread_mutex_unlock(&gWebMutex);
 		return;
 	}
-	assert(*alias->ct > 0);
-	*alias->ct -= 1;
-	if (*alias->ct <= 0) {
+	assert(upnp_atomic_load(alias->ct) > 0);
+	if (upnp_atomic_dec(alias->ct) <= 0) {
 		membuffer_destroy(&alias->doc);
 		membuffer_destroy(&alias->name);
 		free(alias->ct);
 	}
+}
+
+/*!
+ * \brief FNV-1a hash step, used to index virtual directories and aliases.
+ */
+static UPNP_INLINE size_t web_path_hash(
+	/*! [in] Hash of the preceding characters. */
+	size_t h,
+	/*! [in] Next character. */
+	char c)
+{
+	return (h ^ (unsigned char)c) * (size_t)16777619u;
+}
+
+	#define WEB_PATH_HASH_INIT ((size_t)2166136261u)
+
+/*!
+ * \brief Inserts an entry into one of the namespace indexes.
+ */
+static void web_namespace_insert(
+	/*! [in] Namespace being built. */
+	struct web_namespace_t *ns,
+	/*! [in] Index of ns. */
+	struct web_path_entry_t **index,
+	/*! [in] Entry to insert, name and len already set. */
+	struct web_path_entry_t *entry)
+{
+	size_t h = WEB_PATH_HASH_INIT;
+	size_t i;
+
+	for (i = 0; i < entry->len; i++) {
+		h = web_path_hash(h, entry->name[i]);
+	}
+	h &= ns->buckets - 1;
+	entry->next = index[h];
+	index[h] = entry;
+}
+
+/*!
+ * \brief Free a namespace snapshot and release the aliases it references.
+ */
+static void web_namespace_free(
+	/*! [in] Namespace to be freed. */
+	struct web_namespace_t *ns)
+{
+	size_t i;
+
+	if (!ns) {
+		return;
+	}
+	if (ns->entries) {
+		for (i = 0; i < ns->vdirCount; i++) {
+			free((char *)ns->entries[i].name);
+		}
+		for (i = ns->vdirCount; i < ns->vdirCount + ns->aliasCount;
+			i++) {
+			alias_release(&ns->entries[i].alias);
+		}
+	}
+	free(ns->entries);
+	free(ns->vdirs);
+	free(ns->aliases);
+	free(ns);
+}
+
+/*!
+ * \brief Take a reference on the current namespace snapshot.
+ *
+ * \return The snapshot, or NULL if nothing is published.
+ */
+static struct web_namespace_t *web_namespace_grab(void)
+{
+	struct web_namespace_t *ns;
+
+	ithread_mutex_lock(&gWebNamespaceLock);
+	ns = gWebNamespace;
+	if (ns) {
+		upnp_atomic_inc(&ns->refs);
+	}
+	ithread_mutex_unlock(&gWebNamespaceLock);
+
+	return ns;
+}
+
+/*!
+ * \brief Drop a reference taken with web_namespace_grab.
+ */
+static void web_namespace_release(
+	/*! [in] Namespace snapshot, may be NULL. */
+	struct web_namespace_t *ns)
+{
+	if (ns && upnp_atomic_dec(&ns->refs) == 0) {
+		web_namespace_free(ns);
+	}
+}
+
+/*!
+ * \brief Make a namespace snapshot current and drop the reference of the
+ * global pointer on the previous one.
+ */
+static void web_namespace_swap(
+	/*! [in] New snapshot, may be NULL. */
+	struct web_namespace_t *ns)
+{
+	struct web_namespace_t *old;
+
+	ithread_mutex_lock(&gWebNamespaceLock);
+	old = gWebNamespace;
+	gWebNamespace = ns;
+	ithread_mutex_unlock(&gWebNamespaceLock);
+	web_namespace_release(old);
+}
+
+/*!
+ * \brief Build a new namespace snapshot from pVirtualDirList and gAliasList
+ * and make it current. Must be called with gWebMutex held.
+ *
+ * \return
+ * \li \c 0 - OK
+ * \li \c UPNP_E_OUTOF_MEMORY
+ */
+static int web_namespace_publish(void)
+{
+	struct web_namespace_t *ns;
+	struct web_path_entry_t *entry;
+	virtualDirList *vdir;
+	struct xml_alias_list_t *node;
+	size_t count = 0;
+
+	ns = calloc(1, sizeof(struct web_namespace_t));
+	if (!ns) {
+		return UPNP_E_OUTOF_MEMORY;
+	}
+	for (vdir = pVirtualDirList; vdir; vdir = vdir->next) {
+		ns->vdirCount++;
+	}
+	for (node = gAliasList; node; node = node->next) {
+		ns->aliasCount++;
+	}
+	ns->buckets = 8;
+	while (ns->buckets < 2 * (ns->vdirCount + ns->aliasCount)) {
+		ns->buckets <<= 1;
+	}
+	ns->vdirs = calloc(ns->buckets, sizeof(struct web_path_entry_t *));
+	ns->aliases = calloc(ns->buckets, sizeof(struct web_path_entry_t *));
+	ns->entries = calloc(ns->vdirCount + ns->aliasCount + 1,
+		sizeof(struct web_path_entry_t));
+	if (!ns->vdirs || !ns->aliases || !ns->entries) {
+		free(ns->entries);
+		ns->entries = NULL;
+		web_namespace_free(ns);
+		return UPNP_E_OUTOF_MEMORY;
+	}
+	entry = ns->entries;
+	for (vdir = pVirtualDirList; vdir; vdir = vdir->next) {
+		entry->len = strlen(vdir->dirName);
+		entry->name = str_alloc(vdir->dirName, entry->len);
+		if (!entry->name) {
+			web_namespace_free(ns);
+			return UPNP_E_OUTOF_MEMORY;
+		}
+		entry->order = count++;
+		entry->cookie = vdir->cookie;
+		if (entry->len) {
+			web_namespace_insert(ns, ns->vdirs, entry);
+		}
+		entry++;
+	}
+	for (node = gAliasList; node; node = node->next) {
+		alias_grab(&node->alias, &entry->alias);
+		entry->name = entry->alias.name.buf;
+		entry->len = entry->alias.name.length;
+		web_namespace_insert(ns, ns->aliases, entry);
+		entry++;
+	}
+	ns->refs = 1;
+	web_namespace_swap(ns);
+
+	return 0;
+}
+
+int web_server_update_virtual_dirs(void)
+{
+	int ret;
+
+	if (bWebServerState != WEB_SERVER_ENABLED) {
+		return 0;
+	}
+	ithread_mutex_lock(&gWebMutex);
+	ret = web_namespace_publish();
 	ithread_mutex_unlock(&gWebMutex);
+
+	return ret;
+}
+
+/*!
+ * \brief Unlink all the aliases from gAliasList. Must be called with
+ * gWebMutex held.
+ */
+static void alias_list_clear(void)
+{
+	struct xml_alias_list_t *node;
+
+	while (gAliasList) {
+		node = gAliasList;
+		gAliasList = node->next;
+		alias_release(&node->alias);
+		free(node);
+	}
+}
+
+/*!
+ * \brief Unlink the alias with the given name from gAliasList. Must be
+ * called with gWebMutex held.
+ *
+ * \return 1 if an alias was removed, 0 otherwise.
+ */
+static int alias_list_remove(
+	/*! [in] Name of the alias, with the leading '/'. */
+	const char *alias_name)
+{
+	struct xml_alias_list_t **prev = &gAliasList;
+	struct xml_alias_list_t *node;
+
+	for (node = gAliasList; node; node = node->next) {
+		if (strcmp(node->alias.name.buf, alias_name) == 0) {
+			*prev = node->next;
+			alias_release(&node->alias);
+			free(node);
+			return 1;
+		}
+		prev = &node->next;
+	}
+
+	return 0;
 }
 
 int web_server_set_alias(const char *alias_name,
@@ -427,48 +701,85 @@ int web_server_set_alias(const char *alias_name,
 	time_t last_modified)
 {
 	int ret_code;
-	struct xml_alias_t alias;
+	struct xml_alias_list_t *node;
 
-	alias_release(&gAliasDoc);
 	if (alias_name == NULL) {
-		/* don't serve aliased doc anymore */
-		return 0;
+		/* don't serve aliased docs anymore */
+		ithread_mutex_lock(&gWebMutex);
+		alias_list_clear();
+		ret_code = web_namespace_publish();
+		ithread_mutex_unlock(&gWebMutex);
+		return ret_code;
 	}
 	assert(alias_content != NULL);
-	membuffer_init(&alias.doc);
-	membuffer_init(&alias.name);
-	alias.ct = NULL;
+	node = malloc(sizeof(struct xml_alias_list_t));
+	if (node == NULL) {
+		return UPNP_E_OUTOF_MEMORY;
+	}
+	membuffer_init(&node->alias.doc);
+	membuffer_init(&node->alias.name);
+	node->alias.ct = NULL;
 	do {
 		/* insert leading /, if missing */
 		if (*alias_name != '/')
-			if (membuffer_assign_str(&alias.name, "/") != 0)
+			if (membuffer_assign_str(&node->alias.name, "/") != 0)
 				break; /* error; out of mem */
-		ret_code = membuffer_append_str(&alias.name, alias_name);
+		ret_code = membuffer_append_str(&node->alias.name, alias_name);
 		if (ret_code != 0)
 			break; /* error */
-		if ((alias.ct = (int *)malloc(sizeof(int))) == NULL)
+		node->alias.ct =
+			(upnp_atomic_t *)malloc(sizeof(upnp_atomic_t));
+		if (node->alias.ct == NULL)
 			break; /* error */
-		*alias.ct = 1;
-		membuffer_attach(&alias.doc,
+		*node->alias.ct = 1;
+		membuffer_attach(&node->alias.doc,
 			(char *)alias_content,
 			alias_content_length);
-		alias.last_modified = last_modified;
-		/* save in module var */
+		node->alias.last_modified = last_modified;
+		/* save in module var, replacing an alias of the same name */
 		ithread_mutex_lock(&gWebMutex);
-		gAliasDoc = alias;
+		alias_list_remove(node->alias.name.buf);
+		node->next = gAliasList;
+		gAliasList = node;
+		ret_code = web_namespace_publish();
 		ithread_mutex_unlock(&gWebMutex);
 
-		return 0;
+		return ret_code;
 	} while (0);
 	/* error handler */
 	/* free temp alias */
-	membuffer_destroy(&alias.name);
-	membuffer_destroy(&alias.doc);
-	free(alias.ct);
+	membuffer_destroy(&node->alias.name);
+	membuffer_destroy(&node->alias.doc);
+	free(node->alias.ct);
+	free(node);
 
 	return UPNP_E_OUTOF_MEMORY;
 }
 
+int web_server_remove_alias(const char *alias_url)
+{
+	uri_type url;
+	char *alias_name;
+	int ret_code = 0;
+
+	if (alias_url == NULL ||
+		parse_uri(alias_url, strlen(alias_url), &url) != HTTP_SUCCESS) {
+		return UPNP_E_INVALID_PARAM;
+	}
+	alias_name = str_alloc(url.pathquery.buff, url.pathquery.size);
+	if (alias_name == NULL) {
+		return UPNP_E_OUTOF_MEMORY;
+	}
+	ithread_mutex_lock(&gWebMutex);
+	if (alias_list_remove(alias_name)) {
+		ret_code = web_namespace_publish();
+	}
+	ithread_mutex_unlock(&gWebMutex);
+	free(alias_name);
+
+	return ret_code;
+}
+
 int web_server_init()
 {
 	int ret = UPNP_E_SUCCESS;
@@ -478,7 +789,8 @@ int web_server_init()
 		media_list_init();
 		membuffer_init(&gDocumentRootDir);
 		membuffer_init(&gWebserverCorsString);
-		glob_alias_init();
+		gAliasList = NULL;
+		gWebNamespace = NULL;
 		pVirtualDirList = NULL;
 
 		/* Initialize callbacks */
@@ -491,7 +803,10 @@ int web_server_init()
 
 		if (ithread_mutex_init(&gWebMutex, NULL) == -1)
 			ret = UPNP_E_OUTOF_MEMORY;
-		else
+		else if (ithread_mutex_init(&gWebNamespaceLock, NULL) == -1) {
+			ithread_mutex_destroy(&gWebMutex);
+			ret = UPNP_E_OUTOF_MEMORY;
+		} else
 			bWebServerState = WEB_SERVER_ENABLED;
 	}
 
@@ -503,12 +818,13 @@ void web_server_destroy(void)
 	if (bWebServerState == WEB_SERVER_ENABLED) {
 		membuffer_destroy(&gDocumentRootDir);
 		membuffer_destroy(&gWebserverCorsString);
-		alias_release(&gAliasDoc);
 
 		ithread_mutex_lock(&gWebMutex);
-		memset(&gAliasDoc, 0, sizeof(struct xml_alias_t));
+		alias_list_clear();
+		web_namespace_swap(NULL);
 		ithread_mutex_unlock(&gWebMutex);
 
+		ithread_mutex_destroy(&gWebNamespaceLock);
 		ithread_mutex_destroy(&gWebMutex);
 		bWebServerState = WEB_SERVER_DISABLED;
 	}
@@ -622,14 +938,16 @@ int web_server_set_cors(const char *cors_string)
 }
 
 /*!
- * \brief Compare the files names between the one on the XML alias the one
- * passed in as the input parameter. If equal extract file information.
+ * \brief Look the request file up in the aliases of the namespace. If found
+ * take a reference on the alias and extract file information.
  *
  * \return
  * \li \c 1 - On Success
  * \li \c 0 if request is not an alias
  */
-static UPNP_INLINE int get_alias(
+static int get_alias(
+	/*! [in] Namespace snapshot. */
+	struct web_namespace_t *ns,
 	/*! [in] request file passed in to be compared with. */
 	const char *request_file,
 	/*! [out] xml alias object which has a file name stored. */
@@ -638,64 +956,91 @@ static UPNP_INLINE int get_alias(
 	 * comparison succeeds. */
 	UpnpFileInfo *info)
 {
-	int cmp = strcmp(alias->name.buf, request_file);
-	if (cmp == 0) {
-		UpnpFileInfo_set_FileLength(info, (off_t)alias->doc.length);
-		UpnpFileInfo_set_IsDirectory(info, 0);
-		UpnpFileInfo_set_IsReadable(info, 1);
-		UpnpFileInfo_set_LastModified(info, alias->last_modified);
+	struct web_path_entry_t *entry;
+	size_t h = WEB_PATH_HASH_INIT;
+	size_t len;
+
+	if (!ns || !ns->aliasCount) {
+		return 0;
+	}
+	for (len = 0; request_file[len] != '\0'; len++) {
+		h = web_path_hash(h, request_file[len]);
+	}
+	for (entry = ns->aliases[h & (ns->buckets - 1)]; entry;
+		entry = entry->next) {
+		if (entry->len == len &&
+			memcmp(entry->name, request_file, len) == 0) {
+			alias_grab(&entry->alias, alias);
+			UpnpFileInfo_set_FileLength(
+				info, (off_t)alias->doc.length);
+			UpnpFileInfo_set_IsDirectory(info, 0);
+			UpnpFileInfo_set_IsReadable(info, 1);
+			UpnpFileInfo_set_LastModified(
+				info, alias->last_modified);
+			return 1;
+		}
 	}
 
-	return cmp == 0;
+	return 0;
 }
 
 /*!
  * \brief Compares filePath with paths from the list of virtual directory
  * lists.
  *
+ * Every prefix of filePath that ends on a path boundary is looked up in the
+ * virtual directory index of the namespace, so the cost depends on the length
+ * of filePath and not on the number of virtual directories. When several
+ * directories match, the one registered first wins.
+ *
  * \return int.
  */
 static int isFileInVirtualDir(
+	/*! [in] Namespace snapshot. */
+	struct web_namespace_t *ns,
 	/*! [in] Directory path to be tested for virtual directory. */
-	char *filePath,
+	const char *filePath,
 	/*! [out] The cookie registered with this virtual directory, if matched.
 	 */
 	const void **cookie)
 {
-	virtualDirList *pCurVirtualDir;
-	size_t webDirLen;
-
-	pCurVirtualDir = pVirtualDirList;
-	while (pCurVirtualDir != NULL) {
-		webDirLen = strlen(pCurVirtualDir->dirName);
-		if (webDirLen) {
-			if (pCurVirtualDir->dirName[webDirLen - 1] == '/') {
-				if (strncmp(pCurVirtualDir->dirName,
-					    filePath,
-					    webDirLen) == 0) {
-					if (cookie != NULL)
-						*cookie =
-							pCurVirtualDir->cookie;
-					return 1;
+	struct web_path_entry_t *entry;
+	struct web_path_entry_t *found = NULL;
+	size_t h = WEB_PATH_HASH_INIT;
+	size_t i;
+	int boundary;
+
+	if (!ns || !ns->vdirCount) {
+		return 0;
+	}
+	for (i = 0;; i++) {
+		boundary = filePath[i] == '/' || filePath[i] == '\0' ||
+			   filePath[i] == '?';
+		if (i > 0 && (boundary || filePath[i - 1] == '/')) {
+			for (entry = ns->vdirs[h & (ns->buckets - 1)]; entry;
+				entry = entry->next) {
+				if (entry->len != i ||
+					memcmp(entry->name, filePath, i) != 0) {
+					continue;
 				}
-			} else {
-				if (strncmp(pCurVirtualDir->dirName,
-					    filePath,
-					    webDirLen) == 0 &&
-					(filePath[webDirLen] == '/' ||
-						filePath[webDirLen] == '\0' ||
-						filePath[webDirLen] == '?')) {
-					if (cookie != NULL)
-						*cookie =
-							pCurVirtualDir->cookie;
-					return 1;
+				/* "/dir/" matches any path below it, "/dir"
+				 * only when followed by a boundary. */
+				if ((entry->name[i - 1] == '/' || boundary) &&
+					(!found || entry->order < found->order)) {
+					found = entry;
 				}
 			}
 		}
-		pCurVirtualDir = pCurVirtualDir->next;
+		if (filePath[i] == '\0') {
+			break;
+		}
+		h = web_path_hash(h, filePath[i]);
+	}
+	if (found && cookie != NULL) {
+		*cookie = found->cookie;
 	}
 
-	return 0;
+	return found != NULL;
 }
 
 /*!
@@ -1201,6 +1546,7 @@ static int process_request(
 	int alias_grabbed;
 	size_t dummy;
 	memptr hdr_value;
+	struct web_namespace_t *ns;
 
 	print_http_headers(req);
 	url = &req->uri;
@@ -1213,6 +1559,7 @@ static int process_request(
 	request_doc = NULL;
 	finfo = UpnpFileInfo_new();
 	alias_grabbed = 0;
+	ns = web_namespace_grab();
 	err_code = HTTP_INTERNAL_SERVER_ERROR; /* default error */
 	using_virtual_dir = 0;
 	using_alias = 0;
@@ -1242,7 +1589,7 @@ static int process_request(
 		err_code = HTTP_BAD_REQUEST;
 		goto error_handler;
 	}
-	if (isFileInVirtualDir(request_doc, &RespInstr->Cookie)) {
+	if (isFileInVirtualDir(ns, request_doc, &RespInstr->Cookie)) {
 		using_virtual_dir = 1;
 		RespInstr->IsVirtualFile = 1;
 		if (membuffer_assign_str(filename, request_doc) != 0) {
@@ -1250,17 +1597,13 @@ static int process_request(
 		}
 	} else {
 		/* try using alias */
-		if (is_valid_alias(&gAliasDoc)) {
-			alias_grab(alias);
+		using_alias = get_alias(ns, request_doc, alias, finfo);
+		if (using_alias == 1) {
 			alias_grabbed = 1;
-			using_alias = get_alias(request_doc, alias, finfo);
-			if (using_alias == 1) {
-				UpnpFileInfo_set_ContentType(
-					finfo, "text/xml; charset=\"utf-8\"");
-				if (UpnpFileInfo_get_ContentType(finfo) ==
-					NULL) {
-					goto error_handler;
-				}
+			UpnpFileInfo_set_ContentType(
+				finfo, "text/xml; charset=\"utf-8\"");
+			if (UpnpFileInfo_get_ContentType(finfo) == NULL) {
+				goto error_handler;
 			}
 		}
 	}
@@ -1559,10 +1902,11 @@ static int process_request(
 
 error_handler:
 	free(request_doc);
+	web_namespace_release(ns);
 	FreeExtraHTTPHeaders(
 		(UpnpListHead *)UpnpFileInfo_get_ExtraHeadersList(finfo));
 	UpnpFileInfo_delete(finfo);
-	if (err_code != HTTP_OK && alias_grabbed) {
+	if (alias_grabbed && (err_code != HTTP_OK || *rtype != RESP_XMLDOC)) {
 		alias_release(alias);
 	}
 
@@ -1720,6 +2064,80 @@ ExitFunction:
 	return ret_code;
 }
 
+int web_server_load_xml(const char *path, IXML_Document **doc)
+{
+	struct web_namespace_t *ns = NULL;
+	struct xml_alias_t alias;
+	UpnpFileInfo *finfo = NULL;
+	membuffer filename;
+	char *request_doc;
+	size_t len;
+	int ret = UPNP_E_NOT_FOUND;
+	int err;
+
+	*doc = NULL;
+	membuffer_init(&filename);
+	len = strlen(path);
+	request_doc = malloc(len + 1);
+	if (!request_doc) {
+		return UPNP_E_OUTOF_MEMORY;
+	}
+	memcpy(request_doc, path, len + 1);
+	remove_escaped_chars(request_doc, &len);
+	if (remove_dots(request_doc, len) != 0 || *request_doc != '/') {
+		goto exit_function;
+	}
+	ns = web_namespace_grab();
+	/* The application serves virtual directories, only HTTP reaches it. */
+	if (isFileInVirtualDir(ns, request_doc, NULL)) {
+		goto exit_function;
+	}
+	finfo = UpnpFileInfo_new();
+	if (!finfo) {
+		ret = UPNP_E_OUTOF_MEMORY;
+		goto exit_function;
+	}
+	if (get_alias(ns, request_doc, &alias, finfo)) {
+		err = ixmlParseBufferEx(alias.doc.buf, doc);
+		alias_release(&alias);
+	} else {
+		if (gDocumentRootDir.length == 0) {
+			goto exit_function;
+		}
+		if (membuffer_assign_str(&filename, gDocumentRootDir.buf) !=
+				0 ||
+			membuffer_append_str(&filename, request_doc) != 0) {
+			ret = UPNP_E_OUTOF_MEMORY;
+			goto exit_function;
+		}
+		if (get_file_info(filename.buf, finfo) != 0 ||
+			UpnpFileInfo_get_IsDirectory(finfo) ||
+			!UpnpFileInfo_get_IsReadable(finfo)) {
+			goto exit_function;
+		}
+		err = ixmlLoadDocumentEx(filename.buf, doc);
+	}
+	switch (err) {
+	case IXML_SUCCESS:
+		ret = UPNP_E_SUCCESS;
+		break;
+	case IXML_INSUFFICIENT_MEMORY:
+		ret = UPNP_E_OUTOF_MEMORY;
+		break;
+	default:
+		ret = UPNP_E_INVALID_DESC;
+		break;
+	}
+
+exit_function:
+	UpnpFileInfo_delete(finfo);
+	web_namespace_release(ns);
+	membuffer_destroy(&filename);
+	free(request_doc);
+
+	return ret;
+}
+
 void web_server_callback(
 	http_parser_t *parser, /* INOUT */ http_message_t *req, SOCKINFO *info)
 {
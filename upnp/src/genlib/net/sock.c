@@ -57,6 +57,10 @@
 #include <string.h>
 #include <time.h>
 
+#ifndef _WIN32
+	#include <sys/uio.h> /* for struct iovec */
+#endif
+
 #ifdef UPNP_ENABLE_OPEN_SSL
 	#include <openssl/ssl.h>
 #endif
@@ -290,6 +294,124 @@ int sock_write(
 	return sock_read_write(info, (char *)buffer, bufsize, timeoutSecs, 0);
 }
 
+int sock_write_gather(
+	SOCKINFO *info, const sock_buffer *bufs, int count, int *timeoutSecs)
+{
+	int retCode;
+	fd_set writeSet;
+	struct timeval timeout;
+	time_t start_time = time(NULL);
+	SOCKET sockfd = info->socket;
+	long bytes_sent = 0;
+	/* first buffer not completely sent, and how much of it was */
+	int first = 0;
+	size_t offset = 0;
+	int i;
+	int n;
+#ifdef _WIN32
+	WSABUF iov[SOCK_GATHER_MAX];
+	DWORD num_written;
+#else
+	struct iovec iov[SOCK_GATHER_MAX];
+	struct msghdr msg;
+	ssize_t num_written;
+#endif
+
+	assert(count >= 0 && count <= SOCK_GATHER_MAX);
+#ifdef UPNP_ENABLE_OPEN_SSL
+	if (info->ssl) {
+		for (i = 0; i < count; i++) {
+			retCode = sock_write(
+				info, bufs[i].buf, bufs[i].length, timeoutSecs);
+			if (retCode < 0)
+				return retCode;
+			bytes_sent += retCode;
+		}
+		return (int)bytes_sent;
+	}
+#endif
+	FD_ZERO(&writeSet);
+	FD_SET(sockfd, &writeSet);
+	timeout.tv_sec = *timeoutSecs;
+	timeout.tv_usec = 0;
+	while (1) {
+		retCode = select((int)sockfd + 1,
+			NULL,
+			&writeSet,
+			NULL,
+			*timeoutSecs < 0 ? NULL : &timeout);
+		if (retCode == 0)
+			return UPNP_E_TIMEDOUT;
+		if (retCode == -1) {
+			if (errno == EINTR)
+				continue;
+			return UPNP_E_SOCKET_ERROR;
+		}
+		break;
+	}
+#ifdef SO_NOSIGPIPE
+	{
+		int old;
+		int set = 1;
+		socklen_t olen = sizeof(old);
+		getsockopt(sockfd, SOL_SOCKET, SO_NOSIGPIPE, &old, &olen);
+		setsockopt(sockfd, SOL_SOCKET, SO_NOSIGPIPE, &set, sizeof(set));
+#endif
+		while (first < count) {
+			for (i = first, n = 0; i < count; i++, n++) {
+				size_t skip = i == first ? offset : 0;
+#ifdef _WIN32
+				iov[n].buf = (CHAR *)bufs[i].buf + skip;
+				iov[n].len = (ULONG)(bufs[i].length - skip);
+#else
+				iov[n].iov_base = (char *)bufs[i].buf + skip;
+				iov[n].iov_len = bufs[i].length - skip;
+#endif
+			}
+#ifdef _WIN32
+			if (WSASend(sockfd,
+				    iov,
+				    (DWORD)n,
+				    &num_written,
+				    MSG_DONTROUTE,
+				    NULL,
+				    NULL) != 0) {
+				bytes_sent = -1;
+				break;
+			}
+#else
+			memset(&msg, 0, sizeof(msg));
+			msg.msg_iov = iov;
+			msg.msg_iovlen = (size_t)n;
+			num_written = sendmsg(
+				sockfd, &msg, MSG_DONTROUTE | MSG_NOSIGNAL);
+			if (num_written == -1) {
+				bytes_sent = -1;
+				break;
+			}
+#endif
+			bytes_sent += (long)num_written;
+			/* skip what was sent, a partial write leaves offset
+			 * inside the first buffer still pending */
+			offset += (size_t)num_written;
+			while (first < count && offset >= bufs[first].length) {
+				offset -= bufs[first].length;
+				first++;
+			}
+		}
+#ifdef SO_NOSIGPIPE
+		setsockopt(sockfd, SOL_SOCKET, SO_NOSIGPIPE, &old, olen);
+	}
+#endif
+	if (bytes_sent < 0)
+		return UPNP_E_SOCKET_ERROR;
+	/* subtract time used for writing. */
+	if (*timeoutSecs != 0)
+		*timeoutSecs -= (int)(time(NULL) - start_time);
+
+	return (int)bytes_sent;
+}
+
 int sock_make_blocking(SOCKET sock)
 {
 #ifdef _WIN32
@@ -0,0 +1,468 @@
+/**************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * - Neither name of Intel Corporation nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+/*!
+ * \file
+ *
+ * \brief Cache of host name resolutions for URL parsing.
+ */
+
+#include "config.h"
+
+#include "resolver.h"
+
+#include "ThreadPool.h"
+#include "UpnpStdInt.h" /* for int64_t */
+#include "ithread.h"
+#include "metrics.h"
+#include "upnpapi.h"
+#include "uri.h" /* for strncasecmp */
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+	#include <netdb.h>
+#endif
+
+typedef enum
+{
+	/*! Not resolved yet, a job is resolving it. */
+	RESOLVE_PENDING,
+	/*! Resolved, the address is set. */
+	RESOLVE_OK,
+	/*! Did not resolve. */
+	RESOLVE_FAILED
+} resolver_state;
+
+typedef struct RESOLVER_ENTRY
+{
+	/*! Host name, NULL if the slot is free. */
+	char *hostname;
+	resolver_state state;
+	struct sockaddr_storage address;
+	/*! upnp_clock_usec() time at which the result expires. */
+	int64_t expires;
+	/*! upnp_clock_usec() time of the last lookup, for eviction. */
+	int64_t used;
+	/*! A job is resolving the name. */
+	int refreshing;
+} resolver_entry;
+
+/*! Argument of resolver_job(). */
+typedef struct RESOLVER_REQUEST
+{
+	char *hostname;
+	/*! Value of gResolverGeneration when the job was queued. */
+	unsigned generation;
+} resolver_request;
+
+/*! Protects everything below. */
+static ithread_mutex_t gResolverMutex;
+static int gResolverInitialized = 0;
+static resolver_entry gResolverCache[RESOLVER_CACHE_SIZE];
+static UpnpHostResolver gResolver = NULL;
+static void *gResolverCookie = NULL;
+static int gResolverAsync = 0;
+/*! Incremented when the cache is emptied, so that resolutions started
+ * before are not stored. */
+static unsigned gResolverGeneration = 0;
+
+/*!
+ * \brief Resolves a host name, blocking.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_INVALID_URL.
+ */
+static int resolver_resolve(
+	/*! [in] Host name. */
+	const char *hostname,
+	/*! [out] Address, with port 0. */
+	struct sockaddr_storage *address,
+	/*! [in] Resolver, NULL for getaddrinfo(). */
+	UpnpHostResolver resolver,
+	/*! [in] Argument of \b resolver. */
+	void *cookie)
+{
+	struct addrinfo hints;
+	struct addrinfo *res;
+	struct addrinfo *res0;
+
+	memset(address, 0, sizeof(*address));
+	if (resolver) {
+		if (resolver(hostname, address, cookie) != 0)
+			return UPNP_E_INVALID_URL;
+	} else {
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		if (getaddrinfo(hostname, NULL, &hints, &res0) != 0)
+			return UPNP_E_INVALID_URL;
+		for (res = res0; res; res = res->ai_next) {
+			if (res->ai_family == AF_INET ||
+				res->ai_family == AF_INET6) {
+				/* Found a valid IPv4 or IPv6 address. */
+				memcpy(address, res->ai_addr, res->ai_addrlen);
+				break;
+			}
+		}
+		freeaddrinfo(res0);
+	}
+	switch (address->ss_family) {
+	case AF_INET:
+		((struct sockaddr_in *)address)->sin_port = 0;
+		return UPNP_E_SUCCESS;
+	case AF_INET6:
+		((struct sockaddr_in6 *)address)->sin6_port = 0;
+		return UPNP_E_SUCCESS;
+	default:
+		/* Didn't find an AF_INET or AF_INET6 address. */
+		return UPNP_E_INVALID_URL;
+	}
+}
+
+/*!
+ * \brief Finds the cache entry of a host name. The caller holds
+ * gResolverMutex.
+ *
+ * \return The entry or NULL.
+ */
+static resolver_entry *resolver_find(
+	/*! [in] Host name. */
+	const char *hostname)
+{
+	size_t length = strlen(hostname);
+	size_t i;
+
+	for (i = 0; i < RESOLVER_CACHE_SIZE; i++) {
+		if (gResolverCache[i].hostname &&
+			strlen(gResolverCache[i].hostname) == length &&
+			strncasecmp(gResolverCache[i].hostname,
+				hostname,
+				length) == 0)
+			return &gResolverCache[i];
+	}
+
+	return NULL;
+}
+
+/*!
+ * \brief Adds a pending cache entry for a host name, dropping the least
+ * recently used entry no job is resolving if the cache is full. The
+ * caller holds gResolverMutex.
+ *
+ * \return The entry, or NULL if there is no room or no memory.
+ */
+static resolver_entry *resolver_insert(
+	/*! [in] Host name. */
+	const char *hostname,
+	/*! [in] upnp_clock_usec() time. */
+	int64_t now)
+{
+	resolver_entry *entry = NULL;
+	char *copy;
+	size_t i;
+
+	for (i = 0; i < RESOLVER_CACHE_SIZE; i++) {
+		if (gResolverCache[i].hostname == NULL) {
+			entry = &gResolverCache[i];
+			break;
+		}
+		if (!gResolverCache[i].refreshing &&
+			(entry == NULL || gResolverCache[i].used < entry->used))
+			entry = &gResolverCache[i];
+	}
+	if (entry == NULL)
+		return NULL;
+	copy = strdup(hostname);
+	if (copy == NULL)
+		return NULL;
+	free(entry->hostname);
+	memset(entry, 0, sizeof(*entry));
+	entry->hostname = copy;
+	entry->state = RESOLVE_PENDING;
+	entry->used = now;
+
+	return entry;
+}
+
+/*!
+ * \brief Stores the result of a resolution, unless the cache was emptied
+ * since it started.
+ */
+static void resolver_store(
+	/*! [in] Host name. */
+	const char *hostname,
+	/*! [in] gResolverGeneration when the resolution started. */
+	unsigned generation,
+	/*! [in] UPNP_E_SUCCESS or UPNP_E_INVALID_URL. */
+	int ret_code,
+	/*! [in] Address if \b ret_code is UPNP_E_SUCCESS. */
+	const struct sockaddr_storage *address)
+{
+	resolver_entry *entry;
+	int64_t now = upnp_clock_usec();
+
+	ithread_mutex_lock(&gResolverMutex);
+	if (gResolverInitialized && generation == gResolverGeneration) {
+		entry = resolver_find(hostname);
+		if (entry == NULL)
+			entry = resolver_insert(hostname, now);
+		if (entry) {
+			entry->refreshing = 0;
+			if (ret_code == UPNP_E_SUCCESS) {
+				entry->state = RESOLVE_OK;
+				memcpy(&entry->address,
+					address,
+					sizeof(entry->address));
+				entry->expires = now +
+						 (int64_t)RESOLVER_CACHE_TTL *
+							 1000000;
+			} else {
+				entry->state = RESOLVE_FAILED;
+				entry->expires =
+					now + (int64_t)RESOLVER_NEGATIVE_TTL *
+						      1000000;
+			}
+		}
+	}
+	ithread_mutex_unlock(&gResolverMutex);
+}
+
+/*!
+ * \brief Releases a resolution job that did not run.
+ */
+static void resolver_job_free(
+	/*! [in] Request. */
+	void *arg)
+{
+	resolver_request *request = (resolver_request *)arg;
+
+	free(request->hostname);
+	free(request);
+}
+
+/*!
+ * \brief Thread pool job resolving a host name in the background.
+ */
+static void resolver_job(
+	/*! [in] Request. */
+	void *arg)
+{
+	resolver_request *request = (resolver_request *)arg;
+	struct sockaddr_storage address;
+	UpnpHostResolver resolver;
+	void *cookie;
+	int stale;
+	int ret_code;
+
+	ithread_mutex_lock(&gResolverMutex);
+	stale = !gResolverInitialized ||
+		request->generation != gResolverGeneration;
+	resolver = gResolver;
+	cookie = gResolverCookie;
+	ithread_mutex_unlock(&gResolverMutex);
+	if (!stale) {
+		ret_code = resolver_resolve(
+			request->hostname, &address, resolver, cookie);
+		resolver_store(request->hostname,
+			request->generation,
+			ret_code,
+			&address);
+	}
+	resolver_job_free(request);
+}
+
+/*!
+ * \brief Queues a job resolving a host name whose entry has refreshing
+ * set. Clears refreshing again if the job cannot be queued, so that a
+ * later lookup tries again.
+ */
+static void resolver_start(
+	/*! [in] Host name. */
+	const char *hostname,
+	/*! [in] gResolverGeneration when the lookup was made. */
+	unsigned generation)
+{
+	resolver_request *request;
+	resolver_entry *entry;
+	ThreadPoolJob job;
+
+	request = (resolver_request *)malloc(sizeof(resolver_request));
+	if (request) {
+		request->hostname = strdup(hostname);
+		request->generation = generation;
+		if (request->hostname) {
+			memset(&job, 0, sizeof(job));
+			TPJobInit(&job, (start_routine)resolver_job, request);
+			TPJobSetFreeFunction(
+				&job, (free_routine)resolver_job_free);
+			TPJobSetPriority(&job, MED_PRIORITY);
+			if (ThreadPoolAdd(&gSendThreadPool, &job, NULL) == 0)
+				return;
+		}
+		resolver_job_free(request);
+	}
+	ithread_mutex_lock(&gResolverMutex);
+	entry = resolver_find(hostname);
+	if (entry && generation == gResolverGeneration)
+		entry->refreshing = 0;
+	ithread_mutex_unlock(&gResolverMutex);
+}
+
+/*!
+ * \brief Frees all entries and invalidates the resolutions in progress.
+ * The caller holds gResolverMutex.
+ */
+static void resolver_flush(void)
+{
+	size_t i;
+
+	for (i = 0; i < RESOLVER_CACHE_SIZE; i++) {
+		free(gResolverCache[i].hostname);
+		memset(&gResolverCache[i], 0, sizeof(gResolverCache[i]));
+	}
+	gResolverGeneration++;
+}
+
+int resolver_Init(void)
+{
+	if (!gResolverInitialized) {
+		ithread_mutex_init(&gResolverMutex, NULL);
+		memset(gResolverCache, 0, sizeof(gResolverCache));
+		gResolverInitialized = 1;
+	}
+
+	return UPNP_E_SUCCESS;
+}
+
+void resolver_Shutdown(void)
+{
+	if (!gResolverInitialized)
+		return;
+	ithread_mutex_lock(&gResolverMutex);
+	resolver_flush();
+	gResolverInitialized = 0;
+	ithread_mutex_unlock(&gResolverMutex);
+	ithread_mutex_destroy(&gResolverMutex);
+}
+
+int resolver_Lookup(const char *hostname, struct sockaddr_storage *address)
+{
+	resolver_entry *entry;
+	UpnpHostResolver resolver;
+	void *cookie;
+	unsigned generation;
+	int64_t now;
+	int ret_code;
+	int refresh = 0;
+
+	if (!gResolverInitialized)
+		return resolver_resolve(
+			hostname, address, gResolver, gResolverCookie);
+	now = upnp_clock_usec();
+	ithread_mutex_lock(&gResolverMutex);
+	resolver = gResolver;
+	cookie = gResolverCookie;
+	generation = gResolverGeneration;
+	entry = resolver_find(hostname);
+	if (entry) {
+		entry->used = now;
+		if (entry->state != RESOLVE_PENDING && now < entry->expires) {
+			ret_code = UPNP_E_INVALID_URL;
+			if (entry->state == RESOLVE_OK) {
+				memcpy(address,
+					&entry->address,
+					sizeof(*address));
+				ret_code = UPNP_E_SUCCESS;
+			}
+			ithread_mutex_unlock(&gResolverMutex);
+			return ret_code;
+		}
+	}
+	if (gResolverAsync) {
+		if (entry == NULL)
+			entry = resolver_insert(hostname, now);
+		if (entry == NULL) {
+			/* no room, all entries are being resolved */
+			ret_code = UPNP_E_TIMEDOUT;
+		} else {
+			/* use the expired result while it is refreshed */
+			if (entry->state == RESOLVE_OK) {
+				memcpy(address,
+					&entry->address,
+					sizeof(*address));
+				ret_code = UPNP_E_SUCCESS;
+			} else if (entry->state == RESOLVE_FAILED) {
+				ret_code = UPNP_E_INVALID_URL;
+			} else {
+				ret_code = UPNP_E_TIMEDOUT;
+			}
+			if (!entry->refreshing) {
+				entry->refreshing = 1;
+				refresh = 1;
+			}
+		}
+		ithread_mutex_unlock(&gResolverMutex);
+		if (refresh)
+			resolver_start(hostname, generation);
+		return ret_code;
+	}
+	ithread_mutex_unlock(&gResolverMutex);
+	ret_code = resolver_resolve(hostname, address, resolver, cookie);
+	resolver_store(hostname, generation, ret_code, address);
+
+	return ret_code;
+}
+
+void resolver_SetHostResolver(UpnpHostResolver resolver, void *cookie)
+{
+	if (!gResolverInitialized) {
+		gResolver = resolver;
+		gResolverCookie = cookie;
+		return;
+	}
+	ithread_mutex_lock(&gResolverMutex);
+	gResolver = resolver;
+	gResolverCookie = cookie;
+	resolver_flush();
+	ithread_mutex_unlock(&gResolverMutex);
+}
+
+void resolver_SetAsync(int enable)
+{
+	if (!gResolverInitialized) {
+		gResolverAsync = enable != 0;
+		return;
+	}
+	ithread_mutex_lock(&gResolverMutex);
+	gResolverAsync = enable != 0;
+	ithread_mutex_unlock(&gResolverMutex);
+}
@@ -50,6 +50,7 @@
 #include <assert.h>
 
 #include "config.h"
+#include "resolver.h"
 #include "upnpapi.h"
 #include "uri.h"
 
@@ -305,6 +306,11 @@ int token_cmp(token *in1, token *in2)
  * \brief Parses a string representing a host and port (e.g. "127.127.0.1:80"
  * or "localhost") and fills out a hostport_type struct with internet address
  * and a token representing the full host and port.
+ *
+ * Host names are looked up through the resolver cache, see resolver.h.
+ *
+ * \return The length of the host and port, UPNP_E_INVALID_URL, or
+ * 	UPNP_E_TIMEDOUT while a host name is resolved in the background.
  */
 static int parse_hostport(
 	/*! [in] String of characters representing host and port. */
@@ -366,35 +372,9 @@ static int parse_hostport(
 			af = AF_INET;
 		else {
 			/* Must be a host name. */
-			struct addrinfo hints, *res, *res0;
-
-			memset(&hints, 0, sizeof(hints));
-			hints.ai_family = AF_UNSPEC;
-			hints.ai_socktype = SOCK_STREAM;
-
-			ret = getaddrinfo(srvname, NULL, &hints, &res0);
-			if (ret == 0) {
-				for (res = res0; res; res = res->ai_next) {
-					switch (res->ai_family) {
-					case AF_INET:
-					case AF_INET6:
-						/* Found a valid IPv4 or IPv6
-						 * address. */
-						memcpy(&out->IPaddress,
-							res->ai_addr,
-							res->ai_addrlen);
-						goto found;
-					}
-				}
-			found:
-				freeaddrinfo(res0);
-				if (res == NULL)
-					/* Didn't find an AF_INET or AF_INET6
-					 * address. */
-					return UPNP_E_INVALID_URL;
-			} else
-				/* getaddrinfo failed. */
-				return UPNP_E_INVALID_URL;
+			ret = resolver_Lookup(srvname, &out->IPaddress);
+			if (ret != UPNP_E_SUCCESS)
+				return ret;
 		}
 	}
 	/* Check if a port is specified. */
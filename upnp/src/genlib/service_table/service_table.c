@@ -39,40 +39,159 @@
 
 #include "service_table.h"
 #include "config.h"
+#include "membuffer.h"
 
 #ifdef INCLUDE_DEVICE_APIS
 
-	#if EXCLUDE_GENA == 0
-/************************************************************************
- *	Function :	copy_subscription
- *
- *	Parameters :
- *		subscription *in ;	Source subscription
- *		subscription *out ;	Destination subscription
- *
- *	Description :	Makes a copy of the subscription
+/*!
+ * \brief FNV-1a hash of a URL path, used to index the routing buckets.
+ */
+static size_t hashRoutePath(
+	/*! [in] Path and query of the URL. */
+	const char *path,
+	/*! [in] Length of path. */
+	size_t len)
+{
+	size_t h = (size_t)2166136261u;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= (unsigned char)path[i];
+		h *= (size_t)16777619u;
+	}
+
+	return h;
+}
+
+/*!
+ * \brief Extracts the path and query of a URL into a new string.
  *
- *	Return : int ;
- *		HTTP_SUCCESS - On success
+ * \return The allocated path (free with free()) or NULL on error.
+ */
+static char *getURLPath(
+	/*! [in] Absolute or relative URL. */
+	const char *url)
+{
+	uri_type parsed_url;
+
+	if (!url || parse_uri(url, strlen(url), &parsed_url) != HTTP_SUCCESS) {
+		return NULL;
+	}
+
+	return str_alloc(parsed_url.pathquery.buff, parsed_url.pathquery.size);
+}
+
+/*!
+ * \brief Frees the routing buckets of the table (not the services).
+ */
+static void freeServiceRoutes(
+	/*! [in] Service table. */
+	service_table *table)
+{
+	free(table->controlRoutes);
+	free(table->eventRoutes);
+	table->controlRoutes = NULL;
+	table->eventRoutes = NULL;
+	table->routeBuckets = 0;
+}
+
+int buildServiceRoutes(service_table *table)
+{
+	service_info *finger = NULL;
+	service_info **link;
+	size_t count = 0;
+	size_t buckets = 8;
+	size_t i;
+
+	freeServiceRoutes(table);
+	for (finger = table->serviceList; finger; finger = finger->next) {
+		count++;
+	}
+	while (buckets < 2 * count) {
+		buckets <<= 1;
+	}
+	table->controlRoutes = calloc(buckets, sizeof(service_info *));
+	table->eventRoutes = calloc(buckets, sizeof(service_info *));
+	if (!table->controlRoutes || !table->eventRoutes) {
+		freeServiceRoutes(table);
+		return UPNP_E_OUTOF_MEMORY;
+	}
+	table->routeBuckets = buckets;
+	/* Services are appended to their bucket, so when several share a
+	 * path the lookup finds the first one of the list, as a linear scan
+	 * of serviceList would. */
+	for (finger = table->serviceList; finger; finger = finger->next) {
+		finger->nextControlRoute = NULL;
+		finger->nextEventRoute = NULL;
+		if (finger->controlURLPath) {
+			i = hashRoutePath(finger->controlURLPath,
+				    strlen(finger->controlURLPath)) &
+				(buckets - 1);
+			link = &table->controlRoutes[i];
+			while (*link) {
+				link = &(*link)->nextControlRoute;
+			}
+			*link = finger;
+		}
+		if (finger->eventURLPath) {
+			i = hashRoutePath(finger->eventURLPath,
+				    strlen(finger->eventURLPath)) &
+				(buckets - 1);
+			link = &table->eventRoutes[i];
+			while (*link) {
+				link = &(*link)->nextEventRoute;
+			}
+			*link = finger;
+		}
+	}
+
+	return UPNP_E_SUCCESS;
+}
+
+/*!
+ * \brief Compares a stored routing key with a parsed path.
  *
- *	Note :
- ************************************************************************/
-int copy_subscription(subscription *in, subscription *out)
+ * \return 1 if they are equal, 0 otherwise.
+ */
+static int routePathEquals(
+	/*! [in] Stored path, may be NULL. */
+	const char *stored,
+	/*! [in] Path parsed from the request. */
+	const token *path)
 {
-	int return_code = HTTP_SUCCESS;
-
-	memcpy(out->sid, in->sid, SID_SIZE);
-	out->sid[SID_SIZE] = 0;
-	out->ToSendEventKey = in->ToSendEventKey;
-	out->expireTime = in->expireTime;
-	out->active = in->active;
-	return_code = copy_URL_list(&in->DeliveryURLs, &out->DeliveryURLs);
-	if (return_code != HTTP_SUCCESS) {
-		return return_code;
+	return stored && strlen(stored) == path->size &&
+	       !memcmp(stored, path->buff, path->size);
+}
+
+	#if EXCLUDE_GENA == 0
+subscription_urls *newSubscriptionURLs(void)
+{
+	subscription_urls *urls;
+
+	urls = (subscription_urls *)malloc(sizeof(subscription_urls));
+	if (urls) {
+		upnp_atomic_store(&urls->refcount, 1);
+		urls->list.size = (size_t)0;
+		urls->list.URLs = NULL;
+		urls->list.parsedURLs = NULL;
+	}
+
+	return urls;
+}
+
+subscription_urls *holdSubscriptionURLs(subscription_urls *urls)
+{
+	upnp_atomic_inc(&urls->refcount);
+
+	return urls;
+}
+
+void releaseSubscriptionURLs(subscription_urls *urls)
+{
+	if (urls && upnp_atomic_dec(&urls->refcount) == 0) {
+		free_URL_list(&urls->list);
+		free(urls);
 	}
-	ListInit(&out->outgoing, 0, 0);
-	out->next = NULL;
-	return HTTP_SUCCESS;
 }
 
 /************************************************************************
@@ -194,7 +313,8 @@ subscription *GetFirstSubscription(service_info *service)
 void freeSubscription(subscription *sub)
 {
 	if (sub) {
-		free_URL_list(&sub->DeliveryURLs);
+		releaseSubscriptionURLs(sub->DeliveryURLs);
+		sub->DeliveryURLs = NULL;
 		freeSubscriptionQueuedEvents(sub);
 	}
 }
@@ -267,8 +387,8 @@ service_info *FindServiceId(
  *		char * eventURLPath ;	event URL path used to find a service
  *								from the table
  *
- *	Description :	Traverses the service table and finds the node whose
- *		event URL Path matches a know value
+ *	Description :	Finds the node whose event URL Path matches a know
+ *		value through the routing index of the service table
  *
  *	Return : service_info * - pointer to the service list node from the
  *		service table whose event URL matches a known event URL;
@@ -279,7 +399,6 @@ service_info *FindServiceEventURLPath(
 	service_table *table, const char *eventURLPath)
 {
 	service_info *finger = NULL;
-	uri_type parsed_url;
 	uri_type parsed_url_in;
 
 	if (!table || !eventURLPath) {
@@ -287,17 +406,25 @@ service_info *FindServiceEventURLPath(
 	}
 	if (parse_uri(eventURLPath, strlen(eventURLPath), &parsed_url_in) ==
 		HTTP_SUCCESS) {
+		if (table->eventRoutes) {
+			finger = table->eventRoutes
+				[hashRoutePath(parsed_url_in.pathquery.buff,
+					 parsed_url_in.pathquery.size) &
+					(table->routeBuckets - 1)];
+			while (finger) {
+				if (routePathEquals(finger->eventURLPath,
+					    &parsed_url_in.pathquery)) {
+					return finger;
+				}
+				finger = finger->nextEventRoute;
+			}
+			return NULL;
+		}
 		finger = table->serviceList;
 		while (finger) {
-			if (finger->eventURL) {
-				if (parse_uri(finger->eventURL,
-					    strlen(finger->eventURL),
-					    &parsed_url) == HTTP_SUCCESS) {
-					if (!token_cmp(&parsed_url.pathquery,
-						    &parsed_url_in.pathquery)) {
-						return finger;
-					}
-				}
+			if (routePathEquals(finger->eventURLPath,
+				    &parsed_url_in.pathquery)) {
+				return finger;
 			}
 			finger = finger->next;
 		}
@@ -315,8 +442,8 @@ service_info *FindServiceEventURLPath(
 	 *    char *controlURLPath; control URL path used to find a service from
 	 *                          the table
 	 *
-	 * Description: Traverses the service table and finds the node whose
-	 *    control URL Path matches a know value
+	 * Description: Finds the node whose control URL Path matches a know
+	 *    value through the routing index of the service table
 	 *
 	 * Return: service_info *:  pointer to the service list node from the
 	 *    service table whose control URL Path matches a known value.
@@ -326,7 +453,6 @@ service_info *FindServiceControlURLPath(
 	service_table *table, const char *controlURLPath)
 {
 	service_info *finger = NULL;
-	uri_type parsed_url;
 	uri_type parsed_url_in;
 
 	if (!table || !controlURLPath) {
@@ -334,17 +460,25 @@ service_info *FindServiceControlURLPath(
 	}
 	if (parse_uri(controlURLPath, strlen(controlURLPath), &parsed_url_in) ==
 		HTTP_SUCCESS) {
+		if (table->controlRoutes) {
+			finger = table->controlRoutes
+				[hashRoutePath(parsed_url_in.pathquery.buff,
+					 parsed_url_in.pathquery.size) &
+					(table->routeBuckets - 1)];
+			while (finger) {
+				if (routePathEquals(finger->controlURLPath,
+					    &parsed_url_in.pathquery)) {
+					return finger;
+				}
+				finger = finger->nextControlRoute;
+			}
+			return NULL;
+		}
 		finger = table->serviceList;
 		while (finger) {
-			if (finger->controlURL) {
-				if (parse_uri(finger->controlURL,
-					    strlen(finger->controlURL),
-					    &parsed_url) == HTTP_SUCCESS) {
-					if (!token_cmp(&parsed_url.pathquery,
-						    &parsed_url_in.pathquery)) {
-						return finger;
-					}
-				}
+			if (routePathEquals(finger->controlURLPath,
+				    &parsed_url_in.pathquery)) {
+				return finger;
 			}
 			finger = finger->next;
 		}
@@ -581,6 +715,12 @@ void freeService(service_info *in)
 		if (in->eventURL)
 			free(in->eventURL);
 
+		if (in->controlURLPath)
+			free(in->controlURLPath);
+
+		if (in->eventURLPath)
+			free(in->eventURLPath);
+
 		if (in->UDN)
 			ixmlFreeDOMString(in->UDN);
 
@@ -620,6 +760,10 @@ void freeServiceList(service_info *head)
 			free(head->controlURL);
 		if (head->eventURL)
 			free(head->eventURL);
+		if (head->controlURLPath)
+			free(head->controlURLPath);
+		if (head->eventURLPath)
+			free(head->eventURLPath);
 		if (head->UDN)
 			ixmlFreeDOMString(head->UDN);
 		if (head->subscriptionList)
@@ -650,6 +794,7 @@ void freeServiceTable(service_table *table)
 {
 	ixmlFreeDOMString(table->URLBase);
 	freeServiceList(table->serviceList);
+	freeServiceRoutes(table);
 	table->serviceList = NULL;
 	table->endServiceList = NULL;
 }
@@ -780,8 +925,12 @@ service_info *getServiceList(IXML_Node *node, service_info **end, char *URLBase)
 					return NULL;
 				}
 				current->next = NULL;
+				current->nextControlRoute = NULL;
+				current->nextEventRoute = NULL;
 				current->controlURL = NULL;
 				current->eventURL = NULL;
+				current->controlURLPath = NULL;
+				current->eventURLPath = NULL;
 				current->serviceType = NULL;
 				current->serviceId = NULL;
 				current->SCPDURL = NULL;
@@ -833,6 +982,9 @@ service_info *getServiceList(IXML_Node *node, service_info **end, char *URLBase)
 						"SERVICE INFO");
 					current->controlURL = NULL;
 					fail = 0;
+				} else {
+					current->controlURLPath =
+						getURLPath(current->controlURL);
 				}
 				ixmlFreeDOMString(tempDOMString);
 				tempDOMString = NULL;
@@ -856,6 +1008,9 @@ service_info *getServiceList(IXML_Node *node, service_info **end, char *URLBase)
 						"SERVICE INFO");
 					current->eventURL = NULL;
 					fail = 0;
+				} else {
+					current->eventURLPath =
+						getURLPath(current->eventURL);
 				}
 				ixmlFreeDOMString(tempDOMString);
 				tempDOMString = NULL;
@@ -1009,6 +1164,7 @@ int removeServiceTable(IXML_Node *node, service_table *in)
 
 			ixmlNodeList_free(deviceList);
 		}
+		buildServiceRoutes(in);
 	}
 	return 1;
 }
@@ -1052,6 +1208,7 @@ int addServiceTable(
 		if ((in->endServiceList->next = getAllServiceList(
 			     root, in->URLBase, &tempEnd))) {
 			in->endServiceList = tempEnd;
+			buildServiceRoutes(in);
 			return 1;
 		}
 	}
@@ -1095,6 +1252,7 @@ int getServiceTable(
 		out->serviceList = getAllServiceList(
 			root, out->URLBase, &out->endServiceList);
 		if (out->serviceList) {
+			buildServiceRoutes(out);
 			return 1;
 		}
 	}
@@ -39,6 +39,7 @@
 
 #include "membuffer.h"
 #include "config.h"
+#include "ithread.h"
 #include "unixutil.h"
 #include "upnp.h"
 
@@ -92,6 +93,155 @@ int memptr_cmp_nocase(memptr *m, const char *s)
 	return cmp;
 }
 
+/*! Per-thread stack of recycled MEMBUF_POOL_BLOCK_SIZE blocks. */
+typedef struct MEMBUFFER_POOL
+{
+	/*! Number of blocks in the pool. */
+	int count;
+	/*! The blocks. */
+	char *blocks[MEMBUF_POOL_DEPTH];
+	/*! Next pool of gMembufferPools. */
+	struct MEMBUFFER_POOL *next;
+} membuffer_pool;
+
+/*! Key of the calling thread's membuffer_pool. */
+static ithread_key_t gMembufferPoolKey;
+/*! 1 if gMembufferPoolKey is valid. */
+static int gMembufferPoolInit = 0;
+/*! The pools of all the threads, so that membuffer_pool_cleanup() frees
+ * those of the threads still running. */
+static membuffer_pool *gMembufferPools = NULL;
+/*! Protects gMembufferPools. Never destroyed, as an exiting thread may
+ * still be freeing its pool when membuffer_pool_cleanup() returns. */
+static ithread_mutex_t gMembufferPoolMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*!
+ * \brief Frees a pool and its blocks.
+ */
+static void membuffer_pool_free(
+	/*! [in] The membuffer_pool. */
+	membuffer_pool *pool)
+{
+	while (pool->count > 0) {
+		free(pool->blocks[--pool->count]);
+	}
+	free(pool);
+}
+
+/*!
+ * \brief Frees a thread's pool unless membuffer_pool_cleanup() already did.
+ * Called on thread exit.
+ */
+static void membuffer_pool_exit(
+	/*! [in] The membuffer_pool. */
+	void *arg)
+{
+	membuffer_pool **prev;
+	membuffer_pool *pool = NULL;
+
+	ithread_mutex_lock(&gMembufferPoolMutex);
+	for (prev = &gMembufferPools; *prev; prev = &(*prev)->next) {
+		if (*prev == (membuffer_pool *)arg) {
+			pool = *prev;
+			*prev = pool->next;
+			break;
+		}
+	}
+	ithread_mutex_unlock(&gMembufferPoolMutex);
+	if (pool != NULL) {
+		membuffer_pool_free(pool);
+	}
+}
+
+int membuffer_pool_init(void)
+{
+	if (gMembufferPoolInit) {
+		return UPNP_E_SUCCESS;
+	}
+	if (ithread_key_create(&gMembufferPoolKey, membuffer_pool_exit) != 0) {
+		return UPNP_E_INIT_FAILED;
+	}
+	gMembufferPoolInit = 1;
+
+	return UPNP_E_SUCCESS;
+}
+
+void membuffer_pool_cleanup(void)
+{
+	membuffer_pool *pool;
+
+	if (!gMembufferPoolInit) {
+		return;
+	}
+	gMembufferPoolInit = 0;
+	ithread_setspecific(gMembufferPoolKey, NULL);
+	ithread_key_delete(gMembufferPoolKey);
+	/* the threads still running do not free their pool anymore */
+	ithread_mutex_lock(&gMembufferPoolMutex);
+	while (gMembufferPools != NULL) {
+		pool = gMembufferPools;
+		gMembufferPools = pool->next;
+		membuffer_pool_free(pool);
+	}
+	ithread_mutex_unlock(&gMembufferPoolMutex);
+}
+
+/*!
+ * \brief Takes a MEMBUF_POOL_BLOCK_SIZE block from the calling thread's pool,
+ * or from the heap if the pool is empty.
+ *
+ * \return The block or NULL if out of memory.
+ */
+static char *membuffer_pool_get(void)
+{
+	membuffer_pool *pool;
+
+	if (gMembufferPoolInit) {
+		pool = (membuffer_pool *)ithread_getspecific(gMembufferPoolKey);
+		if (pool != NULL && pool->count > 0) {
+			return pool->blocks[--pool->count];
+		}
+	}
+
+	return (char *)malloc(MEMBUF_POOL_BLOCK_SIZE + (size_t)1);
+}
+
+/*!
+ * \brief Gives a block taken with membuffer_pool_get back to the calling
+ * thread's pool, or to the heap if the pool is full.
+ */
+static void membuffer_pool_put(
+	/*! [in] Block to recycle. */
+	char *block)
+{
+	membuffer_pool *pool = NULL;
+
+	if (gMembufferPoolInit) {
+		pool = (membuffer_pool *)ithread_getspecific(gMembufferPoolKey);
+		if (pool == NULL) {
+			pool = (membuffer_pool *)calloc(
+				(size_t)1, sizeof(membuffer_pool));
+			if (pool != NULL &&
+				ithread_setspecific(gMembufferPoolKey, pool) !=
+					0) {
+				free(pool);
+				pool = NULL;
+			}
+			if (pool != NULL) {
+				ithread_mutex_lock(&gMembufferPoolMutex);
+				pool->next = gMembufferPools;
+				gMembufferPools = pool;
+				ithread_mutex_unlock(&gMembufferPoolMutex);
+			}
+		}
+	}
+	if (pool != NULL && pool->count < MEMBUF_POOL_DEPTH) {
+		pool->blocks[pool->count++] = block;
+	} else {
+		free(block);
+	}
+}
+
 /*!
  * \brief Initialize the buffer.
  */
@@ -102,6 +252,7 @@ static UPNP_INLINE void membuffer_initialize(
 	m->buf = NULL;
 	m->length = (size_t)0;
 	m->capacity = (size_t)0;
+	m->pooled = 0;
 }
 
 int membuffer_set_size(membuffer *m, size_t new_length)
@@ -116,8 +267,23 @@ int membuffer_set_size(membuffer *m, size_t new_length)
 			return 0; /* have enough mem; done */
 		}
 
+		if (m->buf == NULL && new_length <= MEMBUF_POOL_BLOCK_SIZE) {
+			temp_buf = membuffer_pool_get();
+			if (temp_buf == NULL) {
+				return UPNP_E_OUTOF_MEMORY;
+			}
+			m->buf = temp_buf;
+			m->capacity = MEMBUF_POOL_BLOCK_SIZE;
+			m->pooled = 1;
+			return 0;
+		}
+
 		diff = new_length - m->length;
-		alloc_len = MAXVAL(m->size_inc, diff) + m->capacity;
+		/* double the capacity, within MEMBUF_MAX_GROWTH */
+		alloc_len = MAXVAL(m->size_inc, diff);
+		alloc_len = MAXVAL(alloc_len,
+				    MINVAL(m->capacity, MEMBUF_MAX_GROWTH)) +
+			    m->capacity;
 	} else { /* decrease length */
 
 		assert(new_length <= m->length);
@@ -126,6 +292,10 @@ int membuffer_set_size(membuffer *m, size_t new_length)
 		if ((m->capacity - new_length) <= m->size_inc) {
 			return 0;
 		}
+		/* pool blocks stay intact so they can be recycled */
+		if (m->pooled) {
+			return 0;
+		}
 
 		alloc_len = new_length + m->size_inc;
 	}
@@ -151,6 +321,7 @@ int membuffer_set_size(membuffer *m, size_t new_length)
 	/* save */
 	m->buf = temp_buf;
 	m->capacity = alloc_len;
+	m->pooled = 0;
 	return 0;
 }
 
@@ -168,7 +339,11 @@ void membuffer_destroy(membuffer *m)
 		return;
 	}
 
-	free(m->buf);
+	if (m->pooled) {
+		membuffer_pool_put(m->buf);
+	} else {
+		free(m->buf);
+	}
 	membuffer_init(m);
 }
 
@@ -297,4 +472,5 @@ void membuffer_attach(membuffer *m, char *new_buf, size_t buf_len)
 	m->buf = new_buf;
 	m->length = buf_len;
 	m->capacity = buf_len;
+	m->pooled = 0;
 }
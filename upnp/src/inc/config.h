@@ -162,6 +162,102 @@
 #define MAX_SUBSCRIPTION_EVENT_AGE 30
 /* @} */
 
+/*! \name NOTIFY_FREE_LIST_SIZE
+ *
+ *  The {\tt NOTIFY_FREE_LIST_SIZE} determines how many per subscriber
+ *  notify jobs are kept for reuse at first, once their events are sent, so
+ *  that fanning an event out to many subscribers does not go through malloc
+ *  for each of them. The lists then grow to keep as many jobs as were ever
+ *  in use at once, that is the subscribers times the events queued for each.
+ *
+ * @{
+ */
+#define NOTIFY_FREE_LIST_SIZE 1024
+/* @} */
+
+/*! \name HTTP_ASYNC_MAX_CONNECTIONS
+ *
+ *  The {\tt HTTP_ASYNC_MAX_CONNECTIONS} determines how many requests the
+ *  asynchronous HTTP client, behind UpnpSendActionAsync() and
+ *  UpnpGetServiceVarStatusAsync(), keeps in progress at a time. Further
+ *  requests wait in order for one of them to finish. Each one in progress
+ *  uses a socket.
+ *
+ * @{
+ */
+#define HTTP_ASYNC_MAX_CONNECTIONS 1024
+/* @} */
+
+/*! \name HTTP_POOL_MAX_IDLE
+ *
+ *  The {\tt HTTP_POOL_MAX_IDLE} determines how many idle keep-alive
+ *  connections control point requests (actions, state variable queries,
+ *  downloads and the UpnpOpenHttp* calls) keep open for reuse, all
+ *  destinations together. {\tt HTTP_POOL_MAX_IDLE_PER_HOST} limits the idle
+ *  connections to one destination address.
+ *
+ * @{
+ */
+#define HTTP_POOL_MAX_IDLE 64
+#define HTTP_POOL_MAX_IDLE_PER_HOST 4
+/* @} */
+
+/*! \name HTTP_POOL_IDLE_TIMEOUT
+ *
+ *  The {\tt HTTP_POOL_IDLE_TIMEOUT} is the number of seconds an idle
+ *  keep-alive connection stays in the pool before it is closed. Keep it
+ *  below the keep-alive timeout of the servers talked to, so that requests
+ *  rarely go out on a connection the server is closing.
+ *
+ * @{
+ */
+#define HTTP_POOL_IDLE_TIMEOUT 4
+/* @} */
+
+/*! \name RESOLVER_CACHE_SIZE
+ *
+ *  The {\tt RESOLVER_CACHE_SIZE} determines how many host names found in
+ *  URLs have their resolution cached. The least recently used one is
+ *  dropped to make room for a new one.
+ *
+ * @{
+ */
+#define RESOLVER_CACHE_SIZE 64
+/* @} */
+
+/*! \name RESOLVER_CACHE_TTL
+ *
+ *  The {\tt RESOLVER_CACHE_TTL} is the number of seconds a resolved host
+ *  address is used before the name is resolved again, and the
+ *  {\tt RESOLVER_NEGATIVE_TTL} the number of seconds a host name that
+ *  failed to resolve is rejected without trying again.
+ *
+ * @{
+ */
+#define RESOLVER_CACHE_TTL 300
+#define RESOLVER_NEGATIVE_TTL 30
+/* @} */
+
+/*! \name MINISERVER_LISTENER_SHARDS
+ *
+ *  The {\tt MINISERVER_LISTENER_SHARDS} is the default number of HTTP
+ *  listener sockets the miniserver opens on its port with SO_REUSEPORT,
+ *  each one accepting connections in its own thread bound to a processor.
+ *  The kernel spreads the incoming connections over them. It can be
+ *  changed before UpnpInit2() with {\tt UpnpSetMiniServerShards}, up to
+ *  {\tt MINISERVER_MAX_LISTENER_SHARDS}. With 1, the HTTP listeners are
+ *  served by the thread reading the SSDP sockets, as they always were.
+ *
+ *  The SSDP sockets are never sharded: multicast datagrams are delivered
+ *  to every socket of a SO_REUSEPORT group, so each search would be
+ *  answered once per shard.
+ *
+ * @{
+ */
+#define MINISERVER_LISTENER_SHARDS 1
+#define MINISERVER_MAX_LISTENER_SHARDS 64
+/* @} */
+
 /*!
  * \name DEFAULT_SOAP_CONTENT_LENGTH
  *
@@ -199,6 +295,41 @@
 #define SSDP_PAUSE 100u
 /* @} */
 
+/*!
+ * \name LOG_ASYNC_RING_SLOTS
+ *
+ * Number of messages each thread can have waiting for the log writer thread
+ * when asynchronous logging is enabled with {\tt UpnpSetLogAsync}. Messages
+ * logged while the ring of a thread is full are dropped and counted. The
+ * default value is 128.
+ *
+ * @{
+ */
+#define LOG_ASYNC_RING_SLOTS 128
+/* @} */
+
+/*!
+ * \name LOG_ASYNC_MSG_SIZE
+ *
+ * Maximum length, in bytes, of a message logged in asynchronous mode. Longer
+ * messages are truncated. The default value is 512.
+ *
+ * @{
+ */
+#define LOG_ASYNC_MSG_SIZE 512
+/* @} */
+
+/*!
+ * \name LOG_ASYNC_FLUSH_INTERVAL
+ *
+ * Time, in milliseconds, the asynchronous log writer thread sleeps when there
+ * is nothing to write. The default value is 10.
+ *
+ * @{
+ */
+#define LOG_ASYNC_FLUSH_INTERVAL 10
+/* @} */
+
 /*!
  * \name WEB_SERVER_BUF_SIZE
  *
@@ -307,6 +438,32 @@
 #define SSDP_PACKET_DISTRIBUTE 1
 /* @} */
 
+/*!
+ * \name SSDP_ADVERTISER_BATCH
+ *
+ * The {\tt SSDP_ADVERTISER_BATCH} is the maximum number of devices whose
+ * advertisements are renewed in one pass of the advertisement scheduler.
+ * Renewals of the devices left over wait for the next pass, one second
+ * later, which is far below AUTO_ADVERTISEMENT_TIME.
+ *
+ * @{
+ */
+#define SSDP_ADVERTISER_BATCH 32
+/* @} */
+
+/*!
+ * \name SSDP_REPLY_MAX_PENDING
+ *
+ * The {\tt SSDP_REPLY_MAX_PENDING} is the maximum number of search replies
+ * waiting for their time in the reply scheduler. The replies of a device
+ * beyond it are dropped, which bounds the memory a flood of searches can
+ * take; the control points search again.
+ *
+ * @{
+ */
+#define SSDP_REPLY_MAX_PENDING 4096
+/* @} */
+
 /*!
  * \name GENA_NOTIFICATION_SENDING_TIMEOUT
  *
@@ -349,6 +506,68 @@
 #define GENA_NOTIFICATION_ANSWERING_TIMEOUT HTTP_DEFAULT_TIMEOUT
 /* @} */
 
+/*!
+ * \name GENA_NOTIFICATION_MIN_TIMEOUT
+ *
+ * Lower bound, in seconds, of the adaptive GENA notification timeouts.
+ *
+ * Once a subscriber has answered, its sending and answering timeouts are
+ * derived from the round trip times measured on its previous notifications
+ * (smoothed RTT plus four times the RTT variance), clamped between this
+ * value and GENA_NOTIFICATION_SENDING_TIMEOUT or
+ * GENA_NOTIFICATION_ANSWERING_TIMEOUT.
+ *
+ * @{
+ */
+#define GENA_NOTIFICATION_MIN_TIMEOUT 2
+/* @} */
+
+/*!
+ * \name GENA_BREAKER_THRESHOLD
+ *
+ * Number of consecutive failed deliveries after which notifications to a
+ * subscriber are held back instead of being sent.
+ *
+ * A control point that left the network without unsubscribing would
+ * otherwise keep one sending thread busy for the full timeout on every
+ * event until its subscription expires.
+ *
+ * @{
+ */
+#define GENA_BREAKER_THRESHOLD 3
+/* @} */
+
+/*!
+ * \name GENA_BREAKER_MIN_BACKOFF / GENA_BREAKER_MAX_BACKOFF
+ *
+ * Time in seconds a held back subscriber waits before the next delivery
+ * attempt. It starts at GENA_BREAKER_MIN_BACKOFF, doubles on every further
+ * failure and is capped at GENA_BREAKER_MAX_BACKOFF. Events raised in the
+ * meantime stay queued on the subscription, within the limits set by
+ * UpnpSetEventQueueLimits().
+ *
+ * @{
+ */
+#define GENA_BREAKER_MIN_BACKOFF 2
+#define GENA_BREAKER_MAX_BACKOFF 60
+/* @} */
+
+/*!
+ * \name GENA_PENDING_NOTIFY_WAIT
+ *
+ * Maximum time in seconds a first notification with an unknown SID waits
+ * for the response of an asynchronous subscription sent to the host it
+ * comes from, before being rejected.
+ *
+ * The initial event of a subscription may arrive before its response has
+ * been processed; it is only held that long, and only when such a
+ * subscription is in flight.
+ *
+ * @{
+ */
+#define GENA_PENDING_NOTIFY_WAIT 2
+/* @} */
+
 /*!
  * \name Module Exclusion
  *
@@ -40,11 +40,13 @@
 
 #include <time.h>
 
+#include "ThreadPool.h"
 #include "UpnpString.h"
 #include "httpparser.h"
 #include "ithread.h"
 #include "sock.h"
 #include "upnp.h"
+#include "upnpatomic.h"
 
 #ifdef __cplusplus
 	#define EXTERN_C extern "C"
@@ -96,6 +98,9 @@
 #define DEFAULT_TIMEOUT 1801
 
 extern ithread_mutex_t GlobalClientSubscribeMutex;
+/*! Signaled with GlobalClientSubscribeMutex when an asynchronous
+ * subscription completes. */
+extern ithread_cond_t GlobalClientSubscribeCond;
 
 /*!
  * \brief Locks the subscription.
@@ -119,17 +124,32 @@ extern ithread_mutex_t GlobalClientSubscribeMutex;
 	UpnpPrintf(UPNP_INFO, GENA, __FILE__, __LINE__, "Subscribe UnLock")
 
 /*!
- * Structure to send NOTIFY message to all subscribed control points
+ * Parts of a NOTIFY message shared by all the subscribers of one event.
  */
-typedef struct NOTIFY_THREAD_STRUCT
+typedef struct NOTIFY_EVENT
 {
-	char *headers;
-	DOMString propertySet;
+	/*! Number of notify_thread_struct pointing to this event. */
+	upnp_atomic_t reference_count;
+	/*! The headers that are the same for every subscriber, the empty line
+	 * and the body. Each subscriber only adds the request line, HOST, SID
+	 * and SEQ in front of it. Points into the same allocation as the
+	 * event. */
+	char *message;
+	size_t messageLength;
+	/*! Points into the same allocation as the event. */
 	char *servId;
+	/*! Points into the same allocation as the event. */
 	char *UDN;
+} notify_event;
+
+/*!
+ * Structure to send NOTIFY message to one subscribed control point
+ */
+typedef struct NOTIFY_THREAD_STRUCT
+{
+	notify_event *event;
 	Upnp_SID sid;
 	time_t ctime;
-	int *reference_count;
 	UpnpDevice_Handle device_handle;
 } notify_thread_struct;
 
@@ -172,6 +192,51 @@ EXTERN_C int genaSubscribe(
 	UpnpString *out_sid);
 #endif /* INCLUDE_CLIENT_APIS */
 
+/*!
+ * \brief Called with the result of genaSubscribeAsync(), from a thread of
+ * the receive thread pool.
+ *
+ * The function takes ownership of \b cookie.
+ */
+typedef void (*gena_subscribe_callback)(
+	/*! [in] UPNP_E_SUCCESS, or the error code genaSubscribe() would
+	 * return. */
+	int err_code,
+	/*! [in] SID of the subscription, empty on error. */
+	const UpnpString *sid,
+	/*! [in] Duration granted by the service, -1 for infinite. */
+	int timeout,
+	/*! [in] Cookie given to genaSubscribeAsync(). */
+	void *cookie);
+
+/*!
+ * \brief Subscribes to a PublisherURL without waiting for the response.
+ *
+ * The SUBSCRIBE request is driven by the asynchronous HTTP client, no
+ * thread waits for the service. The subscription is then added as by
+ * genaSubscribe().
+ *
+ * \return UPNP_E_SUCCESS if the request was sent, \b callback will be
+ * 	called unless the SDK is shut down first. Otherwise \b cookie is left
+ * 	to the caller and an error code is returned.
+ */
+#ifdef INCLUDE_CLIENT_APIS
+EXTERN_C int genaSubscribeAsync(
+	/*! [in] The client handle. */
+	UpnpClient_Handle client_handle,
+	/*! [in] Of the form: "http://134.134.156.80:4000/RedBulb/Event */
+	const UpnpString *PublisherURL,
+	/*! [in] Requested duration, -1 for "infinite". */
+	int TimeOut,
+	/*! [in] Completion callback. */
+	gena_subscribe_callback callback,
+	/*! [in] Releases \b cookie when the callback will not be called, may
+	 * be NULL. */
+	free_routine free_cookie,
+	/*! [in] Argument of \b callback. */
+	void *cookie);
+#endif /* INCLUDE_CLIENT_APIS */
+
 /*!
  * \brief Unsubscribes a SID.
  *
@@ -220,6 +285,25 @@ EXTERN_C int genaUnregisterDevice(
 	UpnpDevice_Handle device_handle);
 #endif /* INCLUDE_CLIENT_APIS */
 
+/*!
+ * \brief Initializes the free lists the per subscriber notify jobs are
+ * taken from.
+ *
+ * \return UPNP_E_SUCCESS, or UPNP_E_INIT_FAILED if the lock cannot be
+ * 	created.
+ */
+#ifdef INCLUDE_DEVICE_APIS
+EXTERN_C int genaNotifyPoolInit(void);
+#endif /* INCLUDE_DEVICE_APIS */
+
+/*!
+ * \brief Releases the notify job free lists. Must be called after the send
+ * thread pool is shut down.
+ */
+#ifdef INCLUDE_DEVICE_APIS
+EXTERN_C void genaNotifyPoolDestroy(void);
+#endif /* INCLUDE_DEVICE_APIS */
+
 /*!
  * \brief Renews a SID.
  *
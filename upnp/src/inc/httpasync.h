@@ -0,0 +1,129 @@
+/**************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * - Neither name of Intel Corporation nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+#ifndef GENLIB_NET_HTTP_HTTPASYNC_H
+#define GENLIB_NET_HTTP_HTTPASYNC_H
+
+/*!
+ * \file
+ *
+ * \brief Asynchronous HTTP client.
+ *
+ * Requests are driven by a single event loop running as a persistent job of
+ * the send thread pool: connections are made, requests written and
+ * responses read with non-blocking sockets, so an outstanding request does
+ * not hold a thread. Completion callbacks run as short jobs of the receive
+ * thread pool, away from the GENA notifications the send thread pool may be
+ * busy delivering: an event can wait for the response of a subscription.
+ */
+
+#include "ThreadPool.h"
+#include "httpparser.h"
+#include "uri.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * \brief Called with the result of an asynchronous request, from a thread of
+ * the receive thread pool.
+ *
+ * The function takes ownership of \b cookie. \b response is destroyed when
+ * it returns.
+ */
+typedef void (*http_async_callback)(
+	/*! [in] UPNP_E_SUCCESS, or the error that ended the request. */
+	int ret_code,
+	/*! [in] Response, parsed as far as it was received. */
+	http_parser_t *response,
+	/*! [in] Cookie given to http_AsyncRequest(). */
+	void *cookie);
+
+/*!
+ * \brief Starts the event loop of the asynchronous HTTP client.
+ *
+ * \return UPNP_E_SUCCESS, or an error if the loop could not be started.
+ */
+int http_AsyncInit(void);
+
+/*!
+ * \brief Stops the event loop.
+ *
+ * Outstanding requests are dropped: their callbacks are not called and
+ * their cookies are released with the free function given to
+ * http_AsyncRequest(). Must be called before the send thread pool is shut
+ * down.
+ */
+void http_AsyncShutdown(void);
+
+/*!
+ * \brief Queues a request on the event loop.
+ *
+ * The destination is connected to, \b request is sent and the response is
+ * read without blocking the calling thread, then \b callback is called. At
+ * most HTTP_ASYNC_MAX_CONNECTIONS requests are in progress at a time, the
+ * others wait in order.
+ *
+ * \return UPNP_E_SUCCESS if the request was queued, \b callback will be
+ * 	called unless the SDK is shut down first. Otherwise the cookie is
+ * 	left to the caller and:
+ * 	\li \c UPNP_E_FINISH: the loop is not running.
+ * 	\li \c UPNP_E_OUTOF_MEMORY
+ */
+int http_AsyncRequest(
+	/*! [in] Destination, only the address is used. */
+	const uri_type *destination,
+	/*! [in] Complete request, must stay valid until \b callback is
+	 * called or \b cookie is released. */
+	const char *request,
+	/*! [in] Length of the request. */
+	size_t request_length,
+	/*! [in] Request method, to parse the response. */
+	http_method_t req_method,
+	/*! [in] Timeout for the whole request, in seconds. */
+	int timeout_secs,
+	/*! [in] 1 to parse the XML body of the response while it is
+	 * received, see http_RecvMessage(). */
+	int push_xml,
+	/*! [in] Completion callback. */
+	http_async_callback callback,
+	/*! [in] Releases \b cookie when the callback will not be called, may
+	 * be NULL. */
+	free_routine free_cookie,
+	/*! [in] Argument of \b callback. */
+	void *cookie);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GENLIB_NET_HTTP_HTTPASYNC_H */
@@ -0,0 +1,110 @@
+/**************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * - Neither name of Intel Corporation nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+#ifndef GENLIB_NET_HTTP_HTTPCONNPOOL_H
+#define GENLIB_NET_HTTP_HTTPCONNPOOL_H
+
+/*!
+ * \file
+ *
+ * \brief Pool of idle client connections kept open with HTTP/1.1
+ * keep-alive.
+ *
+ * Connections are keyed by destination address. A connection is put back
+ * once a response that leaves it usable has been read completely, and is
+ * handed out again for the next request to the same address. Connections
+ * idle for more than HTTP_POOL_IDLE_TIMEOUT seconds, or that became
+ * readable while idle (closed by the server), are closed instead.
+ */
+
+#include "UpnpInet.h"
+#include "httpparser.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * \brief Initializes the pool.
+ *
+ * \return UPNP_E_SUCCESS.
+ */
+int http_ConnPoolInit(void);
+
+/*!
+ * \brief Closes all idle connections and releases the pool.
+ */
+void http_ConnPoolShutdown(void);
+
+/*!
+ * \brief Takes an idle connection to an address out of the pool.
+ *
+ * The socket is blocking and connected, the caller owns it. The server may
+ * still have closed it right before, so a request that fails on it before
+ * any response byte is read should be retried on a new connection.
+ *
+ * \return The socket, or INVALID_SOCKET if there is no idle connection to
+ * 	this address.
+ */
+SOCKET http_ConnPoolGet(
+	/*! [in] Destination address. */
+	const struct sockaddr_storage *address);
+
+/*!
+ * \brief Puts a connection back into the pool, or closes it.
+ *
+ * The oldest idle connection to the same address is closed when there are
+ * already HTTP_POOL_MAX_IDLE_PER_HOST of them, the oldest of all when the
+ * pool holds HTTP_POOL_MAX_IDLE.
+ */
+void http_ConnPoolPut(
+	/*! [in] Destination address the socket is connected to. */
+	const struct sockaddr_storage *address,
+	/*! [in] Blocking socket, the pool takes ownership. */
+	SOCKET sock);
+
+/*!
+ * \brief Tells whether a connection can carry another request after this
+ * response.
+ *
+ * \return 1 if the response was read completely, is HTTP/1.1 or later, has
+ * 	its length given by its headers and does not ask for the connection
+ * 	to be closed. 0 otherwise.
+ */
+int http_ConnPoolReusable(
+	/*! [in] Response received on the connection. */
+	http_parser_t *response);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GENLIB_NET_HTTP_HTTPCONNPOOL_H */
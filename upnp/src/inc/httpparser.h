@@ -38,6 +38,7 @@
  */
 
 #include "LinkedList.h"
+#include "ixml.h"
 #include "membuffer.h"
 #include "upnputil.h"
 #include "uri.h"
@@ -191,8 +192,8 @@ typedef struct
 	int status_code;
 	/*! response only. */
 	membuffer status_msg;
-	/*! response only. the amount of data that's been read by the user,
-	 * that's no longer in the raw message buffer.
+	/*! the amount of data that's been read by the user or given to
+	 * xml_parser, that's no longer in the raw message buffer.
 	 */
 	size_t amount_discarded;
 	/* fields used in both request or response messages. */
@@ -211,6 +212,9 @@ typedef struct
 	membuffer msg;
 	/*! storage for url string. */
 	char *urlbuf;
+	/*! parser the XML body is given to while it is received, or NULL.
+	 * see httpmsg_get_xml_doc(). */
+	IXML_PushParser *xml_parser;
 } http_message_t;
 
 typedef struct
@@ -222,6 +226,9 @@ typedef struct
 	/*! read-only; this is set to 1 if a NOTIFY request has no
 	 * content-length. used to read valid sspd notify msg. */
 	int valid_ssdp_notify_hack;
+	/*! set to 1 after the parser is initialized to parse the body of
+	 * a SOAP or GENA message with an XML body while it is received. */
+	int push_xml;
 	/* private data -- don't touch. */
 	parser_pos_t position;
 	int ent_position;
@@ -265,6 +272,21 @@ void httpmsg_init(http_message_t *msg);
  ************************************************************************/
 void httpmsg_destroy(http_message_t *msg);
 
+/*!
+ * \brief Returns the XML document in the body of a message.
+ *
+ * The body is either parsed by the push parser it was given to while it was
+ * received, or parsed here. In the first case the body is no longer in the
+ * message.
+ *
+ * \return IXML_SUCCESS or an IXML error code, as ixmlParseBufferEx().
+ */
+int httpmsg_get_xml_doc(
+	/*! [in,out] HTTP Message Object. */
+	http_message_t *msg,
+	/*! [out] The document, to free with ixmlDocument_free(). */
+	IXML_Document **doc);
+
 /************************************************************************
  *	Function :	httpmsg_find_hdr_str
  *
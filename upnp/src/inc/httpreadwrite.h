@@ -99,6 +99,34 @@ SOCKET http_Connect(
 	/*! [out] Fixed and corrected URL. */
 	uri_type *url);
 
+/*! Maximum number of destinations raced by http_ConnectFirst(). */
+#define HTTP_CONNECT_FIRST_MAX 8
+
+/*!
+ * \brief Connects to whichever of several destinations accepts first.
+ *
+ * The connections are started together and the slower ones are dropped
+ * as soon as one is established, so an unreachable destination does not
+ * delay the others. Only the first HTTP_CONNECT_FIRST_MAX destinations
+ * are tried.
+ *
+ * \return Socket descriptor on success, or on error:
+ * 	\li \c UPNP_E_OUTOF_SOCKET
+ * 	\li \c UPNP_E_SOCKET_CONNECT
+ */
+SOCKET http_ConnectFirst(
+	/*! [in] Destinations, in order of preference. */
+	uri_type *destination_urls,
+	/*! [in] Number of destinations. */
+	size_t count,
+	/*! [in] Seconds to wait for a connection, at most the default TCP
+	 * connect timeout. */
+	int timeoutSecs,
+	/*! [out] Fixed and corrected URL of the destination connected to. */
+	uri_type *url,
+	/*! [out] Index of that destination, may be NULL. */
+	size_t *index);
+
 /************************************************************************
  * Function: http_RecvMessage
  *
@@ -108,12 +136,16 @@ SOCKET http_Connect(
  *	IN http_method_t request_method;	HTTP request method
  *	IN OUT int* timeout_secs;		time out
  *	OUT int* http_error_code;		HTTP error code returned
+ *	IN int push_xml;			1 to parse the XML body of a
+ *						SOAP or GENA message while it
+ *						is received
  *
  * Description:
  *	Get the data on the socket and take actions based on the read data
  *	to modify the parser objects buffer. If an error is reported while
  *	parsing the data, the error code is passed in the http_errr_code
- *	parameter
+ *	parameter. When push_xml is set, the XML body is taken with
+ *	httpmsg_get_xml_doc().
  *
  * Returns:
  *	 UPNP_E_BAD_HTTPMSG
@@ -123,7 +155,8 @@ int http_RecvMessage(SOCKINFO *info,
 	http_parser_t *parser,
 	http_method_t request_method,
 	int *timeout_secs,
-	int *http_error_code);
+	int *http_error_code,
+	int push_xml);
 
 /*!
  * \brief Sends a message to the destination based on the format parameter.
@@ -168,10 +201,14 @@ int http_SendMessage(
  *	IN http_method_t req_method;	HTTP Request method
  *	IN int timeout_secs;		time out value
  *	OUT http_parser_t* response;	Parser object to receive the repsonse
+ *	IN int push_xml;		1 to parse the XML body of the response
+ *					while it is received
  *
  * Description:
  *	Initiates socket, connects to the destination, sends a
- *	request and waits for the response from the remote end
+ *	request and waits for the response from the remote end. The
+ *	connection is taken from and given back to the keep-alive pool
+ *	when possible.
  *
  * Returns:
  *	UPNP_E_SOCKET_ERROR
@@ -184,7 +221,8 @@ int http_RequestAndResponse(uri_type *destination,
 	size_t request_length,
 	http_method_t req_method,
 	int timeout_secs,
-	http_parser_t *response);
+	http_parser_t *response,
+	int push_xml);
 
 /************************************************************************
  * return codes:
@@ -463,6 +501,9 @@ UPNP_EXPORT_SPEC int http_ReadHttpResponse(
  * \brief Closes the connection created with \b UpnpOpenHttpConnection
  * and frees any memory associated with the connection.
  *
+ * A plain HTTP connection whose response was read completely and can
+ * carry another request goes back to the keep-alive pool instead.
+ *
  * \return An integer representing one of the following:
  *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
  *     \li \c UPNP_E_INVALID_PARAM: \b handle, or is not a valid pointer.
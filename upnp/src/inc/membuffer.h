@@ -66,8 +66,18 @@ typedef struct
 	size_t size_inc;
 	/*! default value of size_inc. */
 #define MEMBUF_DEF_SIZE_INC (size_t)5
+	/*! buf is a MEMBUF_POOL_BLOCK_SIZE block that goes back to the
+	 * thread's pool when destroyed (read-only). */
+	int pooled;
 } membuffer;
 
+/*! Capacity of the recycled blocks; big enough for typical headers. */
+#define MEMBUF_POOL_BLOCK_SIZE (size_t)1024
+/*! Maximum number of recycled blocks kept per thread. */
+#define MEMBUF_POOL_DEPTH 16
+/*! Growth is geometric but never adds more than this at once. */
+#define MEMBUF_MAX_GROWTH ((size_t)1024 * (size_t)1024)
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
@@ -119,10 +129,31 @@ int memptr_cmp_nocase(
 	/*! [in] Constatnt string for the memory object to be compared with. */
 	const char *s);
 
+/*!
+ * \brief Creates the key of the per-thread pools of recycled buffers.
+ *
+ * Until this is called, buffers are always taken from the heap.
+ *
+ * \return
+ * \li UPNP_E_SUCCESS - On Success
+ * \li UPNP_E_INIT_FAILED - If the key cannot be created.
+ */
+int membuffer_pool_init(void);
+
+/*!
+ * \brief Deletes the pool key and frees the pools of all the threads. Must
+ * be called once the other threads no longer use membuffers.
+ */
+void membuffer_pool_cleanup(void);
+
 /*!
  * \brief Increases or decreases buffer cap so that at least 'new_length'
  * bytes can be stored.
  *
+ * Capacity grows geometrically, by at most MEMBUF_MAX_GROWTH per step, so
+ * appending piecewise stays linear. Small buffers are taken from the thread's
+ * pool of recycled blocks.
+ *
  * \return
  * \li UPNP_E_SUCCESS - On Success
  * \li UPNP_E_OUTOF_MEMORY - On failure to allocate memory.
@@ -0,0 +1,184 @@
+/**************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * - Neither name of Intel Corporation nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+/*!
+ * \file
+ *
+ * \brief Lock free counters and histograms behind UpnpGetMetrics().
+ *
+ * Recording a sample costs a few atomic adds and never blocks, so the
+ * metrics are always on. Snapshots read each counter independently and
+ * are not a consistent cut across counters.
+ */
+
+#include "UpnpMetrics.h"
+#include "upnpatomic.h"
+
+#ifdef _WIN32
+	#include <winsock2.h> /* for QueryPerformanceCounter() */
+#else
+	#include <time.h> /* for clock_gettime() */
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! Latency histogram, see UpnpLatencyHistogram for the bucket layout. */
+typedef struct
+{
+	upnp_atomic64_t count;
+	upnp_atomic64_t totalUsec;
+	upnp_atomic64_t bucket[UPNP_METRICS_BUCKETS];
+} upnp_histogram_t;
+
+/*! SDK wide counters. Thread pools keep their own histograms. */
+typedef struct
+{
+	upnp_histogram_t soapAction;
+	upnp_atomic64_t soapActionFailures;
+	upnp_histogram_t notifyDelivery;
+	upnp_atomic64_t notifyFailures;
+	upnp_atomic64_t ssdpPacketsIn;
+	upnp_atomic64_t ssdpPacketsOut;
+	upnp_atomic64_t httpResponses[UPNP_METRICS_HTTP_CLASSES];
+} upnp_metrics_t;
+
+/*! Defined in upnpapi.c, cleared by UpnpInit2(). */
+extern upnp_metrics_t gUpnpMetrics;
+
+/*!
+ * \brief Reads a monotonic clock.
+ *
+ * \return Microseconds since an arbitrary starting point.
+ */
+static UPNP_INLINE int64_t upnp_clock_usec(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return now.QuadPart / freq.QuadPart * 1000000 +
+	       now.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+/*!
+ * \brief Adds a sample to a histogram.
+ */
+static UPNP_INLINE void upnp_histogram_record(
+	/*! [in,out] Histogram. */
+	upnp_histogram_t *h,
+	/*! [in] Sample in microseconds, negative values count as 0. */
+	int64_t usec)
+{
+	uint64_t v;
+	int i = 0;
+
+	if (usec < 0)
+		usec = 0;
+	for (v = (uint64_t)usec; v != 0 && i < UPNP_METRICS_BUCKETS - 1;
+		v >>= 1)
+		i++;
+	upnp_atomic64_add(&h->bucket[i], 1);
+	upnp_atomic64_add(&h->totalUsec, usec);
+	upnp_atomic64_add(&h->count, 1);
+}
+
+/*!
+ * \brief Adds the time elapsed since \b start to a histogram.
+ */
+static UPNP_INLINE void upnp_histogram_since(
+	/*! [in,out] Histogram. */
+	upnp_histogram_t *h,
+	/*! [in] Value returned by upnp_clock_usec() when the timed
+	 * operation began. */
+	int64_t start)
+{
+	upnp_histogram_record(h, upnp_clock_usec() - start);
+}
+
+/*!
+ * \brief Copies a histogram into its public form.
+ */
+static UPNP_INLINE void upnp_histogram_snapshot(
+	/*! [in] Histogram. */
+	upnp_histogram_t *h,
+	/*! [out] Copy. */
+	UpnpLatencyHistogram *out)
+{
+	int i;
+
+	out->count = (uint64_t)upnp_atomic64_load(&h->count);
+	out->totalUsec = (uint64_t)upnp_atomic64_load(&h->totalUsec);
+	for (i = 0; i < UPNP_METRICS_BUCKETS; i++)
+		out->bucket[i] = (uint64_t)upnp_atomic64_load(&h->bucket[i]);
+}
+
+/*!
+ * \brief Increments a counter.
+ */
+static UPNP_INLINE void upnp_metrics_inc(
+	/*! [in,out] Counter. */
+	upnp_atomic64_t *counter)
+{
+	upnp_atomic64_add(counter, 1);
+}
+
+/*!
+ * \brief Counts an HTTP response by status class.
+ */
+static UPNP_INLINE void upnp_metrics_http_status(
+	/*! [in] HTTP status code. */
+	int status_code)
+{
+	int status_class = status_code / 100;
+
+	if (status_class < 1 || status_class >= UPNP_METRICS_HTTP_CLASSES)
+		status_class = 0;
+	upnp_atomic64_add(&gUpnpMetrics.httpResponses[status_class], 1);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* METRICS_H */
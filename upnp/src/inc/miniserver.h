@@ -42,6 +42,26 @@
 
 extern SOCKET gMiniServerStopSock;
 
+/*!
+ * \brief HTTP listeners accepting connections in their own thread, see
+ * MINISERVER_LISTENER_SHARDS.
+ */
+typedef struct MServerShard
+{
+	/*! Index of the shard, picks the processor its thread is bound to. */
+	int index;
+	/*! IPv4 listener, on the port of the other shards. */
+	SOCKET sock4;
+	/*! IPv6 LLA listener, on the port of the other shards. */
+	SOCKET sock6;
+	/*! IPv6 ULA or GUA listener, on the port of the other shards. */
+	SOCKET sock6UlaGua;
+	/*! Socket for stopping miniserver, watched but never read. */
+	SOCKET stopSock;
+	/*! Non-zero while the thread of the shard runs. */
+	volatile int running;
+} MiniServerShard;
+
 typedef struct MServerSockArray
 {
 	/*! IPv4 socket for listening for miniserver requests. */
@@ -76,6 +96,11 @@ typedef struct MServerSockArray
 	 * replies */
 	SOCKET ssdpReqSock6;
 #endif /* INCLUDE_CLIENT_APIS */
+	/*! Number of entries of shards. */
+	int shardCount;
+	/*! HTTP listener shards, NULL unless there are more than one. The
+	 * miniServerSock* listeners are then not used. */
+	MiniServerShard *shards;
 } MiniServerSockArray;
 
 /*! . */
@@ -148,6 +173,23 @@ int StartMiniServer(
  */
 int StopMiniServer();
 
+/*!
+ * \brief Sets the number of HTTP listener shards of the next miniserver
+ * started.
+ *
+ * \return UPNP_E_SUCCESS, or UPNP_E_INVALID_PARAM if \b shards is out of
+ * 	range or, above 1, if SO_REUSEPORT is not available.
+ */
+int SetMiniServerShards(
+	/*! [in] Number of shards, 1 to MINISERVER_MAX_LISTENER_SHARDS. */
+	int shards);
+
+/*!
+ * \brief Returns how many persistent threads the HTTP listener shards take
+ * in the miniserver thread pool, besides the one of RunMiniServer().
+ */
+int GetMiniServerShardThreads(void);
+
 #ifdef __cplusplus
 } /* extern C */
 #endif
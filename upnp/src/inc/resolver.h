@@ -0,0 +1,108 @@
+/**************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * - Neither name of Intel Corporation nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+#ifndef GENLIB_NET_URI_RESOLVER_H
+#define GENLIB_NET_URI_RESOLVER_H
+
+/*!
+ * \file
+ *
+ * \brief Cache of host name resolutions for URL parsing.
+ *
+ * Host names are resolved with getaddrinfo(), or with the resolver set by
+ * UpnpSetHostResolver(). Addresses are kept for RESOLVER_CACHE_TTL
+ * seconds, failures for RESOLVER_NEGATIVE_TTL seconds. In asynchronous
+ * mode a host name that is not cached is resolved by a job of the send
+ * thread pool while the lookup fails right away, and an expired address
+ * is still returned while it is refreshed, so that parsing a URL never
+ * waits for a name server.
+ */
+
+#include "UpnpInet.h"
+#include "upnp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * \brief Initializes the cache.
+ *
+ * \return UPNP_E_SUCCESS.
+ */
+int resolver_Init(void);
+
+/*!
+ * \brief Releases the cache. Must be called after the send thread pool is
+ * shut down.
+ */
+void resolver_Shutdown(void);
+
+/*!
+ * \brief Resolves a host name.
+ *
+ * Before resolver_Init() or after resolver_Shutdown() the name is resolved
+ * without the cache, blocking.
+ *
+ * \return
+ * 	\li \c UPNP_E_SUCCESS: \b address is set, its port is 0.
+ * 	\li \c UPNP_E_INVALID_URL: the name does not resolve.
+ * 	\li \c UPNP_E_TIMEDOUT: asynchronous mode only, the name is being
+ * 		resolved, try again later.
+ */
+int resolver_Lookup(
+	/*! [in] Host name, not a numeric address. */
+	const char *hostname,
+	/*! [out] First IPv4 or IPv6 address of the host. */
+	struct sockaddr_storage *address);
+
+/*!
+ * \brief Sets the function resolving host names, NULL for getaddrinfo().
+ * Empties the cache.
+ */
+void resolver_SetHostResolver(
+	/*! [in] Resolver or NULL. */
+	UpnpHostResolver resolver,
+	/*! [in] Argument of \b resolver. */
+	void *cookie);
+
+/*!
+ * \brief Enables or disables the asynchronous mode.
+ */
+void resolver_SetAsync(
+	/*! [in] Non-zero to enable. */
+	int enable);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GENLIB_NET_URI_RESOLVER_H */
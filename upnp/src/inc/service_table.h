@@ -45,6 +45,7 @@ extern "C" {
 #include "config.h"
 #include "ixml.h"
 #include "upnp.h"
+#include "upnpatomic.h"
 #include "upnpdebug.h"
 #include "uri.h"
 
@@ -52,18 +53,40 @@ extern "C" {
 
 #define SID_SIZE (size_t)41
 
+/*!
+ * \brief Delivery URLs of a subscription.
+ *
+ * They never change after the subscription is created, so a notify job
+ * in flight holds a reference instead of copying them, and they stay
+ * valid after the subscription itself is removed.
+ */
+typedef struct SUBSCRIPTION_URLS
+{
+	upnp_atomic_t refcount;
+	URL_list list;
+} subscription_urls;
+
 typedef struct SUBSCRIPTION
 {
 	Upnp_SID sid;
 	int ToSendEventKey;
 	time_t expireTime;
 	int active;
-	URL_list DeliveryURLs;
+	subscription_urls *DeliveryURLs;
 	/* List of queued events for this subscription. Only one event job
 	   at a time goes into the thread pool. The first element in the
 	   list is a copy of the active job. Others are activated on job
 	   completion. */
 	LinkedList outgoing;
+	/* Delivery health: smoothed round trip time and its variance in
+	   microseconds, 0 until the first answer. */
+	int64_t srtt;
+	int64_t rttvar;
+	/* Consecutive failed deliveries. */
+	int failures;
+	/* upnp_clock_usec() time before which no delivery is attempted, 0
+	   when deliveries are not held back. */
+	int64_t retryAt;
 	struct SUBSCRIPTION *next;
 } subscription;
 
@@ -74,11 +97,19 @@ typedef struct SERVICE_INFO
 	char *SCPDURL;
 	char *controlURL;
 	char *eventURL;
+	/*! Path and query of controlURL, used as the SOAP routing key. */
+	char *controlURLPath;
+	/*! Path and query of eventURL, used as the GENA routing key. */
+	char *eventURLPath;
 	DOMString UDN;
 	int active;
 	int TotalSubscriptions;
 	subscription *subscriptionList;
 	struct SERVICE_INFO *next;
+	/*! Next service in the same control route bucket. */
+	struct SERVICE_INFO *nextControlRoute;
+	/*! Next service in the same event route bucket. */
+	struct SERVICE_INFO *nextEventRoute;
 } service_info;
 
 #ifdef INCLUDE_DEVICE_APIS
@@ -90,20 +121,39 @@ typedef struct SERVICE_TABLE
 	DOMString URLBase;
 	service_info *serviceList;
 	service_info *endServiceList;
+	/*! Hash buckets of services keyed by controlURLPath. */
+	service_info **controlRoutes;
+	/*! Hash buckets of services keyed by eventURLPath. */
+	service_info **eventRoutes;
+	/*! Number of buckets in controlRoutes and eventRoutes (power of 2). */
+	size_t routeBuckets;
 } service_table;
 
 /* Functions for Subscriptions */
 
 /*!
- * \brief Makes a copy of the subscription.
+ * \brief Allocates an empty delivery URL list with one reference.
+ *
+ * \return The list, or NULL if out of memory.
+ */
+subscription_urls *newSubscriptionURLs(void);
+
+/*!
+ * \brief Takes a reference on a delivery URL list.
  *
- * \return HTTP_SUCCESS on success.
+ * \return \b urls.
  */
-int copy_subscription(
-	/*! [in] Source subscription. */
-	subscription *in,
-	/*! [in] Destination subscription. */
-	subscription *out);
+subscription_urls *holdSubscriptionURLs(
+	/*! [in] Delivery URL list. */
+	subscription_urls *urls);
+
+/*!
+ * \brief Drops a reference on a delivery URL list, freeing it with the
+ * last one.
+ */
+void releaseSubscriptionURLs(
+	/*! [in] Delivery URL list, may be NULL. */
+	subscription_urls *urls);
 
 /*
  * \brief Remove the subscription represented by the const Upnp_SID sid
@@ -178,6 +228,18 @@ service_info *FindServiceId(
 	 * table. */
 	const char *UDN);
 
+/*!
+ * \brief Rebuilds the control and event URL path routing index of the table.
+ *
+ * Called whenever the service list changes. If the index cannot be
+ * allocated, lookups fall back to a linear walk of the service list.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_OUTOF_MEMORY.
+ */
+int buildServiceRoutes(
+	/*! [in] Service table whose index is to be rebuilt. */
+	service_table *table);
+
 /*!
  * \brief Traverses the service table and finds the node whose event URL Path
  * matches a know value.
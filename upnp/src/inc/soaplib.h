@@ -38,6 +38,7 @@
 
 /* SOAP module API to be called in Upnp-Dk API */
 
+#include "ThreadPool.h"
 #include "sock.h"
 
 /*!
@@ -101,6 +102,54 @@ int SoapSendActionEx(char *ActionURL,
 	IXML_Document *ActNode,
 	IXML_Document **RespNode);
 
+/*!
+ * \brief Sends a SOAP action built from name/value pairs and returns the
+ * output arguments of the response the same way, without a DOM.
+ *
+ * \return UPNP_E_SUCCESS, the UPnP error code of a SOAP fault or an error
+ * 	code.
+ */
+int SoapSendActionArgs(
+	/*! [in] Device control URL. */
+	char *action_url,
+	/*! [in] Device service type. */
+	char *service_type,
+	/*! [in] Name of the action. */
+	const char *action_name,
+	/*! [in] Input arguments. */
+	const UpnpActionArgument *in_args,
+	/*! [in] Number of input arguments. */
+	size_t in_count,
+	/*! [out] Output arguments, one block to free with free(). */
+	UpnpActionArgument **out_args,
+	/*! [out] Number of output arguments. */
+	size_t *out_count);
+
+/*!
+ * \brief Sends a SOAP action built from name/value pairs and stores the
+ * output arguments of the response through \b bindings, without a DOM.
+ *
+ * \return UPNP_E_SUCCESS, the UPnP error code of a SOAP fault or an error
+ * 	code.
+ */
+int SoapSendActionBind(
+	/*! [in] Device control URL. */
+	char *action_url,
+	/*! [in] Device service type. */
+	char *service_type,
+	/*! [in] Name of the action. */
+	const char *action_name,
+	/*! [in] Input arguments. */
+	const UpnpActionArgument *in_args,
+	/*! [in] Number of input arguments. */
+	size_t in_count,
+	/*! [in] Where to store the output arguments. */
+	const UpnpArgumentBinding *bindings,
+	/*! [in] Number of bindings. */
+	size_t binding_count,
+	/*! [out] Struct the bindings refer to. */
+	void *out);
+
 /****************************************************************************
  * Function: SoapGetServiceVarStatus
  *
@@ -119,6 +168,84 @@ int SoapSendActionEx(char *ActionURL,
 int SoapGetServiceVarStatus(
 	char *ActionURL, DOMString VarName, DOMString *StVar);
 
+/*!
+ * \brief Called with the result of SoapSendActionAsync(), from a thread of
+ * the receive thread pool.
+ *
+ * The function takes ownership of \b response_node and \b cookie.
+ */
+typedef void (*soap_action_callback)(
+	/*! [in] UPNP_E_SUCCESS, the UPnP error code of a SOAP fault or an error
+	 * code, as returned by SoapSendAction(). */
+	int err_code,
+	/*! [in] SOAP response node, or NULL. */
+	IXML_Document *response_node,
+	/*! [in] Cookie given to SoapSendActionAsync(). */
+	void *cookie);
+
+/*!
+ * \brief Called with the result of SoapGetServiceVarStatusAsync(), from a
+ * thread of the receive thread pool.
+ *
+ * The function takes ownership of \b var_value and \b cookie.
+ */
+typedef void (*soap_var_callback)(
+	/*! [in] UPNP_E_SUCCESS, the UPnP error code of a SOAP fault or an error
+	 * code, as returned by SoapGetServiceVarStatus(). */
+	int err_code,
+	/*! [in] Value of the variable, or NULL. */
+	DOMString var_value,
+	/*! [in] Cookie given to SoapGetServiceVarStatusAsync(). */
+	void *cookie);
+
+/*!
+ * \brief Sends a SOAP action without waiting for the response.
+ *
+ * The request is driven by the asynchronous HTTP client, no thread waits
+ * for the device. \b header may be NULL, the request is then the one of
+ * SoapSendAction(), otherwise the one of SoapSendActionEx().
+ *
+ * \return UPNP_E_SUCCESS if the action was sent, \b callback will be called
+ * 	unless the SDK is shut down first. Otherwise \b cookie is left to the
+ * 	caller and an error code is returned.
+ */
+int SoapSendActionAsync(
+	/*! [in] Device control URL. */
+	char *action_url,
+	/*! [in] Device service type. */
+	char *service_type,
+	/*! [in] SOAP header, or NULL. */
+	IXML_Document *header,
+	/*! [in] SOAP action node (SOAP body). */
+	IXML_Document *action_node,
+	/*! [in] Completion callback. */
+	soap_action_callback callback,
+	/*! [in] Releases \b cookie when the callback will not be called, may
+	 * be NULL. */
+	free_routine free_cookie,
+	/*! [in] Argument of \b callback. */
+	void *cookie);
+
+/*!
+ * \brief Queries a state variable without waiting for the response.
+ *
+ * \return UPNP_E_SUCCESS if the query was sent, \b callback will be called
+ * 	unless the SDK is shut down first. Otherwise \b cookie is left to the
+ * 	caller and an error code is returned.
+ */
+int SoapGetServiceVarStatusAsync(
+	/*! [in] Address to send the query to. */
+	char *action_url,
+	/*! [in] Name of the variable. */
+	char *var_name,
+	/*! [in] Completion callback. */
+	soap_var_callback callback,
+	/*! [in] Releases \b cookie when the callback will not be called, may
+	 * be NULL. */
+	free_routine free_cookie,
+	/*! [in] Argument of \b callback. */
+	void *cookie);
+
 extern const char *ContentTypeHeader;
 
 #endif /* SOAPLIB_H */
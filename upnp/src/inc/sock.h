@@ -67,6 +67,16 @@ typedef struct
 #endif
 } SOCKINFO;
 
+/*! Maximum number of buffers passed to sock_write_gather(). */
+#define SOCK_GATHER_MAX 8
+
+/*! One buffer of a gathered write. */
+typedef struct
+{
+	const char *buf;
+	size_t length;
+} sock_buffer;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -187,6 +197,25 @@ int sock_write(
 	/*! [in,out] timeout value. */
 	int *timeoutSecs);
 
+/*!
+ * \brief Writes several buffers on the socket in sockinfo as one stream,
+ * with as few system calls as the kernel allows (sendmsg() or WSASend()).
+ *
+ * \return Integer:
+ * \li \c numBytes - On Success, total number of bytes sent.
+ * \li \c UPNP_E_TIMEDOUT - Timeout.
+ * \li \c UPNP_E_SOCKET_ERROR - Error on socket calls.
+ */
+int sock_write_gather(
+	/*! [in] Socket Information Object. */
+	SOCKINFO *info,
+	/*! [in] Buffers to send, in order. */
+	const sock_buffer *bufs,
+	/*! [in] Number of buffers, at most SOCK_GATHER_MAX. */
+	int count,
+	/*! [in,out] timeout value. */
+	int *timeoutSecs);
+
 /*!
  * \brief Make socket blocking.
  *
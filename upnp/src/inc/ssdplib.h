@@ -135,14 +135,6 @@ typedef struct TData
 	struct sockaddr_storage DestAddr;
 } ThreadData;
 
-typedef struct ssdpsearchreply
-{
-	int MaxAge;
-	UpnpDevice_Handle handle;
-	struct sockaddr_storage dest_addr;
-	SsdpEvent event;
-} SsdpSearchReply;
-
 typedef struct ssdpsearcharg
 {
 	int timeoutEventId;
@@ -163,6 +155,44 @@ typedef struct
 	struct sockaddr_storage dest_addr;
 } ssdp_thread_data;
 
+/*! A device or a service of a registered root device, as advertised. */
+typedef struct SsdpTarget
+{
+	/*! deviceType or serviceType, with its version. */
+	char *type;
+	/*! UDN of the device, or of the device of the service. */
+	char *udn;
+	/*! Length of type without the version. */
+	size_t baseLen;
+	/*! Version of type. */
+	int version;
+	/*! 1 for the root device. */
+	int root;
+	/*! 1 for a service. */
+	int service;
+	/*! Handle of the root device. */
+	UpnpDevice_Handle handle;
+	/*! Next target in the hash bucket of its type. */
+	struct SsdpTarget *nextType;
+	/*! Next device in the hash bucket of its UDN. */
+	struct SsdpTarget *nextUdn;
+} SsdpTarget;
+
+/*! Prebuilt SSDP packets, sent together to one destination. */
+typedef struct SsdpPacketList
+{
+	/*! Where the packets are sent. */
+	struct sockaddr_storage dest;
+	/*! The packets. */
+	char **packets;
+	/*! Lengths of the packets. */
+	size_t *lengths;
+	/*! Number of packets. */
+	size_t count;
+	/*! Number of allocated entries of packets and lengths. */
+	size_t size;
+} SsdpPacketList;
+
 /* globals */
 
 #ifdef INCLUDE_CLIENT_APIS
@@ -180,27 +210,40 @@ typedef int (*ParserFun)(char *, SsdpEvent *);
  */
 
 /*!
- * \brief Sends SSDP advertisements, replies and shutdown messages.
+ * \brief Sends the SSDP shutdown messages of a device. The advertisements
+ * are sent by the advertisement scheduler, see SsdpAdvertiserAdd(), and
+ * the search replies by the replier, see SsdpReplierAdd().
  *
  * \return UPNP_E_SUCCESS if successful else appropriate error.
  */
 int AdvertiseAndReply(
-	/* [in] -1 = Send shutdown, 0 = send reply, 1 = Send Advertisement. */
+	/* [in] -1 = Send shutdown, the only value left. */
 	int AdFlag,
 	/* [in] Device handle. */
 	UpnpDevice_Handle Hnd,
-	/* [in] Search type for sending replies. */
+	/* [in] Advertisement age. */
+	int Exp);
+
+/*!
+ * \brief Creates the replies of a device to a search, and appends them to a
+ * list. HandleReadLock() must be held.
+ *
+ * \return UPNP_E_SUCCESS, UPNP_E_INVALID_HANDLE if \b Hnd is not a device
+ * 	handle, or another error code.
+ */
+int SearchReplyPackets(
+	/* [in,out] The list, its destination is the control point. */
+	SsdpPacketList *list,
+	/* [in] Device handle. */
+	UpnpDevice_Handle Hnd,
+	/* [in] Search type. */
 	enum SsdpSearchType SearchType,
-	/* [in] Destination address. */
-	struct sockaddr *DestAddr,
-	/* [in] Device type. */
+	/* [in] Device type searched. */
 	char *DeviceType,
-	/* [in] Device UDN. */
+	/* [in] Device UDN searched. */
 	char *DeviceUDN,
-	/* [in] Service type. */
-	char *ServiceType,
-	/* [in] Advertisement age. */
-	int Exp);
+	/* [in] Service type searched. */
+	char *ServiceType);
 
 /*!
  * \brief Fills the fields of the event structure like DeviceType, Device UDN
@@ -315,18 +358,11 @@ int SearchByTarget(
  * @{
  */
 
-/*!
- * \brief Wrapper function to reply the search request coming from the
- * control point.
- */
-void advertiseAndReplyThread(
-	/* [in] Structure containing the search request. */
-	void *data);
-
 /*!
  * \brief Handles the search request. It does the sanity checks of the
- * request and then schedules a thread to send a random time reply
- * (random within maximum time given by the control point to reply).
+ * request and then hands the devices answering it to the reply scheduler,
+ * which sends their replies within the maximum time given by the control
+ * point to reply.
  */
 #ifdef INCLUDE_DEVICE_APIS
 void ssdp_handle_device_request(
@@ -345,24 +381,26 @@ static UPNP_INLINE void ssdp_handle_device_request(
 #endif /* INCLUDE_DEVICE_APIS */
 
 /*!
- * \brief Creates the device advertisement request based on the input
- * parameter, and send it to the multicast channel.
+ * \brief Creates the reply packet based on the input parameter, and appends
+ * it to a list to send to the client address of the list.
  *
  * \return UPNP_E_SUCCESS if successful else appropriate error.
  */
-int DeviceAdvertisement(
-	/* [in] type of the device. */
+int SendReplyPackets(
+	/* [in,out] The list, its destination is the client. */
+	SsdpPacketList *list,
+	/* [in] Device type. */
 	char *DevType,
-	/* [in] flag to indicate if the device is root device. */
+	/* [in] 1 means root device 0 means embedded device. */
 	int RootDev,
-	/* [in] UDN. */
+	/* [in] Device UDN. */
 	char *Udn,
-	/* [in] Location URL. */
+	/* [in] Location of Device description document. */
 	char *Location,
-	/* [in] Service duration in sec. */
+	/* [in] Life time of this device. */
 	int Duration,
-	/* [in] Device address family. */
-	int AddressFamily,
+	/* [in] . */
+	int ByType,
 	/* [in] PowerState as defined by UPnP Low Power. */
 	int PowerState,
 	/* [in] SleepPeriod as defined by UPnP Low Power. */
@@ -371,14 +409,14 @@ int DeviceAdvertisement(
 	int RegistrationState);
 
 /*!
- * \brief Creates the reply packet based on the input parameter, and send it
- * to the client addesss given in its input parameter DestAddr.
+ * \brief Creates the reply packets of a device, 3 for a root device and 2
+ * for an embedded one, and appends them to a list.
  *
  * \return UPNP_E_SUCCESS if successful else appropriate error.
  */
-int SendReply(
-	/* [in] destination IP address. */
-	struct sockaddr *DestAddr,
+int DeviceReplyPackets(
+	/* [in,out] The list, its destination is the client. */
+	SsdpPacketList *list,
 	/* [in] Device type. */
 	char *DevType,
 	/* [in] 1 means root device 0 means embedded device. */
@@ -389,8 +427,6 @@ int SendReply(
 	char *Location,
 	/* [in] Life time of this device. */
 	int Duration,
-	/* [in] . */
-	int ByType,
 	/* [in] PowerState as defined by UPnP Low Power. */
 	int PowerState,
 	/* [in] SleepPeriod as defined by UPnP Low Power. */
@@ -399,18 +435,15 @@ int SendReply(
 	int RegistrationState);
 
 /*!
- * \brief Creates the reply packet based on the input parameter, and send it
- * to the client address given in its input parameter DestAddr.
+ * \brief Creates the reply packet of a service, and appends it to a list.
  *
  * \return UPNP_E_SUCCESS if successful else appropriate error.
  */
-int DeviceReply(
-	/* [in] destination IP address. */
-	struct sockaddr *DestAddr,
-	/* [in] Device type. */
-	char *DevType,
-	/* [in] 1 means root device 0 means embedded device. */
-	int RootDev,
+int ServiceReplyPackets(
+	/* [in,out] The list, its destination is the client. */
+	SsdpPacketList *list,
+	/* [in] Service Type. */
+	char *ServType,
 	/* [in] Device UDN. */
 	char *Udn,
 	/* [in] Location of Device description document. */
@@ -425,19 +458,19 @@ int DeviceReply(
 	int RegistrationState);
 
 /*!
- * \brief Creates the advertisement packet based on the input parameter,
- * and send it to the multicast channel.
+ * \brief Creates a HTTP service shutdown request packet and sends it to the
+ * multicast channel through RequestHandler.
  *
  * \return UPNP_E_SUCCESS if successful else appropriate error.
  */
-int ServiceAdvertisement(
+int ServiceShutdown(
 	/* [in] Device UDN. */
 	char *Udn,
 	/* [in] Service Type. */
 	char *ServType,
 	/* [in] Location of Device description document. */
 	char *Location,
-	/* [in] Life time of this device. */
+	/* [in] Service duration in sec. */
 	int Duration,
 	/* [in] Device address family. */
 	int AddressFamily,
@@ -449,22 +482,24 @@ int ServiceAdvertisement(
 	int RegistrationState);
 
 /*!
- * \brief Creates the advertisement packet based on the input parameter,
- * and send it to the multicast channel.
+ * \brief Creates a HTTP device shutdown request packet and send it to the
+ * multicast channel through RequestHandler.
  *
  * \return UPNP_E_SUCCESS if successful else appropriate error.
  */
-int ServiceReply(
-	/* [in] . */
-	struct sockaddr *DestAddr,
-	/* [in] Service Type. */
-	char *ServType,
+int DeviceShutdown(
+	/* [in] Device Type. */
+	char *DevType,
+	/* [in] 1 means root device. */
+	int RootDev,
 	/* [in] Device UDN. */
 	char *Udn,
-	/* [in] Location of Device description document. */
+	/* [in] Location URL. */
 	char *Location,
-	/* [in] Life time of this device. */
+	/* [in] Device duration in sec. */
 	int Duration,
+	/* [in] Device address family. */
+	int AddressFamily,
 	/* [in] PowerState as defined by UPnP Low Power. */
 	int PowerState,
 	/* [in] SleepPeriod as defined by UPnP Low Power. */
@@ -473,17 +508,42 @@ int ServiceReply(
 	int RegistrationState);
 
 /*!
- * \brief Creates a HTTP service shutdown request packet and sends it to the
- * multicast channel through RequestHandler.
+ * \brief Initializes an empty packet list sent to the multicast channel of
+ * a device.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_INVALID_PARAM.
+ */
+int SsdpPacketListInit(
+	/* [out] The list. */
+	SsdpPacketList *list,
+	/* [in] Device address family. */
+	int AddressFamily,
+	/* [in] Location URL, picks the IPv6 multicast scope. */
+	char *Location);
+
+/*!
+ * \brief Frees the packets of a list.
+ */
+void SsdpPacketListFree(
+	/* [in,out] The list. */
+	SsdpPacketList *list);
+
+/*!
+ * \brief Creates the advertisement packets of a device, 3 for a root device
+ * and 2 for an embedded one, and appends them to a list.
  *
  * \return UPNP_E_SUCCESS if successful else appropriate error.
  */
-int ServiceShutdown(
-	/* [in] Device UDN. */
+int DeviceAdvertisementPackets(
+	/* [in,out] The list. */
+	SsdpPacketList *list,
+	/* [in] type of the device. */
+	char *DevType,
+	/* [in] flag to indicate if the device is root device. */
+	int RootDev,
+	/* [in] UDN. */
 	char *Udn,
-	/* [in] Service Type. */
-	char *ServType,
-	/* [in] Location of Device description document. */
+	/* [in] Location URL. */
 	char *Location,
 	/* [in] Service duration in sec. */
 	int Duration,
@@ -497,21 +557,21 @@ int ServiceShutdown(
 	int RegistrationState);
 
 /*!
- * \brief Creates a HTTP device shutdown request packet and send it to the
- * multicast channel through RequestHandler.
+ * \brief Creates the advertisement packet of a service, and appends it to a
+ * list.
  *
  * \return UPNP_E_SUCCESS if successful else appropriate error.
  */
-int DeviceShutdown(
-	/* [in] Device Type. */
-	char *DevType,
-	/* [in] 1 means root device. */
-	int RootDev,
+int ServiceAdvertisementPackets(
+	/* [in,out] The list. */
+	SsdpPacketList *list,
 	/* [in] Device UDN. */
 	char *Udn,
-	/* [in] Location URL. */
+	/* [in] Service Type. */
+	char *ServType,
+	/* [in] Location of Device description document. */
 	char *Location,
-	/* [in] Device duration in sec. */
+	/* [in] Life time of this device. */
 	int Duration,
 	/* [in] Device address family. */
 	int AddressFamily,
@@ -522,8 +582,201 @@ int DeviceShutdown(
 	/* [in] RegistrationState as defined by UPnP Low Power. */
 	int RegistrationState);
 
+/*!
+ * \brief Sends the packets of several lists, through one socket for each
+ * address family.
+ *
+ * \return UPNP_E_SUCCESS, or the error of the last failed send.
+ */
+int SsdpSendPacketLists(
+	/* [in] The lists. */
+	SsdpPacketList **lists,
+	/* [in] Number of lists. */
+	size_t count);
+
 /* @} SSDP Device Functions */
 
+/*!
+ * \name SSDP Search Index
+ *
+ * The devices and services of the registered root devices, read from their
+ * description at registration. A search finds the devices that answer it
+ * from hash tables of the UDNs and the types, without looking at the other
+ * devices, and the replies are made from the list of the device instead of
+ * its description.
+ *
+ * The index is protected by the handle lock: the functions that change it
+ * must be called with HandleLock() held, the others with at least
+ * HandleReadLock() held.
+ *
+ * @{
+ */
+
+#ifdef INCLUDE_DEVICE_APIS
+struct Handle_Info;
+
+/*!
+ * \brief Adds the devices and services of a root device to the index.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_OUTOF_MEMORY.
+ */
+int SsdpIndexAdd(
+	/* [in] Handle of the root device. */
+	UpnpDevice_Handle Hnd,
+	/* [in] The root device, with its DeviceList. */
+	struct Handle_Info *HInfo);
+
+/*!
+ * \brief Removes a root device from the index, if it is there.
+ */
+void SsdpIndexRemove(
+	/* [in] Handle of the root device. */
+	UpnpDevice_Handle Hnd);
+
+/*!
+ * \brief Returns the devices and services of a root device, each device
+ * followed by its services.
+ */
+const SsdpTarget *SsdpIndexTargets(
+	/* [in] Handle of the root device. */
+	UpnpDevice_Handle Hnd,
+	/* [out] Number of targets. */
+	size_t *count);
+
+/*!
+ * \brief Tells whether a device or service answers a search of a type.
+ *
+ * \return 1 if the base of the types is the same and the version searched
+ * 	is not greater than the one of the target, 0 otherwise.
+ */
+int SsdpTargetMatch(
+	/* [in] The device or service. */
+	const SsdpTarget *t,
+	/* [in] The type searched, with its version. */
+	const char *st,
+	/* [out] 1 if the version searched is lower than the one of the
+	 * target, which then answers with its LowerDescURL. */
+	int *lower);
+
+/*!
+ * \brief Finds the root devices having a reply to a search.
+ *
+ * \return The number of handles stored in \b Hnds, in increasing order.
+ */
+int SsdpIndexFindHandles(
+	/* [in] The search. */
+	const SsdpEvent *event,
+	/* [in] Address family the search came from. */
+	int AddressFamily,
+	/* [out] The handles, room for NUM_HANDLE of them. */
+	UpnpDevice_Handle *Hnds);
+#endif /* INCLUDE_DEVICE_APIS */
+
+/* @} SSDP Search Index */
+
+/*!
+ * \name SSDP Advertisement Scheduler
+ *
+ * Renews the advertisements of all the devices announced with
+ * UpnpSendAdvertisement() and friends. The alive packets of each device
+ * are built once and kept, and the renewals of the devices are spread over
+ * their renewal period, so that devices announced together are not renewed
+ * in the same burst. See SSDP_ADVERTISER_BATCH.
+ *
+ * @{
+ */
+
+#ifdef INCLUDE_DEVICE_APIS
+/*!
+ * \brief Initializes the scheduler.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_INIT_FAILED.
+ */
+int SsdpAdvertiserInit(void);
+
+/*!
+ * \brief Releases the scheduler. Must be called after the timer thread and
+ * the send thread pool are shut down.
+ */
+void SsdpAdvertiserShutdown(void);
+
+/*!
+ * \brief Announces devices now and schedules the renewals of their
+ * announcements.
+ *
+ * The packets are built from the current state of the handles, replacing
+ * those of a previous call.
+ *
+ * \return UPNP_E_SUCCESS, UPNP_E_INVALID_HANDLE if none of the handles is a
+ * 	valid device handle, or UPNP_E_OUTOF_MEMORY.
+ */
+int SsdpAdvertiserAdd(
+	/* [in] The device handles. */
+	const UpnpDevice_Handle *Hnds,
+	/* [in] Number of entries of \b Hnds. */
+	size_t Count);
+
+/*!
+ * \brief Stops the renewals of the announcements of a device.
+ */
+void SsdpAdvertiserRemove(
+	/* [in] The device handle. */
+	UpnpDevice_Handle Hnd);
+#endif /* INCLUDE_DEVICE_APIS */
+
+/* @} SSDP Advertisement Scheduler */
+
+/*!
+ * \name SSDP Reply Scheduler
+ *
+ * Sends the replies to the searches of the control points. The replies of
+ * the devices answering a search are spread evenly over its MX window, with
+ * a millisecond precision, and kept in the order of their deadlines by a
+ * single thread of the send thread pool. The replies due together to the
+ * same control point are sent as one batch, and a reply still pending
+ * when the same search comes again is not scheduled twice. See
+ * SSDP_REPLY_MAX_PENDING.
+ *
+ * @{
+ */
+
+#ifdef INCLUDE_DEVICE_APIS
+/*!
+ * \brief Starts the thread of the scheduler in the send thread pool.
+ *
+ * \return UPNP_E_SUCCESS, UPNP_E_INIT, UPNP_E_OUTOF_MEMORY or
+ * 	UPNP_E_INIT_FAILED.
+ */
+int SsdpReplierInit(void);
+
+/*!
+ * \brief Stops the thread of the scheduler, dropping the pending replies.
+ * Must be called after the receive thread pool is shut down, and before
+ * the send thread pool is.
+ */
+void SsdpReplierShutdown(void);
+
+/*!
+ * \brief Schedules the replies of devices to a search.
+ *
+ * \return UPNP_E_SUCCESS, UPNP_E_FINISH if the scheduler is not running,
+ * 	or UPNP_E_OUTOF_MEMORY.
+ */
+int SsdpReplierAdd(
+	/* [in] Handles of the devices answering the search. */
+	const UpnpDevice_Handle *Hnds,
+	/* [in] Number of entries of \b Hnds. */
+	size_t Count,
+	/* [in] Address of the control point. */
+	const struct sockaddr_storage *DestAddr,
+	/* [in] The search. */
+	const SsdpEvent *Event,
+	/* [in] Seconds over which the replies are spread, at least 1. */
+	int Mx);
+#endif /* INCLUDE_DEVICE_APIS */
+
+/* @} SSDP Reply Scheduler */
+
 /* @} SSDPlib SSDP Library */
 
 #endif /* SSDPLIB_H */
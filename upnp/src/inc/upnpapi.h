@@ -53,7 +53,7 @@
 #define DEFAULT_SOAP_CONTENT_LENGTH 16000
 #define MAX_SOAP_CONTENT_LENGTH (size_t)32000
 
-#define NUM_HANDLE 200
+#define NUM_HANDLE 1024
 
 extern size_t g_maxContentLength;
 extern int g_UpnpSdkEQMaxLen;
@@ -69,6 +69,28 @@ typedef enum
 	HND_DEVICE
 } Upnp_Handle_Type;
 
+#ifdef INCLUDE_DEVICE_APIS
+/*!
+ * \brief Description shared by the devices of a bulk registration, see
+ * UpnpRegisterRootDevices(). Never modified once registered.
+ */
+struct Handle_Template
+{
+	/*! Number of handles using the template, under the handle lock. */
+	int refs;
+	/*! The parsed template. */
+	IXML_Document *DescDocument;
+	/*! List of devices in the template. */
+	IXML_NodeList *DeviceList;
+	/*! List of services in the template. */
+	IXML_NodeList *ServiceList;
+	/*! UDNs of the devices of DeviceList, in the same order. */
+	char **UDNs;
+	/*! Number of entries of UDNs. */
+	unsigned long UDNCount;
+};
+#endif
+
 /* Data to be stored in handle table for */
 struct Handle_Info
 {
@@ -112,6 +134,12 @@ struct Handle_Info
 	int MaxSubscriptionTimeOut;
 	/*! Address family: AF_INET or AF_INET6. */
 	int DeviceAf;
+	/*! Shared description of a bulk registered device, or NULL.
+	 * DescDocument, DeviceList and ServiceList then belong to it. */
+	struct Handle_Template *Template;
+	/*! UDN of a bulk registered root device, replacing the one of the
+	 * template, see GetInstanceUDN(). */
+	char InstanceUDN[LINE_SIZE];
 #endif
 
 	/* Client only */
@@ -215,6 +243,33 @@ Upnp_Handle_Type GetDeviceHandleInfoForPath(
 	/*! [out] Service info for found path. */
 	service_info **serv_info);
 
+#ifdef INCLUDE_DEVICE_APIS
+/*! Longest suffix GetInstanceUDN() appends to the UDN of an instance: "-"
+ * and the decimal digits of an unsigned long. */
+#define INSTANCE_UDN_SUFFIX_LEN 21
+
+/*!
+ * \brief Gives the UDN a device of a handle is announced with.
+ *
+ * Devices registered with UpnpRegisterRootDevices() replace the UDN of the
+ * template: the root device takes the UDN of its instance, the embedded
+ * device at \b index of DeviceList that UDN followed by "-<index>". Other
+ * handles keep the UDN of their description.
+ *
+ * \return UPNP_E_SUCCESS, or UPNP_E_INVALID_PARAM if the UDN does not fit
+ * 	in \b len.
+ */
+int GetInstanceUDN(
+	/*! [in] Device handle structure. */
+	const struct Handle_Info *HInfo,
+	/*! [in] Index of the device in DeviceList. */
+	unsigned long index,
+	/*! [in,out] UDN read from the description, replaced in place. */
+	char *UDN,
+	/*! [in] Size of \b UDN. */
+	size_t len);
+#endif
+
 extern char gIF_NAME[LINE_SIZE];
 extern char gIF_IPV4[INET_ADDRSTRLEN];
 extern char gIF_IPV4_NETMASK[INET_ADDRSTRLEN];
@@ -308,14 +363,6 @@ int UpnpGetIfInfo(
 
 void UpnpThreadDistribution(struct UpnpNonblockParam *Param);
 
-/*!
- * \brief This function is a timer thread scheduled by UpnpSendAdvertisement
- * to the send advetisement again.
- */
-void AutoAdvertise(
-	/*! [in] Information provided to the thread. */
-	void *input);
-
 /*!
  * \brief Print handle info.
  *
@@ -0,0 +1,183 @@
+/**************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * - Neither name of Intel Corporation nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+#ifndef UPNPATOMIC_H
+#define UPNPATOMIC_H
+
+/*!
+ * \file
+ *
+ * \brief Atomic counters for reference counts and statistics
+ * that are updated on hot paths without taking a mutex.
+ */
+
+#include "UpnpGlobal.h" /* for UPNP_INLINE */
+#include "UpnpStdInt.h" /* for int64_t */
+
+#ifdef _MSC_VER
+	#include <intrin.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! Atomic counter. Only access it through the functions below. */
+typedef long upnp_atomic_t;
+
+/*!
+ * \brief Adds a value to the counter.
+ *
+ * \return The new value of the counter.
+ */
+static UPNP_INLINE long upnp_atomic_add(
+	/*! [in,out] Counter. */
+	volatile upnp_atomic_t *counter,
+	/*! [in] Value to add, may be negative. */
+	long value)
+{
+#ifdef _MSC_VER
+	return _InterlockedExchangeAdd(counter, value) + value;
+#else
+	return __atomic_add_fetch(counter, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/*!
+ * \brief Increments the counter.
+ *
+ * \return The new value of the counter.
+ */
+static UPNP_INLINE long upnp_atomic_inc(
+	/*! [in,out] Counter. */
+	volatile upnp_atomic_t *counter)
+{
+	return upnp_atomic_add(counter, 1);
+}
+
+/*!
+ * \brief Decrements the counter.
+ *
+ * \return The new value of the counter.
+ */
+static UPNP_INLINE long upnp_atomic_dec(
+	/*! [in,out] Counter. */
+	volatile upnp_atomic_t *counter)
+{
+	return upnp_atomic_add(counter, -1);
+}
+
+/*!
+ * \brief Reads the counter.
+ *
+ * \return The current value of the counter.
+ */
+static UPNP_INLINE long upnp_atomic_load(
+	/*! [in] Counter. */
+	volatile upnp_atomic_t *counter)
+{
+#ifdef _MSC_VER
+	return _InterlockedOr(counter, 0);
+#else
+	return __atomic_load_n(counter, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/*!
+ * \brief Sets the counter.
+ */
+static UPNP_INLINE void upnp_atomic_store(
+	/*! [out] Counter. */
+	volatile upnp_atomic_t *counter,
+	/*! [in] New value. */
+	long value)
+{
+#ifdef _MSC_VER
+	_InterlockedExchange(counter, value);
+#else
+	__atomic_store_n(counter, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/*!
+ * \brief 64 bit atomic counter, for totals that would wrap a 32 bit long.
+ * Only access it through the functions below.
+ */
+typedef int64_t upnp_atomic64_t;
+
+/*!
+ * \brief Adds a value to the 64 bit counter.
+ *
+ * \return The new value of the counter.
+ */
+static UPNP_INLINE int64_t upnp_atomic64_add(
+	/*! [in,out] Counter. */
+	volatile upnp_atomic64_t *counter,
+	/*! [in] Value to add, may be negative. */
+	int64_t value)
+{
+#if defined(_MSC_VER) && defined(_M_IX86)
+	/* No 64 bit exchange-add on 32 bit x86, loop on cmpxchg8b. */
+	int64_t old;
+
+	do {
+		old = *counter;
+	} while (_InterlockedCompareExchange64(counter, old + value, old) !=
+		 old);
+	return old + value;
+#elif defined(_MSC_VER)
+	return _InterlockedExchangeAdd64(counter, value) + value;
+#else
+	return __atomic_add_fetch(counter, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/*!
+ * \brief Reads the 64 bit counter.
+ *
+ * \return The current value of the counter.
+ */
+static UPNP_INLINE int64_t upnp_atomic64_load(
+	/*! [in] Counter. */
+	volatile upnp_atomic64_t *counter)
+{
+#ifdef _MSC_VER
+	return _InterlockedCompareExchange64(counter, 0, 0);
+#else
+	return __atomic_load_n(counter, __ATOMIC_SEQ_CST);
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UPNPATOMIC_H */
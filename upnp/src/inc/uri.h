@@ -328,7 +328,9 @@ char *resolve_rel_url(
  *
  * Caller should check for the pieces they require.
  *
- * \return
+ * \return HTTP_SUCCESS, UPNP_E_INVALID_URL, or UPNP_E_TIMEDOUT if the host
+ * 	name is being resolved in the background (see
+ * 	UpnpSetAsyncHostResolution()).
  */
 int parse_uri(
 	/*! [in] Character string containing uri information to be parsed. */
@@ -84,8 +84,8 @@ int web_server_init(void);
 void web_server_destroy(void);
 
 /*!
- * \brief Replaces current alias with the given alias. To remove the current
- * alias, set alias_name to NULL.
+ * \brief Adds the given alias, replacing any alias with the same name. To
+ * remove all the aliases, set alias_name to NULL.
  *
  * \note alias_content is not freed here
  *
@@ -106,6 +106,28 @@ int web_server_set_alias(
 	 */
 	time_t last_modified);
 
+/*!
+ * \brief Stops serving the alias published at the given URL.
+ *
+ * \return
+ * \li \c 0 - OK
+ * \li \c UPNP_E_INVALID_PARAM
+ * \li \c UPNP_E_OUTOF_MEMORY
+ */
+int web_server_remove_alias(
+	/*! [in] URL of the alias, e.g. the description URL of a device. */
+	const char *alias_url);
+
+/*!
+ * \brief Rebuilds the virtual directory index from pVirtualDirList. Must be
+ * called after every change to the list.
+ *
+ * \return
+ * \li \c 0 - OK
+ * \li \c UPNP_E_OUTOF_MEMORY
+ */
+int web_server_update_virtual_dirs(void);
+
 /*!
  * \brief Assign the path specfied by the input const char* root_dir parameter
  * to the global Document root directory. Also check for path names ending
@@ -127,6 +149,23 @@ int web_server_set_cors(
 	/*! [in] String having the Access-Control-Allow-Origin string. */
 	const char *cors_string);
 
+/*!
+ * \brief Parses the XML document the web server would send for \b path,
+ * without a request: an alias, or a file below the document root.
+ *
+ * \return
+ * \li \c UPNP_E_SUCCESS - OK
+ * \li \c UPNP_E_NOT_FOUND - Not served from here, e.g. an unknown path or a
+ * 	virtual directory; only a request can tell.
+ * \li \c UPNP_E_OUTOF_MEMORY
+ * \li \c UPNP_E_INVALID_DESC - The document does not parse.
+ */
+int web_server_load_xml(
+	/*! [in] Path and query of the URL, e.g. "/desc.xml". */
+	const char *path,
+	/*! [out] The document, to free with ixmlDocument_free(). */
+	IXML_Document **doc);
+
 /*!
  * \brief Main entry point into web server; Handles HTTP GET and HEAD
  * requests.
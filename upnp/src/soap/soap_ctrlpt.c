@@ -35,10 +35,13 @@
 
 		#include <assert.h>
 		#include <ctype.h>
+		#include <errno.h>
+		#include <limits.h>
 		#include <stdarg.h>
 		#include <stdio.h>
 		#include <stdlib.h>
 
+		#include "httpasync.h"
 		#include "httpparser.h"
 		#include "httpreadwrite.h"
 		#include "membuffer.h"
@@ -59,7 +62,10 @@
 		#define SOAP_VAR_RESP_ERROR 4
 
 /*!
- * \brief Compares 'name' and node's name.
+ * \brief Compares 'name' and node's name, with or without its prefix.
+ *
+ * The parser already split the name of the node, so the local name is used
+ * as is instead of being parsed again.
  *
  * \return 0 if both are equal; 1 if not equal, and UPNP_E_OUTOF_MEMORY.
  */
@@ -70,9 +76,7 @@ static int dom_cmp_name(
 	IXML_Node *node)
 {
 	const DOMString node_name = NULL;
-	memptr nameptr;
-	memptr dummy;
-	int ret_code;
+	const char *local_name;
 
 	assert(name);
 	assert(node);
@@ -81,19 +85,20 @@ static int dom_cmp_name(
 	if (node_name == NULL)
 		return UPNP_E_OUTOF_MEMORY;
 	if (strcmp(name, node_name) == 0)
-		ret_code = 0;
-	else if (matchstr((char *)node_name,
-			 strlen(node_name),
-			 "%s:%s%0",
-			 &dummy,
-			 &nameptr) == PARSE_OK &&
-		 strcmp(nameptr.buf, name) == 0)
-		ret_code = 0;
-	else
-		/* names are not the same */
-		ret_code = 1;
+		return 0;
+	local_name = ixmlNode_getLocalName(node);
+	if (local_name == NULL) {
+		/* elements created without a namespace are not split */
+		local_name = strchr(node_name, ':');
+		if (local_name == NULL)
+			return 1;
+		local_name++;
+	} else if (local_name == node_name) {
+		/* interned names without a prefix, already compared */
+		return 1;
+	}
 
-	return ret_code;
+	return strcmp(name, local_name) == 0 ? 0 : 1;
 }
 
 /*!
@@ -293,6 +298,8 @@ static UPNP_INLINE int add_man_header(
  *		IN membuffer* request :	request that will be sent to the device
  *		IN uri_type* destination_url :	destination address string
  *		OUT http_parser_t *response :	response from the device
+ *		IN int push_xml :	1 to parse the XML body of the response
+ *			while it is received
  *
  *	Description :	This function sends the control point's request to the
  *		device and receives a response from it.
@@ -301,8 +308,10 @@ static UPNP_INLINE int add_man_header(
  *
  *	Note :
  ****************************************************************************/
-static int soap_request_and_response(
-	membuffer *request, uri_type *destination_url, http_parser_t *response)
+static int soap_request_and_response(membuffer *request,
+	uri_type *destination_url,
+	http_parser_t *response,
+	int push_xml)
 {
 	int ret_code;
 
@@ -311,7 +320,8 @@ static int soap_request_and_response(
 		request->length,
 		SOAPMETHOD_POST,
 		UPNP_TIMEOUT,
-		response);
+		response,
+		push_xml);
 	if (ret_code != 0) {
 		httpmsg_destroy(&response->msg);
 		return ret_code;
@@ -320,6 +330,7 @@ static int soap_request_and_response(
 	if (response->msg.status_code == HTTP_METHOD_NOT_ALLOWED) {
 		ret_code = add_man_header(request); /* change to M-POST msg */
 		if (ret_code != 0) {
+			httpmsg_destroy(&response->msg);
 			return ret_code;
 		}
 
@@ -331,7 +342,8 @@ static int soap_request_and_response(
 			request->length,
 			HTTPMETHOD_MPOST,
 			UPNP_TIMEOUT,
-			response);
+			response,
+			push_xml);
 		if (ret_code != 0) {
 			httpmsg_destroy(&response->msg);
 		}
@@ -386,7 +398,7 @@ static int get_response_value(http_message_t *hmsg,
 		    hmsg->status_code != HTTP_INTERNAL_SERVER_ERROR) ||
 		!has_xml_content_type(hmsg))
 		goto error_handler;
-	if (ixmlParseBufferEx(hmsg->entity.buf, &doc) != IXML_SUCCESS)
+	if (httpmsg_get_xml_doc(hmsg, &doc) != IXML_SUCCESS)
 		goto error_handler;
 	root_node = ixmlNode_getFirstChild((IXML_Node *)doc);
 	if (root_node == NULL)
@@ -495,66 +507,65 @@ error_handler:
 	return err_code;
 }
 
-/****************************************************************************
- *	Function :	SoapSendAction
- *
- *	Parameters :
- *		IN char* action_url :	device contrl URL
- *		IN char *service_type :	device service type
- *		IN IXML_Document *action_node : SOAP action node
- *		OUT IXML_Document **response_node :	SOAP response node
+/*!
+ * \brief Builds the request of a SOAP action.
  *
- *	Description :	This function is called by UPnP API to send the SOAP
- *		action request and waits till it gets the response from the
- *device pass the response to the API layer
+ * Without a SOAP header the envelope is the one SoapSendAction() always
+ * sent, with one it is the one of SoapSendActionEx().
  *
- *	Return :	int
- *		returns UPNP_E_SUCCESS if successful else returns appropriate
- *error Note :
- ****************************************************************************/
-int SoapSendAction(char *action_url,
+ * \return UPNP_E_SUCCESS or an error code.
+ */
+static int make_action_request(
+	/*! [in] Device control URL. */
+	char *action_url,
+	/*! [in] Device service type. */
 	char *service_type,
+	/*! [in] SOAP header, or NULL. */
+	IXML_Document *header,
+	/*! [in] SOAP action node (SOAP body). */
 	IXML_Document *action_node,
-	IXML_Document **response_node)
+	/*! [out] The request, initialized by the caller. */
+	membuffer *request,
+	/*! [out] Parsed action_url. */
+	uri_type *url,
+	/*! [out] Name of the response node, initialized by the caller. */
+	membuffer *responsename)
 {
+	char *xml_header_str = NULL;
 	char *action_str = NULL;
 	memptr name;
-	membuffer request;
-	membuffer responsename;
-	int err_code;
-	int ret_code;
-	http_parser_t response;
-	uri_type url;
-	int upnp_error_code;
-	char *upnp_error_str;
-	int got_response = 0;
-
-	off_t content_length;
+	int err_code = UPNP_E_OUTOF_MEMORY; /* default error */
 	const char *xml_start =
 		"<s:Envelope "
 		"xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" "
 		"s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/"
-		"\">\r\n"
-		"<s:Body>";
-	const char *xml_end = "</s:Body>\r\n"
-			      "</s:Envelope>\r\n\r\n";
+		"\">\r\n";
+	const char *xml_header_start = "<s:Header>\r\n";
+	const char *xml_header_end = "</s:Header>\r\n";
+	const char *xml_body_start = "<s:Body>";
+	const char *xml_end = header ? "</s:Body>\r\n"
+				       "</s:Envelope>\r\n"
+				     : "</s:Body>\r\n"
+				       "</s:Envelope>\r\n\r\n";
 	size_t xml_start_len;
-	size_t xml_end_len;
+	size_t xml_header_start_len = 0;
+	size_t xml_header_str_len = 0;
+	size_t xml_header_end_len = 0;
+	size_t xml_body_start_len;
 	size_t action_str_len;
+	size_t xml_end_len;
+	off_t content_length;
 
-	*response_node = NULL; /* init */
-
-	err_code = UPNP_E_OUTOF_MEMORY; /* default error */
-
-	UpnpPrintf(UPNP_INFO,
-		SOAP,
-		__FILE__,
-		__LINE__,
-		"Inside SoapSendAction():");
-	/* init */
-	membuffer_init(&request);
-	membuffer_init(&responsename);
-
+	/* header string */
+	if (header) {
+		xml_header_str = ixmlPrintNode((IXML_Node *)header);
+		if (xml_header_str == NULL) {
+			goto error_handler;
+		}
+		xml_header_start_len = strlen(xml_header_start);
+		xml_header_str_len = strlen(xml_header_str);
+		xml_header_end_len = strlen(xml_header_end);
+	}
 	/* print action */
 	action_str = ixmlPrintNode((IXML_Node *)action_node);
 	if (action_str == NULL) {
@@ -566,7 +577,7 @@ int SoapSendAction(char *action_url,
 		goto error_handler;
 	}
 	/* parse url */
-	if (http_FixStrUrl(action_url, strlen(action_url), &url) != 0) {
+	if (http_FixStrUrl(action_url, strlen(action_url), url) != 0) {
 		err_code = UPNP_E_INVALID_URL;
 		goto error_handler;
 	}
@@ -576,19 +587,23 @@ int SoapSendAction(char *action_url,
 		__FILE__,
 		__LINE__,
 		"path=%.*s, hostport=%.*s\n",
-		(int)url.pathquery.size,
-		url.pathquery.buff,
-		(int)url.hostport.text.size,
-		url.hostport.text.buff);
+		(int)url->pathquery.size,
+		url->pathquery.buff,
+		(int)url->hostport.text.size,
+		url->hostport.text.buff);
 
 	xml_start_len = strlen(xml_start);
+	xml_body_start_len = strlen(xml_body_start);
 	xml_end_len = strlen(xml_end);
 	action_str_len = strlen(action_str);
 
 	/* make request msg */
-	request.size_inc = 50;
-	content_length = (off_t)(xml_start_len + action_str_len + xml_end_len);
-	if (http_MakeMessage(&request,
+	request->size_inc = 50;
+	content_length =
+		(off_t)(xml_start_len + xml_header_start_len +
+			xml_header_str_len + xml_header_end_len +
+			xml_body_start_len + action_str_len + xml_end_len);
+	if (http_MakeMessage(request,
 		    1,
 		    1,
 		    "q"
@@ -598,9 +613,13 @@ int SoapSendAction(char *action_url,
 		    "Uc"
 		    "b"
 		    "b"
+		    "b"
+		    "b"
+		    "b"
+		    "b"
 		    "b",
 		    SOAPMETHOD_POST,
-		    &url,
+		    url,
 		    content_length,
 		    ContentTypeHeader,
 		    "SOAPACTION: \"",
@@ -611,51 +630,149 @@ int SoapSendAction(char *action_url,
 		    "\"",
 		    xml_start,
 		    xml_start_len,
+		    xml_header_start,
+		    xml_header_start_len,
+		    xml_header_str ? xml_header_str : "",
+		    xml_header_str_len,
+		    xml_header_end,
+		    xml_header_end_len,
+		    xml_body_start,
+		    xml_body_start_len,
 		    action_str,
 		    action_str_len,
 		    xml_end,
 		    xml_end_len) != 0) {
 		goto error_handler;
 	}
-
-	ret_code = soap_request_and_response(&request, &url, &response);
-	got_response = 1;
-	if (ret_code != UPNP_E_SUCCESS) {
-		err_code = ret_code;
+	if (membuffer_append(responsename, name.buf, name.length) != 0 ||
+		membuffer_append_str(responsename, "Response") != 0) {
 		goto error_handler;
 	}
+	err_code = UPNP_E_SUCCESS;
+
+error_handler:
+	ixmlFreeDOMString(action_str);
+	ixmlFreeDOMString(xml_header_str);
+
+	return err_code;
+}
+
+/*!
+ * \brief Extracts the result of a SOAP action from its response.
+ *
+ * \return UPNP_E_SUCCESS, the UPnP error code of a SOAP fault or an error
+ * 	code.
+ */
+static int action_response(
+	/*! [in] Response from the device. */
+	http_parser_t *response,
+	/*! [in] Name of the response node. */
+	char *responsename,
+	/*! [out] SOAP response node. */
+	IXML_Document **response_node)
+{
+	int upnp_error_code;
+	char *upnp_error_str;
+	int ret_code;
 
-	if (membuffer_append(&responsename, name.buf, name.length) != 0 ||
-		membuffer_append_str(&responsename, "Response") != 0) {
-		goto error_handler;
-	}
 	/* get action node from the response */
-	ret_code = get_response_value(&response.msg,
+	ret_code = get_response_value(&response->msg,
 		SOAP_ACTION_RESP,
-		responsename.buf,
+		responsename,
 		&upnp_error_code,
 		(IXML_Node **)response_node,
 		&upnp_error_str);
-
 	if (ret_code == SOAP_ACTION_RESP) {
-		err_code = UPNP_E_SUCCESS;
+		return UPNP_E_SUCCESS;
 	} else if (ret_code == SOAP_ACTION_RESP_ERROR) {
-		err_code = upnp_error_code;
+		return upnp_error_code;
 	} else {
-		err_code = ret_code;
+		return ret_code;
 	}
+}
+
+/*!
+ * \brief Sends a SOAP action, with or without SOAP header, and waits for
+ * the response.
+ *
+ * \return UPNP_E_SUCCESS if successful else returns appropriate error.
+ */
+static int soap_send_action(
+	/*! [in] Device control URL. */
+	char *action_url,
+	/*! [in] Device service type. */
+	char *service_type,
+	/*! [in] SOAP header, or NULL. */
+	IXML_Document *header,
+	/*! [in] SOAP action node (SOAP body). */
+	IXML_Document *action_node,
+	/*! [out] SOAP response node. */
+	IXML_Document **response_node)
+{
+	membuffer request;
+	membuffer responsename;
+	int err_code;
+	http_parser_t response;
+	uri_type url;
+
+	*response_node = NULL; /* init */
+	membuffer_init(&request);
+	membuffer_init(&responsename);
+
+	err_code = make_action_request(action_url,
+		service_type,
+		header,
+		action_node,
+		&request,
+		&url,
+		&responsename);
+	if (err_code != UPNP_E_SUCCESS)
+		goto error_handler;
+	err_code = soap_request_and_response(&request, &url, &response, 1);
+	if (err_code != UPNP_E_SUCCESS)
+		goto error_handler;
+	err_code = action_response(&response, responsename.buf, response_node);
+	httpmsg_destroy(&response.msg);
 
 error_handler:
-	ixmlFreeDOMString(action_str);
 	membuffer_destroy(&request);
 	membuffer_destroy(&responsename);
-	if (got_response) {
-		httpmsg_destroy(&response.msg);
-	}
 
 	return err_code;
 }
 
+/****************************************************************************
+ *	Function :	SoapSendAction
+ *
+ *	Parameters :
+ *		IN char* action_url :	device contrl URL
+ *		IN char *service_type :	device service type
+ *		IN IXML_Document *action_node : SOAP action node
+ *		OUT IXML_Document **response_node :	SOAP response node
+ *
+ *	Description :	This function is called by UPnP API to send the SOAP
+ *		action request and waits till it gets the response from the
+ *device pass the response to the API layer
+ *
+ *	Return :	int
+ *		returns UPNP_E_SUCCESS if successful else returns appropriate
+ *error Note :
+ ****************************************************************************/
+int SoapSendAction(char *action_url,
+	char *service_type,
+	IXML_Document *action_node,
+	IXML_Document **response_node)
+{
+	UpnpPrintf(UPNP_INFO,
+		SOAP,
+		__FILE__,
+		__LINE__,
+		"Inside SoapSendAction():");
+
+	return soap_send_action(
+		action_url, service_type, NULL, action_node, response_node);
+}
+
 /****************************************************************************
 *	Function :	SoapSendActionEx
 *
@@ -683,203 +800,921 @@ int SoapSendActionEx(char *action_url,
 	IXML_Document *action_node,
 	IXML_Document **response_node)
 {
-	char *xml_header_str = NULL;
-	char *action_str = NULL;
-	memptr name;
-	membuffer request;
-	membuffer responsename;
-	int err_code;
-	int ret_code;
-	http_parser_t response;
-	uri_type url;
-	int upnp_error_code;
-	char *upnp_error_str;
-	int got_response = 0;
-	const char *xml_start =
-		"<s:Envelope "
-		"xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" "
-		"s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/"
-		"\">\r\n";
-	const char *xml_header_start = "<s:Header>\r\n";
-	const char *xml_header_end = "</s:Header>\r\n";
-	const char *xml_body_start = "<s:Body>";
-	const char *xml_end = "</s:Body>\r\n"
-			      "</s:Envelope>\r\n";
-	size_t xml_start_len;
-	size_t xml_header_start_len;
-	size_t xml_header_str_len;
-	size_t xml_header_end_len;
-	size_t xml_body_start_len;
-	size_t action_str_len;
-	size_t xml_end_len;
-	off_t content_length;
-
-	*response_node = NULL; /* init */
-
-	err_code = UPNP_E_OUTOF_MEMORY; /* default error */
-
 	UpnpPrintf(UPNP_INFO,
 		SOAP,
 		__FILE__,
 		__LINE__,
 		"Inside SoapSendActionEx():");
-	/* init */
-	membuffer_init(&request);
-	membuffer_init(&responsename);
 
-	/* header string */
-	xml_header_str = ixmlPrintNode((IXML_Node *)header);
-	if (xml_header_str == NULL) {
-		goto error_handler;
+	if (header == NULL) {
+		*response_node = NULL;
+		return UPNP_E_OUTOF_MEMORY;
 	}
-	/* print action */
-	action_str = ixmlPrintNode((IXML_Node *)action_node);
-	if (action_str == NULL) {
-		goto error_handler;
+
+	return soap_send_action(
+		action_url, service_type, header, action_node, response_node);
+}
+
+/*!
+ * \brief Called by soap_parse_args() for each output argument of an action
+ * response.
+ *
+ * \return UPNP_E_SUCCESS to continue, or an error code that stops the
+ * 	parsing.
+ */
+typedef int (*soap_arg_callback)(
+	/*! [in] Name of the argument, without namespace prefix, not null
+	 * terminated. */
+	const char *name,
+	/*! [in] Length of \b name. */
+	size_t name_len,
+	/*! [in] Value of the argument, unescaped and null terminated. */
+	const char *value,
+	/*! [in] Length of \b value. */
+	size_t value_len,
+	/*! [in] Cookie given to soap_parse_args(). */
+	void *cookie);
+
+/*!
+ * \brief Position of soap_next_tag() in a SOAP message.
+ */
+typedef struct SOAP_SCANNER
+{
+	/*! Next character to scan. */
+	const char *cur;
+	/*! End of the message. */
+	const char *end;
+} soap_scanner;
+
+/*!
+ * \brief An element tag found by soap_next_tag().
+ */
+typedef struct SOAP_TAG
+{
+	/*! Name of the element, without namespace prefix. */
+	const char *name;
+	/*! Length of \b name. */
+	size_t name_len;
+	/*! 1 for an end tag. */
+	int end;
+	/*! 1 for an empty element tag. */
+	int empty;
+	/*! The '<' of the tag. */
+	const char *start;
+	/*! The character after the '>' of the tag. */
+	const char *after;
+} soap_tag;
+
+/*!
+ * \brief Finds a string in a buffer that is not null terminated.
+ *
+ * \return The first occurrence of \b str, or NULL.
+ */
+static const char *soap_find(
+	/*! [in] Start of the buffer. */
+	const char *p,
+	/*! [in] End of the buffer. */
+	const char *end,
+	/*! [in] String to find. */
+	const char *str)
+{
+	size_t len = strlen(str);
+
+	while ((size_t)(end - p) >= len) {
+		p = memchr(p, str[0], (size_t)(end - p) - len + 1);
+		if (p == NULL)
+			return NULL;
+		if (memcmp(p, str, len) == 0)
+			return p;
+		p++;
 	}
-	/* get action name */
-	if (get_action_name(action_str, &name) != 0) {
-		err_code = UPNP_E_INVALID_ACTION;
-		goto error_handler;
+
+	return NULL;
+}
+
+/*!
+ * \brief Moves to the next element tag, skipping text, comments, CDATA
+ * sections, processing instructions and the document type declaration.
+ *
+ * \return 1 if a tag was found, 0 at the end of the message, -1 on
+ * 	malformed markup.
+ */
+static int soap_next_tag(
+	/*! [in,out] Scanner. */
+	soap_scanner *s,
+	/*! [out] Tag found. */
+	soap_tag *tag)
+{
+	const char *p = s->cur;
+	const char *end = s->end;
+	const char *q;
+	char quote = 0;
+
+	for (;;) {
+		p = memchr(p, '<', (size_t)(end - p));
+		if (p == NULL) {
+			s->cur = end;
+			return 0;
+		}
+		if (end - p < 2)
+			return -1;
+		if (p[1] == '?') {
+			q = soap_find(p + 2, end, "?>");
+			if (q == NULL)
+				return -1;
+			p = q + 2;
+		} else if (end - p >= 4 && memcmp(p, "<!--", 4) == 0) {
+			q = soap_find(p + 4, end, "-->");
+			if (q == NULL)
+				return -1;
+			p = q + 3;
+		} else if (end - p >= 9 && memcmp(p, "<![CDATA[", 9) == 0) {
+			q = soap_find(p + 9, end, "]]>");
+			if (q == NULL)
+				return -1;
+			p = q + 3;
+		} else if (p[1] == '!') {
+			q = memchr(p, '>', (size_t)(end - p));
+			if (q == NULL)
+				return -1;
+			p = q + 1;
+		} else {
+			break;
+		}
 	}
-	/* parse url */
-	if (http_FixStrUrl(action_url, strlen(action_url), &url) != 0) {
-		err_code = UPNP_E_INVALID_URL;
-		goto error_handler;
+	tag->start = p++;
+	tag->end = 0;
+	if (*p == '/') {
+		tag->end = 1;
+		p++;
 	}
+	tag->name = p;
+	while (p < end && !isspace((unsigned char)*p) && *p != '>' &&
+		*p != '/') {
+		if (*p == ':')
+			tag->name = p + 1;
+		p++;
+	}
+	tag->name_len = (size_t)(p - tag->name);
+	if (tag->name_len == 0)
+		return -1;
+	/* attributes, a quoted value may hold a '>' */
+	for (; p < end; p++) {
+		if (quote) {
+			if (*p == quote)
+				quote = 0;
+		} else if (*p == '"' || *p == '\'') {
+			quote = *p;
+		} else if (*p == '>') {
+			break;
+		}
+	}
+	if (p == end)
+		return -1;
+	tag->empty = !tag->end && p[-1] == '/';
+	tag->after = p + 1;
+	s->cur = tag->after;
 
-	UpnpPrintf(UPNP_INFO,
-		SOAP,
-		__FILE__,
-		__LINE__,
-		"path=%.*s, hostport=%.*s\n",
-		(int)url.pathquery.size,
-		url.pathquery.buff,
-		(int)url.hostport.text.size,
-		url.hostport.text.buff);
-
-	xml_start_len = strlen(xml_start);
-	xml_body_start_len = strlen(xml_body_start);
-	xml_end_len = strlen(xml_end);
-	action_str_len = strlen(action_str);
+	return 1;
+}
 
-	xml_header_start_len = strlen(xml_header_start);
-	xml_header_end_len = strlen(xml_header_end);
-	xml_header_str_len = strlen(xml_header_str);
+/*!
+ * \brief Compares the name of a tag, without namespace prefix.
+ *
+ * \return 1 if the tag has the name, 0 otherwise.
+ */
+static int soap_tag_is(
+	/*! [in] Tag. */
+	const soap_tag *tag,
+	/*! [in] Name. */
+	const char *name)
+{
+	return tag->name_len == strlen(name) &&
+	       memcmp(tag->name, name, tag->name_len) == 0;
+}
 
-	/* make request msg */
-	request.size_inc = 50;
-	content_length =
-		(off_t)(xml_start_len + xml_header_start_len +
-			xml_header_str_len + xml_header_end_len +
-			xml_body_start_len + action_str_len + xml_end_len);
-	if (http_MakeMessage(&request,
+/*!
+ * \brief Moves past the end tag of an element.
+ *
+ * \return 0, or -1 on malformed markup.
+ */
+static int soap_skip_element(
+	/*! [in,out] Scanner, just after the start tag. */
+	soap_scanner *s,
+	/*! [in] Start tag of the element. */
+	const soap_tag *start,
+	/*! [out] End of the content of the element. */
+	const char **content_end)
+{
+	soap_tag tag;
+	int depth = 1;
+
+	if (start->empty) {
+		*content_end = start->after;
+		return 0;
+	}
+	while (soap_next_tag(s, &tag) == 1) {
+		if (tag.end)
+			depth--;
+		else if (!tag.empty)
+			depth++;
+		if (depth == 0) {
+			if (tag.name_len != start->name_len ||
+				memcmp(tag.name, start->name, tag.name_len) != 0)
+				return -1;
+			*content_end = tag.start;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+/*!
+ * \brief Appends the text of an element content to \b out, resolving the
+ * predefined and character entities and CDATA sections.
+ *
+ * \return 0, 1 if the content holds elements, -1 on malformed content, or
+ * 	UPNP_E_OUTOF_MEMORY.
+ */
+static int soap_unescape(
+	/*! [in] Start of the content. */
+	const char *p,
+	/*! [in] End of the content. */
+	const char *end,
+	/*! [in,out] Text. */
+	membuffer *out)
+{
+	const char *q;
+	char *last;
+	unsigned long c;
+	char utf8[4];
+	size_t len;
+
+	while (p < end) {
+		for (q = p; q < end && *q != '&' && *q != '<'; q++)
+			;
+		if (membuffer_append(out, p, (size_t)(q - p)) != 0)
+			return UPNP_E_OUTOF_MEMORY;
+		p = q;
+		if (p == end)
+			break;
+		if (*p == '<') {
+			if (end - p >= 9 && memcmp(p, "<![CDATA[", 9) == 0) {
+				q = soap_find(p + 9, end, "]]>");
+				if (q == NULL)
+					return -1;
+				if (membuffer_append(
+					    out, p + 9, (size_t)(q - p - 9)) != 0)
+					return UPNP_E_OUTOF_MEMORY;
+				p = q + 3;
+			} else if (end - p >= 4 && memcmp(p, "<!--", 4) == 0) {
+				q = soap_find(p + 4, end, "-->");
+				if (q == NULL)
+					return -1;
+				p = q + 3;
+			} else {
+				return 1;
+			}
+			continue;
+		}
+		q = memchr(p, ';', (size_t)(end - p));
+		if (q == NULL)
+			return -1;
+		p++;
+		len = (size_t)(q - p);
+		if (len == 2 && memcmp(p, "lt", 2) == 0) {
+			c = '<';
+		} else if (len == 2 && memcmp(p, "gt", 2) == 0) {
+			c = '>';
+		} else if (len == 3 && memcmp(p, "amp", 3) == 0) {
+			c = '&';
+		} else if (len == 4 && memcmp(p, "quot", 4) == 0) {
+			c = '"';
+		} else if (len == 4 && memcmp(p, "apos", 4) == 0) {
+			c = '\'';
+		} else if (len >= 3 && p[0] == '#' && p[1] == 'x' &&
+			   isxdigit((unsigned char)p[2])) {
+			c = strtoul(p + 2, &last, 16);
+			if (last != q)
+				return -1;
+		} else if (len >= 2 && p[0] == '#' &&
+			   isdigit((unsigned char)p[1])) {
+			c = strtoul(p + 1, &last, 10);
+			if (last != q)
+				return -1;
+		} else {
+			return -1;
+		}
+		/* UTF-8 */
+		if (c == 0 || c > 0x10FFFF) {
+			return -1;
+		} else if (c < 0x80) {
+			utf8[0] = (char)c;
+			len = 1;
+		} else if (c < 0x800) {
+			utf8[0] = (char)(0xC0 | (c >> 6));
+			utf8[1] = (char)(0x80 | (c & 0x3F));
+			len = 2;
+		} else if (c < 0x10000) {
+			utf8[0] = (char)(0xE0 | (c >> 12));
+			utf8[1] = (char)(0x80 | ((c >> 6) & 0x3F));
+			utf8[2] = (char)(0x80 | (c & 0x3F));
+			len = 3;
+		} else {
+			utf8[0] = (char)(0xF0 | (c >> 18));
+			utf8[1] = (char)(0x80 | ((c >> 12) & 0x3F));
+			utf8[2] = (char)(0x80 | ((c >> 6) & 0x3F));
+			utf8[3] = (char)(0x80 | (c & 0x3F));
+			len = 4;
+		}
+		if (membuffer_append(out, utf8, len) != 0)
+			return UPNP_E_OUTOF_MEMORY;
+		p = q + 1;
+	}
+
+	return 0;
+}
+
+/*!
+ * \brief Reads the text of an element into \b value, or its markup if it
+ * holds elements.
+ *
+ * \return UPNP_E_SUCCESS or an error code.
+ */
+static int soap_element_value(
+	/*! [in,out] Scanner, just after the start tag. */
+	soap_scanner *s,
+	/*! [in] Start tag of the element. */
+	const soap_tag *start,
+	/*! [out] Value, initialized by the caller. */
+	membuffer *value)
+{
+	const char *content_end;
+	int ret_code;
+
+	value->length = 0;
+	if (value->buf)
+		value->buf[0] = 0;
+	if (soap_skip_element(s, start, &content_end) != 0)
+		return UPNP_E_BAD_RESPONSE;
+	ret_code = soap_unescape(start->after, content_end, value);
+	if (ret_code == 1) {
+		value->length = 0;
+		ret_code = membuffer_append(value,
+			start->after,
+			(size_t)(content_end - start->after));
+	}
+	if (ret_code == -1)
+		return UPNP_E_BAD_RESPONSE;
+
+	return ret_code == 0 ? UPNP_E_SUCCESS : UPNP_E_OUTOF_MEMORY;
+}
+
+/*!
+ * \brief Reads the UPnP error code of a SOAP fault.
+ *
+ * \return The error code, or UPNP_E_BAD_RESPONSE if there is none.
+ */
+static int soap_parse_fault(
+	/*! [in,out] Scanner, just after the Fault start tag. */
+	soap_scanner *s,
+	/*! [in] Fault start tag. */
+	const soap_tag *fault,
+	/*! [out] Scratch buffer, initialized by the caller. */
+	membuffer *value)
+{
+	soap_tag tag;
+	int depth = 1;
+	int upnp_error_code = 0;
+
+	if (fault->empty)
+		return UPNP_E_BAD_RESPONSE;
+	while (depth > 0 && soap_next_tag(s, &tag) == 1) {
+		if (tag.end) {
+			depth--;
+		} else if (soap_tag_is(&tag, "errorCode")) {
+			if (soap_element_value(s, &tag, value) !=
+				UPNP_E_SUCCESS)
+				return UPNP_E_BAD_RESPONSE;
+			upnp_error_code = atoi(value->buf ? value->buf : "");
+		} else if (!tag.empty) {
+			depth++;
+		}
+	}
+
+	return upnp_error_code > 0 ? upnp_error_code : UPNP_E_BAD_RESPONSE;
+}
+
+/*!
+ * \brief Scans the response of a SOAP action, calling \b callback for each
+ * output argument.
+ *
+ * The response is scanned in one pass over the message, without building a
+ * DOM.
+ *
+ * \return UPNP_E_SUCCESS, the UPnP error code of a SOAP fault, the error
+ * 	code of \b callback or an error code.
+ */
+static int soap_parse_args(
+	/*! [in] HTTP response. */
+	http_message_t *hmsg,
+	/*! [in] Name of the response element. */
+	const char *responsename,
+	/*! [in] Called for each output argument. */
+	soap_arg_callback callback,
+	/*! [in] Argument of \b callback. */
+	void *cookie)
+{
+	soap_scanner s;
+	soap_tag tag;
+	soap_tag arg;
+	const char *content_end;
+	membuffer value;
+	int ret_code = UPNP_E_BAD_RESPONSE;
+	int found;
+
+	/* only 200 and 500 status codes are relevant */
+	if ((hmsg->status_code != HTTP_OK &&
+		    hmsg->status_code != HTTP_INTERNAL_SERVER_ERROR) ||
+		!has_xml_content_type(hmsg))
+		return UPNP_E_BAD_RESPONSE;
+	s.cur = hmsg->entity.buf;
+	s.end = s.cur + hmsg->entity.length;
+	if (s.cur == NULL)
+		return UPNP_E_BAD_RESPONSE;
+	membuffer_init(&value);
+	if (soap_next_tag(&s, &tag) != 1 || tag.end || tag.empty ||
+		!soap_tag_is(&tag, "Envelope"))
+		goto error_handler;
+	/* Body, after the Header if any */
+	for (;;) {
+		if (soap_next_tag(&s, &tag) != 1 || tag.end)
+			goto error_handler;
+		if (soap_tag_is(&tag, "Body"))
+			break;
+		if (soap_skip_element(&s, &tag, &content_end) != 0)
+			goto error_handler;
+	}
+	if (tag.empty || soap_next_tag(&s, &tag) != 1 || tag.end)
+		goto error_handler;
+	if (soap_tag_is(&tag, "Fault")) {
+		ret_code = soap_parse_fault(&s, &tag, &value);
+		goto error_handler;
+	}
+	if (!soap_tag_is(&tag, responsename))
+		goto error_handler;
+	if (!tag.empty) {
+		while ((found = soap_next_tag(&s, &arg)) == 1 && !arg.end) {
+			ret_code = soap_element_value(&s, &arg, &value);
+			if (ret_code != UPNP_E_SUCCESS)
+				goto error_handler;
+			ret_code = callback(arg.name,
+				arg.name_len,
+				value.buf ? value.buf : "",
+				value.length,
+				cookie);
+			if (ret_code != UPNP_E_SUCCESS)
+				goto error_handler;
+		}
+		if (found != 1 || arg.name_len != tag.name_len ||
+			memcmp(arg.name, tag.name, tag.name_len) != 0) {
+			ret_code = UPNP_E_BAD_RESPONSE;
+			goto error_handler;
+		}
+	}
+	ret_code = UPNP_E_SUCCESS;
+
+error_handler:
+	membuffer_destroy(&value);
+
+	return ret_code;
+}
+
+/*!
+ * \brief Appends a string with the characters XML reserves escaped.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_OUTOF_MEMORY.
+ */
+static int soap_append_escaped(
+	/*! [in,out] Buffer. */
+	membuffer *buf,
+	/*! [in] String. */
+	const char *str)
+{
+	const char *p;
+	const char *entity;
+
+	for (p = str; *p; p++) {
+		switch (*p) {
+		case '<':
+			entity = "&lt;";
+			break;
+		case '>':
+			entity = "&gt;";
+			break;
+		case '&':
+			entity = "&amp;";
+			break;
+		case '"':
+			entity = "&quot;";
+			break;
+		case '\'':
+			entity = "&apos;";
+			break;
+		default:
+			continue;
+		}
+		if (membuffer_append(buf, str, (size_t)(p - str)) != 0 ||
+			membuffer_append_str(buf, entity) != 0)
+			return UPNP_E_OUTOF_MEMORY;
+		str = p + 1;
+	}
+	if (membuffer_append(buf, str, (size_t)(p - str)) != 0)
+		return UPNP_E_OUTOF_MEMORY;
+
+	return UPNP_E_SUCCESS;
+}
+
+/*!
+ * \brief Builds the request of a SOAP action from name/value pairs, with
+ * the envelope of SoapSendAction().
+ *
+ * \return UPNP_E_SUCCESS or an error code.
+ */
+static int make_args_request(
+	/*! [in] Device control URL. */
+	char *action_url,
+	/*! [in] Device service type. */
+	char *service_type,
+	/*! [in] Name of the action. */
+	const char *action_name,
+	/*! [in] Input arguments. */
+	const UpnpActionArgument *in_args,
+	/*! [in] Number of input arguments. */
+	size_t in_count,
+	/*! [out] The request, initialized by the caller. */
+	membuffer *request,
+	/*! [out] Parsed action_url. */
+	uri_type *url)
+{
+	membuffer body;
+	size_t i;
+	int err_code = UPNP_E_OUTOF_MEMORY;
+
+	if (http_FixStrUrl(action_url, strlen(action_url), url) != 0)
+		return UPNP_E_INVALID_URL;
+	membuffer_init(&body);
+	if (membuffer_append_str(&body,
+		    "<s:Envelope "
+		    "xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" "
+		    "s:encodingStyle=\"http://schemas.xmlsoap.org/soap/"
+		    "encoding/\">\r\n"
+		    "<s:Body><u:") != 0 ||
+		membuffer_append_str(&body, action_name) != 0 ||
+		membuffer_append_str(&body, " xmlns:u=\"") != 0 ||
+		soap_append_escaped(&body, service_type) != 0 ||
+		membuffer_append_str(&body, "\">\r\n") != 0)
+		goto error_handler;
+	for (i = 0; i < in_count; i++) {
+		if (membuffer_append_str(&body, "<") != 0 ||
+			membuffer_append_str(&body, in_args[i].name) != 0 ||
+			membuffer_append_str(&body, ">") != 0 ||
+			soap_append_escaped(&body, in_args[i].value) != 0 ||
+			membuffer_append_str(&body, "</") != 0 ||
+			membuffer_append_str(&body, in_args[i].name) != 0 ||
+			membuffer_append_str(&body, ">\r\n") != 0)
+			goto error_handler;
+	}
+	if (membuffer_append_str(&body, "</u:") != 0 ||
+		membuffer_append_str(&body, action_name) != 0 ||
+		membuffer_append_str(&body,
+			">\r\n"
+			"</s:Body>\r\n"
+			"</s:Envelope>\r\n") != 0)
+		goto error_handler;
+
+	request->size_inc = 50;
+	if (http_MakeMessage(request,
 		    1,
 		    1,
 		    "q"
 		    "N"
 		    "s"
-		    "sssbsc"
+		    "sssssc"
 		    "Uc"
-		    "b"
-		    "b"
-		    "b"
-		    "b"
-		    "b"
-		    "b"
 		    "b",
 		    SOAPMETHOD_POST,
-		    &url,
-		    content_length,
+		    url,
+		    (off_t)body.length,
 		    ContentTypeHeader,
 		    "SOAPACTION: \"",
 		    service_type,
 		    "#",
-		    name.buf,
-		    name.length,
+		    action_name,
 		    "\"",
-		    xml_start,
-		    xml_start_len,
-		    xml_header_start,
-		    xml_header_start_len,
-		    xml_header_str,
-		    xml_header_str_len,
-		    xml_header_end,
-		    xml_header_end_len,
-		    xml_body_start,
-		    xml_body_start_len,
-		    action_str,
-		    action_str_len,
-		    xml_end,
-		    xml_end_len) != 0) {
+		    body.buf,
+		    body.length) != 0)
 		goto error_handler;
-	}
+	err_code = UPNP_E_SUCCESS;
 
-	ret_code = soap_request_and_response(&request, &url, &response);
-	got_response = 1;
-	if (ret_code != UPNP_E_SUCCESS) {
-		err_code = ret_code;
-		goto error_handler;
-	}
+error_handler:
+	membuffer_destroy(&body);
 
-	if (membuffer_append(&responsename, name.buf, name.length) != 0 ||
+	return err_code;
+}
+
+/*!
+ * \brief Sends a SOAP action built from name/value pairs and scans its
+ * response.
+ *
+ * \return UPNP_E_SUCCESS, the UPnP error code of a SOAP fault or an error
+ * 	code.
+ */
+static int soap_send_args(
+	/*! [in] Device control URL. */
+	char *action_url,
+	/*! [in] Device service type. */
+	char *service_type,
+	/*! [in] Name of the action. */
+	const char *action_name,
+	/*! [in] Input arguments. */
+	const UpnpActionArgument *in_args,
+	/*! [in] Number of input arguments. */
+	size_t in_count,
+	/*! [in] Called for each output argument. */
+	soap_arg_callback callback,
+	/*! [in] Argument of \b callback. */
+	void *cookie)
+{
+	membuffer request;
+	membuffer responsename;
+	http_parser_t response;
+	uri_type url;
+	int err_code;
+
+	membuffer_init(&request);
+	membuffer_init(&responsename);
+
+	err_code = make_args_request(action_url,
+		service_type,
+		action_name,
+		in_args,
+		in_count,
+		&request,
+		&url);
+	if (err_code != UPNP_E_SUCCESS)
+		goto error_handler;
+	if (membuffer_append_str(&responsename, action_name) != 0 ||
 		membuffer_append_str(&responsename, "Response") != 0) {
+		err_code = UPNP_E_OUTOF_MEMORY;
 		goto error_handler;
 	}
-	/* get action node from the response */
-	ret_code = get_response_value(&response.msg,
-		SOAP_ACTION_RESP,
-		responsename.buf,
-		&upnp_error_code,
-		(IXML_Node **)response_node,
-		&upnp_error_str);
-
-	if (ret_code == SOAP_ACTION_RESP) {
-		err_code = UPNP_E_SUCCESS;
-	} else if (ret_code == SOAP_ACTION_RESP_ERROR) {
-		err_code = upnp_error_code;
-	} else {
-		err_code = ret_code;
-	}
+	/* the arguments are read from the body, it must be kept */
+	err_code = soap_request_and_response(&request, &url, &response, 0);
+	if (err_code != UPNP_E_SUCCESS)
+		goto error_handler;
+	err_code = soap_parse_args(
+		&response.msg, responsename.buf, callback, cookie);
+	httpmsg_destroy(&response.msg);
 
 error_handler:
-
-	ixmlFreeDOMString(action_str);
-	ixmlFreeDOMString(xml_header_str);
 	membuffer_destroy(&request);
 	membuffer_destroy(&responsename);
-	if (got_response) {
-		httpmsg_destroy(&response.msg);
+
+	return err_code;
+}
+
+/*!
+ * \brief Output arguments collected by SoapSendActionArgs().
+ */
+typedef struct SOAP_ARG_LIST
+{
+	/*! Names and values, each null terminated, one after the other. */
+	membuffer strings;
+	/*! Number of arguments. */
+	size_t count;
+} soap_arg_list;
+
+/*!
+ * \brief soap_arg_callback of SoapSendActionArgs().
+ */
+static int soap_collect_arg(const char *name,
+	size_t name_len,
+	const char *value,
+	size_t value_len,
+	void *cookie)
+{
+	soap_arg_list *list = (soap_arg_list *)cookie;
+
+	if (membuffer_append(&list->strings, name, name_len) != 0 ||
+		membuffer_append(&list->strings, "", 1) != 0 ||
+		membuffer_append(&list->strings, value, value_len) != 0 ||
+		membuffer_append(&list->strings, "", 1) != 0)
+		return UPNP_E_OUTOF_MEMORY;
+	list->count++;
+
+	return UPNP_E_SUCCESS;
+}
+
+int SoapSendActionArgs(char *action_url,
+	char *service_type,
+	const char *action_name,
+	const UpnpActionArgument *in_args,
+	size_t in_count,
+	UpnpActionArgument **out_args,
+	size_t *out_count)
+{
+	soap_arg_list list;
+	UpnpActionArgument *args;
+	char *p;
+	size_t i;
+	int err_code;
+
+	UpnpPrintf(UPNP_INFO,
+		SOAP,
+		__FILE__,
+		__LINE__,
+		"Inside SoapSendActionArgs():");
+
+	*out_args = NULL;
+	*out_count = 0;
+	membuffer_init(&list.strings);
+	list.count = 0;
+
+	err_code = soap_send_args(action_url,
+		service_type,
+		action_name,
+		in_args,
+		in_count,
+		soap_collect_arg,
+		&list);
+	if (err_code != UPNP_E_SUCCESS || list.count == 0)
+		goto error_handler;
+	/* the array and the strings in one block */
+	args = malloc(list.count * sizeof(UpnpActionArgument) +
+		      list.strings.length);
+	if (args == NULL) {
+		err_code = UPNP_E_OUTOF_MEMORY;
+		goto error_handler;
+	}
+	p = (char *)(args + list.count);
+	memcpy(p, list.strings.buf, list.strings.length);
+	for (i = 0; i < list.count; i++) {
+		args[i].name = p;
+		p += strlen(p) + 1;
+		args[i].value = p;
+		p += strlen(p) + 1;
 	}
+	*out_args = args;
+	*out_count = list.count;
+
+error_handler:
+	membuffer_destroy(&list.strings);
 
 	return err_code;
 }
 
-/****************************************************************************
- *	Function :	SoapGetServiceVarStatus
- *
- *	Parameters :
- *			IN  char * action_url :	Address to send this variable
- *									query
- *message. IN  char *var_name : Name of the variable. OUT char **var_value :
- *Output value.
- *
- *	Description :	This function creates a status variable query message
- *		send it to the specified URL. It also collect the response.
- *
- *	Return :	int
+/*!
+ * \brief Output struct filled by SoapSendActionBind().
+ */
+typedef struct SOAP_ARG_BIND
+{
+	/*! Where to store the output arguments. */
+	const UpnpArgumentBinding *bindings;
+	/*! Number of bindings. */
+	size_t count;
+	/*! Struct the bindings refer to. */
+	char *out;
+} soap_arg_bind;
+
+/*!
+ * \brief soap_arg_callback of SoapSendActionBind().
+ */
+static int soap_bind_arg(const char *name,
+	size_t name_len,
+	const char *value,
+	size_t value_len,
+	void *cookie)
+{
+	soap_arg_bind *bind = (soap_arg_bind *)cookie;
+	const UpnpArgumentBinding *binding = NULL;
+	char *field;
+	char *last;
+	long l;
+	unsigned long ul;
+	size_t i;
+
+	for (i = 0; i < bind->count; i++) {
+		if (strlen(bind->bindings[i].name) == name_len &&
+			memcmp(bind->bindings[i].name, name, name_len) == 0) {
+			binding = &bind->bindings[i];
+			break;
+		}
+	}
+	if (binding == NULL)
+		return UPNP_E_SUCCESS;
+	field = bind->out + binding->offset;
+	switch (binding->type) {
+	case UPNP_ARG_STRING:
+		if (binding->size == 0)
+			break;
+		if (value_len > binding->size - 1)
+			value_len = binding->size - 1;
+		memcpy(field, value, value_len);
+		field[value_len] = 0;
+		break;
+	case UPNP_ARG_INT:
+		errno = 0;
+		l = strtol(value, &last, 10);
+		if (last == value || errno != 0 || l < INT_MIN || l > INT_MAX)
+			return UPNP_E_BAD_RESPONSE;
+		while (isspace((unsigned char)*last))
+			last++;
+		if (*last)
+			return UPNP_E_BAD_RESPONSE;
+		*(int *)field = (int)l;
+		break;
+	case UPNP_ARG_UINT:
+		while (isspace((unsigned char)*value))
+			value++;
+		if (*value == '-')
+			return UPNP_E_BAD_RESPONSE;
+		errno = 0;
+		ul = strtoul(value, &last, 10);
+		if (last == value || errno != 0 || ul > UINT_MAX)
+			return UPNP_E_BAD_RESPONSE;
+		while (isspace((unsigned char)*last))
+			last++;
+		if (*last)
+			return UPNP_E_BAD_RESPONSE;
+		*(unsigned int *)field = (unsigned int)ul;
+		break;
+	case UPNP_ARG_BOOLEAN:
+		if (strcmp(value, "1") == 0 || strcasecmp(value, "true") == 0 ||
+			strcasecmp(value, "yes") == 0)
+			*(int *)field = 1;
+		else if (strcmp(value, "0") == 0 ||
+			 strcasecmp(value, "false") == 0 ||
+			 strcasecmp(value, "no") == 0)
+			*(int *)field = 0;
+		else
+			return UPNP_E_BAD_RESPONSE;
+		break;
+	default:
+		return UPNP_E_INVALID_PARAM;
+	}
+
+	return UPNP_E_SUCCESS;
+}
+
+int SoapSendActionBind(char *action_url,
+	char *service_type,
+	const char *action_name,
+	const UpnpActionArgument *in_args,
+	size_t in_count,
+	const UpnpArgumentBinding *bindings,
+	size_t binding_count,
+	void *out)
+{
+	soap_arg_bind bind;
+
+	UpnpPrintf(UPNP_INFO,
+		SOAP,
+		__FILE__,
+		__LINE__,
+		"Inside SoapSendActionBind():");
+
+	bind.bindings = bindings;
+	bind.count = binding_count;
+	bind.out = (char *)out;
+
+	return soap_send_args(action_url,
+		service_type,
+		action_name,
+		in_args,
+		in_count,
+		soap_bind_arg,
+		&bind);
+}
+
+/*!
+ * \brief Builds the request of a state variable query.
  *
- *	Note :
- ****************************************************************************/
-int SoapGetServiceVarStatus(char *action_url, char *var_name, char **var_value)
+ * \return UPNP_E_SUCCESS or an error code.
+ */
+static int make_var_request(
+	/*! [in] Address to send the query to. */
+	char *action_url,
+	/*! [in] Name of the variable. */
+	char *var_name,
+	/*! [out] The request, initialized by the caller. */
+	membuffer *request,
+	/*! [out] Parsed action_url. */
+	uri_type *url)
 {
 	const memptr host; /* value for HOST header */
 	const memptr path; /* ctrl path in first line in msg */
-	uri_type url;
-	membuffer request;
-	int ret_code;
-	http_parser_t response;
-	int upnp_error_code;
 	off_t content_length;
 	const char *xml_start =
 		"<s:Envelope "
@@ -895,17 +1730,15 @@ int SoapGetServiceVarStatus(char *action_url, char *var_name, char **var_value)
 			      "</s:Body>\r\n"
 			      "</s:Envelope>\r\n";
 
-	*var_value = NULL; /* return NULL in case of an error */
-	membuffer_init(&request);
 	/* get host hdr and url path */
-	if (get_host_and_path(action_url, &host, &path, &url) == -1) {
+	if (get_host_and_path(action_url, &host, &path, url) == -1) {
 		return UPNP_E_INVALID_URL;
 	}
 	/* make headers */
-	request.size_inc = 50;
+	request->size_inc = 50;
 	content_length =
 		(off_t)(strlen(xml_start) + strlen(var_name) + strlen(xml_end));
-	if (http_MakeMessage(&request,
+	if (http_MakeMessage(request,
 		    1,
 		    1,
 		    "Q"
@@ -930,20 +1763,32 @@ int SoapGetServiceVarStatus(char *action_url, char *var_name, char **var_value)
 		    xml_end) != 0) {
 		return UPNP_E_OUTOF_MEMORY;
 	}
-	/* send msg and get reply */
-	ret_code = soap_request_and_response(&request, &url, &response);
-	membuffer_destroy(&request);
-	if (ret_code != UPNP_E_SUCCESS) {
-		return ret_code;
-	}
+
+	return UPNP_E_SUCCESS;
+}
+
+/*!
+ * \brief Extracts the value of a state variable from a query response.
+ *
+ * \return UPNP_E_SUCCESS, the UPnP error code of a SOAP fault or an error
+ * 	code.
+ */
+static int var_response(
+	/*! [in] Response from the device. */
+	http_parser_t *response,
+	/*! [out] Value of the variable. */
+	char **var_value)
+{
+	int upnp_error_code;
+	int ret_code;
+
 	/* get variable value from the response */
-	ret_code = get_response_value(&response.msg,
+	ret_code = get_response_value(&response->msg,
 		SOAP_VAR_RESP,
 		NULL,
 		&upnp_error_code,
 		NULL,
 		var_value);
-	httpmsg_destroy(&response.msg);
 	if (ret_code == SOAP_VAR_RESP) {
 		return UPNP_E_SUCCESS;
 	} else if (ret_code == SOAP_VAR_RESP_ERROR) {
@@ -953,5 +1798,223 @@ int SoapGetServiceVarStatus(char *action_url, char *var_name, char **var_value)
 	}
 }
 
+/****************************************************************************
+ *	Function :	SoapGetServiceVarStatus
+ *
+ *	Parameters :
+ *			IN  char * action_url :	Address to send this variable
+ *									query
+ *message. IN  char *var_name : Name of the variable. OUT char **var_value :
+ *Output value.
+ *
+ *	Description :	This function creates a status variable query message
+ *		send it to the specified URL. It also collect the response.
+ *
+ *	Return :	int
+ *
+ *	Note :
+ ****************************************************************************/
+int SoapGetServiceVarStatus(char *action_url, char *var_name, char **var_value)
+{
+	uri_type url;
+	membuffer request;
+	int ret_code;
+	http_parser_t response;
+
+	*var_value = NULL; /* return NULL in case of an error */
+	membuffer_init(&request);
+	ret_code = make_var_request(action_url, var_name, &request, &url);
+	if (ret_code != UPNP_E_SUCCESS) {
+		membuffer_destroy(&request);
+		return ret_code;
+	}
+	/* send msg and get reply */
+	ret_code = soap_request_and_response(&request, &url, &response, 1);
+	membuffer_destroy(&request);
+	if (ret_code != UPNP_E_SUCCESS) {
+		return ret_code;
+	}
+	ret_code = var_response(&response, var_value);
+	httpmsg_destroy(&response.msg);
+
+	return ret_code;
+}
+
+/*! State of an asynchronous SOAP request. */
+typedef struct SOAP_ASYNC_REQUEST
+{
+	/*! SOAP_ACTION_RESP or SOAP_VAR_RESP. */
+	int code;
+	membuffer request;
+	/*! Name of the response node, for actions. */
+	membuffer responsename;
+	uri_type url;
+	/*! The request was already retried as M-POST. */
+	int mpost;
+	soap_action_callback action_callback;
+	soap_var_callback var_callback;
+	free_routine free_cookie;
+	void *cookie;
+} soap_async_request;
+
+/*!
+ * \brief Frees an asynchronous SOAP request, and its cookie unless the
+ * callback took it.
+ */
+static void soap_async_free(
+	/*! [in] Request. */
+	void *arg)
+{
+	soap_async_request *req = (soap_async_request *)arg;
+
+	if (req->free_cookie)
+		req->free_cookie(req->cookie);
+	membuffer_destroy(&req->request);
+	membuffer_destroy(&req->responsename);
+	free(req);
+}
+
+/*!
+ * \brief Completion of the HTTP request of an asynchronous SOAP request.
+ *
+ * Does what soap_request_and_response() does after its HTTP requests, then
+ * extracts the result and calls the callback.
+ */
+static void soap_async_response(
+	/*! [in] Result of the HTTP request. */
+	int ret_code,
+	/*! [in] Response from the device. */
+	http_parser_t *response,
+	/*! [in] The soap_async_request. */
+	void *arg)
+{
+	soap_async_request *req = (soap_async_request *)arg;
+	IXML_Document *response_node = NULL;
+	DOMString var_value = NULL;
+	int err_code = ret_code;
+
+	if (ret_code == UPNP_E_SUCCESS &&
+		response->msg.status_code == HTTP_METHOD_NOT_ALLOWED &&
+		!req->mpost) {
+		/* change to M-POST msg and try again */
+		req->mpost = 1;
+		err_code = add_man_header(&req->request);
+		if (err_code == 0) {
+			err_code = http_AsyncRequest(&req->url,
+				req->request.buf,
+				req->request.length,
+				HTTPMETHOD_MPOST,
+				UPNP_TIMEOUT,
+				1,
+				soap_async_response,
+				soap_async_free,
+				req);
+			if (err_code == UPNP_E_SUCCESS)
+				return;
+		}
+	} else if (ret_code == UPNP_E_SUCCESS) {
+		if (req->code == SOAP_ACTION_RESP)
+			err_code = action_response(
+				response, req->responsename.buf, &response_node);
+		else
+			err_code = var_response(response, &var_value);
+	}
+	if (req->code == SOAP_ACTION_RESP)
+		req->action_callback(err_code, response_node, req->cookie);
+	else
+		req->var_callback(err_code, var_value, req->cookie);
+	/* the callback owns the cookie now */
+	req->free_cookie = NULL;
+	soap_async_free(req);
+}
+
+int SoapSendActionAsync(char *action_url,
+	char *service_type,
+	IXML_Document *header,
+	IXML_Document *action_node,
+	soap_action_callback callback,
+	free_routine free_cookie,
+	void *cookie)
+{
+	soap_async_request *req;
+	int err_code;
+
+	req = (soap_async_request *)malloc(sizeof(soap_async_request));
+	if (req == NULL)
+		return UPNP_E_OUTOF_MEMORY;
+	memset(req, 0, sizeof(soap_async_request));
+	membuffer_init(&req->request);
+	membuffer_init(&req->responsename);
+	req->code = SOAP_ACTION_RESP;
+	err_code = make_action_request(action_url,
+		service_type,
+		header,
+		action_node,
+		&req->request,
+		&req->url,
+		&req->responsename);
+	if (err_code == UPNP_E_SUCCESS) {
+		req->action_callback = callback;
+		req->free_cookie = free_cookie;
+		req->cookie = cookie;
+		err_code = http_AsyncRequest(&req->url,
+			req->request.buf,
+			req->request.length,
+			SOAPMETHOD_POST,
+			UPNP_TIMEOUT,
+			1,
+			soap_async_response,
+			soap_async_free,
+			req);
+	}
+	if (err_code != UPNP_E_SUCCESS) {
+		/* the cookie stays with the caller */
+		req->free_cookie = NULL;
+		soap_async_free(req);
+	}
+
+	return err_code;
+}
+
+int SoapGetServiceVarStatusAsync(char *action_url,
+	char *var_name,
+	soap_var_callback callback,
+	free_routine free_cookie,
+	void *cookie)
+{
+	soap_async_request *req;
+	int err_code;
+
+	req = (soap_async_request *)malloc(sizeof(soap_async_request));
+	if (req == NULL)
+		return UPNP_E_OUTOF_MEMORY;
+	memset(req, 0, sizeof(soap_async_request));
+	membuffer_init(&req->request);
+	membuffer_init(&req->responsename);
+	req->code = SOAP_VAR_RESP;
+	err_code = make_var_request(action_url, var_name, &req->request, &req->url);
+	if (err_code == UPNP_E_SUCCESS) {
+		req->var_callback = callback;
+		req->free_cookie = free_cookie;
+		req->cookie = cookie;
+		err_code = http_AsyncRequest(&req->url,
+			req->request.buf,
+			req->request.length,
+			SOAPMETHOD_POST,
+			UPNP_TIMEOUT,
+			1,
+			soap_async_response,
+			soap_async_free,
+			req);
+	}
+	if (err_code != UPNP_E_SUCCESS) {
+		/* the cookie stays with the caller */
+		req->free_cookie = NULL;
+		soap_async_free(req);
+	}
+
+	return err_code;
+}
+
 	#endif /* EXCLUDE_SOAP */
 #endif	       /* INCLUDE_CLIENT_APIS */
@@ -42,6 +42,7 @@
 		#include "UpnpActionRequest.h"
 		#include "httpparser.h"
 		#include "httpreadwrite.h"
+		#include "metrics.h"
 		#include "parsetools.h"
 		#include "soaplib.h"
 		#include "ssdplib.h"
@@ -147,7 +148,7 @@ static void send_error_response(
 	if (http_MakeMessage(&headers,
 		    major,
 		    minor,
-		    "RNsDsSXcc"
+		    "RNsDsSXcCc"
 		    "sssss",
 		    500,
 		    content_length,
@@ -207,7 +208,7 @@ static UPNP_INLINE void send_var_query_response(
 	if (http_MakeMessage(&response,
 		    major,
 		    minor,
-		    "RNsDsSXcc"
+		    "RNsDsSXcCc"
 		    "sss",
 		    HTTP_OK,
 		    content_length,
@@ -267,7 +268,7 @@ static UPNP_INLINE void send_action_response(
 	if (http_MakeMessage(&headers,
 		    major,
 		    minor,
-		    "RNsDsSXcc",
+		    "RNsDsSXcCc",
 		    HTTP_OK, /* status code */
 		    content_length,
 		    ContentTypeHeader,
@@ -396,6 +397,7 @@ static void handle_invoke_action(
 	memptr action_name;
 	DOMString act_node = NULL;
 	memptr hdr_value;
+	int64_t start = upnp_clock_usec();
 
 	/* null-terminate */
 	action_name = soap_info->action_name;
@@ -462,9 +464,12 @@ error_handler:
 	ixmlFreeDOMString(act_node);
 	/* restore */
 	action_name.buf[action_name.length] = save_char;
-	if (err_code != 0)
+	if (err_code != 0) {
 		send_error_response(info, err_code, err_str, request);
+		upnp_metrics_inc(&gUpnpMetrics.soapActionFailures);
+	}
 	UpnpActionRequest_delete(action);
+	upnp_histogram_since(&gUpnpMetrics.soapAction, start);
 }
 
 /*!
@@ -788,7 +793,7 @@ void soap_device_callback(
 		goto error_handler;
 	}
 	/* parse XML */
-	err_code = ixmlParseBufferEx(request->entity.buf, &xml_doc);
+	err_code = httpmsg_get_xml_doc(request, &xml_doc);
 	if (err_code != IXML_SUCCESS) {
 		if (IXML_INSUFFICIENT_MEMORY == err_code)
 			err_code = HTTP_INTERNAL_SERVER_ERROR;
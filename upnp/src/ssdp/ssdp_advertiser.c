@@ -0,0 +1,413 @@
+/**************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * - Neither name of Intel Corporation nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+/*!
+ * \addtogroup SSDPlib
+ *
+ * @{
+ *
+ * \file
+ *
+ * \brief Scheduler renewing the advertisements of all the devices.
+ */
+
+#include "config.h"
+
+#ifdef INCLUDE_DEVICE_APIS
+	#if EXCLUDE_SSDP == 0
+
+		#include "ssdplib.h"
+
+		#include "ThreadPool.h"
+		#include "TimerThread.h"
+		#include "UpnpStdInt.h"
+		#include "ithread.h"
+		#include "upnpapi.h"
+
+		#include <stdlib.h>
+		#include <string.h>
+		#include <time.h>
+
+/*! A device whose advertisements are renewed. */
+typedef struct
+{
+	/*! Alive packets of the device, its embedded devices and services. */
+	SsdpPacketList packets;
+	/*! Seconds between two renewals. */
+	int renewal;
+	/*! Time at which the next renewal is due. */
+	time_t due;
+	/*! Last pass that sent the packets. */
+	unsigned int pass;
+} advertiser_entry;
+
+/*! Protects the variables below. */
+static ithread_mutex_t gAdvertiserMutex;
+/*! Devices, indexed by handle. */
+static advertiser_entry *gAdvertiserEntries[NUM_HANDLE];
+/*! Packets of the pass being sent. */
+static SsdpPacketList *gAdvertiserBatch[NUM_HANDLE];
+/*! Number of the last pass. */
+static unsigned int gAdvertiserPass;
+/*! Number of devices added, spreads their renewals. */
+static uint32_t gAdvertiserAdded;
+/*! Timer event of the next pass, -1 if none is pending. */
+static int gAdvertiserTimerId = -1;
+/*! Time of the next pass, if one is pending. */
+static time_t gAdvertiserTimerDue;
+
+/*!
+ * \brief Returns in how many seconds the advertisements made with \b Exp
+ * are renewed.
+ */
+static int AdvertisementRenewal(
+	/*! [in] Age of the advertisements. */
+	int Exp)
+{
+		#ifdef SSDP_PACKET_DISTRIBUTE
+	return (Exp / 2) - AUTO_ADVERTISEMENT_TIME;
+		#else
+	return Exp - AUTO_ADVERTISEMENT_TIME;
+		#endif
+}
+
+/*!
+ * \brief Builds the alive packets of a device.
+ *
+ * \return UPNP_E_SUCCESS if successful else appropriate error.
+ */
+static int BuildAdvertisements(
+	/*! [in] Handle of the device. */
+	UpnpDevice_Handle Hnd,
+	/*! [in] The device. */
+	struct Handle_Info *SInfo,
+	/*! [out] The packets. */
+	SsdpPacketList *list)
+{
+	const SsdpTarget *targets;
+	const SsdpTarget *t;
+	size_t count;
+	size_t i;
+	int ret;
+
+	targets = SsdpIndexTargets(Hnd, &count);
+	ret = SsdpPacketListInit(list, SInfo->DeviceAf, SInfo->DescURL);
+	for (i = 0; i < count && ret == UPNP_E_SUCCESS; i++) {
+		t = &targets[i];
+		if (t->service)
+			ret = ServiceAdvertisementPackets(list,
+				t->udn,
+				t->type,
+				SInfo->DescURL,
+				SInfo->MaxAge,
+				SInfo->DeviceAf,
+				SInfo->PowerState,
+				SInfo->SleepPeriod,
+				SInfo->RegistrationState);
+		else
+			ret = DeviceAdvertisementPackets(list,
+				t->type,
+				t->root,
+				t->udn,
+				SInfo->DescURL,
+				SInfo->MaxAge,
+				SInfo->DeviceAf,
+				SInfo->PowerState,
+				SInfo->SleepPeriod,
+				SInfo->RegistrationState);
+	}
+	if (ret != UPNP_E_SUCCESS)
+		SsdpPacketListFree(list);
+
+	return ret;
+}
+
+/*!
+ * \brief Sends the packets of the devices of a pass, gAdvertiserMutex must be
+ * locked.
+ */
+static void SendPass(
+	/*! [in] The pass. */
+	unsigned int pass)
+{
+	advertiser_entry *entry;
+	size_t count = 0;
+	int i;
+
+	for (i = 0; i < NUM_HANDLE; i++) {
+		entry = gAdvertiserEntries[i];
+		if (entry && entry->pass == pass)
+			gAdvertiserBatch[count++] = &entry->packets;
+	}
+	if (count)
+		SsdpSendPacketLists(gAdvertiserBatch, count);
+}
+
+/*!
+ * \brief Sends the copies of the packets of a pass after the first one,
+ * SSDP_PAUSE apart.
+ */
+static void SendCopies(
+	/*! [in] The pass. */
+	unsigned int pass)
+{
+	int copy;
+
+	for (copy = 1; copy < NUM_SSDP_COPY; copy++) {
+		imillisleep(SSDP_PAUSE);
+		ithread_mutex_lock(&gAdvertiserMutex);
+		SendPass(pass);
+		ithread_mutex_unlock(&gAdvertiserMutex);
+	}
+}
+
+static void AdvertiserTimer(void *arg);
+
+/*!
+ * \brief Makes sure a pass runs when the first renewal is due,
+ * gAdvertiserMutex must be locked.
+ */
+static void ScheduleNextPass(void)
+{
+	ThreadPoolJob job;
+	time_t now = time(NULL);
+	time_t due = 0;
+	int found = 0;
+	int i;
+
+	for (i = 0; i < NUM_HANDLE; i++) {
+		if (gAdvertiserEntries[i] &&
+			(!found || gAdvertiserEntries[i]->due < due)) {
+			due = gAdvertiserEntries[i]->due;
+			found = 1;
+		}
+	}
+	if (!found)
+		return;
+	if (due <= now)
+		due = now + 1;
+	if (gAdvertiserTimerId != -1) {
+		if (gAdvertiserTimerDue <= due)
+			return;
+		/* Already fired, that pass will schedule the next one. */
+		if (TimerThreadRemove(&gTimerThread, gAdvertiserTimerId, NULL))
+			return;
+		gAdvertiserTimerId = -1;
+	}
+	memset(&job, 0, sizeof(job));
+	TPJobInit(&job, (start_routine)AdvertiserTimer, NULL);
+	TPJobSetPriority(&job, MED_PRIORITY);
+	if (TimerThreadSchedule(&gTimerThread,
+		    due - now,
+		    REL_SEC,
+		    &job,
+		    SHORT_TERM,
+		    &gAdvertiserTimerId) != UPNP_E_SUCCESS) {
+		UpnpPrintf(UPNP_CRITICAL,
+			SSDP,
+			__FILE__,
+			__LINE__,
+			"Cannot schedule the advertisement renewals.\n");
+		gAdvertiserTimerId = -1;
+		return;
+	}
+	gAdvertiserTimerDue = due;
+}
+
+/*!
+ * \brief Renews the advertisements that are due, at most
+ * SSDP_ADVERTISER_BATCH devices at a time.
+ */
+static void AdvertiserTimer(void *arg)
+{
+	advertiser_entry *entry;
+	time_t now;
+	unsigned int pass;
+	int count = 0;
+	int i;
+
+	(void)arg;
+	ithread_mutex_lock(&gAdvertiserMutex);
+	gAdvertiserTimerId = -1;
+	now = time(NULL);
+	pass = ++gAdvertiserPass;
+	for (i = 0; i < NUM_HANDLE && count < SSDP_ADVERTISER_BATCH; i++) {
+		entry = gAdvertiserEntries[i];
+		if (!entry || entry->due > now)
+			continue;
+		entry->pass = pass;
+		/* Keep the place of the device in the period. */
+		entry->due += entry->renewal;
+		if (entry->due <= now)
+			entry->due = now + entry->renewal;
+		count++;
+	}
+	SendPass(pass);
+	ScheduleNextPass();
+	ithread_mutex_unlock(&gAdvertiserMutex);
+	SendCopies(pass);
+}
+
+int SsdpAdvertiserInit(void)
+{
+	int i;
+
+	if (ithread_mutex_init(&gAdvertiserMutex, NULL) != 0)
+		return UPNP_E_INIT_FAILED;
+	for (i = 0; i < NUM_HANDLE; i++)
+		gAdvertiserEntries[i] = NULL;
+	gAdvertiserPass = 0;
+	gAdvertiserAdded = 0;
+	gAdvertiserTimerId = -1;
+
+	return UPNP_E_SUCCESS;
+}
+
+void SsdpAdvertiserShutdown(void)
+{
+	int i;
+
+	for (i = 0; i < NUM_HANDLE; i++)
+		SsdpAdvertiserRemove(i);
+	ithread_mutex_destroy(&gAdvertiserMutex);
+}
+
+int SsdpAdvertiserAdd(const UpnpDevice_Handle *Hnds, size_t Count)
+{
+	advertiser_entry **entries;
+	advertiser_entry *old;
+	struct Handle_Info *SInfo;
+	time_t now;
+	unsigned int pass;
+	uint32_t spread;
+	uint64_t half;
+	int found = 0;
+	int ret = UPNP_E_SUCCESS;
+	size_t i;
+
+	entries = (advertiser_entry **)calloc(Count, sizeof(*entries));
+	if (entries == NULL)
+		return UPNP_E_OUTOF_MEMORY;
+	/* Build the packets first, without holding the scheduler. */
+	HandleReadLock(__FILE__, __LINE__);
+	for (i = 0; i < Count && ret == UPNP_E_SUCCESS; i++) {
+		if (GetHandleInfo(Hnds[i], &SInfo) != HND_DEVICE)
+			continue;
+		entries[i] = (advertiser_entry *)malloc(sizeof(**entries));
+		if (entries[i] == NULL) {
+			ret = UPNP_E_OUTOF_MEMORY;
+			break;
+		}
+		ret = BuildAdvertisements(
+			Hnds[i], SInfo, &entries[i]->packets);
+		if (ret != UPNP_E_SUCCESS) {
+			free(entries[i]);
+			entries[i] = NULL;
+			break;
+		}
+		entries[i]->renewal = AdvertisementRenewal(SInfo->MaxAge);
+		found = 1;
+	}
+	HandleUnlock(__FILE__, __LINE__);
+	if (ret != UPNP_E_SUCCESS) {
+		for (i = 0; i < Count; i++) {
+			if (entries[i]) {
+				SsdpPacketListFree(&entries[i]->packets);
+				free(entries[i]);
+			}
+		}
+		free(entries);
+		return ret;
+	}
+	if (!found) {
+		free(entries);
+		return UPNP_E_INVALID_HANDLE;
+	}
+
+	ithread_mutex_lock(&gAdvertiserMutex);
+	now = time(NULL);
+	pass = ++gAdvertiserPass;
+	/* Leave out the devices unregistered in the meantime, their
+	 * unregistration removes them again once the handle is freed. */
+	HandleReadLock(__FILE__, __LINE__);
+	for (i = 0; i < Count; i++) {
+		if (!entries[i])
+			continue;
+		if (GetHandleInfo(Hnds[i], &SInfo) != HND_DEVICE) {
+			SsdpPacketListFree(&entries[i]->packets);
+			free(entries[i]);
+			continue;
+		}
+		old = gAdvertiserEntries[Hnds[i]];
+		if (old) {
+			SsdpPacketListFree(&old->packets);
+			free(old);
+		}
+		/* The first renewal comes in the second half of the period, at
+		 * a place following the golden ratio, so that the renewals of
+		 * the devices added together are spread evenly. */
+		spread = (uint32_t)(gAdvertiserAdded++ * 2654435769u);
+		half = (uint64_t)(entries[i]->renewal / 2);
+		entries[i]->due = now + entries[i]->renewal -
+				  (time_t)(((uint64_t)spread * half) >> 32);
+		entries[i]->pass = pass;
+		gAdvertiserEntries[Hnds[i]] = entries[i];
+	}
+	HandleUnlock(__FILE__, __LINE__);
+	SendPass(pass);
+	ScheduleNextPass();
+	ithread_mutex_unlock(&gAdvertiserMutex);
+	free(entries);
+	SendCopies(pass);
+
+	return UPNP_E_SUCCESS;
+}
+
+void SsdpAdvertiserRemove(UpnpDevice_Handle Hnd)
+{
+	advertiser_entry *entry;
+
+	if (Hnd < 0 || Hnd >= NUM_HANDLE)
+		return;
+	ithread_mutex_lock(&gAdvertiserMutex);
+	entry = gAdvertiserEntries[Hnd];
+	gAdvertiserEntries[Hnd] = NULL;
+	ithread_mutex_unlock(&gAdvertiserMutex);
+	if (entry) {
+		SsdpPacketListFree(&entry->packets);
+		free(entry);
+	}
+}
+
+	#endif /* EXCLUDE_SSDP == 0 */
+#endif	       /* INCLUDE_DEVICE_APIS */
+
+/* @} SSDPlib */
@@ -50,6 +50,7 @@
 		#include "UpnpInet.h"
 		#include "httpparser.h"
 		#include "httpreadwrite.h"
+		#include "metrics.h"
 		#include "ssdplib.h"
 		#include "statcodes.h"
 		#include "unixutil.h"
@@ -722,12 +723,13 @@ int SearchByTarget(int Hnd, int Mx, char *St, void *Cookie)
 				__LINE__,
 				">>> SSDP SEND M-SEARCH >>>\n%s\n",
 				ReqBufv6UlaGua);
-			sendto(gSsdpReqSocket6,
-				ReqBufv6UlaGua,
-				strlen(ReqBufv6UlaGua),
-				0,
-				(struct sockaddr *)&__ss_v6,
-				sizeof(struct sockaddr_in6));
+			if (sendto(gSsdpReqSocket6,
+				    ReqBufv6UlaGua,
+				    strlen(ReqBufv6UlaGua),
+				    0,
+				    (struct sockaddr *)&__ss_v6,
+				    sizeof(struct sockaddr_in6)) > 0)
+				upnp_metrics_inc(&gUpnpMetrics.ssdpPacketsOut);
 			NumCopy++;
 			imillisleep(SSDP_PAUSE);
 		}
@@ -740,12 +742,13 @@ int SearchByTarget(int Hnd, int Mx, char *St, void *Cookie)
 				__LINE__,
 				">>> SSDP SEND M-SEARCH >>>\n%s\n",
 				ReqBufv6);
-			sendto(gSsdpReqSocket6,
-				ReqBufv6,
-				strlen(ReqBufv6),
-				0,
-				(struct sockaddr *)&__ss_v6,
-				sizeof(struct sockaddr_in6));
+			if (sendto(gSsdpReqSocket6,
+				    ReqBufv6,
+				    strlen(ReqBufv6),
+				    0,
+				    (struct sockaddr *)&__ss_v6,
+				    sizeof(struct sockaddr_in6)) > 0)
+				upnp_metrics_inc(&gUpnpMetrics.ssdpPacketsOut);
 			NumCopy++;
 			imillisleep(SSDP_PAUSE);
 		}
@@ -761,12 +764,13 @@ int SearchByTarget(int Hnd, int Mx, char *St, void *Cookie)
 				__LINE__,
 				">>> SSDP SEND M-SEARCH >>>\n%s\n",
 				ReqBufv4);
-			sendto(gSsdpReqSocket4,
-				ReqBufv4,
-				strlen(ReqBufv4),
-				0,
-				(struct sockaddr *)&__ss_v4,
-				sizeof(struct sockaddr_in));
+			if (sendto(gSsdpReqSocket4,
+				    ReqBufv4,
+				    strlen(ReqBufv4),
+				    0,
+				    (struct sockaddr *)&__ss_v4,
+				    sizeof(struct sockaddr_in)) > 0)
+				upnp_metrics_inc(&gUpnpMetrics.ssdpPacketsOut);
 			NumCopy++;
 			imillisleep(SSDP_PAUSE);
 		}
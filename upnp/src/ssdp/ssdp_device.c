@@ -47,12 +47,14 @@
 		#include "UpnpInet.h"
 		#include "httpparser.h"
 		#include "httpreadwrite.h"
+		#include "metrics.h"
 		#include "ssdplib.h"
 		#include "statcodes.h"
 		#include "upnpapi.h"
 
 		#include <assert.h>
 		#include <stdio.h>
+		#include <stdlib.h>
 		#include <string.h>
 
 		#include "posix_overwrites.h" // IWYU pragma: keep
@@ -61,39 +63,21 @@
 		#define MSGTYPE_ADVERTISEMENT 1
 		#define MSGTYPE_REPLY 2
 
-void advertiseAndReplyThread(void *data)
-{
-	SsdpSearchReply *arg = (SsdpSearchReply *)data;
-
-	AdvertiseAndReply(0,
-		arg->handle,
-		arg->event.RequestType,
-		(struct sockaddr *)&arg->dest_addr,
-		arg->event.DeviceType,
-		arg->event.UDN,
-		arg->event.ServiceType,
-		arg->MaxAge);
-	free(arg);
-}
-
 		#ifdef INCLUDE_DEVICE_APIS
 void ssdp_handle_device_request(
 	http_message_t *hmsg, struct sockaddr_storage *dest_addr)
 {
 			#define MX_FUDGE_FACTOR 10
-	int handle, start;
+	UpnpDevice_Handle *handles;
+	int count;
+	int n = 0;
+	int i;
 	struct Handle_Info *dev_info = NULL;
 	memptr hdr_value;
 	int mx;
 	char save_char;
 	SsdpEvent event;
 	int ret_code;
-	SsdpSearchReply *threadArg = NULL;
-	ThreadPoolJob job;
-	int replyTime;
-	int maxAge;
-
-	memset(&job, 0, sizeof(job));
 
 	/* check man hdr. */
 	if (httpmsg_find_hdr(hmsg, HDR_MAN, &hdr_value) == NULL ||
@@ -116,81 +100,54 @@ void ssdp_handle_device_request(
 		/* bad ST header. */
 		return;
 
-	start = 0;
-	for (;;) {
-		HandleLock(__FILE__, __LINE__);
-		/* device info. */
-		switch (GetDeviceHandleInfo(
-			start, (int)dest_addr->ss_family, &handle, &dev_info)) {
-		case HND_DEVICE:
-			break;
-		default:
-			HandleUnlock(__FILE__, __LINE__);
-			/* no info found. */
-			return;
-		}
-		maxAge = dev_info->MaxAge;
-		HandleUnlock(__FILE__, __LINE__);
+	/* Subtract a percentage from the mx to allow for network and
+	 * processing delays (i.e. if search is for 30 seconds, respond
+	 * within 0 - 27 seconds). */
+	if (mx >= 2)
+		mx -= MAXVAL(1, mx / MX_FUDGE_FACTOR);
+	if (mx < 1)
+		mx = 1;
+	UpnpPrintf(UPNP_INFO,
+		API,
+		__FILE__,
+		__LINE__,
+		"MX     =  %d\n",
+		event.Mx);
+	UpnpPrintf(UPNP_INFO,
+		API,
+		__FILE__,
+		__LINE__,
+		"DeviceType   =  %s\n",
+		event.DeviceType);
+	UpnpPrintf(UPNP_INFO,
+		API,
+		__FILE__,
+		__LINE__,
+		"DeviceUuid   =  %s\n",
+		event.UDN);
+	UpnpPrintf(UPNP_INFO,
+		API,
+		__FILE__,
+		__LINE__,
+		"ServiceType =  %s\n",
+		event.ServiceType);
 
-		UpnpPrintf(UPNP_INFO,
-			API,
-			__FILE__,
-			__LINE__,
-			"MAX-AGE     =  %d\n",
-			maxAge);
-		UpnpPrintf(UPNP_INFO,
-			API,
-			__FILE__,
-			__LINE__,
-			"MX     =  %d\n",
-			event.Mx);
-		UpnpPrintf(UPNP_INFO,
-			API,
-			__FILE__,
-			__LINE__,
-			"DeviceType   =  %s\n",
-			event.DeviceType);
-		UpnpPrintf(UPNP_INFO,
-			API,
-			__FILE__,
-			__LINE__,
-			"DeviceUuid   =  %s\n",
-			event.UDN);
-		UpnpPrintf(UPNP_INFO,
-			API,
-			__FILE__,
-			__LINE__,
-			"ServiceType =  %s\n",
-			event.ServiceType);
-		threadArg = (SsdpSearchReply *)malloc(sizeof(SsdpSearchReply));
-		if (threadArg == NULL)
-			return;
-		threadArg->handle = handle;
-		memcpy(&threadArg->dest_addr,
-			dest_addr,
-			sizeof(threadArg->dest_addr));
-		threadArg->event = event;
-		threadArg->MaxAge = maxAge;
-
-		TPJobInit(&job, advertiseAndReplyThread, threadArg);
-		TPJobSetFreeFunction(&job, (free_routine)free);
-
-		/* Subtract a percentage from the mx to allow for network and
-		 * processing delays (i.e. if search is for 30 seconds, respond
-		 * within 0 - 27 seconds). */
-		if (mx >= 2)
-			mx -= MAXVAL(1, mx / MX_FUDGE_FACTOR);
-		if (mx < 1)
-			mx = 1;
-		replyTime = rand() % mx;
-		TimerThreadSchedule(&gTimerThread,
-			replyTime,
-			REL_SEC,
-			&job,
-			SHORT_TERM,
-			NULL);
-		start = handle;
+	/* Only the devices having a reply, from the search index. */
+	handles = (UpnpDevice_Handle *)malloc(
+		NUM_HANDLE * sizeof(UpnpDevice_Handle));
+	if (handles == NULL)
+		return;
+	HandleReadLock(__FILE__, __LINE__);
+	count = SsdpIndexFindHandles(
+		&event, (int)dest_addr->ss_family, handles);
+	for (i = 0; i < count; i++) {
+		if (GetHandleInfo(handles[i], &dev_info) == HND_DEVICE)
+			handles[n++] = handles[i];
 	}
+	HandleUnlock(__FILE__, __LINE__);
+	if (n > 0)
+		SsdpReplierAdd(handles, (size_t)n, dest_addr, &event, mx);
+	free(handles);
 }
 		#endif
 
@@ -216,28 +173,24 @@ static void ProcessSocketError(
 					ProcessSocketError( \
 						file, line, func_name); \
 					ret = error; \
-					goto end_NewRequestHandler; \
+					goto end_function; \
 				} \
 			} while (0)
 
 /*!
- * \brief Works as a request handler which passes the HTTP request string
- * to multicast channel.
+ * \brief Opens a socket bound to the SSDP port for sending to the multicast
+ * channel of \b AddressFamily.
  *
  * \return UPNP_E_SUCCESS if successful else appropriate error.
  */
-static int NewRequestHandler(
-	/*! [in] Ip address, to send the reply. */
-	struct sockaddr *DestAddr,
-	/*! [in] Number of packet to be sent. */
-	int NumPacket,
-	/*! [in] . */
-	char **RqPacket)
+static int OpenRequestSocket(
+	/*! [in] Address family of the destinations. */
+	int AddressFamily,
+	/*! [out] The socket. */
+	SOCKET *Sock)
 {
 	int rc;
-	SOCKET ReplySock;
-	socklen_t socklen = sizeof(struct sockaddr_storage);
-	int Index;
+	SOCKET ReplySock = INVALID_SOCKET;
 	struct in_addr replyAddr;
 	struct addrinfo hints, *res;
 	int yes = 1;
@@ -246,7 +199,6 @@ static int NewRequestHandler(
 		#ifdef UPNP_ENABLE_IPV6
 	int hops = 1;
 		#endif
-	char buf_ntop[INET6_ADDRSTRLEN];
 	int ret = UPNP_E_SUCCESS;
 
 	if (strlen(gIF_IPV4) > (size_t)0 &&
@@ -255,7 +207,7 @@ static int NewRequestHandler(
 	}
 
 	memset(&hints, 0, sizeof(hints));
-	hints.ai_family = DestAddr->sa_family;
+	hints.ai_family = AddressFamily;
 	hints.ai_socktype = SOCK_DGRAM;
 	hints.ai_flags = AI_PASSIVE;
 	if ((rc = getaddrinfo(NULL, SSDP_PORT_STR, &hints, &res)) != 0) {
@@ -266,14 +218,13 @@ static int NewRequestHandler(
 			"SSDP_LIB: New Request Handler:"
 			"Error in getaddrinfo(): %s\n",
 			gai_strerror(rc));
-		ret = UPNP_E_SOCKET_ERROR;
-		goto end_NewRequestHandlerDontClose;
+		return UPNP_E_SOCKET_ERROR;
 	}
 	ReplySock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
 	if (ReplySock == INVALID_SOCKET) {
 		ProcessSocketError(__FILE__, __LINE__, "socket");
-		ret = UPNP_E_OUTOF_SOCKET;
-		goto end_NewRequestHandlerDontClose;
+		freeaddrinfo(res);
+		return UPNP_E_OUTOF_SOCKET;
 	}
 	rc = setsockopt(ReplySock,
 		SOL_SOCKET,
@@ -284,12 +235,8 @@ static int NewRequestHandler(
 		__FILE__, __LINE__, UPNP_E_SOCKET_ERROR, "setsockopt-1");
 	rc = bind(ReplySock, res->ai_addr, res->ai_addrlen);
 	PROCESS_SOCKET_ERROR(__FILE__, __LINE__, UPNP_E_SOCKET_BIND, "bind");
-	switch (DestAddr->sa_family) {
+	switch (AddressFamily) {
 	case AF_INET:
-		inet_ntop(AF_INET,
-			&((struct sockaddr_in *)DestAddr)->sin_addr,
-			buf_ntop,
-			sizeof(buf_ntop));
 		rc = setsockopt(ReplySock,
 			IPPROTO_IP,
 			IP_MULTICAST_IF,
@@ -308,14 +255,9 @@ static int NewRequestHandler(
 			__LINE__,
 			UPNP_E_SOCKET_ERROR,
 			"setsockopt-3");
-		socklen = sizeof(struct sockaddr_in);
 		break;
 		#ifdef UPNP_ENABLE_IPV6
 	case AF_INET6:
-		inet_ntop(AF_INET6,
-			&((struct sockaddr_in6 *)DestAddr)->sin6_addr,
-			buf_ntop,
-			sizeof(buf_ntop));
 		rc = setsockopt(ReplySock,
 			IPPROTO_IPV6,
 			IPV6_MULTICAST_IF,
@@ -343,9 +285,60 @@ static int NewRequestHandler(
 			__LINE__,
 			"Invalid destination address specified.");
 		ret = UPNP_E_NETWORK_ERROR;
-		goto end_NewRequestHandler;
+		goto end_function;
+	}
+
+end_function:
+	freeaddrinfo(res);
+	if (ret != UPNP_E_SUCCESS) {
+		UpnpCloseSocket(ReplySock);
+		ReplySock = INVALID_SOCKET;
 	}
+	*Sock = ReplySock;
+
+	return ret;
+}
+
+/*!
+ * \brief Sends packets through a socket from OpenRequestSocket().
+ *
+ * \return UPNP_E_SUCCESS if successful else appropriate error.
+ */
+static int SendRequestPackets(
+	/*! [in] The socket. */
+	SOCKET ReplySock,
+	/*! [in] Ip address, to send the packets. */
+	struct sockaddr *DestAddr,
+	/*! [in] Number of packet to be sent. */
+	size_t NumPacket,
+	/*! [in] The packets. */
+	char **RqPacket,
+	/*! [in] Lengths of the packets, or NULL. */
+	const size_t *Lengths)
+{
+	socklen_t socklen;
+	size_t Index;
+	char buf_ntop[INET6_ADDRSTRLEN];
+	int ret = UPNP_E_SUCCESS;
 
+	switch (DestAddr->sa_family) {
+	case AF_INET:
+		inet_ntop(AF_INET,
+			&((struct sockaddr_in *)DestAddr)->sin_addr,
+			buf_ntop,
+			sizeof(buf_ntop));
+		socklen = sizeof(struct sockaddr_in);
+		break;
+	case AF_INET6:
+		inet_ntop(AF_INET6,
+			&((struct sockaddr_in6 *)DestAddr)->sin6_addr,
+			buf_ntop,
+			sizeof(buf_ntop));
+		socklen = sizeof(struct sockaddr_in6);
+		break;
+	default:
+		return UPNP_E_NETWORK_ERROR;
+	}
 	for (Index = 0; Index < NumPacket; Index++) {
 		ssize_t rc;
 		UpnpPrintf(UPNP_INFO,
@@ -354,20 +347,82 @@ static int NewRequestHandler(
 			__LINE__,
 			">>> SSDP SEND to %s >>>\n%s\n",
 			buf_ntop,
-			*(RqPacket + Index));
+			RqPacket[Index]);
 		rc = sendto(ReplySock,
-			*(RqPacket + Index),
-			strlen(*(RqPacket + Index)),
+			RqPacket[Index],
+			Lengths ? Lengths[Index] : strlen(RqPacket[Index]),
 			0,
 			DestAddr,
 			socklen);
 		PROCESS_SOCKET_ERROR(
 			__FILE__, __LINE__, UPNP_E_SOCKET_WRITE, "sendto");
+		upnp_metrics_inc(&gUpnpMetrics.ssdpPacketsOut);
 	}
 
-end_NewRequestHandler:
+end_function:
+	return ret;
+}
+
+/*!
+ * \brief Works as a request handler which passes the HTTP request string
+ * to multicast channel.
+ *
+ * \return UPNP_E_SUCCESS if successful else appropriate error.
+ */
+static int NewRequestHandler(
+	/*! [in] Ip address, to send the reply. */
+	struct sockaddr *DestAddr,
+	/*! [in] Number of packet to be sent. */
+	int NumPacket,
+	/*! [in] . */
+	char **RqPacket)
+{
+	SOCKET ReplySock;
+	int ret;
+
+	ret = OpenRequestSocket(DestAddr->sa_family, &ReplySock);
+	if (ret != UPNP_E_SUCCESS)
+		return ret;
+	ret = SendRequestPackets(
+		ReplySock, DestAddr, (size_t)NumPacket, RqPacket, NULL);
 	UpnpCloseSocket(ReplySock);
-end_NewRequestHandlerDontClose:
+
+	return ret;
+}
+
+int SsdpSendPacketLists(SsdpPacketList **lists, size_t count)
+{
+	/* One socket for each family, opened on first use. */
+	SOCKET socks[2] = {INVALID_SOCKET, INVALID_SOCKET};
+	int opened[2] = {0, 0};
+	size_t i;
+	int f;
+	int rc;
+	int ret = UPNP_E_SUCCESS;
+
+	for (i = 0; i < count; i++) {
+		f = lists[i]->dest.ss_family == AF_INET ? 0 : 1;
+		if (!opened[f]) {
+			opened[f] = 1;
+			rc = OpenRequestSocket(
+				lists[i]->dest.ss_family, &socks[f]);
+			if (rc != UPNP_E_SUCCESS)
+				ret = rc;
+		}
+		if (socks[f] == INVALID_SOCKET)
+			continue;
+		rc = SendRequestPackets(socks[f],
+			(struct sockaddr *)&lists[i]->dest,
+			lists[i]->count,
+			lists[i]->packets,
+			lists[i]->lengths);
+		if (rc != UPNP_E_SUCCESS)
+			ret = rc;
+	}
+	for (f = 0; f < 2; f++) {
+		if (socks[f] != INVALID_SOCKET)
+			UpnpCloseSocket(socks[f]);
+	}
 
 	return ret;
 }
@@ -786,34 +841,13 @@ static void CreateServicePacket(
 	return;
 }
 
-int DeviceAdvertisement(char *DevType,
-	int RootDev,
-	char *Udn,
-	char *Location,
-	int Duration,
-	int AddressFamily,
-	int PowerState,
-	int SleepPeriod,
-	int RegistrationState)
+int SsdpPacketListInit(
+	SsdpPacketList *list, int AddressFamily, char *Location)
 {
-	struct sockaddr_storage __ss;
-	struct sockaddr_in *DestAddr4 = (struct sockaddr_in *)&__ss;
-	struct sockaddr_in6 *DestAddr6 = (struct sockaddr_in6 *)&__ss;
-	/* char Mil_Nt[LINE_SIZE] */
-	char Mil_Usn[LINE_SIZE];
-	char *msgs[3];
-	int ret_code = UPNP_E_OUTOF_MEMORY;
-	int rc = 0;
+	struct sockaddr_in *DestAddr4 = (struct sockaddr_in *)&list->dest;
+	struct sockaddr_in6 *DestAddr6 = (struct sockaddr_in6 *)&list->dest;
 
-	UpnpPrintf(UPNP_INFO,
-		SSDP,
-		__FILE__,
-		__LINE__,
-		"In function DeviceAdvertisement\n");
-	msgs[0] = NULL;
-	msgs[1] = NULL;
-	msgs[2] = NULL;
-	memset(&__ss, 0, sizeof(__ss));
+	memset(list, 0, sizeof(*list));
 	switch (AddressFamily) {
 	case AF_INET:
 		DestAddr4->sin_family = (sa_family_t)AF_INET;
@@ -835,26 +869,105 @@ int DeviceAdvertisement(char *DevType,
 			__FILE__,
 			__LINE__,
 			"Invalid device address family.\n");
-		ret_code = UPNP_E_INVALID_PARAM;
-		goto error_handler;
+		return UPNP_E_INVALID_PARAM;
+	}
+
+	return UPNP_E_SUCCESS;
+}
+
+void SsdpPacketListFree(SsdpPacketList *list)
+{
+	size_t i;
+
+	for (i = 0; i < list->count; i++)
+		free(list->packets[i]);
+	free(list->packets);
+	free(list->lengths);
+	list->packets = NULL;
+	list->lengths = NULL;
+	list->count = 0;
+	list->size = 0;
+}
+
+/*!
+ * \brief Appends a packet from CreateServicePacket() to a list, which then
+ * owns it.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_OUTOF_MEMORY, \b packet is then freed.
+ */
+static int AddPacket(
+	/*! [in,out] The list. */
+	SsdpPacketList *list,
+	/*! [in] The packet, NULL if it could not be created. */
+	char *packet)
+{
+	char **packets;
+	size_t *lengths;
+	size_t size;
+
+	if (packet == NULL)
+		return UPNP_E_OUTOF_MEMORY;
+	if (list->count == list->size) {
+		size = list->size ? list->size * 2 : (size_t)4;
+		packets = (char **)realloc(
+			list->packets, size * sizeof(*list->packets));
+		if (packets == NULL) {
+			free(packet);
+			return UPNP_E_OUTOF_MEMORY;
+		}
+		list->packets = packets;
+		lengths = (size_t *)realloc(
+			list->lengths, size * sizeof(*list->lengths));
+		if (lengths == NULL) {
+			free(packet);
+			return UPNP_E_OUTOF_MEMORY;
+		}
+		list->lengths = lengths;
+		list->size = size;
 	}
+	list->packets[list->count] = packet;
+	list->lengths[list->count] = strlen(packet);
+	list->count++;
+
+	return UPNP_E_SUCCESS;
+}
+
+int DeviceAdvertisementPackets(SsdpPacketList *list,
+	char *DevType,
+	int RootDev,
+	char *Udn,
+	char *Location,
+	int Duration,
+	int AddressFamily,
+	int PowerState,
+	int SleepPeriod,
+	int RegistrationState)
+{
+	char Mil_Usn[LINE_SIZE];
+	char *msg;
+	int ret_code;
+	int rc = 0;
+
 	/* If deviceis a root device , here we need to send 3 advertisement
 	 * or reply */
 	if (RootDev) {
 		rc = snprintf(
 			Mil_Usn, sizeof(Mil_Usn), "%s::upnp:rootdevice", Udn);
 		if (rc < 0 || (unsigned int)rc >= sizeof(Mil_Usn))
-			goto error_handler;
+			return UPNP_E_OUTOF_MEMORY;
 		CreateServicePacket(MSGTYPE_ADVERTISEMENT,
 			"upnp:rootdevice",
 			Mil_Usn,
 			Location,
 			Duration,
-			&msgs[0],
+			&msg,
 			AddressFamily,
 			PowerState,
 			SleepPeriod,
 			RegistrationState);
+		ret_code = AddPacket(list, msg);
+		if (ret_code != UPNP_E_SUCCESS)
+			return ret_code;
 	}
 	/* both root and sub-devices need to send these two messages */
 	CreateServicePacket(MSGTYPE_ADVERTISEMENT,
@@ -862,51 +975,32 @@ int DeviceAdvertisement(char *DevType,
 		Udn,
 		Location,
 		Duration,
-		&msgs[1],
+		&msg,
 		AddressFamily,
 		PowerState,
 		SleepPeriod,
 		RegistrationState);
+	ret_code = AddPacket(list, msg);
+	if (ret_code != UPNP_E_SUCCESS)
+		return ret_code;
 	rc = snprintf(Mil_Usn, sizeof(Mil_Usn), "%s::%s", Udn, DevType);
 	if (rc < 0 || (unsigned int)rc >= sizeof(Mil_Usn))
-		goto error_handler;
+		return UPNP_E_OUTOF_MEMORY;
 	CreateServicePacket(MSGTYPE_ADVERTISEMENT,
 		DevType,
 		Mil_Usn,
 		Location,
 		Duration,
-		&msgs[2],
+		&msg,
 		AddressFamily,
 		PowerState,
 		SleepPeriod,
 		RegistrationState);
-	/* check error */
-	if ((RootDev && msgs[0] == NULL) || msgs[1] == NULL ||
-		msgs[2] == NULL) {
-		goto error_handler;
-	}
-	/* send packets */
-	if (RootDev) {
-		/* send 3 msg types */
-		ret_code = NewRequestHandler(
-			(struct sockaddr *)&__ss, 3, &msgs[0]);
-	} else { /* sub-device */
-
-		/* send 2 msg types */
-		ret_code = NewRequestHandler(
-			(struct sockaddr *)&__ss, 2, &msgs[1]);
-	}
-
-error_handler:
-	/* free msgs */
-	free(msgs[0]);
-	free(msgs[1]);
-	free(msgs[2]);
 
-	return ret_code;
+	return AddPacket(list, msg);
 }
 
-int SendReply(struct sockaddr *DestAddr,
+int SendReplyPackets(SsdpPacketList *list,
 	char *DevType,
 	int RootDev,
 	char *Udn,
@@ -917,88 +1011,58 @@ int SendReply(struct sockaddr *DestAddr,
 	int SleepPeriod,
 	int RegistrationState)
 {
-	int ret_code = UPNP_E_OUTOF_MEMORY;
-	char *msgs[2];
-	int num_msgs;
+	char *msg;
 	char Mil_Usn[LINE_SIZE];
-	int i;
 	int rc = 0;
 
-	msgs[0] = NULL;
-	msgs[1] = NULL;
 	if (RootDev) {
 		/* one msg for root device */
-		num_msgs = 1;
-
 		rc = snprintf(
 			Mil_Usn, sizeof(Mil_Usn), "%s::upnp:rootdevice", Udn);
 		if (rc < 0 || (unsigned int)rc >= sizeof(Mil_Usn))
-			goto error_handler;
+			return UPNP_E_OUTOF_MEMORY;
 		CreateServicePacket(MSGTYPE_REPLY,
 			"upnp:rootdevice",
 			Mil_Usn,
 			Location,
 			Duration,
-			&msgs[0],
-			(int)DestAddr->sa_family,
+			&msg,
+			(int)list->dest.ss_family,
 			PowerState,
 			SleepPeriod,
 			RegistrationState);
-	} else {
-		/* two msgs for embedded devices */
-		num_msgs = 1;
-
+	} else if (!ByType) {
 		/*NK: FIX for extra response when someone searches by udn */
-		if (!ByType) {
-			CreateServicePacket(MSGTYPE_REPLY,
-				Udn,
-				Udn,
-				Location,
-				Duration,
-				&msgs[0],
-				(int)DestAddr->sa_family,
-				PowerState,
-				SleepPeriod,
-				RegistrationState);
-		} else {
-			rc = snprintf(Mil_Usn,
-				sizeof(Mil_Usn),
-				"%s::%s",
-				Udn,
-				DevType);
-			if (rc < 0 || (unsigned int)rc >= sizeof(Mil_Usn))
-				goto error_handler;
-			CreateServicePacket(MSGTYPE_REPLY,
-				DevType,
-				Mil_Usn,
-				Location,
-				Duration,
-				&msgs[0],
-				(int)DestAddr->sa_family,
-				PowerState,
-				SleepPeriod,
-				RegistrationState);
-		}
-	}
-	/* check error */
-	for (i = 0; i < num_msgs; i++) {
-		if (msgs[i] == NULL) {
-			goto error_handler;
-		}
-	}
-	/* send msgs */
-	ret_code = NewRequestHandler(DestAddr, num_msgs, msgs);
-
-error_handler:
-	for (i = 0; i < num_msgs; i++) {
-		if (msgs[i] != NULL)
-			free(msgs[i]);
+		CreateServicePacket(MSGTYPE_REPLY,
+			Udn,
+			Udn,
+			Location,
+			Duration,
+			&msg,
+			(int)list->dest.ss_family,
+			PowerState,
+			SleepPeriod,
+			RegistrationState);
+	} else {
+		rc = snprintf(Mil_Usn, sizeof(Mil_Usn), "%s::%s", Udn, DevType);
+		if (rc < 0 || (unsigned int)rc >= sizeof(Mil_Usn))
+			return UPNP_E_OUTOF_MEMORY;
+		CreateServicePacket(MSGTYPE_REPLY,
+			DevType,
+			Mil_Usn,
+			Location,
+			Duration,
+			&msg,
+			(int)list->dest.ss_family,
+			PowerState,
+			SleepPeriod,
+			RegistrationState);
 	}
 
-	return ret_code;
+	return AddPacket(list, msg);
 }
 
-int DeviceReply(struct sockaddr *DestAddr,
+int DeviceReplyPackets(SsdpPacketList *list,
 	char *DevType,
 	int RootDev,
 	char *Udn,
@@ -1008,87 +1072,64 @@ int DeviceReply(struct sockaddr *DestAddr,
 	int SleepPeriod,
 	int RegistrationState)
 {
-	char *szReq[3], Mil_Nt[LINE_SIZE], Mil_Usn[LINE_SIZE];
-	int RetVal = UPNP_E_OUTOF_MEMORY;
+	char Mil_Usn[LINE_SIZE];
+	char *msg;
+	int ret_code;
 	int rc = 0;
 
-	szReq[0] = NULL;
-	szReq[1] = NULL;
-	szReq[2] = NULL;
 	/* create 2 or 3 msgs */
 	if (RootDev) {
 		/* 3 replies for root device */
-		memset(Mil_Nt, 0, sizeof(Mil_Nt));
-		strncpy(Mil_Nt, "upnp:rootdevice", sizeof(Mil_Nt) - 1);
 		rc = snprintf(
 			Mil_Usn, sizeof(Mil_Usn), "%s::upnp:rootdevice", Udn);
 		if (rc < 0 || (unsigned int)rc >= sizeof(Mil_Usn))
-			goto error_handler;
+			return UPNP_E_OUTOF_MEMORY;
 		CreateServicePacket(MSGTYPE_REPLY,
-			Mil_Nt,
+			"upnp:rootdevice",
 			Mil_Usn,
 			Location,
 			Duration,
-			&szReq[0],
-			(int)DestAddr->sa_family,
+			&msg,
+			(int)list->dest.ss_family,
 			PowerState,
 			SleepPeriod,
 			RegistrationState);
+		ret_code = AddPacket(list, msg);
+		if (ret_code != UPNP_E_SUCCESS)
+			return ret_code;
 	}
-	rc = snprintf(Mil_Nt, sizeof(Mil_Nt), "%s", Udn);
-	if (rc < 0 || (unsigned int)rc >= sizeof(Mil_Nt))
-		goto error_handler;
-	rc = snprintf(Mil_Usn, sizeof(Mil_Usn), "%s", Udn);
-	if (rc < 0 || (unsigned int)rc >= sizeof(Mil_Usn))
-		goto error_handler;
 	CreateServicePacket(MSGTYPE_REPLY,
-		Mil_Nt,
-		Mil_Usn,
+		Udn,
+		Udn,
 		Location,
 		Duration,
-		&szReq[1],
-		(int)DestAddr->sa_family,
+		&msg,
+		(int)list->dest.ss_family,
 		PowerState,
 		SleepPeriod,
 		RegistrationState);
-	rc = snprintf(Mil_Nt, sizeof(Mil_Nt), "%s", DevType);
-	if (rc < 0 || (unsigned int)rc >= sizeof(Mil_Nt))
-		goto error_handler;
+	ret_code = AddPacket(list, msg);
+	if (ret_code != UPNP_E_SUCCESS)
+		return ret_code;
 	rc = snprintf(Mil_Usn, sizeof(Mil_Usn), "%s::%s", Udn, DevType);
 	if (rc < 0 || (unsigned int)rc >= sizeof(Mil_Usn))
-		goto error_handler;
+		return UPNP_E_OUTOF_MEMORY;
 	CreateServicePacket(MSGTYPE_REPLY,
-		Mil_Nt,
+		DevType,
 		Mil_Usn,
 		Location,
 		Duration,
-		&szReq[2],
-		(int)DestAddr->sa_family,
+		&msg,
+		(int)list->dest.ss_family,
 		PowerState,
 		SleepPeriod,
 		RegistrationState);
-	/* check error */
-	if ((RootDev && szReq[0] == NULL) || szReq[1] == NULL ||
-		szReq[2] == NULL) {
-		goto error_handler;
-	}
-	/* send replies */
-	if (RootDev) {
-		RetVal = NewRequestHandler(DestAddr, 3, szReq);
-	} else {
-		RetVal = NewRequestHandler(DestAddr, 2, &szReq[1]);
-	}
 
-error_handler:
-	/* free */
-	free(szReq[0]);
-	free(szReq[1]);
-	free(szReq[2]);
-
-	return RetVal;
+	return AddPacket(list, msg);
 }
 
-int ServiceAdvertisement(char *Udn,
+int ServiceAdvertisementPackets(SsdpPacketList *list,
+	char *Udn,
 	char *ServType,
 	char *Location,
 	int Duration,
@@ -1098,64 +1139,27 @@ int ServiceAdvertisement(char *Udn,
 	int RegistrationState)
 {
 	char Mil_Usn[LINE_SIZE];
-	char *szReq[1];
-	int RetVal = UPNP_E_OUTOF_MEMORY;
-	struct sockaddr_storage __ss;
-	struct sockaddr_in *DestAddr4 = (struct sockaddr_in *)&__ss;
-	struct sockaddr_in6 *DestAddr6 = (struct sockaddr_in6 *)&__ss;
+	char *msg;
 	int rc = 0;
 
-	memset(&__ss, 0, sizeof(__ss));
-	szReq[0] = NULL;
-	switch (AddressFamily) {
-	case AF_INET:
-		DestAddr4->sin_family = (sa_family_t)AddressFamily;
-		inet_pton(AF_INET, SSDP_IP, &DestAddr4->sin_addr);
-		DestAddr4->sin_port = htons(SSDP_PORT);
-		break;
-	case AF_INET6:
-		DestAddr6->sin6_family = (sa_family_t)AddressFamily;
-		inet_pton(AF_INET6,
-			(isUrlV6UlaGua(Location)) ? SSDP_IPV6_SITELOCAL
-						  : SSDP_IPV6_LINKLOCAL,
-			&DestAddr6->sin6_addr);
-		DestAddr6->sin6_port = htons(SSDP_PORT);
-		DestAddr6->sin6_scope_id = gIF_INDEX;
-		break;
-	default:
-		UpnpPrintf(UPNP_CRITICAL,
-			SSDP,
-			__FILE__,
-			__LINE__,
-			"Invalid device address family.\n");
-	}
 	rc = snprintf(Mil_Usn, sizeof(Mil_Usn), "%s::%s", Udn, ServType);
 	if (rc < 0 || (unsigned int)rc >= sizeof(Mil_Usn))
-		goto error_handler;
-	/* CreateServiceRequestPacket(1,szReq[0],Mil_Nt,Mil_Usn,
-	 * Server,Location,Duration); */
+		return UPNP_E_OUTOF_MEMORY;
 	CreateServicePacket(MSGTYPE_ADVERTISEMENT,
 		ServType,
 		Mil_Usn,
 		Location,
 		Duration,
-		&szReq[0],
+		&msg,
 		AddressFamily,
 		PowerState,
 		SleepPeriod,
 		RegistrationState);
-	if (szReq[0] == NULL) {
-		goto error_handler;
-	}
-	RetVal = NewRequestHandler((struct sockaddr *)&__ss, 1, szReq);
 
-error_handler:
-	free(szReq[0]);
-
-	return RetVal;
+	return AddPacket(list, msg);
 }
 
-int ServiceReply(struct sockaddr *DestAddr,
+int ServiceReplyPackets(SsdpPacketList *list,
 	char *ServType,
 	char *Udn,
 	char *Location,
@@ -1165,32 +1169,24 @@ int ServiceReply(struct sockaddr *DestAddr,
 	int RegistrationState)
 {
 	char Mil_Usn[LINE_SIZE];
-	char *szReq[1];
-	int RetVal = UPNP_E_OUTOF_MEMORY;
+	char *msg;
 	int rc = 0;
 
-	szReq[0] = NULL;
 	rc = snprintf(Mil_Usn, sizeof(Mil_Usn), "%s::%s", Udn, ServType);
 	if (rc < 0 || (unsigned int)rc >= sizeof(Mil_Usn))
-		goto error_handler;
+		return UPNP_E_OUTOF_MEMORY;
 	CreateServicePacket(MSGTYPE_REPLY,
 		ServType,
 		Mil_Usn,
 		Location,
 		Duration,
-		&szReq[0],
-		(int)DestAddr->sa_family,
+		&msg,
+		(int)list->dest.ss_family,
 		PowerState,
 		SleepPeriod,
 		RegistrationState);
-	if (szReq[0] == NULL)
-		goto error_handler;
-	RetVal = NewRequestHandler(DestAddr, 1, szReq);
 
-error_handler:
-	free(szReq[0]);
-
-	return RetVal;
+	return AddPacket(list, msg);
 }
 
 int ServiceShutdown(char *Udn,
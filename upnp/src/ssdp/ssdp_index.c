@@ -0,0 +1,427 @@
+/**************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * - Neither name of Intel Corporation nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+/*!
+ * \addtogroup SSDPlib
+ *
+ * @{
+ *
+ * \file
+ *
+ * \brief Index of the search targets of the registered devices.
+ */
+
+#include "config.h"
+
+#ifdef INCLUDE_DEVICE_APIS
+	#if EXCLUDE_SSDP == 0
+
+		#include "ssdplib.h"
+
+		#include "upnpapi.h"
+
+		#include <ctype.h>
+		#include <stdlib.h>
+		#include <string.h>
+
+		/*! Number of buckets of the hash tables, a power of 2. */
+		#define INDEX_BUCKETS 1024
+
+/*! Search targets of a root device. */
+typedef struct
+{
+	/*! Devices and services, each device followed by its services. */
+	SsdpTarget *targets;
+	/*! Number of entries of targets. */
+	size_t count;
+	/*! Address family of the device. */
+	int af;
+} index_entry;
+
+static const char SERVICELIST_STR[] = "serviceList";
+
+/*! Search targets, indexed by handle. */
+static index_entry gIndex[NUM_HANDLE];
+/*! Devices and services by type, without the version. */
+static SsdpTarget *gTypeBuckets[INDEX_BUCKETS];
+/*! Devices by UDN. */
+static SsdpTarget *gUdnBuckets[INDEX_BUCKETS];
+
+/*!
+ * \brief Case insensitive hash of the first \b len characters of \b str.
+ */
+static unsigned int HashKey(const char *str, size_t len)
+{
+	uint32_t hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < len && str[i]; i++) {
+		hash ^= (uint32_t)tolower((unsigned char)str[i]);
+		hash *= 16777619u;
+	}
+
+	return (unsigned int)(hash & (INDEX_BUCKETS - 1));
+}
+
+/*!
+ * \brief Splits a device or service type in its base and its version.
+ *
+ * \return The length of the base, before the last ':', 0 if there is none.
+ */
+static size_t SplitType(
+	/*! [in] The type, e.g. urn:schemas-upnp-org:device:MediaServer:1. */
+	const char *type,
+	/*! [out] The version. */
+	int *version)
+{
+	const char *colon = strrchr(type, ':');
+
+	if (colon == NULL || colon == type) {
+		*version = 0;
+		return 0;
+	}
+	*version = atoi(colon + 1);
+
+	return (size_t)(colon - type);
+}
+
+/*!
+ * \brief Copies the value of the first \b tag element under \b element.
+ *
+ * \return The value, to free with free(), or NULL.
+ */
+static char *GetFirstValue(
+	/*! [in] Element to search. */
+	IXML_Node *element,
+	/*! [in] Tag name. */
+	const char *tag)
+{
+	IXML_NodeList *nodeList;
+	IXML_Node *textNode = NULL;
+	const DOMString str = NULL;
+	char *value = NULL;
+
+	nodeList =
+		ixmlElement_getElementsByTagName((IXML_Element *)element, tag);
+	if (!nodeList)
+		return NULL;
+	textNode = ixmlNode_getFirstChild(ixmlNodeList_item(nodeList, 0lu));
+	if (textNode)
+		str = ixmlNode_getNodeValue(textNode);
+	if (str)
+		value = strdup(str);
+	ixmlNodeList_free(nodeList);
+
+	return value;
+}
+
+/*!
+ * \brief Appends a device or a service to a list of targets.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_OUTOF_MEMORY, \b type is then freed.
+ */
+static int AddTarget(
+	/*! [in,out] The targets of the device. */
+	index_entry *entry,
+	/*! [in,out] Allocated entries of the targets. */
+	size_t *size,
+	/*! [in] Handle of the root device. */
+	UpnpDevice_Handle Hnd,
+	/*! [in] The type, owned by the target. */
+	char *type,
+	/*! [in] The UDN, copied. */
+	const char *udn,
+	/*! [in] 1 for the root device. */
+	int root,
+	/*! [in] 1 for a service. */
+	int service)
+{
+	SsdpTarget *targets;
+	SsdpTarget *t;
+
+	if (entry->count == *size) {
+		*size = *size ? *size * 2 : (size_t)8;
+		targets = (SsdpTarget *)realloc(
+			entry->targets, *size * sizeof(*targets));
+		if (targets == NULL) {
+			free(type);
+			return UPNP_E_OUTOF_MEMORY;
+		}
+		entry->targets = targets;
+	}
+	t = &entry->targets[entry->count];
+	memset(t, 0, sizeof(*t));
+	t->type = type;
+	t->udn = strdup(udn);
+	if (t->udn == NULL) {
+		free(type);
+		return UPNP_E_OUTOF_MEMORY;
+	}
+	t->baseLen = SplitType(type, &t->version);
+	t->root = root;
+	t->service = service;
+	t->handle = Hnd;
+	entry->count++;
+
+	return UPNP_E_SUCCESS;
+}
+
+/*!
+ * \brief Frees the targets of a device, which are not in the hash tables.
+ */
+static void FreeTargets(index_entry *entry)
+{
+	size_t i;
+
+	for (i = 0; i < entry->count; i++) {
+		free(entry->targets[i].type);
+		free(entry->targets[i].udn);
+	}
+	free(entry->targets);
+	memset(entry, 0, sizeof(*entry));
+}
+
+/*!
+ * \brief Lists the devices and services of a description, as they are
+ * advertised.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_OUTOF_MEMORY.
+ */
+static int ReadTargets(
+	/*! [in] Handle of the root device. */
+	UpnpDevice_Handle Hnd,
+	/*! [in] The root device. */
+	struct Handle_Info *HInfo,
+	/*! [out] The targets. */
+	index_entry *entry)
+{
+	unsigned long i;
+	unsigned long j;
+	char UDNstr[LINE_SIZE];
+	char *devType;
+	char *udn;
+	char *servType;
+	IXML_Node *devNode;
+	IXML_Node *node;
+	IXML_NodeList *services;
+	size_t size = 0;
+	int ret = UPNP_E_SUCCESS;
+
+	memset(entry, 0, sizeof(*entry));
+	entry->af = HInfo->DeviceAf;
+	for (i = 0lu; ret == UPNP_E_SUCCESS; i++) {
+		devNode = ixmlNodeList_item(HInfo->DeviceList, i);
+		if (!devNode)
+			break;
+		devType = GetFirstValue(devNode, "deviceType");
+		udn = GetFirstValue(devNode, "UDN");
+		if (!devType || !udn) {
+			free(devType);
+			free(udn);
+			continue;
+		}
+		memset(UDNstr, 0, sizeof(UDNstr));
+		strncpy(UDNstr, udn, sizeof(UDNstr) - 1);
+		free(udn);
+		ret = GetInstanceUDN(HInfo, i, UDNstr, sizeof(UDNstr));
+		if (ret != UPNP_E_SUCCESS) {
+			free(devType);
+			break;
+		}
+		ret = AddTarget(entry, &size, Hnd, devType, UDNstr, i == 0lu, 0);
+		/* Only the services of the serviceList child of the device,
+		 * they are advertised with the UDN of their own device. */
+		for (node = ixmlNode_getFirstChild(devNode); node;
+			node = ixmlNode_getNextSibling(node)) {
+			if (!strcmp(ixmlNode_getNodeName(node),
+				    SERVICELIST_STR))
+				break;
+		}
+		if (!node)
+			continue;
+		services = ixmlElement_getElementsByTagName(
+			(IXML_Element *)node, "service");
+		for (j = 0lu; ret == UPNP_E_SUCCESS; j++) {
+			node = ixmlNodeList_item(services, j);
+			if (!node)
+				break;
+			servType = GetFirstValue(node, "serviceType");
+			if (!servType)
+				continue;
+			ret = AddTarget(
+				entry, &size, Hnd, servType, UDNstr, 0, 1);
+		}
+		ixmlNodeList_free(services);
+	}
+	if (ret != UPNP_E_SUCCESS)
+		FreeTargets(entry);
+
+	return ret;
+}
+
+int SsdpIndexAdd(UpnpDevice_Handle Hnd, struct Handle_Info *HInfo)
+{
+	index_entry entry;
+	SsdpTarget *t;
+	unsigned int b;
+	size_t i;
+	int ret;
+
+	if (Hnd < 0 || Hnd >= NUM_HANDLE)
+		return UPNP_E_INVALID_HANDLE;
+	ret = ReadTargets(Hnd, HInfo, &entry);
+	if (ret != UPNP_E_SUCCESS)
+		return ret;
+	SsdpIndexRemove(Hnd);
+	gIndex[Hnd] = entry;
+	for (i = 0; i < entry.count; i++) {
+		t = &entry.targets[i];
+		b = HashKey(t->type, t->baseLen);
+		t->nextType = gTypeBuckets[b];
+		gTypeBuckets[b] = t;
+		if (!t->service) {
+			b = HashKey(t->udn, strlen(t->udn));
+			t->nextUdn = gUdnBuckets[b];
+			gUdnBuckets[b] = t;
+		}
+	}
+
+	return UPNP_E_SUCCESS;
+}
+
+void SsdpIndexRemove(UpnpDevice_Handle Hnd)
+{
+	SsdpTarget **p;
+	SsdpTarget *t;
+	size_t i;
+
+	if (Hnd < 0 || Hnd >= NUM_HANDLE || gIndex[Hnd].count == 0)
+		return;
+	for (i = 0; i < gIndex[Hnd].count; i++) {
+		t = &gIndex[Hnd].targets[i];
+		p = &gTypeBuckets[HashKey(t->type, t->baseLen)];
+		while (*p != t)
+			p = &(*p)->nextType;
+		*p = t->nextType;
+		if (!t->service) {
+			p = &gUdnBuckets[HashKey(t->udn, strlen(t->udn))];
+			while (*p != t)
+				p = &(*p)->nextUdn;
+			*p = t->nextUdn;
+		}
+	}
+	FreeTargets(&gIndex[Hnd]);
+}
+
+const SsdpTarget *SsdpIndexTargets(UpnpDevice_Handle Hnd, size_t *count)
+{
+	if (Hnd < 0 || Hnd >= NUM_HANDLE) {
+		*count = 0;
+		return NULL;
+	}
+	*count = gIndex[Hnd].count;
+
+	return gIndex[Hnd].targets;
+}
+
+int SsdpTargetMatch(const SsdpTarget *t, const char *st, int *lower)
+{
+	int version;
+	size_t baseLen = SplitType(st, &version);
+
+	if (baseLen == 0 || baseLen != t->baseLen ||
+		strncasecmp(st, t->type, baseLen) != 0 || version > t->version)
+		return 0;
+	/* A lower version is answered with the description of the lower
+	 * version. */
+	*lower = version < t->version;
+
+	return 1;
+}
+
+int SsdpIndexFindHandles(
+	const SsdpEvent *event, int AddressFamily, UpnpDevice_Handle *Hnds)
+{
+	unsigned char found[NUM_HANDLE];
+	const SsdpTarget *t;
+	const char *st;
+	size_t len;
+	int service;
+	int lower;
+	int count = 0;
+	int i;
+
+	memset(found, 0, sizeof(found));
+	switch (event->RequestType) {
+	case SSDP_ALL:
+	case SSDP_ROOTDEVICE:
+		/* Every device answers. */
+		for (i = 0; i < NUM_HANDLE; i++)
+			found[i] = gIndex[i].count != 0;
+		break;
+	case SSDP_DEVICEUDN:
+		len = strlen(event->UDN);
+		if (len == 0)
+			return 0;
+		for (t = gUdnBuckets[HashKey(event->UDN, len)]; t;
+			t = t->nextUdn) {
+			if (!strcasecmp(event->UDN, t->udn))
+				found[t->handle] = 1;
+		}
+		break;
+	case SSDP_DEVICETYPE:
+	case SSDP_SERVICE:
+		service = event->RequestType == SSDP_SERVICE;
+		st = service ? event->ServiceType : event->DeviceType;
+		len = SplitType(st, &i);
+		if (len == 0)
+			return 0;
+		for (t = gTypeBuckets[HashKey(st, len)]; t; t = t->nextType) {
+			if (t->service == service &&
+				SsdpTargetMatch(t, st, &lower))
+				found[t->handle] = 1;
+		}
+		break;
+	default:
+		return 0;
+	}
+	for (i = 0; i < NUM_HANDLE; i++) {
+		if (found[i] && gIndex[i].af == AddressFamily)
+			Hnds[count++] = i;
+	}
+
+	return count;
+}
+
+	#endif /* EXCLUDE_SSDP == 0 */
+#endif	       /* INCLUDE_DEVICE_APIS */
+
+/* @} SSDPlib */
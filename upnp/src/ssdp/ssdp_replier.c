@@ -0,0 +1,532 @@
+/**************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * - Neither name of Intel Corporation nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+
+/*!
+ * \addtogroup SSDPlib
+ *
+ * @{
+ *
+ * \file
+ *
+ * \brief Scheduler of the replies to the searches of the control points.
+ */
+
+#include "config.h"
+
+#ifdef INCLUDE_DEVICE_APIS
+	#if EXCLUDE_SSDP == 0
+
+		#include "ssdplib.h"
+
+		#include "ThreadPool.h"
+		#include "UpnpInet.h"
+		#include "UpnpStdInt.h"
+		#include "ithread.h"
+		#include "metrics.h"
+		#include "upnpapi.h"
+
+		#include <stdio.h>
+		#include <stdlib.h>
+		#include <string.h>
+
+		/*! Number of buckets of the table of the pending replies. */
+		#define REPLY_BUCKETS 512
+		/*! Maximum number of replies sent in one batch. */
+		#define REPLY_BATCH 64
+
+/*! The replies of a device to a search. */
+typedef struct ssdp_reply
+{
+	/*! upnp_clock_usec() time at which the replies are sent, a whole
+	 * number of milliseconds. */
+	int64_t due;
+	/*! Handle of the device. */
+	UpnpDevice_Handle handle;
+	/*! Control point the replies are sent to. */
+	struct sockaddr_storage dest;
+	/*! Search type. */
+	enum SsdpSearchType type;
+	/*! Device type, service type or UDN searched, depending on type. */
+	char target[LINE_SIZE];
+	/*! Hash of handle, dest, type and target. */
+	uint32_t hash;
+	/*! Place of the reply in gReplyHeap. */
+	size_t place;
+	/*! Next reply in the same bucket of gReplyBuckets. */
+	struct ssdp_reply *next;
+} ssdp_reply;
+
+typedef enum
+{
+	REPLIER_IDLE,
+	REPLIER_RUNNING,
+	REPLIER_STOPPING
+} replier_state;
+
+/*! Protects the variables below. */
+static ithread_mutex_t gReplierMutex;
+/*! Signaled when the first deadline changes or the scheduler stops. */
+static ithread_cond_t gReplierCond;
+static volatile replier_state gReplierState = REPLIER_IDLE;
+/*! Pending replies, a binary heap ordered by deadline. */
+static ssdp_reply **gReplyHeap = NULL;
+/*! Number of pending replies. */
+static size_t gReplyCount;
+/*! Pending replies, by hash, to find those of a repeated search. */
+static ssdp_reply *gReplyBuckets[REPLY_BUCKETS];
+/*! Replies of the batch being sent, only used by the thread. */
+static ssdp_reply *gReplyBatch[REPLY_BATCH];
+/*! Packets of the batch, one list for each control point. */
+static SsdpPacketList gReplyLists[REPLY_BATCH];
+static SsdpPacketList *gReplyListPtrs[REPLY_BATCH];
+
+/*!
+ * \brief Returns the part of a search that the replies depend on, beside
+ * its type.
+ */
+static const char *SearchTarget(
+	/*! [in] The search. */
+	const SsdpEvent *Event)
+{
+	switch (Event->RequestType) {
+	case SSDP_DEVICEUDN:
+		return Event->UDN;
+	case SSDP_DEVICETYPE:
+		return Event->DeviceType;
+	case SSDP_SERVICE:
+		return Event->ServiceType;
+	default:
+		return "";
+	}
+}
+
+/*!
+ * \brief Adds bytes to a FNV-1a hash.
+ */
+static uint32_t HashBytes(
+	/*! [in] Hash of the previous bytes. */
+	uint32_t h,
+	/*! [in] The bytes. */
+	const void *p,
+	/*! [in] Number of bytes. */
+	size_t n)
+{
+	const unsigned char *b = (const unsigned char *)p;
+
+	while (n--) {
+		h ^= *b++;
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+/*!
+ * \brief Hashes the port and address of a control point.
+ */
+static uint32_t HashDestination(
+	/*! [in] Hash of the previous bytes. */
+	uint32_t h,
+	/*! [in] The address. */
+	const struct sockaddr_storage *a)
+{
+	const struct sockaddr_in *a4 = (const struct sockaddr_in *)a;
+	const struct sockaddr_in6 *a6 = (const struct sockaddr_in6 *)a;
+
+	if (a->ss_family == AF_INET6) {
+		h = HashBytes(h, &a6->sin6_port, sizeof(a6->sin6_port));
+		return HashBytes(h, &a6->sin6_addr, sizeof(a6->sin6_addr));
+	}
+	h = HashBytes(h, &a4->sin_port, sizeof(a4->sin_port));
+
+	return HashBytes(h, &a4->sin_addr, sizeof(a4->sin_addr));
+}
+
+/*!
+ * \brief Tells whether two addresses are the ones of the same control point.
+ */
+static int SameDestination(
+	/*! [in] The first address. */
+	const struct sockaddr_storage *a,
+	/*! [in] The second address. */
+	const struct sockaddr_storage *b)
+{
+	const struct sockaddr_in *a4 = (const struct sockaddr_in *)a;
+	const struct sockaddr_in *b4 = (const struct sockaddr_in *)b;
+	const struct sockaddr_in6 *a6 = (const struct sockaddr_in6 *)a;
+	const struct sockaddr_in6 *b6 = (const struct sockaddr_in6 *)b;
+
+	if (a->ss_family != b->ss_family)
+		return 0;
+	if (a->ss_family == AF_INET6)
+		return a6->sin6_port == b6->sin6_port &&
+		       a6->sin6_scope_id == b6->sin6_scope_id &&
+		       !memcmp(&a6->sin6_addr,
+			       &b6->sin6_addr,
+			       sizeof(a6->sin6_addr));
+
+	return a4->sin_port == b4->sin_port &&
+	       a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+}
+
+/*!
+ * \brief Returns a random number of milliseconds below \b n.
+ */
+static int64_t RandomBelow(
+	/*! [in] Upper bound, at least 1. */
+	int64_t n)
+{
+	return (int64_t)((double)rand() / ((double)RAND_MAX + 1.0) *
+			 (double)n);
+}
+
+/*!
+ * \brief Stores a reply at a place of the heap.
+ */
+static void HeapSet(
+	/*! [in] The place. */
+	size_t i,
+	/*! [in] The reply. */
+	ssdp_reply *r)
+{
+	gReplyHeap[i] = r;
+	r->place = i;
+}
+
+/*!
+ * \brief Moves a reply towards the top of the heap until its parent is due
+ * before it.
+ */
+static void HeapUp(
+	/*! [in] Place of the reply. */
+	size_t i)
+{
+	ssdp_reply *r = gReplyHeap[i];
+	size_t parent;
+
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (gReplyHeap[parent]->due <= r->due)
+			break;
+		HeapSet(i, gReplyHeap[parent]);
+		i = parent;
+	}
+	HeapSet(i, r);
+}
+
+/*!
+ * \brief Moves a reply towards the bottom of the heap until its children
+ * are due after it.
+ */
+static void HeapDown(
+	/*! [in] Place of the reply. */
+	size_t i)
+{
+	ssdp_reply *r = gReplyHeap[i];
+	size_t child;
+
+	for (;;) {
+		child = 2 * i + 1;
+		if (child >= gReplyCount)
+			break;
+		if (child + 1 < gReplyCount &&
+			gReplyHeap[child + 1]->due < gReplyHeap[child]->due)
+			child++;
+		if (r->due <= gReplyHeap[child]->due)
+			break;
+		HeapSet(i, gReplyHeap[child]);
+		i = child;
+	}
+	HeapSet(i, r);
+}
+
+/*!
+ * \brief Takes the first reply due out of the scheduler, gReplierMutex must
+ * be locked and a reply pending.
+ */
+static ssdp_reply *HeapPop(void)
+{
+	ssdp_reply *r = gReplyHeap[0];
+	ssdp_reply **pp;
+
+	gReplyCount--;
+	if (gReplyCount > 0) {
+		HeapSet(0, gReplyHeap[gReplyCount]);
+		HeapDown(0);
+	}
+	for (pp = &gReplyBuckets[r->hash % REPLY_BUCKETS]; *pp != r;
+		pp = &(*pp)->next)
+		;
+	*pp = r->next;
+
+	return r;
+}
+
+/*!
+ * \brief Sends the replies of a batch, grouped by control point, and frees
+ * them.
+ */
+static void SendBatch(
+	/*! [in] Number of replies in gReplyBatch. */
+	size_t n)
+{
+	ssdp_reply *r;
+	size_t lists = 0;
+	size_t sent = 0;
+	size_t i;
+	size_t j;
+
+	HandleReadLock(__FILE__, __LINE__);
+	for (i = 0; i < n; i++) {
+		r = gReplyBatch[i];
+		for (j = 0; j < lists; j++) {
+			if (SameDestination(&gReplyLists[j].dest, &r->dest))
+				break;
+		}
+		if (j == lists) {
+			memset(&gReplyLists[j], 0, sizeof(gReplyLists[j]));
+			memcpy(&gReplyLists[j].dest, &r->dest, sizeof(r->dest));
+			lists++;
+		}
+		/* Devices unregistered in the meantime have no reply. */
+		SearchReplyPackets(&gReplyLists[j],
+			r->handle,
+			r->type,
+			r->target,
+			r->target,
+			r->target);
+		free(r);
+	}
+	HandleUnlock(__FILE__, __LINE__);
+	for (j = 0; j < lists; j++) {
+		if (gReplyLists[j].count > 0)
+			gReplyListPtrs[sent++] = &gReplyLists[j];
+	}
+	if (sent > 0)
+		SsdpSendPacketLists(gReplyListPtrs, sent);
+	for (j = 0; j < lists; j++)
+		SsdpPacketListFree(&gReplyLists[j]);
+}
+
+/*!
+ * \brief Waits on gReplierCond for at most \b usec microseconds.
+ */
+static void ReplierWait(
+	/*! [in] Microseconds to wait. */
+	int64_t usec)
+{
+	struct timeval now;
+	struct timespec deadline;
+
+	gettimeofday(&now, NULL);
+	usec += now.tv_usec;
+	deadline.tv_sec = now.tv_sec + (time_t)(usec / 1000000);
+	deadline.tv_nsec = (long)(usec % 1000000) * 1000;
+	ithread_cond_timedwait(&gReplierCond, &gReplierMutex, &deadline);
+}
+
+/*!
+ * \brief Thread of the scheduler, sends the replies when they are due.
+ */
+static void ReplierLoop(void *arg)
+{
+	int64_t now;
+	size_t n;
+
+	(void)arg;
+	ithread_mutex_lock(&gReplierMutex);
+	while (gReplierState == REPLIER_RUNNING) {
+		if (gReplyCount == 0) {
+			ithread_cond_wait(&gReplierCond, &gReplierMutex);
+			continue;
+		}
+		now = upnp_clock_usec();
+		if (gReplyHeap[0]->due > now) {
+			ReplierWait(gReplyHeap[0]->due - now);
+			continue;
+		}
+		n = 0;
+		while (gReplyCount > 0 && gReplyHeap[0]->due <= now &&
+			n < REPLY_BATCH)
+			gReplyBatch[n++] = HeapPop();
+		ithread_mutex_unlock(&gReplierMutex);
+		SendBatch(n);
+		ithread_mutex_lock(&gReplierMutex);
+	}
+	gReplierState = REPLIER_IDLE;
+	ithread_cond_broadcast(&gReplierCond);
+	ithread_mutex_unlock(&gReplierMutex);
+}
+
+int SsdpReplierInit(void)
+{
+	ThreadPoolJob job;
+
+	if (gReplierState != REPLIER_IDLE)
+		return UPNP_E_INIT;
+	gReplyHeap = (ssdp_reply **)malloc(
+		SSDP_REPLY_MAX_PENDING * sizeof(*gReplyHeap));
+	if (gReplyHeap == NULL)
+		return UPNP_E_OUTOF_MEMORY;
+	memset(gReplyBuckets, 0, sizeof(gReplyBuckets));
+	gReplyCount = 0;
+	ithread_mutex_init(&gReplierMutex, NULL);
+	ithread_cond_init(&gReplierCond, NULL);
+	gReplierState = REPLIER_RUNNING;
+	memset(&job, 0, sizeof(job));
+	TPJobInit(&job, (start_routine)ReplierLoop, NULL);
+	TPJobSetPriority(&job, MED_PRIORITY);
+	if (ThreadPoolAddPersistent(&gSendThreadPool, &job, NULL) != 0) {
+		gReplierState = REPLIER_IDLE;
+		ithread_cond_destroy(&gReplierCond);
+		ithread_mutex_destroy(&gReplierMutex);
+		free(gReplyHeap);
+		gReplyHeap = NULL;
+		return UPNP_E_INIT_FAILED;
+	}
+
+	return UPNP_E_SUCCESS;
+}
+
+void SsdpReplierShutdown(void)
+{
+	if (gReplierState == REPLIER_IDLE)
+		return;
+	ithread_mutex_lock(&gReplierMutex);
+	gReplierState = REPLIER_STOPPING;
+	ithread_cond_broadcast(&gReplierCond);
+	while (gReplierState != REPLIER_IDLE)
+		ithread_cond_wait(&gReplierCond, &gReplierMutex);
+	while (gReplyCount > 0)
+		free(HeapPop());
+	ithread_mutex_unlock(&gReplierMutex);
+	ithread_cond_destroy(&gReplierCond);
+	ithread_mutex_destroy(&gReplierMutex);
+	free(gReplyHeap);
+	gReplyHeap = NULL;
+}
+
+int SsdpReplierAdd(const UpnpDevice_Handle *Hnds,
+	size_t Count,
+	const struct sockaddr_storage *DestAddr,
+	const SsdpEvent *Event,
+	int Mx)
+{
+	const char *target = SearchTarget(Event);
+	ssdp_reply *r;
+	int64_t now;
+	int64_t slot;
+	int64_t due;
+	uint32_t hash;
+	int wake = 0;
+	int ret = UPNP_E_SUCCESS;
+	size_t i;
+
+	if (gReplierState != REPLIER_RUNNING)
+		return UPNP_E_FINISH;
+	if (Count == 0)
+		return UPNP_E_SUCCESS;
+	if (Mx < 1)
+		Mx = 1;
+	/* Each device replies in its own slice of the window, at a random
+	 * place in it, so that the replies are spread evenly however many
+	 * devices answer. */
+	slot = (int64_t)Mx * 1000 / (int64_t)Count;
+	if (slot < 1)
+		slot = 1;
+	ithread_mutex_lock(&gReplierMutex);
+	if (gReplierState != REPLIER_RUNNING) {
+		ithread_mutex_unlock(&gReplierMutex);
+		return UPNP_E_FINISH;
+	}
+	now = upnp_clock_usec() / 1000;
+	for (i = 0; i < Count; i++) {
+		due = (now + (int64_t)i * slot + RandomBelow(slot)) * 1000;
+		hash = HashBytes(2166136261u, &Hnds[i], sizeof(Hnds[i]));
+		hash = HashDestination(hash, DestAddr);
+		hash = HashBytes(
+			hash, &Event->RequestType, sizeof(Event->RequestType));
+		hash = HashBytes(hash, target, strlen(target));
+		for (r = gReplyBuckets[hash % REPLY_BUCKETS]; r; r = r->next) {
+			if (r->hash == hash && r->handle == Hnds[i] &&
+				r->type == Event->RequestType &&
+				SameDestination(&r->dest, DestAddr) &&
+				!strcmp(r->target, target))
+				break;
+		}
+		if (r) {
+			/* The same search again, the pending reply answers
+			 * it, within the window of both. */
+			if (due < r->due) {
+				r->due = due;
+				HeapUp(r->place);
+				wake |= r->place == 0;
+			}
+			continue;
+		}
+		if (gReplyCount == SSDP_REPLY_MAX_PENDING) {
+			UpnpPrintf(UPNP_INFO,
+				SSDP,
+				__FILE__,
+				__LINE__,
+				"Too many pending search replies, dropped.\n");
+			ret = UPNP_E_OUTOF_MEMORY;
+			break;
+		}
+		r = (ssdp_reply *)malloc(sizeof(ssdp_reply));
+		if (r == NULL) {
+			ret = UPNP_E_OUTOF_MEMORY;
+			break;
+		}
+		r->due = due;
+		r->handle = Hnds[i];
+		memcpy(&r->dest, DestAddr, sizeof(r->dest));
+		r->type = Event->RequestType;
+		snprintf(r->target, sizeof(r->target), "%s", target);
+		r->hash = hash;
+		r->next = gReplyBuckets[hash % REPLY_BUCKETS];
+		gReplyBuckets[hash % REPLY_BUCKETS] = r;
+		HeapSet(gReplyCount++, r);
+		HeapUp(r->place);
+		wake |= r->place == 0;
+	}
+	if (wake)
+		ithread_cond_signal(&gReplierCond);
+	ithread_mutex_unlock(&gReplierMutex);
+
+	return ret;
+}
+
+	#endif /* EXCLUDE_SSDP == 0 */
+#endif	       /* INCLUDE_DEVICE_APIS */
+
+/* @} SSDPlib */
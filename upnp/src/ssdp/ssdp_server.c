@@ -48,6 +48,7 @@
 	#include "httpparser.h"
 	#include "httpreadwrite.h"
 	#include "membuffer.h"
+	#include "metrics.h"
 	#include "miniserver.h"
 	#include "sock.h"
 	#include "upnpapi.h"
@@ -85,38 +86,127 @@ struct SSDPSockArray
 };
 
 	#ifdef INCLUDE_DEVICE_APIS
-static const char SERVICELIST_STR[] = "serviceList";
-
-int AdvertiseAndReply(int AdFlag,
+int SearchReplyPackets(SsdpPacketList *list,
 	UpnpDevice_Handle Hnd,
 	enum SsdpSearchType SearchType,
-	struct sockaddr *DestAddr,
 	char *DeviceType,
 	char *DeviceUDN,
-	char *ServiceType,
-	int Exp)
+	char *ServiceType)
+{
+	struct Handle_Info *SInfo = NULL;
+	const SsdpTarget *targets;
+	const SsdpTarget *t;
+	size_t count;
+	size_t i;
+	int lower;
+	int ret = UPNP_E_SUCCESS;
+
+	if (GetHandleInfo(Hnd, &SInfo) != HND_DEVICE)
+		return UPNP_E_INVALID_HANDLE;
+	/* The devices and services, as read from the description at
+	 * registration. */
+	targets = SsdpIndexTargets(Hnd, &count);
+	for (i = 0; i < count && ret == UPNP_E_SUCCESS; i++) {
+		t = &targets[i];
+		switch (SearchType) {
+		case SSDP_ALL:
+			if (t->service)
+				ret = ServiceReplyPackets(list,
+					t->type,
+					t->udn,
+					SInfo->DescURL,
+					SInfo->MaxAge,
+					SInfo->PowerState,
+					SInfo->SleepPeriod,
+					SInfo->RegistrationState);
+			else
+				ret = DeviceReplyPackets(list,
+					t->type,
+					t->root,
+					t->udn,
+					SInfo->DescURL,
+					SInfo->MaxAge,
+					SInfo->PowerState,
+					SInfo->SleepPeriod,
+					SInfo->RegistrationState);
+			break;
+		case SSDP_ROOTDEVICE:
+			if (t->root)
+				ret = SendReplyPackets(list,
+					t->type,
+					1,
+					t->udn,
+					SInfo->DescURL,
+					SInfo->MaxAge,
+					0,
+					SInfo->PowerState,
+					SInfo->SleepPeriod,
+					SInfo->RegistrationState);
+			break;
+		case SSDP_DEVICEUDN:
+			if (!t->service && DeviceUDN &&
+				strlen(DeviceUDN) != (size_t)0 &&
+				!strcasecmp(DeviceUDN, t->udn))
+				ret = SendReplyPackets(list,
+					t->type,
+					0,
+					t->udn,
+					SInfo->DescURL,
+					SInfo->MaxAge,
+					0,
+					SInfo->PowerState,
+					SInfo->SleepPeriod,
+					SInfo->RegistrationState);
+			break;
+		case SSDP_DEVICETYPE:
+		case SSDP_SERVICE:
+			/* Answered with the type searched, and with the lower
+			 * description URL if its version is lower than the one
+			 * of the device or service. */
+			if (SearchType == SSDP_SERVICE) {
+				if (!t->service || !ServiceType ||
+					!SsdpTargetMatch(t, ServiceType, &lower))
+					break;
+			} else if (t->service || !DeviceType ||
+				   !SsdpTargetMatch(t, DeviceType, &lower)) {
+				break;
+			}
+			UpnpPrintf(UPNP_INFO,
+				API,
+				__FILE__,
+				__LINE__,
+				"Type=%s and search type=%s MATCH\n",
+				t->type,
+				t->service ? ServiceType : DeviceType);
+			ret = SendReplyPackets(list,
+				t->service ? ServiceType : DeviceType,
+				0,
+				t->udn,
+				lower ? SInfo->LowerDescURL : SInfo->DescURL,
+				SInfo->MaxAge,
+				1,
+				SInfo->PowerState,
+				SInfo->SleepPeriod,
+				SInfo->RegistrationState);
+			break;
+		default:
+			break;
+		}
+	}
+
+	return ret;
+}
+
+int AdvertiseAndReply(int AdFlag, UpnpDevice_Handle Hnd, int Exp)
 {
 	int retVal = UPNP_E_SUCCESS;
-	long unsigned int i;
-	long unsigned int j;
-	int defaultExp = DEFAULT_MAXAGE;
+	size_t i;
+	size_t count;
 	struct Handle_Info *SInfo = NULL;
-	char UDNstr[100];
-	char devType[100];
-	char servType[100];
-	IXML_NodeList *nodeList = NULL;
-	IXML_NodeList *tmpNodeList = NULL;
-	IXML_Node *tmpNode = NULL;
-	IXML_Node *tmpNode2 = NULL;
-	IXML_Node *textNode = NULL;
-	const DOMString tmpStr;
-	const DOMString dbgStr;
+	const SsdpTarget *targets;
+	const SsdpTarget *t;
 	int NumCopy = 0;
 
-	memset(UDNstr, 0, sizeof(UDNstr));
-	memset(devType, 0, sizeof(devType));
-	memset(servType, 0, sizeof(servType));
-
 	UpnpPrintf(UPNP_ALL,
 		API,
 		__FILE__,
@@ -130,405 +220,41 @@ int AdvertiseAndReply(int AdFlag,
 		retVal = UPNP_E_INVALID_HANDLE;
 		goto end_function;
 	}
-	defaultExp = SInfo->MaxAge;
-	/* parse the device list and send advertisements/replies */
-	while (NumCopy == 0 || (AdFlag && NumCopy < NUM_SSDP_COPY)) {
+	if (AdFlag != -1) {
+		retVal = UPNP_E_INVALID_PARAM;
+		goto end_function;
+	}
+	/* The devices and services, as read from the description at
+	 * registration. */
+	targets = SsdpIndexTargets(Hnd, &count);
+	for (NumCopy = 0; NumCopy < NUM_SSDP_COPY; NumCopy++) {
 		if (NumCopy != 0)
 			imillisleep(SSDP_PAUSE);
-		NumCopy++;
-		for (i = 0lu;; i++) {
-			UpnpPrintf(UPNP_ALL,
-				API,
-				__FILE__,
-				__LINE__,
-				"Entering new device list with i = %lu\n\n",
-				i);
-			tmpNode = ixmlNodeList_item(SInfo->DeviceList, i);
-			if (!tmpNode) {
-				UpnpPrintf(UPNP_ALL,
-					API,
-					__FILE__,
-					__LINE__,
-					"Exiting new device list with i = "
-					"%lu\n\n",
-					i);
-				break;
-			}
-			dbgStr = ixmlNode_getNodeName(tmpNode);
-			UpnpPrintf(UPNP_INFO,
-				API,
-				__FILE__,
-				__LINE__,
-				"Extracting device type once for %s\n",
-				dbgStr);
-			ixmlNodeList_free(nodeList);
-			nodeList = ixmlElement_getElementsByTagName(
-				(IXML_Element *)tmpNode, "deviceType");
-			if (!nodeList)
-				continue;
-			UpnpPrintf(UPNP_ALL,
-				API,
-				__FILE__,
-				__LINE__,
-				"Extracting UDN for %s\n",
-				dbgStr);
-			UpnpPrintf(UPNP_ALL,
-				API,
-				__FILE__,
-				__LINE__,
-				"Extracting device type\n");
-			tmpNode2 = ixmlNodeList_item(nodeList, 0lu);
-			if (!tmpNode2)
-				continue;
-			textNode = ixmlNode_getFirstChild(tmpNode2);
-			if (!textNode)
-				continue;
-			UpnpPrintf(UPNP_ALL,
-				API,
-				__FILE__,
-				__LINE__,
-				"Extracting device type \n");
-			tmpStr = ixmlNode_getNodeValue(textNode);
-			if (!tmpStr)
-				continue;
-			strncpy(devType, tmpStr, sizeof(devType) - 1);
-			UpnpPrintf(UPNP_ALL,
-				API,
-				__FILE__,
-				__LINE__,
-				"Extracting device type = %s\n",
-				devType);
-			if (!tmpNode) {
-				UpnpPrintf(UPNP_ALL,
-					API,
-					__FILE__,
-					__LINE__,
-					"TempNode is NULL\n");
-			}
-			dbgStr = ixmlNode_getNodeName(tmpNode);
-			UpnpPrintf(UPNP_ALL,
-				API,
-				__FILE__,
-				__LINE__,
-				"Extracting UDN for %s\n",
-				dbgStr);
-			ixmlNodeList_free(nodeList);
-			nodeList = ixmlElement_getElementsByTagName(
-				(IXML_Element *)tmpNode, "UDN");
-			if (!nodeList) {
-				UpnpPrintf(UPNP_CRITICAL,
-					API,
-					__FILE__,
-					__LINE__,
-					"UDN not found!\n");
-				continue;
-			}
-			tmpNode2 = ixmlNodeList_item(nodeList, 0lu);
-			if (!tmpNode2) {
-				UpnpPrintf(UPNP_CRITICAL,
-					API,
-					__FILE__,
-					__LINE__,
-					"UDN not found!\n");
-				continue;
-			}
-			textNode = ixmlNode_getFirstChild(tmpNode2);
-			if (!textNode) {
-				UpnpPrintf(UPNP_CRITICAL,
-					API,
-					__FILE__,
-					__LINE__,
-					"UDN not found!\n");
-				continue;
-			}
-			tmpStr = ixmlNode_getNodeValue(textNode);
-			if (!tmpStr) {
-				UpnpPrintf(UPNP_CRITICAL,
-					API,
-					__FILE__,
-					__LINE__,
-					"UDN not found!\n");
-				continue;
-			}
-			strncpy(UDNstr, tmpStr, sizeof(UDNstr) - 1);
-			UpnpPrintf(UPNP_INFO,
-				API,
-				__FILE__,
-				__LINE__,
-				"Sending UDNStr = %s \n",
-				UDNstr);
-			if (AdFlag) {
-				/* send the device advertisement */
-				if (AdFlag == 1) {
-					DeviceAdvertisement(devType,
-						i == 0lu,
-						UDNstr,
-						SInfo->DescURL,
-						Exp,
-						SInfo->DeviceAf,
-						SInfo->PowerState,
-						SInfo->SleepPeriod,
-						SInfo->RegistrationState);
-				} else {
-					/* AdFlag == -1 */
-					DeviceShutdown(devType,
-						i == 0lu,
-						UDNstr,
-						SInfo->DescURL,
-						Exp,
-						SInfo->DeviceAf,
-						SInfo->PowerState,
-						SInfo->SleepPeriod,
-						SInfo->RegistrationState);
-				}
-			} else {
-				switch (SearchType) {
-				case SSDP_ALL:
-					DeviceReply(DestAddr,
-						devType,
-						i == 0lu,
-						UDNstr,
-						SInfo->DescURL,
-						defaultExp,
-						SInfo->PowerState,
-						SInfo->SleepPeriod,
-						SInfo->RegistrationState);
-					break;
-				case SSDP_ROOTDEVICE:
-					if (i == 0lu) {
-						SendReply(DestAddr,
-							devType,
-							1,
-							UDNstr,
-							SInfo->DescURL,
-							defaultExp,
-							0,
-							SInfo->PowerState,
-							SInfo->SleepPeriod,
-							SInfo->RegistrationState);
-					}
-					break;
-				case SSDP_DEVICEUDN: {
-					/* clang-format off */
-					if (DeviceUDN && strlen(DeviceUDN) != (size_t)0) {
-						if (strcasecmp(DeviceUDN, UDNstr)) {
-							UpnpPrintf(UPNP_INFO, API, __FILE__, __LINE__,
-								"DeviceUDN=%s and search UDN=%s DID NOT match\n",
-								UDNstr, DeviceUDN);
-						} else {
-							UpnpPrintf(UPNP_INFO, API, __FILE__, __LINE__,
-								"DeviceUDN=%s and search UDN=%s MATCH\n",
-								UDNstr, DeviceUDN);
-							SendReply(DestAddr, devType, 0, UDNstr, SInfo->DescURL, defaultExp, 0,
-								SInfo->PowerState,
-								SInfo->SleepPeriod,
-								SInfo->RegistrationState);
-						}
-					}
-					/* clang-format on */
-					break;
-				}
-				case SSDP_DEVICETYPE: {
-					/* clang-format off */
-					if (!strncasecmp(DeviceType, devType, strlen(DeviceType) - (size_t)2)) {
-						if (atoi(strrchr(DeviceType, ':') + 1)
-						    < atoi(&devType[strlen(devType) - (size_t)1])) {
-							/* the requested version is lower than the device version
-							 * must reply with the lower version number and the lower
-							 * description URL */
-							UpnpPrintf(UPNP_INFO, API, __FILE__, __LINE__,
-								   "DeviceType=%s and search devType=%s MATCH\n",
-								   devType, DeviceType);
-							SendReply(DestAddr, DeviceType, 0, UDNstr, SInfo->LowerDescURL,
-								  defaultExp, 1,
-								  SInfo->PowerState,
-								  SInfo->SleepPeriod,
-								  SInfo->RegistrationState);
-						} else if (atoi(strrchr(DeviceType, ':') + 1)
-							   == atoi(&devType[strlen(devType) - (size_t)1])) {
-							UpnpPrintf(UPNP_INFO, API, __FILE__, __LINE__,
-								   "DeviceType=%s and search devType=%s MATCH\n",
-								   devType, DeviceType);
-							SendReply(DestAddr, DeviceType, 0, UDNstr, SInfo->DescURL,
-								  defaultExp, 1,
-								  SInfo->PowerState,
-								  SInfo->SleepPeriod,
-								  SInfo->RegistrationState);
-						} else {
-							UpnpPrintf(UPNP_INFO, API, __FILE__, __LINE__,
-								   "DeviceType=%s and search devType=%s DID NOT MATCH\n",
-								   devType, DeviceType);
-						}
-					} else {
-						UpnpPrintf(UPNP_INFO, API, __FILE__, __LINE__,
-							   "DeviceType=%s and search devType=%s DID NOT MATCH\n",
-							   devType, DeviceType);
-					}
-					/* clang-format on */
-					break;
-				}
-				default:
-					break;
-				}
-			}
-			/* send service advertisements for services
-			 * corresponding to the same device */
-			UpnpPrintf(UPNP_INFO,
-				API,
-				__FILE__,
-				__LINE__,
-				"Sending service Advertisement\n");
-			/* Correct service traversal such that each device's
-			 * serviceList is directly traversed as a child of its
-			 * parent device. This ensures that the service's alive
-			 * message uses the UDN of the parent device. */
-			tmpNode = ixmlNode_getFirstChild(tmpNode);
-			while (tmpNode) {
-				dbgStr = ixmlNode_getNodeName(tmpNode);
-				if (!strncmp(dbgStr,
-					    SERVICELIST_STR,
-					    sizeof SERVICELIST_STR)) {
-					break;
-				}
-				tmpNode = ixmlNode_getNextSibling(tmpNode);
-			}
-			ixmlNodeList_free(nodeList);
-			if (!tmpNode) {
-				nodeList = NULL;
-				continue;
-			}
-			nodeList = ixmlElement_getElementsByTagName(
-				(IXML_Element *)tmpNode, "service");
-			if (!nodeList) {
-				UpnpPrintf(UPNP_INFO,
-					API,
-					__FILE__,
-					__LINE__,
-					"Service not found 3\n");
-				continue;
-			}
-			for (j = 0lu;; j++) {
-				tmpNode = ixmlNodeList_item(nodeList, j);
-				if (!tmpNode) {
-					break;
-				}
-				ixmlNodeList_free(tmpNodeList);
-				tmpNodeList = ixmlElement_getElementsByTagName(
-					(IXML_Element *)tmpNode, "serviceType");
-				if (!tmpNodeList) {
-					UpnpPrintf(UPNP_CRITICAL,
-						API,
-						__FILE__,
-						__LINE__,
-						"ServiceType not found \n");
-					continue;
-				}
-				tmpNode2 = ixmlNodeList_item(tmpNodeList, 0lu);
-				if (!tmpNode2)
-					continue;
-				textNode = ixmlNode_getFirstChild(tmpNode2);
-				if (!textNode)
-					continue;
-				/* servType is of format
-				 * Servicetype:ServiceVersion */
-				tmpStr = ixmlNode_getNodeValue(textNode);
-				if (!tmpStr)
-					continue;
-				strncpy(servType, tmpStr, sizeof(servType) - 1);
-				UpnpPrintf(UPNP_INFO,
-					API,
-					__FILE__,
-					__LINE__,
-					"ServiceType = %s\n",
-					servType);
-				if (AdFlag) {
-					if (AdFlag == 1) {
-						ServiceAdvertisement(UDNstr,
-							servType,
-							SInfo->DescURL,
-							Exp,
-							SInfo->DeviceAf,
-							SInfo->PowerState,
-							SInfo->SleepPeriod,
-							SInfo->RegistrationState);
-					} else {
-						/* AdFlag == -1 */
-						ServiceShutdown(UDNstr,
-							servType,
-							SInfo->DescURL,
-							Exp,
-							SInfo->DeviceAf,
-							SInfo->PowerState,
-							SInfo->SleepPeriod,
-							SInfo->RegistrationState);
-					}
-				} else {
-					switch (SearchType) {
-					case SSDP_ALL:
-						ServiceReply(DestAddr,
-							servType,
-							UDNstr,
-							SInfo->DescURL,
-							defaultExp,
-							SInfo->PowerState,
-							SInfo->SleepPeriod,
-							SInfo->RegistrationState);
-						break;
-					case SSDP_SERVICE:
-						/* clang-format off */
-						if (ServiceType) {
-							if (!strncasecmp(ServiceType, servType, strlen(ServiceType) - (size_t)2)) {
-								if (atoi(strrchr(ServiceType, ':') + 1) <
-								    atoi(&servType[strlen(servType) - (size_t)1])) {
-									/* the requested version is lower than the service version
-									 * must reply with the lower version number and the lower
-									 * description URL */
-									UpnpPrintf(UPNP_INFO, API, __FILE__, __LINE__,
-										   "ServiceType=%s and search servType=%s MATCH\n",
-										   ServiceType, servType);
-									SendReply(DestAddr, ServiceType, 0, UDNstr, SInfo->LowerDescURL,
-										  defaultExp, 1,
-										  SInfo->PowerState,
-										  SInfo->SleepPeriod,
-										  SInfo->RegistrationState);
-								} else if (atoi(strrchr (ServiceType, ':') + 1) ==
-									   atoi(&servType[strlen(servType) - (size_t)1])) {
-									UpnpPrintf(UPNP_INFO, API, __FILE__, __LINE__,
-										   "ServiceType=%s and search servType=%s MATCH\n",
-										   ServiceType, servType);
-									SendReply(DestAddr, ServiceType, 0, UDNstr, SInfo->DescURL,
-										  defaultExp, 1,
-										  SInfo->PowerState,
-										  SInfo->SleepPeriod,
-										  SInfo->RegistrationState);
-								} else {
-									UpnpPrintf(UPNP_INFO, API, __FILE__, __LINE__,
-									   "ServiceType=%s and search servType=%s DID NOT MATCH\n",
-									   ServiceType, servType);
-								}
-							} else {
-								UpnpPrintf(UPNP_INFO, API, __FILE__, __LINE__,
-									   "ServiceType=%s and search servType=%s DID NOT MATCH\n",
-									   ServiceType, servType);
-							}
-						}
-						/* clang-format on */
-						break;
-					default:
-						break;
-					}
-				}
-			}
-			ixmlNodeList_free(tmpNodeList);
-			tmpNodeList = NULL;
-			ixmlNodeList_free(nodeList);
-			nodeList = NULL;
+		for (i = 0; i < count; i++) {
+			t = &targets[i];
+			if (t->service)
+				ServiceShutdown(t->udn,
+					t->type,
+					SInfo->DescURL,
+					Exp,
+					SInfo->DeviceAf,
+					SInfo->PowerState,
+					SInfo->SleepPeriod,
+					SInfo->RegistrationState);
+			else
+				DeviceShutdown(t->type,
+					t->root,
+					t->udn,
+					SInfo->DescURL,
+					Exp,
+					SInfo->DeviceAf,
+					SInfo->PowerState,
+					SInfo->SleepPeriod,
+					SInfo->RegistrationState);
 		}
 	}
 
 end_function:
-	ixmlNodeList_free(tmpNodeList);
-	ixmlNodeList_free(nodeList);
 	UpnpPrintf(UPNP_ALL,
 		API,
 		__FILE__,
@@ -852,6 +578,7 @@ int readFromSSDPSocket(SOCKET socket)
 		(struct sockaddr *)&__ss,
 		&socklen);
 	if (byteReceived > 0) {
+		upnp_metrics_inc(&gUpnpMetrics.ssdpPacketsIn);
 		requestBuf[byteReceived] = '\0';
 		switch (__ss.ss_family) {
 		case AF_INET:
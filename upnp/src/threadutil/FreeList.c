@@ -34,6 +34,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 
 int FreeListInit(FreeList *free_list, size_t elementSize, int maxFreeListLength)
 {
@@ -90,6 +91,38 @@ int FreeListFree(FreeList *free_list, void *element)
 	return 0;
 }
 
+int FreeListFill(FreeList *free_list)
+{
+	FreeListNode *temp = NULL;
+
+	assert(free_list != NULL);
+
+	if (!free_list)
+		return EINVAL;
+	while (free_list->freeListLength + 1 < free_list->maxFreeListLength) {
+		temp = malloc(free_list->element_size);
+		if (!temp)
+			return ENOMEM;
+		memset(temp, 0, free_list->element_size);
+		free_list->freeListLength++;
+		temp->next = free_list->head;
+		free_list->head = temp;
+	}
+
+	return 0;
+}
+
+int FreeListSetMaxLength(FreeList *free_list, int maxFreeListLength)
+{
+	assert(free_list != NULL);
+
+	if (!free_list)
+		return EINVAL;
+	free_list->maxFreeListLength = maxFreeListLength;
+
+	return 0;
+}
+
 int FreeListDestroy(FreeList *free_list)
 {
 	FreeListNode *temp = NULL;
@@ -110,6 +110,35 @@ int FreeListFree(
 	/*! Must be a pointer allocated by FreeListAlloc. */
 	void *element);
 
+/*!
+ * \brief Allocates items until the free list is full.
+ *
+ * The memory is allocated and written by the calling thread, which decides
+ * where it lives on NUMA systems.
+ *
+ * \return:
+ *	\li \c 0 on success.
+ *	\li \c EINVAL on failure.
+ *	\li \c ENOMEM if the list could not be filled.
+ */
+int FreeListFill(
+	/*! Must be valid, non null, pointer to a free list. */
+	FreeList *free_list);
+
+/*!
+ * \brief Changes the max size of the free list.
+ * Items already kept above the new size are kept until they are allocated.
+ * \return:
+ *	\li \c 0 on success.
+ *	\li \c EINVAL on failure.
+ */
+int FreeListSetMaxLength(
+	/*! Must be valid, non null, pointer to a free list. */
+	FreeList *free_list,
+	/*! Max size that the free list can grow to before returning
+	 * memory to O.S. */
+	int maxFreeListLength);
+
 /*!
  * \brief Releases the resources stored with the free list.
  *
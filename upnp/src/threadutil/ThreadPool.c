@@ -34,6 +34,10 @@
  * \file
  */
 
+#ifndef _GNU_SOURCE
+	#define _GNU_SOURCE /* For sched_setaffinity() in sched.h */
+#endif
+
 #if !defined(_WIN32)
 	#include <sys/param.h>
 #endif
@@ -46,6 +50,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h> /* for memset()*/
+#ifdef __linux__
+	#include <sched.h>
+#endif
+#ifdef _WIN32
+	#include <windows.h>
+#endif
 
 /*!
  * \brief Returns the difference in milliseconds between two timeval structures.
@@ -447,6 +457,200 @@ static void SetSeed(void)
 #endif
 }
 
+/*!
+ * \brief Reads a list of processors and ranges like "0-3,8".
+ *
+ * \internal
+ *
+ * \return 0, or EINVAL if the list is not valid.
+ */
+static int ParseCpuList(
+	/*! . */
+	const char *list,
+	/*! Processors of the list, see TPPlacement. */
+	unsigned char *mask)
+{
+	const char *p = list;
+	char *end;
+	long first;
+	long last;
+	long cpu;
+
+	memset(mask, 0, TP_MAX_CPUS / 8);
+	if (!list) {
+		return 0;
+	}
+	while (*p && *p != '\n') {
+		first = strtol(p, &end, 10);
+		if (end == p || first < 0 || first >= TP_MAX_CPUS) {
+			return EINVAL;
+		}
+		last = first;
+		p = end;
+		if (*p == '-') {
+			++p;
+			last = strtol(p, &end, 10);
+			if (end == p || last < first || last >= TP_MAX_CPUS) {
+				return EINVAL;
+			}
+			p = end;
+		}
+		for (cpu = first; cpu <= last; cpu++) {
+			mask[cpu / 8] |= (unsigned char)(1u << (cpu % 8));
+		}
+		if (*p == ',') {
+			++p;
+		} else if (*p && *p != '\n') {
+			return EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+#if defined(__linux__) && defined(CPU_SET)
+/*!
+ * \brief Reads the processors of a NUMA node.
+ *
+ * \internal
+ *
+ * \return 0, or EINVAL if the node does not exist.
+ */
+static int ReadNodeCpus(
+	/*! . */
+	int node,
+	/*! Processors of the node, see TPPlacement. */
+	unsigned char *mask)
+{
+	char path[64];
+	char list[4096];
+	size_t len;
+	FILE *fp;
+
+	snprintf(path,
+		sizeof(path),
+		"/sys/devices/system/node/node%d/cpulist",
+		node);
+	fp = fopen(path, "r");
+	if (!fp) {
+		return EINVAL;
+	}
+	len = fread(list, 1, sizeof(list) - 1, fp);
+	fclose(fp);
+	list[len] = '\0';
+
+	return ParseCpuList(list, mask);
+}
+#endif
+
+int ThreadPoolPlaceThread(const TPPlacement *placement)
+{
+#if defined(__linux__) && defined(CPU_SET)
+	unsigned char node[TP_MAX_CPUS / 8];
+	cpu_set_t set;
+	unsigned char bit;
+	int anyCpu = 1;
+	int cpu;
+	int i;
+
+	if (!placement) {
+		return EINVAL;
+	}
+	for (i = 0; i < TP_MAX_CPUS / 8; i++) {
+		if (placement->cpuMask[i]) {
+			anyCpu = 0;
+			break;
+		}
+	}
+	if (anyCpu && placement->numaNode < 0) {
+		/* Keep what the thread inherited, from taskset for
+		 * instance. */
+		return 0;
+	}
+	if (placement->numaNode >= 0 &&
+		ReadNodeCpus(placement->numaNode, node) != 0) {
+		return EINVAL;
+	}
+	CPU_ZERO(&set);
+	for (cpu = 0; cpu < TP_MAX_CPUS && cpu < CPU_SETSIZE; cpu++) {
+		bit = (unsigned char)(1u << (cpu % 8));
+		if ((anyCpu || placement->cpuMask[cpu / 8] & bit) &&
+			(placement->numaNode < 0 || node[cpu / 8] & bit)) {
+			CPU_SET(cpu, &set);
+		}
+	}
+	if (CPU_COUNT(&set) == 0) {
+		return EINVAL;
+	}
+
+	return sched_setaffinity(0, sizeof(set), &set) == 0 ? 0 : errno;
+#elif defined(_WIN32)
+	GROUP_AFFINITY node;
+	GROUP_AFFINITY affinity;
+	WORD groups;
+	WORD group;
+	DWORD count;
+	DWORD i;
+	int anyCpu = 1;
+	int first = 0;
+	int cpu;
+
+	if (!placement) {
+		return EINVAL;
+	}
+	for (cpu = 0; cpu < TP_MAX_CPUS / 8; cpu++) {
+		if (placement->cpuMask[cpu]) {
+			anyCpu = 0;
+			break;
+		}
+	}
+	if (anyCpu && placement->numaNode < 0) {
+		return 0;
+	}
+	if (placement->numaNode >= 0 &&
+		!GetNumaNodeProcessorMaskEx(
+			(USHORT)placement->numaNode, &node)) {
+		return EINVAL;
+	}
+	/* Processors are numbered across the groups in order. A thread runs
+	 * in a single group: the first one holding a processor it may use. */
+	ZeroMemory(&affinity, sizeof(affinity));
+	groups = GetActiveProcessorGroupCount();
+	for (group = 0; group < groups && !affinity.Mask; group++) {
+		count = GetActiveProcessorCount(group);
+		for (i = 0; i < count && i < sizeof(KAFFINITY) * 8; i++) {
+			cpu = first + (int)i;
+			if (cpu >= TP_MAX_CPUS) {
+				break;
+			}
+			if (!anyCpu && !(placement->cpuMask[cpu / 8] &
+					       (1u << (cpu % 8)))) {
+				continue;
+			}
+			if (placement->numaNode >= 0 &&
+				(node.Group != group ||
+					!(node.Mask & ((KAFFINITY)1 << i)))) {
+				continue;
+			}
+			affinity.Group = group;
+			affinity.Mask |= (KAFFINITY)1 << i;
+		}
+		first += (int)count;
+	}
+	if (!affinity.Mask) {
+		return EINVAL;
+	}
+
+	return SetThreadGroupAffinity(GetCurrentThread(), &affinity, NULL)
+		? 0
+		: EINVAL;
+#else
+	(void)placement;
+
+	return 0;
+#endif
+}
+
 /*!
  * \brief Implements a thread pool worker. Worker waits for a job to become
  * available. Worker picks up persistent jobs first, high priority,
@@ -461,6 +665,7 @@ static void *WorkerThread(
 	void *arg)
 {
 	time_t start = 0;
+	int64_t runStart = 0;
 
 	ThreadPoolJob *job = NULL;
 	ListNode *head = NULL;
@@ -469,14 +674,25 @@ static void *WorkerThread(
 	int retCode = 0;
 	int persistent = -1;
 	ThreadPool *tp = (ThreadPool *)arg;
+	TPPlacement placement;
 
 	ithread_initialize_thread();
 
+	ithread_mutex_lock(&tp->mutex);
+	placement = tp->attr.placement;
+	ithread_mutex_unlock(&tp->mutex);
+	ThreadPoolPlaceThread(&placement);
+
 	/* Increment total thread count */
 	ithread_mutex_lock(&tp->mutex);
 	tp->totalThreads++;
 	tp->pendingWorkerThreadStart = 0;
 	ithread_cond_broadcast(&tp->start_and_shutdown);
+	/* Allocated from here, the jobs live where the threads run. */
+	if (placement.localJobs && !tp->localJobsFilled) {
+		FreeListFill(&tp->jobFreeList);
+		tp->localJobsFilled = 1;
+	}
 	ithread_mutex_unlock(&tp->mutex);
 
 	SetSeed();
@@ -587,8 +803,16 @@ static void *WorkerThread(
 		if (SetPriority(job->priority) != 0) {
 		} else {
 		}
-		/* run the job */
-		job->func(job->arg);
+		/* run the job, persistent jobs never return so are not timed */
+		if (persistent == 0) {
+			runStart = upnp_clock_usec();
+			upnp_histogram_record(
+				&tp->waitTime, runStart - job->queuedUsec);
+			job->func(job->arg);
+			upnp_histogram_since(&tp->runTime, runStart);
+		} else {
+			job->func(job->arg);
+		}
 		/* return to Normal */
 		SetPriority(DEFAULT_PRIORITY);
 	}
@@ -624,6 +848,7 @@ static ThreadPoolJob *CreateThreadPoolJob(
 		*newJob = *job;
 		newJob->jobId = id;
 		gettimeofday(&newJob->requestTime, NULL);
+		newJob->queuedUsec = upnp_clock_usec();
 	}
 
 	return newJob;
@@ -744,6 +969,8 @@ int ThreadPoolInit(ThreadPool *tp, ThreadPoolAttr *attr)
 	retCode += FreeListInit(
 		&tp->jobFreeList, sizeof(ThreadPoolJob), JOBFREELISTSIZE);
 	StatsInit(&tp->stats);
+	memset(&tp->waitTime, 0, sizeof(tp->waitTime));
+	memset(&tp->runTime, 0, sizeof(tp->runTime));
 	retCode += ListInit(&tp->highJobQ, CmpThreadPoolJob, NULL);
 	retCode += ListInit(&tp->medJobQ, CmpThreadPoolJob, NULL);
 	retCode += ListInit(&tp->lowJobQ, CmpThreadPoolJob, NULL);
@@ -751,6 +978,7 @@ int ThreadPoolInit(ThreadPool *tp, ThreadPoolAttr *attr)
 		retCode = EAGAIN;
 	} else {
 		tp->persistentJob = NULL;
+		tp->localJobsFilled = 0;
 		tp->lastJobId = 0;
 		tp->shutdown = 0;
 		tp->totalThreads = 0;
@@ -1083,6 +1311,9 @@ int TPAttrInit(ThreadPoolAttr *attr)
 	attr->schedPolicy = DEFAULT_POLICY;
 	attr->starvationTime = DEFAULT_STARVATION_TIME;
 	attr->maxJobsTotal = maxJobsTotal;
+	memset(attr->placement.cpuMask, 0, sizeof(attr->placement.cpuMask));
+	attr->placement.numaNode = -1;
+	attr->placement.localJobs = 0;
 
 	return 0;
 }
@@ -1195,6 +1426,57 @@ int TPAttrSetMaxJobsTotal(ThreadPoolAttr *attr, int maxJobsTotal)
 	return 0;
 }
 
+int TPAttrSetCpuAffinity(ThreadPoolAttr *attr, const char *cpus)
+{
+	unsigned char mask[TP_MAX_CPUS / 8];
+
+	if (!attr || ParseCpuList(cpus, mask) != 0)
+		return EINVAL;
+#if !(defined(__linux__) && defined(CPU_SET)) && !defined(_WIN32)
+	if (cpus && *cpus)
+		return EINVAL;
+#endif
+	memcpy(attr->placement.cpuMask, mask, sizeof(mask));
+
+	return 0;
+}
+
+int TPAttrSetNumaNode(ThreadPoolAttr *attr, int numaNode)
+{
+#if defined(__linux__) && defined(CPU_SET)
+	unsigned char mask[TP_MAX_CPUS / 8];
+#elif defined(_WIN32)
+	GROUP_AFFINITY node;
+#endif
+
+	if (!attr || numaNode < -1)
+		return EINVAL;
+#if defined(__linux__) && defined(CPU_SET)
+	if (numaNode >= 0 && ReadNodeCpus(numaNode, mask) != 0)
+		return EINVAL;
+#elif defined(_WIN32)
+	if (numaNode >= 0 &&
+		(!GetNumaNodeProcessorMaskEx((USHORT)numaNode, &node) ||
+			!node.Mask))
+		return EINVAL;
+#else
+	if (numaNode >= 0)
+		return EINVAL;
+#endif
+	attr->placement.numaNode = numaNode;
+
+	return 0;
+}
+
+int TPAttrSetLocalJobs(ThreadPoolAttr *attr, int localJobs)
+{
+	if (!attr)
+		return EINVAL;
+	attr->placement.localJobs = localJobs;
+
+	return 0;
+}
+
 #ifdef STATS
 void ThreadPoolPrintStats(ThreadPoolStats *stats)
 {
@@ -1270,6 +1552,30 @@ int ThreadPoolGetStats(ThreadPool *tp, ThreadPoolStats *stats)
 }
 #endif /* STATS */
 
+int ThreadPoolGetMetrics(ThreadPool *tp, UpnpThreadPoolMetrics *metrics)
+{
+	if (tp == NULL || metrics == NULL)
+		return EINVAL;
+	/* if not shutdown then acquire mutex */
+	if (!tp->shutdown)
+		ithread_mutex_lock(&tp->mutex);
+
+	metrics->totalThreads = tp->totalThreads;
+	metrics->busyThreads = tp->busyThreads;
+	metrics->queuedJobs = (int)(ListSize(&tp->highJobQ) +
+				    ListSize(&tp->medJobQ) +
+				    ListSize(&tp->lowJobQ));
+
+	/* if not shutdown then release mutex */
+	if (!tp->shutdown)
+		ithread_mutex_unlock(&tp->mutex);
+
+	upnp_histogram_snapshot(&tp->waitTime, &metrics->queueWait);
+	upnp_histogram_snapshot(&tp->runTime, &metrics->runTime);
+
+	return 0;
+}
+
 #ifdef _WIN32
 	#if defined(_MSC_VER) || defined(_MSC_EXTENSIONS)
 		#define DELTA_EPOCH_IN_MICROSECS 11644473600000000Ui64
@@ -42,6 +42,7 @@
 #include "UpnpGlobal.h" /* for UPNP_INLINE, UPNP_EXPORT_SPEC */
 #include "UpnpInet.h"
 #include "ithread.h"
+#include "metrics.h"
 
 #include <errno.h>
 
@@ -140,6 +141,21 @@ typedef int PolicyType;
 /*! Function for freeing a thread argument. */
 typedef void (*free_routine)(void *arg);
 
+/*! Highest number of processors a CPU affinity mask can name. */
+#define TP_MAX_CPUS 1024
+
+/*! Where the threads of a pool run and allocate their jobs. */
+typedef struct TPPLACEMENT
+{
+	/*! Processors the threads may run on, bit n % 8 of byte n / 8 for
+	 * processor n. No bit set for any processor. */
+	unsigned char cpuMask[TP_MAX_CPUS / 8];
+	/*! NUMA node the threads run on, -1 for any. */
+	int numaNode;
+	/*! Non-zero to allocate the free jobs from a thread of the pool. */
+	int localJobs;
+} TPPlacement;
+
 /*! Attributes for thread pool. Used to set and change parameters of thread
  * pool. */
 typedef struct THREADPOOLATTR
@@ -162,6 +178,8 @@ typedef struct THREADPOOLATTR
 	int starvationTime;
 	/*! scheduling policy to use. */
 	PolicyType schedPolicy;
+	/*! processors and NUMA node of the threads, applied when they start. */
+	TPPlacement placement;
 } ThreadPoolAttr;
 
 /*! Internal ThreadPool Job. */
@@ -171,6 +189,8 @@ typedef struct THREADPOOLJOB
 	void *arg;
 	free_routine free_func;
 	struct timeval requestTime;
+	/*! upnp_clock_usec() when the job was queued. */
+	int64_t queuedUsec;
 	ThreadPriority priority;
 	int jobId;
 } ThreadPoolJob;
@@ -244,10 +264,17 @@ typedef struct THREADPOOL
 	LinkedList highJobQ;
 	/*! persistent job */
 	ThreadPoolJob *persistentJob;
+	/*! set once a worker thread has filled the job free list, see
+	 * TPAttrSetLocalJobs() */
+	int localJobsFilled;
 	/*! thread pool attributes */
 	ThreadPoolAttr attr;
 	/*! statistics */
 	ThreadPoolStats stats;
+	/*! time jobs spent queued, updated without holding mutex */
+	upnp_histogram_t waitTime;
+	/*! time jobs spent running, updated without holding mutex */
+	upnp_histogram_t runTime;
 } ThreadPool;
 
 /*!
@@ -506,6 +533,65 @@ int TPAttrSetMaxJobsTotal(
 	/*! maximum number of jobs. */
 	int maxJobsTotal);
 
+/*!
+ * \brief Sets the processors the threads of the pool may run on.
+ *
+ * Threads already running keep their processors.
+ *
+ * \return 0, or EINVAL if \b cpus is not a valid list or thread affinity
+ * 	is not supported.
+ */
+int TPAttrSetCpuAffinity(
+	/*! must be valid thread pool attributes. */
+	ThreadPoolAttr *attr,
+	/*! list of processors and ranges like "0-3,8", NULL or empty for
+	 * any processor. */
+	const char *cpus);
+
+/*!
+ * \brief Sets the NUMA node whose processors the threads of the pool run
+ * on.
+ *
+ * Combined with TPAttrSetCpuAffinity(), the threads run on the processors
+ * of both. The memory the threads allocate comes from their node under the
+ * default memory policy.
+ *
+ * \return 0, or EINVAL if the node does not exist or NUMA placement is not
+ * 	supported.
+ */
+int TPAttrSetNumaNode(
+	/*! must be valid thread pool attributes. */
+	ThreadPoolAttr *attr,
+	/*! node number, -1 for any. */
+	int numaNode);
+
+/*!
+ * \brief Sets whether the free list of jobs is allocated by a thread of the
+ * pool rather than by the threads adding jobs.
+ *
+ * With the threads placed on a NUMA node, the jobs then live on that node.
+ *
+ * \return Always returns 0.
+ */
+int TPAttrSetLocalJobs(
+	/*! must be valid thread pool attributes. */
+	ThreadPoolAttr *attr,
+	/*! non-zero to enable. */
+	int localJobs);
+
+/*!
+ * \brief Binds the calling thread to the processors of \b placement.
+ *
+ * On Windows the thread runs in one processor group, the first one holding
+ * a processor of \b placement. Does nothing on systems without thread
+ * affinity.
+ *
+ * \return 0, or an error code of the system.
+ */
+int ThreadPoolPlaceThread(
+	/*! placement of a thread pool attributes. */
+	const TPPlacement *placement);
+
 /*!
  * \brief Returns various statistics about the thread pool.
  *
@@ -544,6 +630,20 @@ static UPNP_INLINE void ThreadPoolPrintStats(
 }
 #endif
 
+/*!
+ * \brief Fills the thread pool part of UpnpGetMetrics().
+ *
+ * Unlike ThreadPoolGetStats() this is always available; the histograms are
+ * read without the pool mutex, only the thread and queue counts take it.
+ *
+ * \return 0 on success, EINVAL if an argument is NULL.
+ */
+int ThreadPoolGetMetrics(
+	/*! Valid initialized threadpool. */
+	ThreadPool *tp,
+	/*! Valid metrics, out parameter. */
+	UpnpThreadPoolMetrics *metrics);
+
 #ifdef __cplusplus
 }
 #endif
@@ -71,6 +71,10 @@ static void TimerThreadWorker(
 
 	assert(timer != NULL);
 
+	/* The thread ends with its pool, it is not placed back. */
+	if (timer->hasPlacement) {
+		ThreadPoolPlaceThread(&timer->placement);
+	}
 	ithread_mutex_lock(&timer->mutex);
 	while (1) {
 		/* mutex should always be locked at top of loop */
@@ -194,7 +198,8 @@ static TimerEvent *CreateTimerEvent(
 	return temp;
 }
 
-int TimerThreadInit(TimerThread *timer, ThreadPool *tp)
+int TimerThreadInit(
+	TimerThread *timer, ThreadPool *tp, const TPPlacement *placement)
 {
 
 	int rc = 0;
@@ -223,6 +228,10 @@ int TimerThreadInit(TimerThread *timer, ThreadPool *tp)
 
 	timer->shutdown = 0;
 	timer->tp = tp;
+	timer->hasPlacement = placement != NULL;
+	if (placement) {
+		timer->placement = *placement;
+	}
 	timer->lastEventId = 0;
 	rc += ListInit(&timer->eventQ, NULL, NULL);
 
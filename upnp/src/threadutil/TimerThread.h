@@ -74,6 +74,9 @@ typedef struct TIMERTHREAD
 	int shutdown;
 	FreeList freeEvents;
 	ThreadPool *tp;
+	/*! Where the timer thread runs, unless hasPlacement is 0. */
+	TPPlacement placement;
+	int hasPlacement;
 } TimerThread;
 
 /*!
@@ -102,7 +105,10 @@ int TimerThreadInit(
 	TimerThread *timer,
 	/*! [in] Valid thread pool to use. Must be started. Must be valid for
 	 * lifetime of timer. Timer must be shutdown BEFORE thread pool. */
-	ThreadPool *tp);
+	ThreadPool *tp,
+	/*! [in] Where the timer thread runs, NULL to keep the placement of
+	 * the threads of \b tp. */
+	const TPPlacement *placement);
 
 /*!
  * \brief Schedules an event to run at a specified time.